@@ -10,6 +10,7 @@
 ***********************************************************************
 */
 #include <fcntl.h>
+#include <time.h>
 
 #include "common_includes.h"
 
@@ -32,9 +33,27 @@
 //#include "bvr_ctl.h"
 #include "bvr_namespace.h"
 #include "bvr_netfilter.h"
+#include "bvr_snapshot.h"
 
 char *g_conf_file=NULL;
 static int g_daemon_conf = 0;
+static int g_ctl_tid = -1;  //first control thread, loads the snapshot
+
+/* tables shared by the packet threads, created in parallel on start up,
+ * after the slabs of the l2 framework */
+static const struct {
+    const char *name;
+    int (*init)(int numa_id);
+} g_init_subsys[] = {
+    {"bvr_arp", bvr_arp_init},
+    {"netfilter", nf_init},
+    {"namespace", namespace_init},
+};
+static int g_init_numa;             //numa of the port, the tables are on
+static int g_init_any_numa;         //no thread on it, all threads help
+static volatile unsigned g_init_next;
+static volatile int g_init_failed;
+
 extern int log_console;
 extern int log_debug;
 extern br_conf_t g_bvrouter_conf_info;
@@ -127,6 +146,16 @@ static void bvrouter_sig_handler(__unused int para)
 	exit(0);
 }
 #endif
+
+/**
+ * @brief SIGTERM handler when a snapshot is configured, a control thread
+ *        writes it and exits
+ */
+static void bvrouter_term_handler(__unused int para)
+{
+	g_bvr_snap_exit = 1;
+}
+
 /**
  * @brief signal handler init
  * @return -1=failed, 0=success
@@ -253,6 +282,7 @@ static int pal_conf_set(struct pal_config *palconf)
 		palconf->port[pid].ip = bi->ip;
 		palconf->port[pid].gw_ip = bi->gw_ip;
 		palconf->port[pid].netmask = bi->netmask;
+		palconf->port[pid].mtu = bi->mtu;
 		memcpy(palconf->port[pid].mac, bi->mac, 6);
 		ppid = pid;
 		pid++;
@@ -273,9 +303,11 @@ static int pal_conf_set(struct pal_config *palconf)
 		palconf->thread[tid].mode = PAL_THREAD_CUSTOM;
 		palconf->thread[tid].func = control_process_thread;
 		palconf->thread[tid].arg = NULL;
-		//FIX: I think that 1 control thread is enough
+		//control threads serve the connections of one listen socket in parallel
 		palconf->thread[tid].cpu = g_bvrouter_conf_info.control_cpus[idx];
 		sprintf(palconf->thread[tid].name, "pal_ctl_%d", tid);
+		if (g_ctl_tid < 0)
+			g_ctl_tid = tid;
 		tid++;
 	}
 
@@ -314,9 +346,102 @@ static int pal_conf_set(struct pal_config *palconf)
 }
 
 
+static long bvrouter_ms_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 +
+		(now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/**
+ * @brief start up job of each pal thread: create its own objects on its
+ *        numa, then take steps creating the shared tables until none is
+ *        left, if it is on their numa
+ */
+static int bvrouter_init_thread(__unused void *arg)
+{
+	int tid = pal_thread_id();
+	int mode = pal_thread_conf(tid)->mode;
+	unsigned n_l2 = l2_slab_init_steps();
+	unsigned n = n_l2 + ARRAY_SIZE(g_init_subsys);
+	unsigned step;
+
+	l2_thread_init(tid);
+	/* only the packet threads track connections and cache flows */
+	if ((mode == PAL_THREAD_RECEIVER || mode == PAL_THREAD_WORKER) &&
+		nf_thread_init(tid))
+	{
+		g_init_failed = 1;
+		return -1;
+	}
+
+	if (!g_init_any_numa && pal_tid_to_numa(tid) != g_init_numa)
+		return 0;
+
+	while ((step = __sync_fetch_and_add(&g_init_next, 1)) < n)
+	{
+		if (step < n_l2)
+		{
+			l2_slab_init_step(step, g_init_numa);
+			continue;
+		}
+		if (g_init_subsys[step - n_l2].init(g_init_numa))
+		{
+			BVR_ERROR("main: init %s failed\n", g_init_subsys[step - n_l2].name);
+			g_init_failed = 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief create the tables of the router on all pal threads at once,
+ *        before they start the packet loops
+ * @return -1=failed, 0=success
+ */
+static int bvrouter_init_tables(int numa_id)
+{
+	int tid;
+
+	g_init_numa = numa_id;
+	g_init_any_numa = 1;
+	PAL_FOR_EACH_THREAD(tid)
+	{
+		if (pal_tid_to_numa(tid) == numa_id)
+			g_init_any_numa = 0;
+	}
+
+	PAL_FOR_EACH_THREAD(tid)
+	{
+		pal_remote_launch(bvrouter_init_thread, NULL, tid);
+	}
+	pal_wait_all_threads();
+
+	if (g_init_failed)
+		return -1;
+
+	l2_addr_init();
+	return 0;
+}
+
+/**
+ * @brief load the snapshot on a control thread, whose pal timers and
+ *        object caches are then used
+ */
+static int bvrouter_load_snapshot(void *path)
+{
+	bvr_snapshot_load(path);
+	return 0;
+}
+
+
 int MAIN(int argc, char **argv)
 {
 	struct pal_config palconf;
+	struct timespec start_time, tables_time;
+	long pal_ms, tables_ms;
 	int ret;
 	//must use program parameters
 	if(argc<2)
@@ -357,6 +482,16 @@ int MAIN(int argc, char **argv)
 
 	dump_bvrouter_config();
 
+	if (g_bvrouter_conf_info.snapshot_file[0] != '\0' &&
+	    g_bvrouter_conf_info.control_cpus_cnt &&
+	    signal(SIGTERM, bvrouter_term_handler) == SIG_ERR)
+	{
+		perror("signal SIGTERM");
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+
 	/* set global environment confiure */
 	if (pal_conf_set(&palconf) < 0)
 		log_print("bgw init PAL config failed\n");
@@ -385,13 +520,27 @@ int MAIN(int argc, char **argv)
         numa_id = bi->socket_id;
     }
 
-    if (bvr_arp_init(numa_id) || nf_init(numa_id) || namespace_init(numa_id))
-    {
+	pal_ms = bvrouter_ms_since(&start_time);
+
+	clock_gettime(CLOCK_MONOTONIC, &tables_time);
+	if (bvrouter_init_tables(numa_id) < 0)
+	{
 		BVR_ERROR("main: init subsys failed\n");
 		return -1;
-    }
+	}
+	tables_ms = bvrouter_ms_since(&tables_time);
+
+	/* restore the control state before the data path runs */
+	if (g_bvrouter_conf_info.snapshot_file[0] != '\0' && g_ctl_tid >= 0)
+	{
+		pal_remote_launch(bvrouter_load_snapshot,
+				g_bvrouter_conf_info.snapshot_file, g_ctl_tid);
+		pal_wait_thread(g_ctl_tid);
+	}
+
+	log_print("main: started in %ld ms, pal %ld ms, tables %ld ms",
+			bvrouter_ms_since(&start_time), pal_ms, tables_ms);
 
-    l2_slab_init(numa_id);
 	/* threads start*/
 	pal_start();
 
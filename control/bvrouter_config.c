@@ -11,6 +11,7 @@
 */
 
 #include "common_includes.h"
+#include "pal_skb.h"
 
 #include "bvrouter_config.h"
 #include "parser.h"
@@ -332,6 +333,44 @@ static int netmask_handler(vector strvec)
 	return 0;
 }
 
+/**
+ *  @brief the bounding interface's underlay mtu parse handler
+ *  @param[in] strvec the string vector
+ *  @return 0=success, -1=failed
+ */
+static int mtu_handler(vector strvec)
+{
+        int mtu;
+
+        if(!strvec)
+        {
+                log_print("mtu_handler: with NULL strvec.\n");
+                return -1;
+        }
+
+        if(check_param_cnt(strvec, 1) < 0)
+        {
+                return -1;
+        }
+
+        mtu = bvrouter_atoi(VECTOR_SLOT(strvec, 1));
+        if(mtu < ETHER_MTU || mtu > PAL_MAX_MTU)
+        {
+                log_print("mtu_handler: mtu is not in [%d, %d] range.",
+                        ETHER_MTU, PAL_MAX_MTU);
+                return -1;
+        }
+
+        bound_interface_t *bi = list_tail_data(&(g_bvrouter_conf_info.bound_interfaces),
+                        bound_interface_t, l);
+        if(!bi)
+                return -1;
+
+        bi->mtu = mtu;
+
+	return 0;
+}
+
 /**
  * @brief the bounding interface's ip parse handler
  * @param[in] strvec the string vector
@@ -603,6 +642,68 @@ static int vnic_handler(vector strvec)
         return 0;
 }
 
+/**
+ *  @brief the snapshot file parse handler
+ *  @param[in] strvec the string vector
+ *  @return 0=success, -1=failed
+ */
+static int snapshot_file_handler(vector strvec)
+{
+        char *path;
+
+        if(!strvec)
+        {
+                log_print("snapshot_file_handler: with NULL strvec.\n");
+                return -1;
+        }
+
+        if(check_param_cnt(strvec, 1) < 0)
+        {
+                return -1;
+        }
+
+        path = VECTOR_SLOT(strvec, 1);
+        if(strlen(path) >= MAX_PATH_SIZE)
+        {
+                log_print("snapshot_file_handler: path longer than %d.", MAX_PATH_SIZE - 1);
+                return -1;
+        }
+        strcpy(g_bvrouter_conf_info.snapshot_file, path);
+
+        return 0;
+}
+
+/**
+ *  @brief the snapshot interval parse handler
+ *  @param[in] strvec the string vector
+ *  @return 0=success, -1=failed
+ */
+static int snapshot_itl_handler(vector strvec)
+{
+        int itl;
+
+        if(!strvec)
+        {
+                log_print("snapshot_itl_handler: with NULL strvec.\n");
+                return -1;
+        }
+
+        if(check_param_cnt(strvec, 1) < 0)
+        {
+                return -1;
+        }
+
+        itl = bvrouter_atoi(VECTOR_SLOT(strvec, 1));
+        if(itl < 0)
+        {
+                log_print("snapshot_itl_handler: wrong interval.");
+                return -1;
+        }
+        g_bvrouter_conf_info.snapshot_itl = itl;
+
+        return 0;
+}
+
 /**
  * @brief key word register
  * @return 0 success
@@ -620,6 +721,7 @@ static int init_cfg_keywords(void)
 	install_keyword("gw_ip", &gwip_handler);
 
 	install_keyword("netmask", &netmask_handler);
+	install_keyword("mtu", &mtu_handler);
 	install_keyword("slaves", &slaves_handler);
 	install_keyword("socket_id", &si_handler);
 	install_keyword("worker_cpu", &wc_handler);
@@ -630,6 +732,8 @@ static int init_cfg_keywords(void)
 	install_keyword("monitor_cpu", &mc_handler);
 	install_keyword("arp_cpu", &arp_handler);
 	install_keyword("vnic_cpu", &vnic_handler);
+	install_keyword("snapshot_file", &snapshot_file_handler);
+	install_keyword("snapshot_interval", &snapshot_itl_handler);
 
 	return 0;
 }
@@ -692,11 +796,19 @@ void dump_bvrouter_config(void)
 		log_print("the vnic cpu %u", g_bvrouter_conf_info.vnic_cpus[idx]);
 	}
 
+	if(g_bvrouter_conf_info.snapshot_file[0] != '\0')
+	{
+		log_print("the snapshot file %s every %u seconds",
+				g_bvrouter_conf_info.snapshot_file, g_bvrouter_conf_info.snapshot_itl);
+	}
+
 	list_for_each_entry(bi, &g_bvrouter_conf_info.bound_interfaces, l)
 	{
 		log_print("the %s interface's ip %s", bi->name, trans_ip(bi->ip));
 		log_print("the %s interface's gw_ip %s", bi->name, trans_ip(bi->gw_ip));
 		log_print("the %s interface's netmask %s", bi->name, trans_ip(bi->netmask));
+		log_print("the %s interface's mtu %u", bi->name,
+				bi->mtu ? bi->mtu : ETHER_MTU);
 		for(idx=0; idx < bi->slave_ports_cnt; idx++)
 		{
 			log_print("the %s interface's slave port %u", bi->name, bi->slave_ports[idx]);
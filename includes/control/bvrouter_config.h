@@ -20,6 +20,7 @@
 #define VERSION_STRING "1.0.0.0"
 #define MAX_CPU_NUMBER 32
 #define MAX_NAME_SIZE 32
+#define MAX_PATH_SIZE 256
 
 typedef struct bound_interface
 {
@@ -36,6 +37,7 @@ typedef struct bound_interface
 	uint32_t gw_ip;
     uint32_t vtep_ip;
 	uint32_t netmask;
+	uint16_t mtu;	/* underlay mtu, 0 means ETHER_MTU */
 	uint8_t slave_ports[4];
 	uint8_t worker_cpus[MAX_CPU_NUMBER];
 	uint8_t slowpath_cpus[MAX_CPU_NUMBER];
@@ -55,6 +57,8 @@ typedef struct bvrouter_conf
 	uint8_t monitor_cpus[MAX_CPU_NUMBER];
 	uint8_t arp_cpus[MAX_CPU_NUMBER];
 	uint8_t vnic_cpus[MAX_CPU_NUMBER];
+	char snapshot_file[MAX_PATH_SIZE];	//control state saved and loaded at startup, empty for none
+	uint32_t snapshot_itl;	//seconds between two snapshots, 0 for none
 }br_conf_t;
 
 extern int load_bvrouter_config(void);
@@ -9,67 +9,415 @@
 #include "pal_ipgroup.h"
 #include "pal_netif.h"
 #include "pal_malloc.h"
+#include "pal_slab.h"
+#include "pal_cuckoo.h"
+#include "pal_csum.h"
+#include "pal_jiffies.h"
 #include "pal_vnic.h"
 #include "pal_vport.h"
 
 
+#include "bvr_errno.h"
 #include "bvr_netfilter.h"
+#include "bvr_conntrack.h"
+#include "bvr_flow.h"
 #include "bvr_alg.h"
 #include "bvr_ftp.h"
 #include "bvr_hash.h"
 #include "logger.h"
-#define FTP_PORT 21
 
+/*connections expired per pkt*/
+#define BVR_ALG_EXPIRE_BUDGET       4
 
-static u32 bvr_alg_decode(struct sk_buff *skb, u32 *direction, __unused void *private_data)
+static const struct bvr_alg_helper *g_alg_helpers[BVR_ALG_HELPER_MAX];
+
+/*ports having a helper, per protocol. read without the lock as a filter*/
+static u64 g_alg_port_map[2][65536 / 64];
+
+static pal_spinlock_t g_alg_lock = PAL_SPINLOCK_INITIALIZER;
+static struct pal_cuckoo *g_alg_conn_htable;
+static struct pal_slab *g_alg_conn_slab;
+/*least recently used first*/
+static PAL_LIST_HEAD(g_alg_conn_lru);
+
+static inline u64 *bvr_alg_port_map(u8 proto)
+{
+    return g_alg_port_map[proto == PAL_IPPROTO_TCP ? 0 : 1];
+}
+
+static inline int bvr_alg_port_test(const u64 *map, u16 port)
+{
+    return (map[port >> 6] >> (port & 63)) & 1;
+}
+
+static void bvr_alg_port_map_rebuild(void)
+{
+    const struct bvr_alg_helper *helper;
+    u64 *map;
+    int i;
+
+    memset(g_alg_port_map, 0, sizeof(g_alg_port_map));
+    for (i = 0; i < BVR_ALG_HELPER_MAX; i++) {
+        helper = g_alg_helpers[i];
+        if (helper != NULL) {
+            map = bvr_alg_port_map(helper->proto);
+            map[helper->port >> 6] |= 1ULL << (helper->port & 63);
+        }
+    }
+}
+
+/*called with the lock held, ports in host order*/
+static const struct bvr_alg_helper *bvr_alg_find_helper(u8 proto, u16 sport, u16 dport)
+{
+    const struct bvr_alg_helper *helper;
+    int i;
+
+    for (i = 0; i < BVR_ALG_HELPER_MAX; i++) {
+        helper = g_alg_helpers[i];
+        if (helper != NULL && helper->proto == proto &&
+            (helper->port == sport || helper->port == dport)) {
+            return helper;
+        }
+    }
+
+    return NULL;
+}
+
+static void bvr_alg_conn_free(struct bvr_alg_conn *conn)
+{
+    pal_cuckoo_del(g_alg_conn_htable, &conn->key);
+    pal_list_del(&conn->lru);
+    pal_slab_free(conn);
+}
+
+/*called with the lock held*/
+static void bvr_alg_conn_expire(int budget)
+{
+    struct bvr_alg_conn *conn, *n;
+
+    pal_list_for_each_entry_safe(conn, n, &g_alg_conn_lru, lru) {
+        if (budget-- == 0 || conn->expires > jiffies) {
+            break;
+        }
+        bvr_alg_conn_free(conn);
+    }
+}
+
+/*
+ * @brief find the connection of a pkt, create it if needed. when the
+ *        table is full, the least recently used connection is dropped.
+ *        called with the lock held
+ */
+static struct bvr_alg_conn *bvr_alg_conn_get(const struct nf_conn_key *key,
+    const struct bvr_alg_helper *helper)
+{
+    struct bvr_alg_conn *conn;
+
+    conn = pal_cuckoo_lookup(g_alg_conn_htable, key);
+    if (conn != NULL) {
+        return conn;
+    }
+
+    conn = pal_slab_alloc(g_alg_conn_slab);
+    if (conn == NULL && !pal_list_empty(&g_alg_conn_lru)) {
+        bvr_alg_conn_free(pal_list_first_entry(&g_alg_conn_lru, struct bvr_alg_conn, lru));
+        conn = pal_slab_alloc(g_alg_conn_slab);
+    }
+    if (conn == NULL) {
+        return NULL;
+    }
+
+    memset(conn, 0, sizeof(*conn));
+    conn->key = *key;
+    conn->helper = helper;
+    if (pal_cuckoo_add(g_alg_conn_htable, key, conn)) {
+        pal_slab_free(conn);
+        return NULL;
+    }
+    pal_list_add_tail(&conn->lru, &g_alg_conn_lru);
+
+    return conn;
+}
+
+static void bvr_alg_conn_refresh(struct bvr_alg_conn *conn, u8 proto, const struct tcp_hdr *tcph)
+{
+    u64 timeout;
+
+    if (proto == PAL_IPPROTO_TCP) {
+        timeout = (tcph->fin || tcph->rst) ? NF_CT_TCP_CLOSE_TIMEOUT : NF_CT_TCP_EST_TIMEOUT;
+    } else {
+        timeout = NF_CT_UDP_STREAM_TIMEOUT;
+    }
+
+    conn->expires = jiffies + timeout;
+    pal_list_del(&conn->lru);
+    pal_list_add_tail(&conn->lru, &g_alg_conn_lru);
+}
+
+/*seq a is after seq b*/
+static inline int bvr_alg_seq_after(u32 a, u32 b)
+{
+    return (int)(b - a) < 0;
+}
+
+/*
+ * @brief record a length change of delta bytes made to the pkt starting at seq
+ */
+static void bvr_alg_seq_set(struct bvr_alg_conn *conn, int dir, u32 seq, int delta)
+{
+    struct bvr_alg_seq *this = &conn->seq[dir];
+
+    /*a retransmission of the pkt already mangled is not counted again*/
+    if (this->offset_before == this->offset_after ||
+        bvr_alg_seq_after(seq, this->correction_pos)) {
+        this->correction_pos = seq;
+        this->offset_before = this->offset_after;
+        this->offset_after += delta;
+    }
+}
+
+/*
+ * @brief move seq by the bytes this direction added, and ack by the bytes
+ *        the other direction added
+ */
+static void bvr_alg_seq_adjust(struct sk_buff *skb, struct bvr_alg_conn *conn, int dir)
+{
+    struct tcp_hdr *tcph = skb_tcp_header(skb);
+    const struct bvr_alg_seq *this = &conn->seq[dir];
+    const struct bvr_alg_seq *other = &conn->seq[!dir];
+    u32 seq = pal_ntohl(tcph->seq), ack = pal_ntohl(tcph->ack_seq);
+    u32 newseq, newack;
+    int seqoff, ackoff;
+
+    seqoff = bvr_alg_seq_after(seq, this->correction_pos) ?
+        this->offset_after : this->offset_before;
+    ackoff = bvr_alg_seq_after(ack - other->offset_before, other->correction_pos) ?
+        other->offset_after : other->offset_before;
+    if (seqoff == 0 && ackoff == 0) {
+        return;
+    }
+
+    newseq = pal_htonl(seq + seqoff);
+    newack = pal_htonl(ack - ackoff);
+    /*hardware fills the checksum of a mangled pkt*/
+    if (!(skb->mbuf.ol_flags & PKT_TX_TCP_CKSUM)) {
+        pal_csum_replace4(&tcph->check, tcph->seq, newseq);
+        pal_csum_replace4(&tcph->check, tcph->ack_seq, newack);
+    }
+    tcph->seq = newseq;
+    tcph->ack_seq = newack;
+}
+
+u32 bvr_alg_mangle_tcp_packet(struct sk_buff *skb, struct bvr_alg_conn *conn, int dir,
+    u32 match_offset, u32 match_len, const char *rep_buffer, u32 rep_len)
+{
+    struct ip_hdr *iph = skb_ip_header(skb);
+    struct tcp_hdr *tcph = skb_tcp_header(skb);
+    int delta = (int)rep_len - (int)match_len;
+    u32 data_len, tot_len;
+    u8 *data;
+
+    /*the whole payload must be in the first segment to be moved*/
+    if (!pskb_may_pull(skb, skb_pkt_len(skb)) || match_offset + match_len > skb_len(skb)) {
+        BVR_DEBUG("bvr_alg_mangle_tcp_packet: can't reach the match\n");
+        return 0;
+    }
+    if (delta > 0 && ((u32)delta > rte_pktmbuf_tailroom(&skb->mbuf) ||
+        skb_l2_len(skb) + delta > PAL_MAX_PKT_SIZE)) {
+        BVR_ERROR("bvr_alg_mangle_tcp_packet: mangle failed, must enlarge the packet size.\n");
+        return 0;
+    }
+
+    data = skb_data(skb);
+    data_len = skb_len(skb);
+    if (delta > 0) {
+        skb_append(skb, delta);
+    }
+    memmove(data + match_offset + rep_len, data + match_offset + match_len,
+        data_len - (match_offset + match_len));
+    memcpy(data + match_offset, rep_buffer, rep_len);
+    if (delta < 0) {
+        skb_adjust(skb, -delta);
+    }
+
+    if (delta != 0) {
+        tot_len = pal_ntohs(iph->tot_len) + delta;
+        iph->tot_len = pal_htons(tot_len);
+        bvr_alg_seq_set(conn, dir, pal_ntohl(tcph->seq), delta);
+    }
+
+    skb_iptcp_csum_offload(skb, iph->saddr, iph->daddr, pal_ntohs(iph->tot_len) - (iph->ihl << 2), iph->ihl << 2);
+    return 1;
+}
+
+/*
+ * @brief run the helper of a control connection and fix its seq/ack.
+ *        the data pointer is on the l4 header
+ */
+static u32 bvr_alg_process(struct sk_buff *skb, struct net *net, int dir)
 {
     struct ip_hdr *iph = skb_ip_header(skb);
     struct tcp_hdr *tcph = NULL;
-    /*private data*/
-    u32 ftpport = FTP_PORT;
+    struct udp_hdr *udph = NULL;
+    const struct bvr_alg_helper *helper;
+    struct bvr_alg_conn *conn;
+    struct nf_conn_key key;
+    u16 sport, dport, hlen;
+    const u64 *map;
+    u32 ret = NF_ACCEPT;
+
+    if ((iph->protocol != PAL_IPPROTO_TCP && iph->protocol != PAL_IPPROTO_UDP) ||
+        ip_is_fragment(iph)) {
+        return NF_ACCEPT;
+    }
 
-    switch (iph->protocol) {
-    case PAL_IPPROTO_TCP:
+    /*tcp and udp ports are at the same place*/
+    if (unlikely(!pskb_may_pull(skb, sizeof(struct udp_hdr)))) {
+        return NF_ACCEPT;
+    }
+    udph = skb_udp_header(skb);
+    sport = pal_ntohs(udph->source);
+    dport = pal_ntohs(udph->dest);
+    map = bvr_alg_port_map(iph->protocol);
+    if (likely(!bvr_alg_port_test(map, sport) && !bvr_alg_port_test(map, dport))) {
+        return NF_ACCEPT;
+    }
+    /*helpers see every pkt of their connections*/
+    bvr_flow_rec_abort();
+
+    if (iph->protocol == PAL_IPPROTO_TCP) {
         tcph = skb_tcp_header(skb);
-        /* decode for ftp */
-        {
-            if (pal_ntohs(tcph->source) == ftpport) {
-                *direction = FTP_PASSIVE;
-                return BVR_ALG_FTP;
-            }
+        hlen = tcph->doff * 4;
+        if (!pskb_may_pull(skb, hlen)) {
+            return NF_DROP;
         }
-        break;
-    case PAL_IPPROTO_UDP:
-    case PAL_IPPROTO_ICMP:
-    default:
-        break;
+    } else {
+        hlen = sizeof(struct udp_hdr);
+    }
+
+    nf_ct_key_init(&key, net, iph->protocol, iph->saddr, iph->daddr, udph->source, udph->dest);
+
+    pal_spinlock_lock(&g_alg_lock);
+    bvr_alg_conn_expire(BVR_ALG_EXPIRE_BUDGET);
+
+    helper = bvr_alg_find_helper(iph->protocol, sport, dport);
+    conn = helper ? bvr_alg_conn_get(&key, helper) : NULL;
+    if (conn == NULL) {
+        goto out;
+    }
+    bvr_alg_conn_refresh(conn, iph->protocol, tcph);
+
+    if (conn->helper->help != NULL && skb_pkt_len(skb) > hlen) {
+        skb_pull(skb, hlen);
+        ret = conn->helper->help(skb, conn, dir);
+        skb_push(skb, hlen);
+    }
+    if (ret != NF_DROP && tcph != NULL) {
+        bvr_alg_seq_adjust(skb, conn, dir);
     }
-    return BVR_ALG_ANY;
-}
 
+out:
+    pal_spinlock_unlock(&g_alg_lock);
+    return ret;
+}
 
+/*outgoing pkts, after snat*/
 static u32 bvr_alg_out(__unused u8 hooknum, struct sk_buff *skb, struct vport *in, struct vport *out, __unused void *private_data)
 {
     if (!in || !out) {
         return NF_ACCEPT;
     }
 
-    if (in->vport_type == VXLAN_VPORT && out->vport_type == PHY_VPORT)
-    {
-        u32 direction = 0;
-        u32 appid = bvr_alg_decode(skb, &direction, private_data);
+    if (in->vport_type == VXLAN_VPORT && out->vport_type == PHY_VPORT) {
+        return bvr_alg_process(skb, dev_net(in), BVR_ALG_DIR_OUT);
+    }
+    return NF_ACCEPT;
+}
 
-        switch (appid) {
-        case BVR_ALG_FTP:
-            bvr_alg_ftp_out(skb, direction);
-            break;
-        default:
-            break;
-        }
-        return NF_ACCEPT;
+/*incoming pkts, before dnat*/
+static u32 bvr_alg_in(__unused u8 hooknum, struct sk_buff *skb, struct vport *in, __unused struct vport *out, __unused void *private_data)
+{
+    if (in && in->vport_type == PHY_VPORT) {
+        return bvr_alg_process(skb, dev_net(in), BVR_ALG_DIR_IN);
     }
     return NF_ACCEPT;
+}
 
+int bvr_alg_register(const struct bvr_alg_helper *helper)
+{
+    int i, slot = -1, ret = 0;
+
+    if (helper == NULL || helper->port == 0 ||
+        (helper->proto != PAL_IPPROTO_TCP && helper->proto != PAL_IPPROTO_UDP)) {
+        return -NN_EINVAL;
+    }
+
+    pal_spinlock_lock(&g_alg_lock);
+    for (i = 0; i < BVR_ALG_HELPER_MAX; i++) {
+        if (g_alg_helpers[i] == NULL) {
+            if (slot < 0) {
+                slot = i;
+            }
+        } else if (g_alg_helpers[i]->proto == helper->proto &&
+            g_alg_helpers[i]->port == helper->port) {
+            ret = -NN_ENFEXIST;
+            goto out;
+        }
+    }
+    if (slot < 0) {
+        ret = -NN_ENOSPACE;
+        goto out;
+    }
+
+    g_alg_helpers[slot] = helper;
+    bvr_alg_port_map_rebuild();
+    bvr_flow_flush();
+    BVR_DEBUG("alg helper %s registered on port %u\n", helper->name, helper->port);
+
+out:
+    pal_spinlock_unlock(&g_alg_lock);
+    return ret;
+}
+
+void bvr_alg_unregister(const struct bvr_alg_helper *helper)
+{
+    struct bvr_alg_conn *conn, *n;
+    int i;
+
+    pal_spinlock_lock(&g_alg_lock);
+    for (i = 0; i < BVR_ALG_HELPER_MAX; i++) {
+        if (g_alg_helpers[i] == helper) {
+            g_alg_helpers[i] = NULL;
+        }
+    }
+    bvr_alg_port_map_rebuild();
+    bvr_flow_flush();
+
+    pal_list_for_each_entry_safe(conn, n, &g_alg_conn_lru, lru) {
+        if (conn->helper == helper) {
+            bvr_alg_conn_free(conn);
+        }
+    }
+    pal_spinlock_unlock(&g_alg_lock);
+}
+
+int bvr_alg_init(int numa_id)
+{
+    g_alg_conn_slab = pal_slab_create_multipc("alg_conn", BVR_ALG_CONN_MAX,
+        sizeof(struct bvr_alg_conn), numa_id, 0);
+    g_alg_conn_htable = pal_cuckoo_create("alg_conn", BVR_ALG_CONN_MAX,
+        sizeof(struct nf_conn_key), numa_id);
+    if (g_alg_conn_slab == NULL || g_alg_conn_htable == NULL) {
+        PAL_ERROR("alg init error\n");
+        return -1;
+    }
+
+    if (bvr_ftp_init()) {
+        PAL_ERROR("ftp alg init error\n");
+        return -1;
+    }
+
+    return 0;
 }
 
 struct nf_hook_ops alg_ops = {
@@ -77,6 +425,16 @@ struct nf_hook_ops alg_ops = {
     .pf = NFPROTO_IPV4,
     .hooknum = NF_POSTROUTING,
     .priority = NF_IP_PRI_ALG,
+    /*payload is only mangled for snated connections*/
+    .active = nf_snat_active,
  //   .private_data = 21,
 };
 
+struct nf_hook_ops alg_in_ops = {
+    .hook = bvr_alg_in,
+    .pf = NFPROTO_IPV4,
+    .hooknum = NF_PREROUTING,
+    .priority = NF_IP_PRI_ALG_IN,
+    .active = nf_snat_active,
+};
+
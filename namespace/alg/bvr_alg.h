@@ -3,16 +3,91 @@
 #define __BVR_ALG_H__
 
 #include "pal_skb.h"
+#include "pal_spinlock.h"
+#include "bvr_conntrack.h"
 
-enum bvr_alg_proto {
-    BVR_ALG_ANY = 0,
-    BVR_ALG_FTP,
-    BVR_ALG_MAX,
+/*
+ * ALG helpers are registered for the server port of their control
+ * connection. Only packets to or from a registered port enter the ALG
+ * code, each control connection is tracked with the conntrack key of its
+ * public side: outgoing packets are seen after snat, incoming ones before
+ * dnat. When a helper changes the payload length, the seq/ack offsets of
+ * the connection are recorded and applied to the following packets of
+ * both directions.
+ *
+ * Control connections are rare and slow, so their table is shared by all
+ * packet threads under one lock: the two directions of a connection may
+ * be handled by different threads.
+ */
+
+/*max number of registered helpers*/
+#define BVR_ALG_HELPER_MAX          8
+/*max number of tracked control connections*/
+#define BVR_ALG_CONN_MAX            (1U << 12)
+#define BVR_ALG_NAME_SIZE           16
+
+/*side of the nat a packet goes to*/
+enum {
+    BVR_ALG_DIR_OUT = 0,    /*from a vxlan vport to a phy vport*/
+    BVR_ALG_DIR_IN,         /*from a phy vport*/
+    BVR_ALG_DIR_MAX,
+};
+
+/*payload length change made by a helper in one direction*/
+struct bvr_alg_seq {
+    u32 correction_pos;     /*seq of the last mangled pkt, host order*/
+    int offset_before;      /*offset of the bytes before correction_pos*/
+    int offset_after;       /*offset of the bytes after it*/
+};
+
+struct bvr_alg_helper;
+
+struct bvr_alg_conn {
+    struct nf_conn_key key;
+    const struct bvr_alg_helper *helper;
+    struct pal_list_head lru;
+    u64 expires;
+    struct bvr_alg_seq seq[BVR_ALG_DIR_MAX];
+};
+
+struct bvr_alg_helper {
+    char name[BVR_ALG_NAME_SIZE];
+    u8 proto;               /*PAL_IPPROTO_TCP or PAL_IPPROTO_UDP*/
+    u16 port;               /*server port of the control connection, host order*/
+    /*
+     * called with the data pointer on the l4 payload for each pkt of a
+     * control connection, and the ALG lock held.
+     * return NF_ACCEPT or NF_DROP
+     */
+    u32 (*help)(struct sk_buff *skb, struct bvr_alg_conn *conn, int dir);
 };
 
-typedef struct bvr_alg_data_s {
-    u32 ftpdata;
-} bvr_alg_data_t;
+/*
+ * @brief register a helper, the helper must stay valid until unregistered
+ * @return 0 for success, -NN_EINVAL for a bad helper, -NN_ENFEXIST if the
+ *         port already has a helper, -NN_ENOSPACE if the table is full
+ */
+int bvr_alg_register(const struct bvr_alg_helper *helper);
+
+/*
+ * @brief unregister a helper and forget its connections
+ */
+void bvr_alg_unregister(const struct bvr_alg_helper *helper);
+
+/*
+ * @brief replace match_len bytes at match_offset from the data pointer of
+ *        a tcp pkt with rep_buffer. the pkt may grow or shrink, the seq
+ *        offsets of the connection are updated and the checksums offloaded.
+ * @return 1 for success, 0 if the pkt can't be mangled
+ */
+u32 bvr_alg_mangle_tcp_packet(struct sk_buff *skb, struct bvr_alg_conn *conn, int dir,
+    u32 match_offset, u32 match_len, const char *rep_buffer, u32 rep_len);
+
+/*
+ * @brief create the connection table and register the built-in helpers
+ * @return 0 for success, -1 for error
+ */
+int bvr_alg_init(int numa_id);
 
 #endif
 
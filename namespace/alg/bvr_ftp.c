@@ -11,6 +11,7 @@
 #include "pal_malloc.h"
 #include "pal_vnic.h"
 #include "bvr_hash.h"
+#include "bvr_alg.h"
 #include "bvr_ftp.h"
 #include "bvr_netfilter.h"
 #include "logger.h"
@@ -243,48 +244,40 @@ static u32 bc_ftp_check_ip(u32 ip, u32 *newip)
     return HOOK_ACCEPT;
 }
 #endif
-static u32 bvr_mangle_rfc959_packet(struct sk_buff *skb, u32 newip, u16 port, u32 matchoff, u32 matchlen)
+static u32 bvr_mangle_rfc959_packet(struct sk_buff *skb, struct bvr_alg_conn *conn, int dir,
+        u32 newip, u16 port, u32 matchoff, u32 matchlen)
 {
-    u8 *data = skb->mbuf.pkt.data;
     char buffer[sizeof("nnn,nnn,nnn,nnn,nnn,nnn")];
 
     sprintf(buffer, "%u,%u,%u,%u,%u,%u", NIPQUAD(newip), port&0xFF, port>>8);
 
-    /* for my test: matchoff is greater than 1  */
-    if (strlen(buffer) > matchlen) {
-        matchoff -= (strlen(buffer) - matchlen);
-    } else {
-        memset(data + matchoff - 1, ' ', matchlen - strlen(buffer));
-        matchoff += (matchlen - strlen(buffer));
-    }
-    matchlen = strlen(buffer);
-    *(data + matchoff - 1) = '(';
-    /* end */
-
-    return bvr_alg_mangle_tcp_packet(skb, matchoff, matchlen, buffer, strlen(buffer));
+    /*the length may change, the seq/ack of the connection follow*/
+    return bvr_alg_mangle_tcp_packet(skb, conn, dir, matchoff, matchlen, buffer, strlen(buffer));
 }
 
 /* |1|132.235.1.2|6275| */
-static u32 bvr_mangle_eprt_packet(struct sk_buff *skb, u32 newip, u16 port, u32 matchoff, u32 matchlen)
+static u32 bvr_mangle_eprt_packet(struct sk_buff *skb, struct bvr_alg_conn *conn, int dir,
+        u32 newip, u16 port, u32 matchoff, u32 matchlen)
 {
     char buffer[sizeof("|1|255.255.255.255|65535|")];
 
-    sprintf(buffer, "|1|%u.%u.%u.%u|%u|", NIPQUAD(newip), port);
+    sprintf(buffer, "|1|%u.%u.%u.%u|%u|", NIPQUAD(newip), pal_ntohs(port));
 
-    return bvr_alg_mangle_tcp_packet(skb, matchoff, matchlen, buffer, strlen(buffer));
+    return bvr_alg_mangle_tcp_packet(skb, conn, dir, matchoff, matchlen, buffer, strlen(buffer));
 }
 
-/* |1|132.235.1.2|6275| */
-static u32 bvr_mangle_epsv_packet(struct sk_buff *skb, __unused u32 newip, u16 port, u32 matchoff, u32 matchlen)
+/* |||6275| */
+static u32 bvr_mangle_epsv_packet(struct sk_buff *skb, struct bvr_alg_conn *conn, int dir,
+        __unused u32 newip, u16 port, u32 matchoff, u32 matchlen)
 {
     char buffer[sizeof("|||65535|")];
 
-    sprintf(buffer, "|||%u|", port);
+    sprintf(buffer, "|||%u|", pal_ntohs(port));
 
-    return bvr_alg_mangle_tcp_packet(skb, matchoff, matchlen, buffer, strlen(buffer));
+    return bvr_alg_mangle_tcp_packet(skb, conn, dir, matchoff, matchlen, buffer, strlen(buffer));
 }
 
-static u32 (*bvr_mangle[])(struct sk_buff *, u32, u16, u32, u32)
+static u32 (*bvr_mangle[])(struct sk_buff *, struct bvr_alg_conn *, int, u32, u16, u32, u32)
 = {
     [FTP_PORT] = bvr_mangle_rfc959_packet,
     [FTP_PASV] = bvr_mangle_rfc959_packet,
@@ -292,11 +285,12 @@ static u32 (*bvr_mangle[])(struct sk_buff *, u32, u16, u32, u32)
     [FTP_EPSV] = bvr_mangle_epsv_packet
 };
 
-static u32 bvr_ftp_mangle(struct sk_buff *skb, u32 ip, u16 port, enum bvr_ftp_type type, u32 matchoff, u32 matchlen)
+static u32 bvr_ftp_mangle(struct sk_buff *skb, struct bvr_alg_conn *conn, int dir,
+        u32 ip, u16 port, enum bvr_ftp_type type, u32 matchoff, u32 matchlen)
 {
     BVR_DEBUG("bc_ftp_mangle: type %d, off %u len %u\n", type, matchoff, matchlen);
 
-    if (!bvr_mangle[type](skb, ip, port, matchoff, matchlen))
+    if (!bvr_mangle[type](skb, conn, dir, ip, port, matchoff, matchlen))
     {
         BVR_DEBUG("bc_ftp_mangle: mangle failed.\n");
         return NF_DROP;
@@ -305,123 +299,74 @@ static u32 bvr_ftp_mangle(struct sk_buff *skb, u32 ip, u16 port, enum bvr_ftp_ty
     return NF_ACCEPT;
 }
 
-static void bvr_mangle_contents(struct sk_buff *skb, u32 match_offset, u32 match_len, const char *rep_buffer, u32 rep_len)
-{
-
-    u8 *data = skb->mbuf.pkt.data;
-    u32 data_len = skb->mbuf.pkt.data_len;
-//  struct ip_hdr *iph = skb_ip_header(skb);
-//  struct tcp_hdr *tcph = skb_tcp_header(skb);
-//  u32 len = data_len + iph->ihl * 4 + tcph->doff * 4;
-
-    /* move post-replacement */
-    memmove(data + match_offset + rep_len, data + match_offset + match_len,
-            data_len - (match_offset + match_len));
-
-    /* insert data from buffer */
-    memcpy(data + match_offset, rep_buffer, rep_len);
-    /*we never make skb len changed,rep_len the same as match_len */
-#if 0
-    s32 seq_offset = rep_len - match_len;
-    /* update skb info */
-    if (rep_len > match_len) {
-        BVR_DEBUG("bc_mangle_contents: Extending packet by %u from %u bytes\n", rep_len - match_len, len);
-        skb_append(skb, rep_len - match_len);
-    } else {
-        BVR_DEBUG("bc_mangle_contents: Shrinking packet from %u from %u bytes\n", match_len - rep_len, len);
-        skb_adjust(skb, match_len - rep_len);
-    }
-
-    /* fix IP hdr checksum information */
-    iph->tot_len = pal_htons(len + seq_offset);
-#endif
-}
-
-
-/* Generic function for mangling variable-length address changes
- * (like the PORT XXX,XXX,XXX,XXX,XXX,XXX command in FTP).
- *
- * Takes care about all the nasty sequence number changes, checksumming,
- * skb enlargement, ...
- *
- * */
-u32 bvr_alg_mangle_tcp_packet(struct sk_buff *skb, u32 match_offset, u32 match_len, const char *rep_buffer, u32 rep_len)
-{
-    struct ip_hdr *iph = skb_ip_header(skb);
-    u32 pkt_len = skb->mbuf.pkt.data_len + ((u8 *)skb_data(skb) - (u8 *)skb_l2_header(skb));
-
-    if (rep_len > match_len && (rep_len - match_len) + pkt_len > PAL_MAX_PKT_SIZE) {
-        BVR_ERROR("bc_alg_mangle_tcp_packet: mangle failed, must enlarge the packet size.\n");
-        return 0;
-    }
-
-    bvr_mangle_contents(skb, match_offset, match_len, rep_buffer, rep_len);
-
-    /* TODO: maybe A problem */
-    //if (rep_len != match_len) {
-    //  bc_replace_tcp_seq(skb, (int)rep_len - (int)match_len);
-    //}
-
-    skb_iptcp_csum_offload(skb, iph->saddr, iph->daddr, pal_ntohs(iph->tot_len) - (iph->ihl << 2), iph->ihl << 2);
-    return 1;
-}
-
-u32 bvr_alg_ftp_out(struct sk_buff *skb, u32 ftp_mode)
+/*
+ * @brief rewrite the address in PORT/EPRT commands of inner clients and in
+ *        PASV/EPSV responses of inner servers to the snated address.
+ *        the data pointer is on the tcp payload
+ */
+static u32 bvr_ftp_help(struct sk_buff *skb, struct bvr_alg_conn *conn, int dir)
 {
     u16 port;
-    u32 i, j = 0, ret = 0;
+    u32 i, j = 0, ret = NF_ACCEPT;
     int found = 0;
     u32 ip, data_len, newip = 0, matchlen = 0, matchoff = 0;
     const char *data;
     struct ip_hdr *iph = skb_ip_header(skb);
     struct tcp_hdr *tcph = skb_tcp_header(skb);
 
-    skb_pull(skb, tcph->doff * 4);
+    /*only pkts leaving through the snat carry inner addresses*/
+    if (dir != BVR_ALG_DIR_OUT) {
+        return NF_ACCEPT;
+    }
+    /*responses come from the server port, commands go to it*/
+    i = (pal_ntohs(tcph->source) == conn->helper->port) ? FTP_PASSIVE : FTP_ACTIVE;
 
     data_len = skb_len(skb);
     data = skb_data(skb);
 
-    for (i = FTP_ACTIVE; i < FTP_MODE_MAX; i++) {
-        if (ftp_mode != FTP_MODE_MAX && ftp_mode != i) {
-            continue;
-        }
-        for (j = 0; j < 2; j++) {
-            found = bvr_find_pattern(data, data_len,
-                    search[i][j].pattern,
-                    search[i][j].plen,
-                    search[i][j].skip,
-                    search[i][j].term,
-                    &matchoff, &matchlen,
-                    &ip, &port,
-                    search[i][j].getnum);
-            if (found) goto match_end;
-        }
+    for (j = 0; j < 2; j++) {
+        found = bvr_find_pattern(data, data_len,
+                search[i][j].pattern,
+                search[i][j].plen,
+                search[i][j].skip,
+                search[i][j].term,
+                &matchoff, &matchlen,
+                &ip, &port,
+                search[i][j].getnum);
+        if (found) break;
     }
 
-match_end:
     if (found == -1)
     {
-        BVR_DEBUG("bvr_alg_ftp_out: partial %s %u+%u\n", search[i][j].pattern, pal_ntohl(tcph->seq), data_len);
-        ret = NF_DROP;
-        goto ftp_out;
+        BVR_DEBUG("bvr_ftp_help: partial %s %u+%u\n", search[i][j].pattern, pal_ntohl(tcph->seq), data_len);
+        return NF_DROP;
     } else if (found == 0) {
-        goto ftp_out;
+        return NF_ACCEPT;
     }
 
-    BVR_DEBUG("bvr_alg_ftp_out: match `%.*s' (%u bytes at %u)\n", matchlen, data + matchoff, matchlen, pal_ntohl(tcph->seq) + matchoff);
+    BVR_DEBUG("bvr_ftp_help: match `%.*s' (%u bytes at %u)\n", matchlen, data + matchoff, matchlen, pal_ntohl(tcph->seq) + matchoff);
 
-    /*FIXME:is that OK? ALG after snat*/
+    /*ALG runs after snat, the source is the public address*/
     if (likely(ip != iph->saddr)) {
         newip = iph->saddr;
     }else{
-        goto ftp_out;
+        return NF_ACCEPT;
     }
 
     /* mangle the packet */
-    ret = bvr_ftp_mangle(skb, newip, port, search[i][j].ftptype, matchoff, matchlen);
+    ret = bvr_ftp_mangle(skb, conn, dir, newip, port, search[i][j].ftptype, matchoff, matchlen);
 
-ftp_out:
-    skb_push(skb, tcph->doff * 4);
     return ret;
 }
 
+static const struct bvr_alg_helper bvr_ftp_helper = {
+    .name = "ftp",
+    .proto = PAL_IPPROTO_TCP,
+    .port = FTP_CTRL_PORT,
+    .help = bvr_ftp_help,
+};
+
+int bvr_ftp_init(void)
+{
+    return bvr_alg_register(&bvr_ftp_helper);
+}
@@ -34,8 +34,12 @@ typedef struct bvr_ftp_search_s {
     u32 (*getnum)(const char *, u32, u32 *, u16 *, char);
 } bvr_ftp_search_t;
 
-extern u32 bvr_alg_ftp_out(struct sk_buff *skb, u32 ftp_mode);
-extern u32 bvr_alg_mangle_tcp_packet(struct sk_buff *skb, u32 match_offset, u32 match_len, const char *rep_buffer, u32 rep_len);
+#define FTP_CTRL_PORT 21
+
+/*
+ * @brief register the ftp helper on the ftp control port
+ */
+extern int bvr_ftp_init(void);
 
 #endif
 
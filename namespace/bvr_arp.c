@@ -239,14 +239,14 @@ int del_arp_entry(struct net *net, struct arp_entry entry)
  */
 int bvr_arp_init(int numa_id)
 {
-    g_bvr_arp_slab = pal_slab_create("bvr_arp", BVRARP_SLAB_SIZE,
+    g_bvr_arp_slab = pal_slab_create_multipc("bvr_arp", BVRARP_SLAB_SIZE,
         sizeof(struct arp_entry), numa_id, 0);
     if (g_bvr_arp_slab == NULL) {
         PAL_ERROR("bvr arp init error\n");
         return -1;
     }
 
-    g_bvr_arp_table_slab = pal_slab_create("bvr_arp_table", BVRARP_TABLE_SLAB_SIZE,
+    g_bvr_arp_table_slab = pal_slab_create_multipc("bvr_arp_table", BVRARP_TABLE_SLAB_SIZE,
         sizeof(struct pal_hlist_head) * ARP_TABLE_SIZE, numa_id, 0);
     if (g_bvr_arp_table_slab == NULL) {
         PAL_ERROR("bvr arp init error\n");
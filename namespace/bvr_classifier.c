@@ -0,0 +1,311 @@
+/**
+**********************************************************************
+*
+* Copyright (c) 2014 Baidu.com, Inc. All Rights Reserved
+* @file         $HeadURL: $
+* @brief        compiled classifier of the filter rules
+* @author       zhangyu(zhangyu09@baidu.com)
+* @date         $Date:$
+* @version      $Id: $
+***********************************************************************
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pal_malloc.h"
+#include "pal_byteorder.h"
+#include "bvr_netfilter.h"
+#include "bvr_classifier.h"
+#include "logger.h"
+
+/*a rule and the order the mask search meets it, to break priority ties
+  the same way*/
+struct ipt_cls_rule {
+    struct ipt_filter_entry *entry;
+    u32 seq;
+    u32 lo[IPT_CLS_DIM_MAX];
+    u32 hi[IPT_CLS_DIM_MAX];
+};
+
+static int ipt_cls_rule_cmp(const void *a, const void *b)
+{
+    const struct ipt_cls_rule *ra = a, *rb = b;
+
+    if (ra->entry->priority != rb->entry->priority) {
+        return ra->entry->priority < rb->entry->priority ? -1 : 1;
+    }
+    return ra->seq < rb->seq ? -1 : (ra->seq > rb->seq);
+}
+
+static int ipt_cls_u32_cmp(const void *a, const void *b)
+{
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+    return x < y ? -1 : (x > y);
+}
+
+/*index of the interval holding value*/
+static inline u32 ipt_cls_find(const struct ipt_cls_dim *dim, u32 value)
+{
+    u32 lo = 0, hi = dim->n - 1, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi + 1) >> 1;
+        if (dim->bound[mid] <= value) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return lo;
+}
+
+/*
+ * @brief: turn the address of a rule into an interval
+ * @return 1 for success, 0 if the rule never matches, -1 if the mask is not
+ *         a prefix
+ */
+static int ipt_cls_addr_range(u32 key, u32 mask, u32 *lo, u32 *hi)
+{
+    u32 k = pal_ntohl(key), inv = ~pal_ntohl(mask);
+
+    if (inv & (inv + 1)) {
+        return -1;
+    }
+    if (k & inv) {
+        return 0;
+    }
+    *lo = k;
+    *hi = k | inv;
+    return 1;
+}
+
+/*
+ * @brief: turn a rule into one interval per field
+ * @return 1 for success, 0 if the rule never matches, -1 if it can't be compiled
+ */
+static int ipt_cls_rule_init(struct ipt_cls_rule *rule)
+{
+    struct ipt_filter_entry *entry = rule->entry;
+    int ret;
+
+    ret = ipt_cls_addr_range(entry->key.sip, entry->mask_value.sip,
+        &rule->lo[IPT_CLS_DIM_SIP], &rule->hi[IPT_CLS_DIM_SIP]);
+    if (ret <= 0) {
+        return ret;
+    }
+    ret = ipt_cls_addr_range(entry->key.dip, entry->mask_value.dip,
+        &rule->lo[IPT_CLS_DIM_DIP], &rule->hi[IPT_CLS_DIM_DIP]);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    /*without proto mask, the mask search compares proto 0 to the key*/
+    if (entry->mask_value.proto) {
+        rule->lo[IPT_CLS_DIM_PROTO] = rule->hi[IPT_CLS_DIM_PROTO] = entry->key.proto;
+    } else if (entry->key.proto == 0) {
+        rule->lo[IPT_CLS_DIM_PROTO] = 0;
+        rule->hi[IPT_CLS_DIM_PROTO] = 0xff;
+    } else {
+        return 0;
+    }
+
+    if (entry->mask_value.sport) {
+        rule->lo[IPT_CLS_DIM_SPORT] = entry->key.sport[0];
+        rule->hi[IPT_CLS_DIM_SPORT] = entry->key.sport[1];
+    } else {
+        rule->lo[IPT_CLS_DIM_SPORT] = 0;
+        rule->hi[IPT_CLS_DIM_SPORT] = 0xffff;
+    }
+    if (entry->mask_value.dport) {
+        rule->lo[IPT_CLS_DIM_DPORT] = entry->key.dport[0];
+        rule->hi[IPT_CLS_DIM_DPORT] = entry->key.dport[1];
+    } else {
+        rule->lo[IPT_CLS_DIM_DPORT] = 0;
+        rule->hi[IPT_CLS_DIM_DPORT] = 0xffff;
+    }
+    if (rule->lo[IPT_CLS_DIM_SPORT] > rule->hi[IPT_CLS_DIM_SPORT] ||
+        rule->lo[IPT_CLS_DIM_DPORT] > rule->hi[IPT_CLS_DIM_DPORT]) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * @brief: cut one field into elementary intervals and set the bit of each
+ *         rule in the intervals it covers
+ */
+static int ipt_cls_dim_build(struct ipt_filter_cls *cls, int d,
+    const struct ipt_cls_rule *rules, u32 *points)
+{
+    struct ipt_cls_dim *dim = &cls->dim[d];
+    u32 i, j, n = 0, lo, hi;
+
+    points[n++] = 0;
+    for (i = 0; i < cls->rule_num; i++) {
+        points[n++] = rules[i].lo[d];
+        if (rules[i].hi[d] != 0xffffffff) {
+            points[n++] = rules[i].hi[d] + 1;
+        }
+    }
+    qsort(points, n, sizeof(u32), ipt_cls_u32_cmp);
+    for (i = 1, j = 1; i < n; i++) {
+        if (points[i] != points[j - 1]) {
+            points[j++] = points[i];
+        }
+    }
+
+    dim->n = j;
+    dim->bound = pal_malloc(dim->n * sizeof(u32));
+    dim->bitmap = pal_malloc(dim->n * cls->words * sizeof(u64));
+    if (dim->bound == NULL || dim->bitmap == NULL) {
+        return -1;
+    }
+    memset(dim->bitmap, 0, dim->n * cls->words * sizeof(u64));
+    memcpy(dim->bound, points, dim->n * sizeof(u32));
+
+    for (i = 0; i < cls->rule_num; i++) {
+        lo = ipt_cls_find(dim, rules[i].lo[d]);
+        hi = ipt_cls_find(dim, rules[i].hi[d]);
+        for (j = lo; j <= hi; j++) {
+            dim->bitmap[j * cls->words + (i >> 6)] |= 1ULL << (i & 63);
+        }
+    }
+
+    return 0;
+}
+
+struct ipt_filter_cls *ipt_filter_cls_build(struct filter_rule_table *table)
+{
+    struct ipt_filter_cls *cls = NULL;
+    struct ipt_cls_rule *rules = NULL;
+    struct ipt_flow_mask *mask = NULL;
+    struct ipt_filter_entry *entry = NULL;
+    struct pal_hlist_node *pos = NULL;
+    u32 *points = NULL;
+    u32 i, n = 0, seq = 0;
+    int d, ret;
+
+    if (table->rule_num == 0 || table->rule_num > IPT_CLS_MAX_RULES) {
+        return NULL;
+    }
+
+    /*only the classifier itself is read by the datapath*/
+    rules = malloc(table->rule_num * sizeof(*rules));
+    points = malloc((2 * table->rule_num + 1) * sizeof(u32));
+    cls = pal_malloc(sizeof(*cls));
+    if (rules == NULL || points == NULL || cls == NULL) {
+        goto fail;
+    }
+    memset(cls, 0, sizeof(*cls));
+
+    /*walk the rules in the order the mask search meets them*/
+    pal_list_for_each_entry(mask, &table->mask_list, list)
+    {
+        for (i = 0; i < filter_hmap_size(table); i++) {
+            pal_hlist_for_each_entry(entry, pos, &table->filter_hmap[i], hlist)
+            {
+                if (entry->mask != mask) {
+                    continue;
+                }
+                if (n == table->rule_num) {
+                    goto fail;
+                }
+                rules[n].entry = entry;
+                rules[n].seq = seq++;
+                ret = ipt_cls_rule_init(&rules[n]);
+                if (ret < 0) {
+                    BVR_DEBUG("filter rule mask is not a prefix, not compiled\n");
+                    goto fail;
+                }
+                /*rules which never match are left out*/
+                n += ret;
+            }
+        }
+    }
+    qsort(rules, n, sizeof(*rules), ipt_cls_rule_cmp);
+
+    cls->rule_num = n;
+    cls->words = (n + 63) >> 6;
+    if (cls->words == 0) {
+        cls->words = 1;
+    }
+    cls->rules = pal_malloc((n + 1) * sizeof(*cls->rules));
+    if (cls->rules == NULL) {
+        goto fail;
+    }
+    for (i = 0; i < n; i++) {
+        cls->rules[i] = rules[i].entry;
+    }
+
+    for (d = 0; d < IPT_CLS_DIM_MAX; d++) {
+        if (ipt_cls_dim_build(cls, d, rules, points)) {
+            goto fail;
+        }
+    }
+
+    free(rules);
+    free(points);
+    return cls;
+
+fail:
+    free(rules);
+    free(points);
+    ipt_filter_cls_free(cls);
+    return NULL;
+}
+
+void ipt_filter_cls_free(struct ipt_filter_cls *cls)
+{
+    int d;
+
+    if (cls == NULL) {
+        return;
+    }
+
+    for (d = 0; d < IPT_CLS_DIM_MAX; d++) {
+        if (cls->dim[d].bound) {
+            pal_free(cls->dim[d].bound);
+        }
+        if (cls->dim[d].bitmap) {
+            pal_free(cls->dim[d].bitmap);
+        }
+    }
+    if (cls->rules) {
+        pal_free(cls->rules);
+    }
+    pal_free(cls);
+}
+
+struct ipt_filter_entry *ipt_filter_cls_search(const struct ipt_filter_cls *cls,
+    u8 proto, u32 sip, u32 dip, u16 sport, u16 dport)
+{
+    const u64 *bm[IPT_CLS_DIM_MAX];
+    u32 value[IPT_CLS_DIM_MAX];
+    u32 w;
+    u64 hit;
+    int d;
+
+    value[IPT_CLS_DIM_SIP] = pal_ntohl(sip);
+    value[IPT_CLS_DIM_DIP] = pal_ntohl(dip);
+    value[IPT_CLS_DIM_PROTO] = proto;
+    value[IPT_CLS_DIM_SPORT] = pal_ntohs(sport);
+    value[IPT_CLS_DIM_DPORT] = pal_ntohs(dport);
+
+    for (d = 0; d < IPT_CLS_DIM_MAX; d++) {
+        bm[d] = &cls->dim[d].bitmap[ipt_cls_find(&cls->dim[d], value[d]) * cls->words];
+    }
+
+    for (w = 0; w < cls->words; w++) {
+        hit = bm[IPT_CLS_DIM_SIP][w] & bm[IPT_CLS_DIM_DIP][w] & bm[IPT_CLS_DIM_PROTO][w]
+            & bm[IPT_CLS_DIM_SPORT][w] & bm[IPT_CLS_DIM_DPORT][w];
+        if (hit) {
+            return cls->rules[(w << 6) + __builtin_ctzll(hit)];
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,73 @@
+/**
+**********************************************************************
+*
+* Copyright (c) 2014 Baidu.com, Inc. All Rights Reserved
+* @file         $HeadURL: $
+* @brief        compiled classifier of the filter rules
+* @author       zhangyu(zhangyu09@baidu.com)
+* @date         $Date:$
+* @version      $Id: $
+***********************************************************************
+*/
+
+#ifndef CLASSIFIER_H
+#define CLASSIFIER_H
+
+#include "pal_utils.h"
+
+/*
+ * The rules of a filter hook are compiled into a bit vector classifier:
+ * each field is cut into elementary intervals by the bounds of the rules,
+ * and each interval keeps a bitmap of the rules covering it, rules being
+ * ordered by priority. A lookup does one binary search per field and ANDs
+ * the bitmaps, the first bit set is the best rule. Prefixes and port ranges
+ * are both intervals, so the cost does not depend on how many different
+ * masks the rules use.
+ */
+
+/*bitmaps grow with the square of the rule number, bigger tables are
+  searched by masks*/
+#define IPT_CLS_MAX_RULES           2048
+
+enum {
+    IPT_CLS_DIM_SIP = 0,
+    IPT_CLS_DIM_DIP,
+    IPT_CLS_DIM_PROTO,
+    IPT_CLS_DIM_SPORT,
+    IPT_CLS_DIM_DPORT,
+    IPT_CLS_DIM_MAX,
+};
+
+struct ipt_cls_dim {
+    u32 n;          /*number of intervals*/
+    u32 *bound;     /*lowest value of each interval, bound[0] is 0*/
+    u64 *bitmap;    /*n bitmaps of words u64 each*/
+};
+
+struct ipt_filter_cls {
+    u32 rule_num;
+    u32 words;
+    struct ipt_filter_entry **rules;    /*by priority*/
+    struct ipt_cls_dim dim[IPT_CLS_DIM_MAX];
+};
+
+struct filter_rule_table;
+struct ipt_filter_entry;
+
+/*
+ * @brief compile the rules of a hook. called by the control thread only
+ * @return the classifier, NULL if the rules can't be compiled or no memory,
+ *         the rules are then searched by masks
+ */
+struct ipt_filter_cls *ipt_filter_cls_build(struct filter_rule_table *table);
+
+void ipt_filter_cls_free(struct ipt_filter_cls *cls);
+
+/*
+ * @brief find the best rule of a pkt, addresses and ports in network order
+ * @return ipt_filter_entry of the highest priority, NULL if no rule matches
+ */
+struct ipt_filter_entry *ipt_filter_cls_search(const struct ipt_filter_cls *cls,
+    u8 proto, u32 sip, u32 dip, u16 sport, u16 dport);
+
+#endif
@@ -0,0 +1,202 @@
+/**
+**********************************************************************
+*
+* Copyright (c) 2014 Baidu.com, Inc. All Rights Reserved
+* @file         $HeadURL: $
+* @brief        connection tracking for the forwarding filter
+* @author       zhangyu(zhangyu09@baidu.com)
+* @date         $Date:$
+* @version      $Id: $
+***********************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pal_slab.h"
+#include "pal_cuckoo.h"
+#include "pal_thread.h"
+#include "pal_timer.h"
+#include "pal_jiffies.h"
+#include "pal_utils.h"
+#include "bvr_conntrack.h"
+
+/*shard of one packet thread, only touched by that thread*/
+struct nf_ct_shard {
+    struct pal_cuckoo *htable;
+    struct pal_slab *slab;
+};
+
+static struct nf_ct_shard g_nf_ct_shard[PAL_MAX_THREAD];
+
+static const u64 nf_ct_tcp_timeouts[NF_CT_TCP_MAX] = {
+    [NF_CT_TCP_NONE]        = NF_CT_TCP_SYN_TIMEOUT,
+    [NF_CT_TCP_SYN_SENT]    = NF_CT_TCP_SYN_TIMEOUT,
+    [NF_CT_TCP_SYN_RECV]    = NF_CT_TCP_SYN_TIMEOUT,
+    [NF_CT_TCP_ESTABLISHED] = NF_CT_TCP_EST_TIMEOUT,
+    [NF_CT_TCP_FIN_WAIT]    = NF_CT_TCP_FIN_TIMEOUT,
+    [NF_CT_TCP_CLOSE]       = NF_CT_TCP_CLOSE_TIMEOUT,
+};
+
+static inline struct nf_ct_shard *nf_ct_this_shard(void)
+{
+    struct nf_ct_shard *shard = &g_nf_ct_shard[pal_thread_id()];
+
+    return shard->htable ? shard : NULL;
+}
+
+/*
+ * @brief: timer of a connection. packets only push ct->expires forward, so
+ *         the timer is re-armed until the connection is really idle.
+ *         timers run on the thread which armed them, the owner of the shard.
+ */
+static void nf_ct_timeout(unsigned long data)
+{
+    struct nf_conn *ct = (struct nf_conn *)data;
+    struct nf_ct_shard *shard = nf_ct_this_shard();
+
+    if (ct->expires > jiffies) {
+        mod_timer(&ct->timer, ct->expires);
+        return;
+    }
+
+    pal_cuckoo_del(shard->htable, &ct->key);
+    pal_slab_free(ct);
+}
+
+struct nf_conn *nf_ct_find(const struct nf_conn_key *key)
+{
+    struct nf_ct_shard *shard = nf_ct_this_shard();
+
+    if (unlikely(shard == NULL)) {
+        return NULL;
+    }
+
+    return pal_cuckoo_lookup(shard->htable, key);
+}
+
+struct nf_conn *nf_ct_new(const struct nf_conn_key *key, u32 sip, u16 sport)
+{
+    struct nf_ct_shard *shard = nf_ct_this_shard();
+    struct nf_conn *ct = NULL;
+
+    if (unlikely(shard == NULL)) {
+        return NULL;
+    }
+
+    ct = pal_slab_alloc(shard->slab);
+    if (ct == NULL) {
+        return NULL;
+    }
+
+    memset(ct, 0, sizeof(*ct));
+    ct->key = *key;
+    ct->orig_ip = sip;
+    ct->orig_port = sport;
+    ct->state = NF_CT_TCP_NONE;
+
+    if (pal_cuckoo_add(shard->htable, key, ct)) {
+        pal_slab_free(ct);
+        return NULL;
+    }
+
+    init_timer(&ct->timer);
+    ct->timer.function = nf_ct_timeout;
+    ct->timer.data = (unsigned long)ct;
+
+    return ct;
+}
+
+/*
+ * @brief: track the tcp state as seen by the router, only the flags are
+ *         checked, the sequence numbers are not
+ */
+static void nf_ct_tcp_update(struct nf_conn *ct, int dir, const struct tcp_hdr *tcph)
+{
+    if (tcph->rst) {
+        ct->state = NF_CT_TCP_CLOSE;
+        return;
+    }
+
+    if (tcph->syn) {
+        if (!tcph->ack) {
+            /*a new connection reusing the same ports*/
+            if (dir == NF_CT_DIR_ORIGINAL &&
+                (ct->state == NF_CT_TCP_NONE || ct->state == NF_CT_TCP_CLOSE)) {
+                ct->state = NF_CT_TCP_SYN_SENT;
+                ct->flags = 0;
+            }
+        } else if (dir == NF_CT_DIR_REPLY && ct->state == NF_CT_TCP_SYN_SENT) {
+            ct->state = NF_CT_TCP_SYN_RECV;
+        }
+        return;
+    }
+
+    if (tcph->fin) {
+        ct->flags |= (dir == NF_CT_DIR_ORIGINAL) ? NF_CT_F_FIN_ORIG : NF_CT_F_FIN_REPLY;
+        if ((ct->flags & NF_CT_F_FIN_ORIG) && (ct->flags & NF_CT_F_FIN_REPLY)) {
+            ct->state = NF_CT_TCP_CLOSE;
+        } else {
+            ct->state = NF_CT_TCP_FIN_WAIT;
+        }
+        return;
+    }
+
+    /*picked up in the middle, or the handshake completed*/
+    if (ct->state == NF_CT_TCP_NONE ||
+        (ct->state == NF_CT_TCP_SYN_RECV && dir == NF_CT_DIR_ORIGINAL)) {
+        ct->state = NF_CT_TCP_ESTABLISHED;
+    }
+}
+
+void nf_ct_refresh(struct nf_conn *ct, int dir, const struct tcp_hdr *tcph)
+{
+    u64 timeout;
+
+    if (dir == NF_CT_DIR_REPLY) {
+        ct->flags |= NF_CT_F_REPLY_SEEN;
+    }
+
+    switch (ct->key.proto) {
+        case PAL_IPPROTO_TCP:
+            nf_ct_tcp_update(ct, dir, tcph);
+            timeout = nf_ct_tcp_timeouts[ct->state];
+            break;
+        case PAL_IPPROTO_UDP:
+            timeout = (ct->flags & NF_CT_F_REPLY_SEEN) ?
+                NF_CT_UDP_STREAM_TIMEOUT : NF_CT_UDP_TIMEOUT;
+            break;
+        default:
+            timeout = NF_CT_ICMP_TIMEOUT;
+            break;
+    }
+
+    ct->expires = jiffies + timeout;
+    /*the timer only needs to move when the timeout gets shorter*/
+    if (!timer_pending(&ct->timer) || ct->expires < ct->timer.expires) {
+        mod_timer(&ct->timer, ct->expires);
+    }
+}
+
+/*
+ * @brief: create the shard of a thread which handles packets, on the
+ *         numa node of the thread
+ * @return 0 for success, -1 for error
+ */
+int nf_ct_thread_init(int tid)
+{
+    char name[32];
+    struct nf_ct_shard *shard = &g_nf_ct_shard[tid];
+
+    snprintf(name, sizeof(name), "nf_ct_%d", tid);
+    shard->slab = pal_slab_create(name, NF_CT_SHARD_SIZE,
+        sizeof(struct nf_conn), pal_tid_to_numa(tid), 0);
+    shard->htable = pal_cuckoo_create(name, NF_CT_SHARD_SIZE,
+        sizeof(struct nf_conn_key), pal_tid_to_numa(tid));
+    if (shard->slab == NULL || shard->htable == NULL) {
+        PAL_ERROR("conntrack init error on thread %d\n", tid);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+/**
+**********************************************************************
+*
+* Copyright (c) 2014 Baidu.com, Inc. All Rights Reserved
+* @file         $HeadURL: $
+* @brief        connection tracking for the forwarding filter
+* @author       zhangyu(zhangyu09@baidu.com)
+* @date         $Date:$
+* @version      $Id: $
+***********************************************************************
+*/
+
+#ifndef CONNTRACK_H
+#define CONNTRACK_H
+
+#include <string.h>
+#include "pal_pktdef.h"
+#include "pal_timer.h"
+#include "pal_jiffies.h"
+#include "bvr_namespace.h"
+
+/*
+ * Each packet thread tracks the connections it sees in its own shard, so
+ * the table is never shared and needs no lock. A connection remembers the
+ * filter rule each direction hit, established packets reuse it instead of
+ * searching the filter table again, until the filter table changes.
+ */
+
+/*connections tracked by one packet thread*/
+#define NF_CT_SHARD_SIZE            (1U << 16)
+
+enum {
+    NF_CT_DIR_ORIGINAL = 0,
+    NF_CT_DIR_REPLY,
+    NF_CT_DIR_MAX,
+};
+
+/*tcp states, only used to pick the timeout*/
+enum {
+    NF_CT_TCP_NONE = 0,
+    NF_CT_TCP_SYN_SENT,
+    NF_CT_TCP_SYN_RECV,
+    NF_CT_TCP_ESTABLISHED,
+    NF_CT_TCP_FIN_WAIT,
+    NF_CT_TCP_CLOSE,
+    NF_CT_TCP_MAX,
+};
+
+#define NF_CT_F_REPLY_SEEN          0x1
+#define NF_CT_F_FIN_ORIG            0x2
+#define NF_CT_F_FIN_REPLY           0x4
+
+/*timeouts in jiffies*/
+#define NF_CT_TCP_SYN_TIMEOUT       (60 * HZ)
+#define NF_CT_TCP_EST_TIMEOUT       (1800 * HZ)
+#define NF_CT_TCP_FIN_TIMEOUT       (30 * HZ)
+#define NF_CT_TCP_CLOSE_TIMEOUT     (10 * HZ)
+#define NF_CT_UDP_TIMEOUT           (30 * HZ)
+#define NF_CT_UDP_STREAM_TIMEOUT    (180 * HZ)
+#define NF_CT_ICMP_TIMEOUT          (30 * HZ)
+
+/*both directions of a connection have the same key: the lower address first*/
+struct nf_conn_key {
+    u64 net;
+    u32 ip[2];
+    u16 port[2];    /*port[i] goes with ip[i], icmp echo id for icmp*/
+    u8 proto;
+    u8 pad[3];
+};
+
+struct ipt_filter_entry;
+
+struct nf_conn {
+    struct timer_list timer;
+    struct nf_conn_key key;
+    u64 expires;                /*pushed forward by packets, checked by the timer*/
+    u32 orig_ip;                /*source of the first packet*/
+    u16 orig_port;
+    u8 state;
+    u8 flags;
+    /*filter rule hit by each direction and the filter table generation
+      it was looked up at, 0 if the direction was not classified yet*/
+    u64 gen[NF_CT_DIR_MAX];
+    struct ipt_filter_entry *rule[NF_CT_DIR_MAX];
+};
+
+static inline void nf_ct_key_init(struct nf_conn_key *key, struct net *net, u8 proto,
+    u32 sip, u32 dip, u16 sport, u16 dport)
+{
+    key->net = (u64)(unsigned long)net;
+    key->proto = proto;
+    memset(key->pad, 0, sizeof(key->pad));
+    if (sip < dip || (sip == dip && sport <= dport)) {
+        key->ip[0] = sip;
+        key->ip[1] = dip;
+        key->port[0] = sport;
+        key->port[1] = dport;
+    } else {
+        key->ip[0] = dip;
+        key->ip[1] = sip;
+        key->port[0] = dport;
+        key->port[1] = sport;
+    }
+}
+
+static inline int nf_ct_dir(const struct nf_conn *ct, u32 sip, u16 sport)
+{
+    return (sip == ct->orig_ip && sport == ct->orig_port) ?
+        NF_CT_DIR_ORIGINAL : NF_CT_DIR_REPLY;
+}
+
+/*
+ * @brief find a connection in the shard of this thread
+ * @return the connection, NULL if not tracked
+ */
+struct nf_conn *nf_ct_find(const struct nf_conn_key *key);
+
+/*
+ * @brief start tracking a connection in the shard of this thread
+ * @param sip/sport source of the first packet, defining the original direction
+ * @return the new connection, NULL if this thread has no shard or it is full
+ */
+struct nf_conn *nf_ct_new(const struct nf_conn_key *key, u32 sip, u16 sport);
+
+/*
+ * @brief update the state of a connection with a packet and push its timeout
+ * @param tcph tcp header of the packet, NULL for other protocols
+ */
+void nf_ct_refresh(struct nf_conn *ct, int dir, const struct tcp_hdr *tcph);
+
+/*
+ * @brief create the shard of a packet thread, run on that thread
+ */
+int nf_ct_thread_init(int tid);
+
+#endif
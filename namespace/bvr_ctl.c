@@ -11,6 +11,10 @@
 */
 
 #include <stdlib.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/tcp.h>
 #include "bvrouter_config.h"
 #include "bvr_ctl.h"
 #include "bvr_cjson.h"
@@ -18,6 +22,7 @@
 #include "bvr_netfilter.h"
 #include "bvr_errno.h"
 #include "bvr_arp.h"
+#include "bvr_snapshot.h"
 #include "pal_l2_ctl.h"
 #include "pal_list.h"
 #include "pal_vxlan.h"
@@ -26,8 +31,17 @@
 #include "pal_vport.h"
 #include "pal_route.h"
 #include "pal_error.h"
+#include "pal_timer.h"
+#include "pal_qsbr.h"
+#include "pal_netif.h"
+#include "pal_slab.h"
 #include "logger.h"
 #define NN_CTL_LISTEN_PORT 12345
+/* control threads run their pal timers every 10ms */
+#define NN_CTL_TIMER_INTERVAL 0.01
+#define NN_CTL_TIMER_BUDGET 100
+/* a reply not taken by the client within this time closes the connection */
+#define NN_CTL_SEND_TIMEOUT_MS 5000
 extern br_conf_t g_bvrouter_conf_info;
 extern struct pal_hlist_head namespace_hash_table[];
 
@@ -65,20 +79,12 @@ static int set_nonblock(int fd)
 }
 
 /*
-* @brief set fd to block mode.
-*        send msg on block mode
-* @brief return -1 for failed, 0 for success
+* @brief hold back the replies of pipelined messages, so that they leave
+*        together when the connection is uncorked
 */
-static int set_block(int fd)
+static inline void set_cork(int fd, int on)
 {
-    int flags;
-
-    flags = fcntl(fd, F_GETFL);
-    if (flags < 0)
-        return -1;
-    if (fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) < 0)
-        return -1;
-    return 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
 }
 
 
@@ -158,6 +164,35 @@ static inline u32 get_ip_and_mask(char *src, u32 *ip, u32 *mask)
     return 0;
 }
 
+/*
+* @brief: get a nat address from "a.b.c.d" or "a.b.c.d/len", plain address is /32
+*/
+static inline int get_nat_prefix(char *src, u32 *ip, u8 *plen)
+{
+    u32 len = 0;
+
+    if (strchr(src, '/') == NULL) {
+        if (!inet_aton(src, (struct in_addr *)ip)) {
+            return -1;
+        }
+        *plen = NAT_PLEN_MAX;
+        return 0;
+    }
+    if (get_ip_and_mask(src, ip, &len)) {
+        return -1;
+    }
+    *plen = len;
+    return 0;
+}
+
+/*
+* @brief: print a nat address, with the prefix length unless it is /32
+*/
+static inline char *nat_prefix_str(u32 ip, u8 plen)
+{
+    return trans_ip(ip, plen == NAT_PLEN_MAX ? 0 : plen);
+}
+
 /*
 * @brief: get port_start and port_end from "xx:xx"
 */
@@ -243,35 +278,285 @@ static inline u32 get_mac_addr(char *src, unsigned char *dst)
 
 
 /*
-* @brief: send data in block mode
+* @brief: send all the data, waiting for the socket to drain if it is full
 */
 
 static int send_bytes(int fd, u8 *buf, unsigned len)
 {
     int nsent;
-
-    if (set_block(fd) < 0) {
-        return -1;
-    }
+    struct pollfd pfd;
 
     while (len > 0) {
         nsent = send(fd, buf, len, 0);
         if (nsent < 0) {
             if (errno == EINTR) {
                 continue;
+            } else if (errno == EAGAIN) {
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                nsent = poll(&pfd, 1, NN_CTL_SEND_TIMEOUT_MS);
+                if (nsent == 0 || (nsent < 0 && errno != EINTR)) {
+                    return -1;
+                }
+                continue;
             } else {
-                set_nonblock(fd);
                 return -1;
             }
         }
         len -= nsent;
         buf += nsent;
     }
-    set_nonblock(fd);
     return 0;
 }
 
 
+/*
+ * @brief send the reply of a command. while the command holds its locks,
+ *        see dispatch_msg(), the reply is kept and sent by ctl_reply_flush()
+ *        once they are released, so that a slow client does not stall the
+ *        commands waiting for them
+ * @return 0 on success, -1 on failure
+ */
+static int ctl_reply(struct conn_ev *ev, const void *buf, unsigned len)
+{
+    char *reply;
+    u32 size;
+
+    if (!ev->reply_defer) {
+        return send_bytes(ev->ev.fd, (u8 *)buf, len);
+    }
+
+    if (ev->reply_len + len > ev->reply_size) {
+        for (size = ev->reply_size ? ev->reply_size : 256; size < ev->reply_len + len; size <<= 1);
+        reply = realloc(ev->reply, size);
+        if (reply == NULL) {
+            return -1;
+        }
+        ev->reply = reply;
+        ev->reply_size = size;
+    }
+    memcpy(ev->reply + ev->reply_len, buf, len);
+    ev->reply_len += len;
+    return 0;
+}
+
+/*
+ * @brief send the reply kept by ctl_reply(), with no lock held
+ */
+static void ctl_reply_flush(struct conn_ev *ev)
+{
+    ev->reply_defer = 0;
+    if (ev->reply_len && send_bytes(ev->ev.fd, (u8 *)ev->reply, ev->reply_len) < 0) {
+        BVR_ERROR("send ret message failed\n");
+    }
+    ev->reply_len = 0;
+
+    if (ev->reply_size > NN_CTL_KEEP_BUF_SIZE) {
+        free(ev->reply);
+        ev->reply = NULL;
+        ev->reply_size = 0;
+    }
+}
+
+/*
+ * @brief the json body of the command being run. ctl_lock() parses it for
+ *        the locks, and the handler takes it from there instead of parsing
+ *        it again. the handler frees it by cJSON_Delete()
+ * @return the body, NULL if it is not valid json
+ */
+static cJSON *ctl_body(struct conn_ev *ev)
+{
+    cJSON *root = ev->root;
+
+    ev->root = NULL;
+    return root ? root : cJSON_Parse(ev->buf);
+}
+
+
+/*
+ * Control threads run commands in parallel, see bvr_controlplane_process().
+ * A command takes in this order:
+ *  - the control lock, for write if it changes the whole router (namespaces,
+ *    ports), for read otherwise
+ *  - the lock of its namespace, struct net ctl_lock
+ *  - the lock of its vni, one of NN_CTL_VNI_LOCKS shared by the vnis
+ *    (a sync locks the vnis of its namespace, in index order)
+ * then the locks of pal taken by the functions it calls. Commands on other
+ * namespaces and vnis run meanwhile.
+ */
+#define NN_CTL_VNI_LOCKS 64
+
+static pthread_rwlock_t g_ctl_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t g_ctl_vni_lock[NN_CTL_VNI_LOCKS] = {
+    [0 ... NN_CTL_VNI_LOCKS - 1] = PTHREAD_MUTEX_INITIALIZER
+};
+
+/*locks of a command, other than the control lock*/
+struct ctl_held {
+    struct net *net;
+    pthread_mutex_t *vni;
+};
+
+static void ctl_lock_net(struct ctl_held *held, char *name)
+{
+    held->net = net_get(name);
+    if (held->net) {
+        pthread_mutex_lock(&held->net->ctl_lock);
+    }
+}
+
+static inline pthread_mutex_t *ctl_vni_lock(u32 vni)
+{
+    return &g_ctl_vni_lock[vni % NN_CTL_VNI_LOCKS];
+}
+
+static void ctl_lock_vni(struct ctl_held *held, u32 vni)
+{
+    held->vni = ctl_vni_lock(vni);
+    pthread_mutex_lock(held->vni);
+}
+
+/*
+ * @brief take the locks of a command, see NN_CTL_LOCK_GLOBAL.
+ *        a namespace or vni not found is not locked, the handler answers it
+ */
+static void ctl_lock(struct conn_ev *ev, int kind, struct ctl_held *held)
+{
+    cJSON *root, *tmp;
+    u32 vni;
+
+    held->net = NULL;
+    held->vni = NULL;
+    if (kind == NN_CTL_LOCK_GLOBAL) {
+        pthread_rwlock_wrlock(&g_ctl_lock);
+        return;
+    }
+    pthread_rwlock_rdlock(&g_ctl_lock);
+    if (kind == NN_CTL_LOCK_SHARED) {
+        return;
+    }
+
+    /*the handler takes the body, see ctl_body()*/
+    root = ev->root = cJSON_Parse(ev->buf);
+    if (!root) {
+        return;
+    }
+    tmp = cJSON_GetObjectItem(root, kind == NN_CTL_LOCK_NS ? "name" : "bvrouter");
+    if (kind != NN_CTL_LOCK_VNI && tmp && tmp->type == cJSON_String) {
+        ctl_lock_net(held, tmp->valuestring);
+    }
+    if (kind == NN_CTL_LOCK_VNI || kind == NN_CTL_LOCK_NET_VNI) {
+        tmp = cJSON_GetObjectItem(root, "vni");
+        if (tmp && tmp->type == cJSON_Number) {
+            ctl_lock_vni(held, tmp->valueint);
+        }
+    } else if (kind == NN_CTL_LOCK_NET_IF) {
+        tmp = cJSON_GetObjectItem(root, "ifname");
+        if (tmp && tmp->type == cJSON_String &&
+            int_vport_vni_ctl(tmp->valuestring, &vni) == 0) {
+            ctl_lock_vni(held, vni);
+        }
+    }
+}
+
+static void ctl_unlock(struct ctl_held *held)
+{
+    if (held->vni) {
+        pthread_mutex_unlock(held->vni);
+    }
+    if (held->net) {
+        pthread_mutex_unlock(&held->net->ctl_lock);
+    }
+    pthread_rwlock_unlock(&g_ctl_lock);
+}
+
+
+/*
+ * @brief stream the reply of a show command if its json body asks for it,
+ *        see NN_CTL_RET_MORE. the chunks are sent by stream_next()
+ * @param fill packs the next entries of the table in a chunk, returns 1 if
+ *        entries are left, 0 if not, or a NN error
+ * @return 1 if the stream is started, 0 if not asked, a NN error if
+ *         "stream" is invalid
+ */
+static int stream_start(struct conn_ev *ev, cJSON *root,
+    int (* fill)(struct conn_ev *ev, cJSON *chunk), u32 arg, const char *net_name)
+{
+    cJSON *tmp = cJSON_GetObjectItem(root, "stream");
+
+    if (tmp == NULL) {
+        return 0;
+    }
+    if (tmp->type != cJSON_Number || tmp->valueint <= 0 ||
+        tmp->valueint > NN_CTL_STREAM_MAX) {
+        BVR_WARNING("stream chunk size out of range\n");
+        return -NN_EOUTRANGE;
+    }
+
+    ev->stream = fill;
+    ev->stream_cursor = 0;
+    ev->stream_limit = tmp->valueint;
+    ev->stream_arg = arg;
+    snprintf(ev->stream_net, sizeof(ev->stream_net), "%s", net_name ? net_name : "");
+    return 1;
+}
+
+
+/*
+ * @brief send the next chunk of the streamed reply of ev. the stream is
+ *        over after its last chunk, or an error
+ * @return 0 on success, -1 if the chunk could not be sent
+ */
+static int stream_next(struct conn_ev *ev)
+{
+    struct ctl_held held;
+    cJSON *chunk = NULL;
+    char *out = NULL;
+    int ret = -NN_ENOMEM;
+
+    chunk = cJSON_CreateArray();
+    if (chunk != NULL) {
+        /*the dumped table is locked for a chunk only*/
+        held.net = NULL;
+        held.vni = NULL;
+        pthread_rwlock_rdlock(&g_ctl_lock);
+        if (ev->stream_net[0] != '\0') {
+            ctl_lock_net(&held, ev->stream_net);
+        } else {
+            ctl_lock_vni(&held, ev->stream_arg);
+        }
+        ret = ev->stream(ev, chunk);
+        ctl_unlock(&held);
+        if (ret >= 0 && (out = cJSON_PrintUnformatted(chunk)) == NULL) {
+            ret = -NN_ENOMEM;
+        }
+        cJSON_Delete(chunk);
+    }
+
+    if (ret < 0) {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = ret;
+    } else {
+        ev->msg_prefix.msg_len = strlen(out);
+        ev->msg_prefix.ret_state = ret ? NN_CTL_RET_MORE : 0;
+    }
+    if (ret <= 0) {
+        ev->stream = NULL;
+    }
+
+    ret = 0;
+    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0 ||
+        (ev->msg_prefix.msg_len &&
+        send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)) {
+        BVR_ERROR("send ret message failed\n");
+        ev->stream = NULL;
+        ret = -1;
+    }
+    free(out);
+    return ret;
+}
+
+
 /*
  * @brief only for test
  * @json param:as your wish
@@ -280,11 +565,12 @@ static int send_bytes(int fd, u8 *buf, unsigned len)
 static u32 bvr_cmd_test_handler(struct conn_ev *ev)
 {
     BVR_DEBUG("nn_cmd_test_handler called\n");
-    cJSON *root = cJSON_Parse(ev->buf);
+    cJSON *root = ctl_body(ev);
     struct ipt_nat_entry entry;
     entry.orig_ip = cJSON_GetObjectItem(root, "orig_ip")->valueint;
     entry.nat_ip = cJSON_GetObjectItem(root, "nat_ip")->valueint;
     entry.nat_target = cJSON_GetObjectItem(root, "nat_target")->valueint;
+    entry.orig_plen = entry.nat_plen = NAT_PLEN_MAX;
     printf("name %s\n",cJSON_GetObjectItem(root, "name")->valuestring);
     cJSON_Delete(root);
     BVR_DEBUG("test handler,we get org ip %x,nat ip %x,nat target %d\n",
@@ -293,7 +579,7 @@ static u32 bvr_cmd_test_handler(struct conn_ev *ev)
 
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = 10;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0) {
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0) {
 
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -311,7 +597,7 @@ static u32 bvr_cmd_create_namespace_handler(struct conn_ev *ev)
     BVR_DEBUG("nn_cmd_create_namespace_handler called\n");
     int ret = 0;
     /*parse the json string, only one name param*/
-    cJSON *root = cJSON_Parse(ev->buf);
+    cJSON *root = ctl_body(ev);
 
     if (!root) {
         ret = -NN_ENOMEM;
@@ -333,7 +619,7 @@ ret_state:
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
     /*send prefix back*/
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -356,7 +642,7 @@ static u32 bvr_cmd_set_portstatus_interval_handler(struct conn_ev *ev)
     BVR_DEBUG("nn_bvr_cmd_set_portstatus_interval_handler called\n");
     int ret = 0;
     /*parse the json string, only one interval param*/
-    cJSON *root = cJSON_Parse(ev->buf);
+    cJSON *root = ctl_body(ev);
 
     if (!root) {
         ret = -NN_ENOMEM;
@@ -383,7 +669,7 @@ ret_state:
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
     /*send prefix back*/
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -407,7 +693,7 @@ static u32 bvr_cmd_get_port_update_handler(struct conn_ev *ev)
     cJSON *root = NULL, *func = NULL;
 
     /*test if the function name is right*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -459,13 +745,13 @@ static u32 bvr_cmd_get_port_update_handler(struct conn_ev *ev)
 
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -495,7 +781,7 @@ static u32 bvr_cmd_del_namespace_handler(struct conn_ev *ev)
     BVR_DEBUG("nn_cmd_del_namespace_handler called\n");
     int ret = 0;
     /*parse the json string, only one name param*/
-    cJSON *root = cJSON_Parse(ev->buf);
+    cJSON *root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -517,7 +803,7 @@ ret_state:
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
     /*send prefix back*/
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -543,7 +829,7 @@ static u32 bvr_cmd_list_namespace_handler(struct conn_ev *ev)
     cJSON *root = NULL, *bv_name = NULL, *func = NULL;
 
     /*test if the function name is right*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -601,13 +887,13 @@ static u32 bvr_cmd_list_namespace_handler(struct conn_ev *ev)
 
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -632,28 +918,14 @@ error:
 static struct cJSON *pack_net_entry(struct net *net)
 {
     struct cJSON *root = NULL;
-    u32 i;
     struct statistics sum;
-    memset(&sum, 0, sizeof(sum));
     char tmp[64];
     root = cJSON_CreateObject();
     if (!root) {
         return NULL;
     }
     cJSON_AddStringToObject(root, "bvrname", net->name);
-    for (i = 0; i < PAL_MAX_CPU; i++)
-    {
-        sum.arperror_pkts += net->stats[i].arperror_pkts;
-        sum.arperror_bytes += net->stats[i].arperror_bytes;
-        sum.hdrerror_bytes += net->stats[i].hdrerror_bytes;
-        sum.hdrerror_pkts += net->stats[i].hdrerror_pkts;
-        sum.input_bytes += net->stats[i].input_bytes;
-        sum.input_pkts += net->stats[i].input_pkts;
-        sum.output_bytes += net->stats[i].output_bytes;
-        sum.output_pkts += net->stats[i].output_pkts;
-        sum.rterror_bytes += net->stats[i].rterror_bytes;
-        sum.rterror_pkts += net->stats[i].rterror_pkts;
-    }
+    pal_pcpu_sum(&sum, net->stats, sizeof(sum));
     /*use string for u64*/
     sprintf(tmp, "%lu", sum.arperror_bytes);
     cJSON_AddStringToObject(root, "arperror_bytes", tmp);
@@ -677,6 +949,18 @@ static struct cJSON *pack_net_entry(struct net *net)
     cJSON_AddStringToObject(root, "rterror_bytes", tmp);
     sprintf(tmp, "%lu", sum.rterror_pkts);
     cJSON_AddStringToObject(root, "rterror_pkts", tmp);
+    sprintf(tmp, "%lu", sum.mssclamp_pkts);
+    cJSON_AddStringToObject(root, "mssclamp_pkts", tmp);
+    sprintf(tmp, "%lu", sum.ct_hit_pkts);
+    cJSON_AddStringToObject(root, "ct_hit_pkts", tmp);
+    sprintf(tmp, "%lu", sum.ct_new_conns);
+    cJSON_AddStringToObject(root, "ct_new_conns", tmp);
+    sprintf(tmp, "%lu", sum.flow_hit_pkts);
+    cJSON_AddStringToObject(root, "flow_hit_pkts", tmp);
+    sprintf(tmp, "%u", net->mss_clamp);
+    cJSON_AddStringToObject(root, "mss_clamp", tmp);
+    sprintf(tmp, "%lu", net->sync_gen);
+    cJSON_AddStringToObject(root, "sync_gen", tmp);
     return root;
 
 }
@@ -696,7 +980,7 @@ static u32 bvr_cmd_show_namespace_handler(struct conn_ev *ev)
     cJSON *root = NULL, *name = NULL;
 
     /*test if the function name is right*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -747,13 +1031,13 @@ static u32 bvr_cmd_show_namespace_handler(struct conn_ev *ev)
     }
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -781,16 +1065,16 @@ static int parse_ip_nat_entry(cJSON *root, u32 *hook_num, struct ipt_nat_entry *
     int ret = 0;
     /*all the elements are position params, so we can get them*/
     *hook_num = cJSON_GetObjectItem(root, "hook_num")->valueint;
-    ret = inet_aton(cJSON_GetObjectItem(root, "orig_ip")->valuestring,
-        (struct in_addr *)&entry->orig_ip);
-    if (!ret) {
+    ret = get_nat_prefix(cJSON_GetObjectItem(root, "orig_ip")->valuestring,
+        &entry->orig_ip, &entry->orig_plen);
+    if (ret) {
         BVR_WARNING("parse nat entry orig ip error.\n");
         return -NN_EPARSECMD;
     }
-    ret = inet_aton(cJSON_GetObjectItem(root, "nat_ip")->valuestring,
-        (struct in_addr *)&entry->nat_ip);
+    ret = get_nat_prefix(cJSON_GetObjectItem(root, "nat_ip")->valuestring,
+        &entry->nat_ip, &entry->nat_plen);
 
-    if (!ret) {
+    if (ret) {
         BVR_WARNING("parse nat entry nat ip error.\n");
         return -NN_EPARSECMD;
     }
@@ -934,7 +1218,7 @@ static u32 bvr_cmd_add_netfilter_rule(struct conn_ev *ev)
 
 
     /*parse the bvrouter name, if bvrouter not exist return error*/
-    cJSON *root = cJSON_Parse(ev->buf);
+    cJSON *root = ctl_body(ev);
     if (NULL == root) {
         ret = -NN_ENOMEM;
         BVR_WARNING("parse root error\n");
@@ -1004,7 +1288,7 @@ ret_state:
 
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -1027,7 +1311,7 @@ static u32 bvr_cmd_del_netfilter_rule(struct conn_ev *ev)
     u32 hook_num = 0, ret = 0;
 
     /*parse the bvrouter name, if bvrouter not exist return error*/
-    cJSON *root = cJSON_Parse(ev->buf);
+    cJSON *root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -1051,10 +1335,10 @@ static u32 bvr_cmd_del_netfilter_rule(struct conn_ev *ev)
         memset(&nat_entry, 0, sizeof(nat_entry));
 
         hook_num = cJSON_GetObjectItem(root, "hook_num")->valueint;
-        ret = inet_aton(cJSON_GetObjectItem(root, "orig_ip")->valuestring,
-            (struct in_addr *)&nat_entry.orig_ip);
+        ret = get_nat_prefix(cJSON_GetObjectItem(root, "orig_ip")->valuestring,
+            &nat_entry.orig_ip, &nat_entry.orig_plen);
 
-        if (!ret) {
+        if (ret) {
             BVR_WARNING("parse nat entry orig ip error.\n");
             ret =  -NN_EPARSECMD;
             goto ret_state;
@@ -1085,7 +1369,7 @@ ret_state:
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -1100,7 +1384,7 @@ ret_state:
 
 static struct cJSON *pack_ipt_nat_rule(struct net *net)
 {
-    u32 i = 0 ,j = 0, k = 0;
+    u32 i = 0, k = 0;
     struct cJSON *root = NULL, *sub = NULL, *rule = NULL;
     char tmp[64];
     root = cJSON_CreateObject();
@@ -1115,46 +1399,40 @@ static struct cJSON *pack_ipt_nat_rule(struct net *net)
         //cJSON_AddItemTo(root, sub = cJSON_CreateObject());
         cJSON_AddItemToObject(root, hook_name[i], sub = cJSON_CreateArray());
         //cJSON_AddStringToObject(sub, "hook_num", hook_name[i]);
-        for (j = 0; j < NAT_TABLE_SIZE; j++) {
-            struct ipt_nat_entry *entry = NULL;
-            struct pal_hlist_node *pos = NULL;
+        if (nat_table == NULL) {
+            /*the net never had nat rules*/
+            continue;
+        }
+        struct nat_rule_table *table = &nat_table->table[i];
+        struct ipt_nat_entry *entry = NULL;
+
+        pal_list_for_each_entry(entry, &table->nat_list, list) {
+            struct counter sum;
+            cJSON_AddItemToArray(sub, rule = cJSON_CreateObject());
+            switch (entry->nat_target) {
+                case NF_SNAT:
+                    cJSON_AddStringToObject(rule, "source-ip", nat_prefix_str(entry->orig_ip, entry->orig_plen));
+                    cJSON_AddStringToObject(rule, "to-ip", nat_prefix_str(entry->nat_ip, entry->nat_plen));
+                    cJSON_AddStringToObject(rule, "target", "SNAT");
+                    SUM_COUNTER(entry->counter, sum);
+                    sprintf(tmp, "%lu", sum.pcnt);
+                    cJSON_AddStringToObject(rule, "hit_pkts", tmp);
+                    sprintf(tmp, "%lu", sum.bcnt);
+                    cJSON_AddStringToObject(rule, "hit_bytes", tmp);
 
-            struct nat_rule_table *table = &nat_table->table[i];
-            struct pal_hlist_head *head = &table->nat_hmap[j];
-            pal_hlist_for_each_entry(entry, pos, head, hlist) {
-                u64 pcnt = 0, bcnt = 0;
-                cJSON_AddItemToArray(sub, rule = cJSON_CreateObject());
-                switch (entry->nat_target) {
-                    case NF_SNAT:
-                        cJSON_AddStringToObject(rule, "source-ip", trans_ip(entry->orig_ip, 0));
-                        cJSON_AddStringToObject(rule, "to-ip", trans_ip(entry->nat_ip, 0));
-                        cJSON_AddStringToObject(rule, "target", "SNAT");
-                        for (k = 0; k < PAL_MAX_CPU; k++) {
-                            pcnt += entry->counter.cnt[k].pcnt;
-                            bcnt += entry->counter.cnt[k].bcnt;
-                        }
-                        sprintf(tmp, "%lu", pcnt);
-                        cJSON_AddStringToObject(rule, "hit_pkts", tmp);
-                        sprintf(tmp, "%lu", bcnt);
-                        cJSON_AddStringToObject(rule, "hit_bytes", tmp);
-
-                        break;
-                    case NF_DNAT:
-                        cJSON_AddStringToObject(rule, "destination-ip", trans_ip(entry->orig_ip, 0));
-                        cJSON_AddStringToObject(rule, "to-ip", trans_ip(entry->nat_ip, 0));
-                        cJSON_AddStringToObject(rule, "target", "DNAT");
-                        for (k = 0; k < PAL_MAX_CPU; k++) {
-                            pcnt += entry->counter.cnt[k].pcnt;
-                            bcnt += entry->counter.cnt[k].bcnt;
-                        }
-                        sprintf(tmp, "%lu", pcnt);
-                        cJSON_AddStringToObject(rule, "hit_pkts", tmp);
-                        sprintf(tmp, "%lu", bcnt);
-                        cJSON_AddStringToObject(rule, "hit_bytes", tmp);
-                        break;
-                    default:
-                        break;
-                }
+                    break;
+                case NF_DNAT:
+                    cJSON_AddStringToObject(rule, "destination-ip", nat_prefix_str(entry->orig_ip, entry->orig_plen));
+                    cJSON_AddStringToObject(rule, "to-ip", nat_prefix_str(entry->nat_ip, entry->nat_plen));
+                    cJSON_AddStringToObject(rule, "target", "DNAT");
+                    SUM_COUNTER(entry->counter, sum);
+                    sprintf(tmp, "%lu", sum.pcnt);
+                    cJSON_AddStringToObject(rule, "hit_pkts", tmp);
+                    sprintf(tmp, "%lu", sum.bcnt);
+                    cJSON_AddStringToObject(rule, "hit_bytes", tmp);
+                    break;
+                default:
+                    break;
             }
         }
 
@@ -1163,11 +1441,44 @@ static struct cJSON *pack_ipt_nat_rule(struct net *net)
     return root;
 }
 
-static struct cJSON *pack_ipt_filter_rule(struct net *net)
+static struct cJSON *pack_ipt_filter_entry(struct cJSON *array, struct ipt_filter_entry *entry)
 {
-    u32 i ,j, k;
-    struct cJSON *root = NULL, *sub = NULL, *rule = NULL;
+    struct cJSON *rule = NULL;
+    struct counter sum;
     char tmp[64];
+
+    cJSON_AddItemToArray(array, rule = cJSON_CreateObject());
+
+    cJSON_AddStringToObject(rule, "source-ip", trans_ip(entry->key.sip,
+        get_mask_count(entry->mask_value.sip)));
+    BVR_DEBUG("mask %x",entry->mask_value.sip);
+    cJSON_AddStringToObject(rule, "destination-ip", trans_ip(entry->key.dip,
+        get_mask_count(entry->mask_value.dip)));
+    cJSON_AddNumberToObject(rule, "source-port-start", entry->key.sport[0]);
+    cJSON_AddNumberToObject(rule, "source-port-end", entry->key.sport[1]);
+    BVR_DEBUG("pack filter sport %d-%p, sport2 %d-%p\n", entry->key.sport[0], &entry->key.sport[0],
+        entry->key.sport[1],&entry->key.sport[1]);
+
+    cJSON_AddNumberToObject(rule, "dest-port-start", entry->key.dport[0]);
+    cJSON_AddNumberToObject(rule, "dest-port-end", entry->key.dport[1]);
+    cJSON_AddNumberToObject(rule, "proto", entry->key.proto);
+    cJSON_AddNumberToObject(rule, "priority", entry->priority);
+    cJSON_AddNumberToObject(rule, "dir", entry->dir);
+
+    cJSON_AddStringToObject(rule, "target", target_name[entry->filter_target]);
+    SUM_COUNTER(entry->counter, sum);
+
+    sprintf(tmp, "%lu", sum.pcnt);
+    cJSON_AddStringToObject(rule, "hit_pkts", tmp);
+    sprintf(tmp, "%lu", sum.bcnt);
+    cJSON_AddStringToObject(rule, "hit_bytes", tmp);
+    return rule;
+}
+
+static struct cJSON *pack_ipt_filter_rule(struct net *net)
+{
+    u32 i ,j;
+    struct cJSON *root = NULL, *sub = NULL;
     root = cJSON_CreateObject();
     if (root == NULL) {
         return NULL;
@@ -1178,41 +1489,12 @@ static struct cJSON *pack_ipt_filter_rule(struct net *net)
     for (i = 0; i < NF_MAX_HOOKS; i++) {
         cJSON_AddItemToObject(root, hook_name[i], sub = cJSON_CreateArray());
         //cJSON_AddStringToObject(sub, "hook_num", hook_name[i]);
-        for (j = 0; j < FILTER_TABLE_SIZE; j++) {
+        for (j = 0; filter_table && j < filter_hmap_size(&filter_table->table[i]); j++) {
             struct ipt_filter_entry *entry = NULL;
             struct pal_hlist_node *pos = NULL;
             struct pal_hlist_head *head = &filter_table->table[i].filter_hmap[j];
             pal_hlist_for_each_entry(entry, pos, head, hlist) {
-
-                u64 bcnt = 0, pcnt = 0;
-                cJSON_AddItemToArray(sub, rule = cJSON_CreateObject());
-
-                cJSON_AddStringToObject(rule, "source-ip", trans_ip(entry->key.sip,
-                    get_mask_count(entry->mask_value.sip)));
-                BVR_DEBUG("mask %x",entry->mask_value.sip);
-                cJSON_AddStringToObject(rule, "destination-ip", trans_ip(entry->key.dip,
-                    get_mask_count(entry->mask_value.dip)));
-                cJSON_AddNumberToObject(rule, "source-port-start", entry->key.sport[0]);
-                cJSON_AddNumberToObject(rule, "source-port-end", entry->key.sport[1]);
-                BVR_DEBUG("pack filter sport %d-%p, sport2 %d-%p\n", entry->key.sport[0], &entry->key.sport[0],
-                    entry->key.sport[1],&entry->key.sport[1]);
-
-                cJSON_AddNumberToObject(rule, "dest-port-start", entry->key.dport[0]);
-                cJSON_AddNumberToObject(rule, "dest-port-end", entry->key.dport[1]);
-                cJSON_AddNumberToObject(rule, "proto", entry->key.proto);
-                cJSON_AddNumberToObject(rule, "priority", entry->priority);
-                cJSON_AddNumberToObject(rule, "dir", entry->dir);
-
-                cJSON_AddStringToObject(rule, "target", target_name[entry->filter_target]);
-                for (k = 0; k < PAL_MAX_CPU; k++) {
-                    pcnt += entry->counter.cnt[k].pcnt;
-                    bcnt += entry->counter.cnt[k].bcnt;
-                }
-
-                sprintf(tmp, "%lu", pcnt);
-                cJSON_AddStringToObject(rule, "hit_pkts", tmp);
-                sprintf(tmp, "%lu", bcnt);
-                cJSON_AddStringToObject(rule, "hit_bytes", tmp);
+                pack_ipt_filter_entry(sub, entry);
             }
         }
     }
@@ -1220,6 +1502,38 @@ static struct cJSON *pack_ipt_filter_rule(struct net *net)
     return root;
 }
 
+static int stream_ipt_filter_rule(struct conn_ev *ev, struct cJSON *chunk)
+{
+    u32 i, j, n = 0, end = ev->stream_cursor + ev->stream_limit;
+    struct xt_filter_table *filter_table;
+    struct ipt_filter_entry *entry = NULL;
+    struct pal_hlist_node *pos = NULL;
+    struct net *net;
+
+    net = net_get(ev->stream_net);
+    if (!net) {
+        return -NN_ENSNOTEXIST;
+    }
+    filter_table = (struct xt_filter_table *)net->filter->private;
+
+    /*skip the rules already sent, the table may have changed since*/
+    for (i = 0; filter_table && i < NF_MAX_HOOKS; i++) {
+        for (j = 0; j < filter_hmap_size(&filter_table->table[i]); j++) {
+            pal_hlist_for_each_entry(entry, pos, &filter_table->table[i].filter_hmap[j], hlist) {
+                if (n == end) {
+                    ev->stream_cursor = end;
+                    return 1;
+                }
+                if (n++ >= ev->stream_cursor) {
+                    cJSON_AddStringToObject(pack_ipt_filter_entry(chunk, entry),
+                        "hook", hook_name[i]);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
 
  /*
  * @brief show netfilter rule of bvrouter
@@ -1233,10 +1547,11 @@ static u32 bvr_cmd_show_netfilter_rule(struct conn_ev *ev)
     struct net *net = NULL;
     char table_name[32];
     char *out = NULL;
+    int ret;
 
     /*parse the bvrouter name, if bvrouter not exist return error*/
     cJSON *root = NULL;
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -1261,6 +1576,18 @@ static u32 bvr_cmd_show_netfilter_rule(struct conn_ev *ev)
     }
 
     strcpy(table_name, table->valuestring);
+    if (!strcmp(table_name, FILTER_TABLE)) {
+        ret = stream_start(ev, root, stream_ipt_filter_rule, 0, net->name);
+        if (ret) {
+            cJSON_Delete(root);
+            if (ret > 0) {
+                return 0;
+            }
+            ev->msg_prefix.msg_len = 0;
+            ev->msg_prefix.ret_state = ret;
+            goto ret_state;
+        }
+    }
     cJSON_Delete(root);
 
     if (!strcmp(table_name, NAT_TABLE)) {
@@ -1297,13 +1624,13 @@ static u32 bvr_cmd_show_netfilter_rule(struct conn_ev *ev)
 
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -1333,7 +1660,7 @@ static u32 bvr_cmd_flush_netfilter_rule(struct conn_ev *ev)
 
 
     /*parse the bvrouter name, if bvrouter not exist return error*/
-    cJSON *root = cJSON_Parse(ev->buf);
+    cJSON *root = ctl_body(ev);
     if (NULL == root) {
         ret = -NN_ENOMEM;
         BVR_WARNING("parse root error\n");
@@ -1384,7 +1711,7 @@ ret_state:
 
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -1395,6 +1722,126 @@ ret_state:
 
 
 
+/*
+ * The commands below are shared by the json and the binary encodings,
+ * they return 0 on success, otherwise a status error.
+ */
+
+static int ctl_arp_add(u32 vni, struct vxlan_arp_entry *entry)
+{
+    int ret = vxlan_arp_add_ctl(vni, entry);
+
+    if (ret == -ENXIO || ret == -ESRCH) {
+        return -NN_EIFNOTEXIST;
+    } else if (ret == -EEXIST) {
+        return -NN_EARPEXIST;
+    } else if (ret == -ENOSPC) {
+        return -NN_ENOSPACE;
+    } else if (ret == -ENOMEM) {
+        return -NN_ENOMEM;
+    } else if (ret) {
+        BVR_WARNING("unknown error code when add arp entry return the orignal code %d", ret);
+    }
+    return ret;
+}
+
+static int ctl_arp_del(u32 vni, struct vxlan_arp_entry *entry)
+{
+    int ret = vxlan_arp_delete_ctl(vni, entry);
+
+    if (ret == -ENXIO || ret == -ESRCH) {
+        return -NN_EIFNOTEXIST;
+    } else if (ret == -ENOENT) {
+        return -NN_EARPNOTEXIST;
+    } else if (ret) {
+        BVR_WARNING("unknown error code when del arp entry return the orignal code %d", ret);
+    }
+    return ret;
+}
+
+static int ctl_fdb_add(u32 vni, struct fdb_entry *entry)
+{
+    int ret = vxlan_fdb_add_ctl(vni, entry);
+
+    if (ret == -ENXIO || ret == -ESRCH) {
+        return -NN_EIFNOTEXIST;
+    } else if (ret == -EEXIST) {
+        return -NN_EFDBEXIST;
+    } else if (ret == -ENOSPC) {
+        return -NN_ENOSPACE;
+    } else if (ret == -ENOMEM) {
+        return -NN_ENOMEM;
+    } else if (ret) {
+        BVR_WARNING("unknown error code when add fdb entry return the orignal code %d", ret);
+    }
+    return ret;
+}
+
+static int ctl_fdb_del(u32 vni, u8 *mac)
+{
+    int ret = vxlan_fdb_delete_ctl(vni, mac);
+
+    if (ret == -ENXIO || ret == -ESRCH) {
+        return -NN_EIFNOTEXIST;
+    } else if (ret == -ENOENT) {
+        return -NN_EFDBNOTEXIST;
+    } else if (ret) {
+        BVR_WARNING("unknown error code when delete fdb entry return the orignal code %d", ret);
+    }
+    return ret;
+}
+
+static int ctl_route_add(struct net *net, u32 prefix, u32 prefixlen, u32 nexthop,
+    char *to_vport)
+{
+    int ret = pal_route_add_to_net(net, prefix, prefixlen, nexthop, to_vport);
+
+    switch (ret) {
+    case 0:
+        net_flow_invalidate(net);
+        return 0;
+    case -EROUTE_IF_NOT_EXIST:
+        return -NN_ERTIFNEXIST;
+    case -EROUTE_WRONG_PREFIX:
+        return -NN_ERINVALPREFIX;
+    case -EROUTE_WRONG_NETMASK:
+        return -NN_ERINVALMASK;
+    case -EROUTE_MISS_DST:
+        return -NN_ERNODST;
+    case -EROUTE_CIDR_EXIST:
+        return -NN_ERCIDREXIST;
+    case -EROUTE_GW_UNREACHABLE:
+        return -NN_ERGWUNREACHABLE;
+    case -EROUTE_GW_UNABLE_PHYPORT:
+        return -NN_ERGWONPHYPORT;
+    case -EROUTE_ERROR:
+        return -NN_EEXCERR;
+    default:
+        BVR_ERROR("unknown error code when add route return the orignal code %d", ret);
+        return -NN_EEXCERR;
+    }
+}
+
+static int ctl_route_del(struct net *net, u32 prefix, u32 prefixlen)
+{
+    int ret = pal_route_del_from_net(net, prefix, prefixlen);
+
+    switch (ret) {
+    case 0:
+        net_flow_invalidate(net);
+        return 0;
+    case -EROUTE_WRONG_NETMASK:
+        return -NN_ERINVALMASK;
+    case -EROUTE_CIDR_NOT_EXIST:
+        return -NN_ERCIDRNEXIST;
+    default:
+        BVR_ERROR("unknown error code when del route return the orignal code %d", ret);
+        return -NN_EEXCERR;
+    }
+}
+
+
+
 /*
  * @brief add arp entry to bvrouter
  * @json param:"bvrouter" "ip" "mac"
@@ -1410,7 +1857,7 @@ static u32 bvr_cmd_add_arp_table_entry(struct conn_ev *ev)
     int vni = -1;
     int ret = 0;
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -1443,32 +1890,14 @@ static u32 bvr_cmd_add_arp_table_entry(struct conn_ev *ev)
         goto ret_state;
     }
     BVR_DEBUG("arp entry add mac "MACPRINT_FMT, MACPRINT(entry.mac_addr));
-    ret = vxlan_arp_add_ctl(vni, &entry);
-    if (ret) {
-        if (ret == -ENXIO || ret == -ESRCH) {
-            ret = -NN_EIFNOTEXIST;
-            goto ret_state;
-        }else if (ret == -EEXIST) {
-            ret = -NN_EARPEXIST;
-            goto ret_state;
-        }else if (ret == -ENOSPC) {
-            ret = -NN_ENOSPACE;
-            goto ret_state;
-        }else if (ret == -ENOMEM) {
-            ret = -NN_ENOMEM;
-            goto ret_state;
-        }else {
-            BVR_WARNING("unknown error code when add arp entry return the orignal code %d", ret);
-            goto ret_state;
-        }
-    }
+    ret = ctl_arp_add(vni, &entry);
 
 ret_state:
     /*return the exe status*/
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -1491,7 +1920,7 @@ static u32 bvr_cmd_del_arp_table_entry(struct conn_ev *ev)
     int vni = -1;
     int ret = 0;
     struct vxlan_arp_entry entry;
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -1514,27 +1943,14 @@ static u32 bvr_cmd_del_arp_table_entry(struct conn_ev *ev)
         goto ret_state;
     }
 
-    ret = vxlan_arp_delete_ctl(vni, &entry);
-
-    if (ret) {
-        if (ret == -ENXIO || ret == -ESRCH) {
-            ret = -NN_EIFNOTEXIST;
-            goto ret_state;
-        }else if (ret == -ENOENT) {
-            ret = -NN_EARPNOTEXIST;
-            goto ret_state;
-        }else {
-            BVR_WARNING("unknown error code when del arp entry return the orignal code %d", ret);
-            goto ret_state;
-        }
-    }
+    ret = ctl_arp_del(vni, &entry);
 
 ret_state:
     /*return the exe status*/
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -1573,29 +1989,55 @@ __unused static struct cJSON *pack_arp_table_entries(struct net *net)
     return root;
 }
 
+static struct cJSON *pack_arp_entry(struct cJSON *array, struct vxlan_arp_entry *entry)
+{
+    struct cJSON *sub = NULL;
+
+    cJSON_AddItemToArray(array, sub = cJSON_CreateObject());
+    cJSON_AddStringToObject(sub, "ip", trans_ip(entry->ip, 0));
+    cJSON_AddStringToObject(sub, "mac", trans_mac(entry->mac_addr));
+    return sub;
+}
+
 /*TODO*/
 static struct cJSON *pack_arp_entries(struct vxlan_dev *vport)
 {
-    u32 i = 0;
-    struct cJSON *root = NULL, *sub = NULL;
+    struct cJSON *root = NULL;
     struct vxlan_arp_entry *entry = NULL;
-    struct pal_hlist_node *pos = NULL;
 
     root = cJSON_CreateArray();
     if (root == NULL) {
         return NULL;
     }
-    for (i = 0; i < ARP_HASH_SIZE; i++)
+    pal_list_for_each_entry(entry, &vport->arp_list, list)
     {
-        pal_hlist_for_each_entry(entry, pos, vxlan_arp_head_index(vport, i), hlist)
-        {
-            cJSON_AddItemToArray(root, sub = cJSON_CreateObject());
-            cJSON_AddStringToObject(sub, "ip", trans_ip(entry->ip, 0));
-            cJSON_AddStringToObject(sub, "mac", trans_mac(entry->mac_addr));
+        pack_arp_entry(root, entry);
+    }
+    return root;
+}
+
+static int stream_arp_entries(struct conn_ev *ev, struct cJSON *chunk)
+{
+    u32 n = 0, end = ev->stream_cursor + ev->stream_limit;
+    struct vxlan_arp_entry *entry = NULL;
+    struct vxlan_dev *vxlan_dev;
 
+    vxlan_dev = get_vxlan_dev(ev->stream_arg);
+    if (!vxlan_dev) {
+        return -NN_EIFNOTEXIST;
+    }
+
+    pal_list_for_each_entry(entry, &vxlan_dev->arp_list, list)
+    {
+        if (n == end) {
+            ev->stream_cursor = end;
+            return 1;
+        }
+        if (n++ >= ev->stream_cursor) {
+            pack_arp_entry(chunk, entry);
         }
     }
-    return root;
+    return 0;
 }
 
 
@@ -1611,8 +2053,9 @@ static u32 bvr_cmd_show_arp_table_entries(struct conn_ev *ev)
     //    struct net *net = NULL;
     char *out = NULL;
     cJSON *root = NULL;
+    int ret;
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -1638,7 +2081,17 @@ static u32 bvr_cmd_show_arp_table_entries(struct conn_ev *ev)
         cJSON_Delete(root);
         goto ret_state;
     }
-    cJSON_Delete(root);
+    ret = stream_start(ev, root, stream_arp_entries, vni, NULL);
+    if (ret) {
+        cJSON_Delete(root);
+        if (ret > 0) {
+            return 0;
+        }
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = ret;
+        goto ret_state;
+    }
+    cJSON_Delete(root);
 
     /*pack interface information in cjson*/
     root = pack_arp_entries(vxlan_dev);
@@ -1659,13 +2112,13 @@ static u32 bvr_cmd_show_arp_table_entries(struct conn_ev *ev)
         ev->msg_prefix.ret_state = -NN_ENOMEM;
     }
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -1721,7 +2174,7 @@ static u32 bvr_cmd_add_internal_interface(struct conn_ev *ev)
     struct int_vport_entry entry;
     /*internal port add or remove should update port_polling*/
     g_bvrouter_conf_info.port_update = 1;
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -1770,7 +2223,7 @@ ret_state:
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -1809,7 +2262,7 @@ static u32 bvr_cmd_add_external_interface(struct conn_ev *ev)
     int ret = 0;
     struct phy_vport_entry entry;
     /*parse json cmd to find the bvrouter*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -1857,7 +2310,7 @@ ret_state:
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -1882,7 +2335,7 @@ static u32 bvr_cmd_del_interface(struct conn_ev *ev)
     /*internal port add or remove should update port_polling*/
     g_bvrouter_conf_info.port_update = 1;
     /*parse json cmd to find the bvrouter*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -1911,7 +2364,7 @@ ret_state:
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -1920,13 +2373,77 @@ ret_state:
 
 }
 
+static struct cJSON *pack_interface_entry(struct cJSON *array, struct vport *pos)
+{
+    struct cJSON *sub = NULL;
+    char tmp[64];
+
+    cJSON_AddItemToArray(array, sub = cJSON_CreateObject());
+    cJSON_AddStringToObject(sub, "ifname", pos->vport_name);
+    cJSON_AddStringToObject(sub, "inet addr", trans_ip(pos->vport_ip, pos->prefix_len));
+    cJSON_AddStringToObject(sub, "hwaddr", trans_mac(pos->vport_eth_addr));
+    /*for phy vport pack floating ip and status*/
+    if (pos->vport_type == PHY_VPORT) {
+        struct phy_vport *phy_vport = (struct phy_vport *)pos;
+        struct ip_cell *fip = NULL;
+        struct cJSON *sub_sub = NULL, *ip_info = NULL;
+        cJSON_AddItemToObject(sub, "floating IPs", sub_sub = cJSON_CreateArray());
+
+        pal_list_for_each_entry(fip, &phy_vport->floating_list, list)
+        {
+            cJSON_AddItemToArray(sub_sub, ip_info = cJSON_CreateObject());
+            cJSON_AddStringToObject(ip_info, "inet addr", trans_ip(fip->ip, 0));
+        }
+        /*pack the statistics*/
+        struct vport_stats stats;
+        pal_pcpu_sum(&stats, phy_vport->stats, sizeof(stats));
+        sprintf(tmp, "%lu", stats.rx_packets);
+        cJSON_AddStringToObject(sub, "rx_pkts", tmp);
+        sprintf(tmp, "%lu", stats.rx_dropped);
+        cJSON_AddStringToObject(sub, "rx_dropped", tmp);
+        sprintf(tmp, "%lu", stats.rx_errors);
+        cJSON_AddStringToObject(sub, "rx_errors", tmp);
+        sprintf(tmp, "%lu", stats.tx_packets);
+        cJSON_AddStringToObject(sub, "tx_pkts", tmp);
+        sprintf(tmp, "%lu", stats.tx_dropped);
+        cJSON_AddStringToObject(sub, "tx_dropped", tmp);
+        sprintf(tmp, "%lu", stats.tx_errors);
+        cJSON_AddStringToObject(sub, "tx_errors", tmp);
+
+    }
+    if (pos->vport_type == VXLAN_VPORT) {
+        /*pack vxlan statistics*/
+        struct int_vport *vxlan_vport = (struct int_vport *)pos;
+
+        struct vport_stats stats;
+        pal_pcpu_sum(&stats, vxlan_vport->stats, sizeof(stats));
+        sprintf(tmp, "%lu", stats.rx_packets);
+        cJSON_AddStringToObject(sub, "rx_pkts", tmp);
+        sprintf(tmp, "%lu", stats.rx_dropped);
+        cJSON_AddStringToObject(sub, "rx_dropped", tmp);
+        sprintf(tmp, "%lu", stats.rx_errors);
+        cJSON_AddStringToObject(sub, "rx_errors", tmp);
+        sprintf(tmp, "%lu", stats.tx_packets);
+        cJSON_AddStringToObject(sub, "tx_pkts", tmp);
+        sprintf(tmp, "%lu", stats.tx_dropped);
+        cJSON_AddStringToObject(sub, "tx_dropped", tmp);
+        sprintf(tmp, "%lu", stats.tx_errors);
+        cJSON_AddStringToObject(sub, "tx_errors", tmp);
+        sprintf(tmp, "%u", vxlan_vport->vdev->vni);
+        cJSON_AddStringToObject(sub, "vni", tmp);
+        sprintf(tmp, "%u", vxlan_vport->mss_clamp);
+        cJSON_AddStringToObject(sub, "mss_clamp", tmp);
+
+    }
+    /*TODO:pack floating ip into interface infomation*/
+    return sub;
+}
+
 /*TODO:vport delete interface should return a json string*/
 static struct cJSON *pack_interfaces_entries(struct net *net)
 {
     struct vport *pos = NULL;
-    struct cJSON *root = NULL, *sub = NULL;
-    char tmp[64];
-    u32 i = 0;
+    struct cJSON *root = NULL;
     root = cJSON_CreateArray();
     if (root == NULL) {
         return NULL;
@@ -1934,85 +2451,36 @@ static struct cJSON *pack_interfaces_entries(struct net *net)
 
     pal_list_for_each_entry(pos, &net->dev_base_head, list_nd)
     {
-        cJSON_AddItemToArray(root, sub = cJSON_CreateObject());
-        cJSON_AddStringToObject(sub, "ifname", pos->vport_name);
-        cJSON_AddStringToObject(sub, "inet addr", trans_ip(pos->vport_ip, pos->prefix_len));
-        cJSON_AddStringToObject(sub, "hwaddr", trans_mac(pos->vport_eth_addr));
-        /*for phy vport pack floating ip and status*/
-        if (pos->vport_type == PHY_VPORT) {
-            struct phy_vport *phy_vport = (struct phy_vport *)pos;
-            struct ip_cell *fip = NULL;
-            struct cJSON *sub_sub = NULL, *ip_info = NULL;
-            cJSON_AddItemToObject(sub, "floating IPs", sub_sub = cJSON_CreateArray());
-
-            pal_list_for_each_entry(fip, &phy_vport->floating_list, list)
-            {
-                cJSON_AddItemToArray(sub_sub, ip_info = cJSON_CreateObject());
-                cJSON_AddStringToObject(ip_info, "inet addr", trans_ip(fip->ip, 0));
-            }
-            /*pack the statistics*/
-            struct vport_stats stats;
-            memset(&stats, 0, sizeof(stats));
-
-            for (i = 0; i < PAL_MAX_CPU; i++) {
-                stats.rx_packets += phy_vport->stats[i].rx_packets;
-                stats.rx_errors += phy_vport->stats[i].rx_errors;
-                stats.rx_dropped += phy_vport->stats[i].rx_dropped;
-                stats.tx_packets += phy_vport->stats[i].tx_packets;
-                stats.tx_errors += phy_vport->stats[i].tx_errors;
-                stats.tx_dropped += phy_vport->stats[i].tx_dropped;
-            }
-            sprintf(tmp, "%lu", stats.rx_packets);
-            cJSON_AddStringToObject(sub, "rx_pkts", tmp);
-            sprintf(tmp, "%lu", stats.rx_dropped);
-            cJSON_AddStringToObject(sub, "rx_dropped", tmp);
-            sprintf(tmp, "%lu", stats.rx_errors);
-            cJSON_AddStringToObject(sub, "rx_errors", tmp);
-            sprintf(tmp, "%lu", stats.tx_packets);
-            cJSON_AddStringToObject(sub, "tx_pkts", tmp);
-            sprintf(tmp, "%lu", stats.tx_dropped);
-            cJSON_AddStringToObject(sub, "tx_dropped", tmp);
-            sprintf(tmp, "%lu", stats.tx_errors);
-            cJSON_AddStringToObject(sub, "tx_errors", tmp);
-
-        }
-        if (pos->vport_type == VXLAN_VPORT) {
-            /*pack vxlan statistics*/
-            struct int_vport *vxlan_vport = (struct int_vport *)pos;
-
-            struct vport_stats stats;
-            memset(&stats, 0, sizeof(stats));
-
-            for (i = 0; i < PAL_MAX_CPU; i++) {
-                stats.rx_packets += vxlan_vport->stats[i].rx_packets;
-                stats.rx_errors += vxlan_vport->stats[i].rx_errors;
-                stats.rx_dropped += vxlan_vport->stats[i].rx_dropped;
-                stats.tx_packets += vxlan_vport->stats[i].tx_packets;
-                stats.tx_errors += vxlan_vport->stats[i].tx_errors;
-                stats.tx_dropped += vxlan_vport->stats[i].tx_dropped;
-            }
-            sprintf(tmp, "%lu", stats.rx_packets);
-            cJSON_AddStringToObject(sub, "rx_pkts", tmp);
-            sprintf(tmp, "%lu", stats.rx_dropped);
-            cJSON_AddStringToObject(sub, "rx_dropped", tmp);
-            sprintf(tmp, "%lu", stats.rx_errors);
-            cJSON_AddStringToObject(sub, "rx_errors", tmp);
-            sprintf(tmp, "%lu", stats.tx_packets);
-            cJSON_AddStringToObject(sub, "tx_pkts", tmp);
-            sprintf(tmp, "%lu", stats.tx_dropped);
-            cJSON_AddStringToObject(sub, "tx_dropped", tmp);
-            sprintf(tmp, "%lu", stats.tx_errors);
-            cJSON_AddStringToObject(sub, "tx_errors", tmp);
-            sprintf(tmp, "%u", vxlan_vport->vdev->vni);
-            cJSON_AddStringToObject(sub, "vni", tmp);
-
-        }
-        /*TODO:pack floating ip into interface infomation*/
+        pack_interface_entry(root, pos);
     }
 
     return root;
 }
 
+static int stream_interfaces_entries(struct conn_ev *ev, struct cJSON *chunk)
+{
+    u32 n = 0, end = ev->stream_cursor + ev->stream_limit;
+    struct vport *pos = NULL;
+    struct net *net;
+
+    net = net_get(ev->stream_net);
+    if (!net) {
+        return -NN_ENSNOTEXIST;
+    }
+
+    pal_list_for_each_entry(pos, &net->dev_base_head, list_nd)
+    {
+        if (n == end) {
+            ev->stream_cursor = end;
+            return 1;
+        }
+        if (n++ >= ev->stream_cursor) {
+            pack_interface_entry(chunk, pos);
+        }
+    }
+    return 0;
+}
+
 /*
  * @brief show all interfaces of a bvrouter
  * @json param:"bvrouter"
@@ -2024,9 +2492,10 @@ static u32 bvr_cmd_show_interfaces(struct conn_ev *ev)
     struct net *net = NULL;
     char *out = NULL;
     cJSON *root = NULL;
+    int ret;
     /*parse the bvrouter name, if bvrouter not exist return error*/
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -2040,6 +2509,16 @@ static u32 bvr_cmd_show_interfaces(struct conn_ev *ev)
         cJSON_Delete(root);
         goto ret_state;
     }
+    ret = stream_start(ev, root, stream_interfaces_entries, 0, net->name);
+    if (ret) {
+        cJSON_Delete(root);
+        if (ret > 0) {
+            return 0;
+        }
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = ret;
+        goto ret_state;
+    }
     cJSON_Delete(root);
 
     /*pack interface information in cjson*/
@@ -2062,13 +2541,13 @@ static u32 bvr_cmd_show_interfaces(struct conn_ev *ev)
     }
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -2129,7 +2608,7 @@ static u32 bvr_cmd_show_route_table(struct conn_ev *ev)
     cJSON *root = NULL;
     /*parse the bvrouter name, if bvrouter not exist return error*/
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -2165,13 +2644,13 @@ static u32 bvr_cmd_show_route_table(struct conn_ev *ev)
     }
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -2206,7 +2685,7 @@ static u32 bvr_cmd_add_route(struct conn_ev *ev) {
     cJSON *root = NULL;
     cJSON *cidr = NULL;
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -2235,44 +2714,14 @@ static u32 bvr_cmd_add_route(struct conn_ev *ev) {
         goto ret_state;
     }
 
-    ret = pal_route_add_to_net(net, prefix, prefixlen, nexthop_nl, to_vport);
-    if (ret) {
-        if (ret == -EROUTE_IF_NOT_EXIST) {
-            ret = -NN_ERTIFNEXIST;
-            goto ret_state;
-        } else if (ret == -EROUTE_WRONG_PREFIX) {
-            ret = -NN_ERINVALPREFIX;
-            goto ret_state;
-        } else if (ret == -EROUTE_WRONG_NETMASK) {
-            ret = -NN_ERINVALMASK;
-            goto ret_state;
-        } else if (ret == -EROUTE_MISS_DST) {
-            ret = -NN_ERNODST;
-            goto ret_state;
-        } else if (ret == -EROUTE_CIDR_EXIST) {
-            ret = -NN_ERCIDREXIST;
-            goto ret_state;
-        } else if (ret == -EROUTE_GW_UNREACHABLE) {
-            ret = -NN_ERGWUNREACHABLE;
-            goto ret_state;
-        } else if (ret == -EROUTE_GW_UNABLE_PHYPORT) {
-            ret = -NN_ERGWONPHYPORT;
-            goto ret_state;
-        } else if (ret == -EROUTE_ERROR) {
-            ret = -NN_EEXCERR;
-            goto ret_state;
-        } else {
-            BVR_ERROR("unknown error code when add external interface return the orignal code %d", ret);
-            ret = -NN_EEXCERR;
-            goto ret_state;
-        }
-    }
+    ret = ctl_route_add(net, prefix, prefixlen, nexthop_nl, to_vport);
+
 ret_state:
     /*return the exe status*/
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -2296,7 +2745,7 @@ static u32 bvr_cmd_del_route(struct conn_ev *ev) {
     char *cidr = NULL;
     cJSON *root = NULL;
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -2320,27 +2769,14 @@ static u32 bvr_cmd_del_route(struct conn_ev *ev) {
         goto ret_state;
     }
 
-    ret = pal_route_del_from_net(net, prefix, prefixlen);
-    if (ret) {
-        if (ret == -EROUTE_WRONG_NETMASK) {
-            ret = -NN_ERINVALMASK;
-            goto ret_state;
-        } else if (ret == -EROUTE_CIDR_NOT_EXIST) {
-            ret = -NN_ERCIDRNEXIST;
-            goto ret_state;
-        } else {
-            BVR_ERROR("unknown error code when add external interface return the orignal code %d", ret);
-            ret = -NN_EEXCERR;
-            goto ret_state;
-        }
-    }
+    ret = ctl_route_del(net, prefix, prefixlen);
 
 ret_state:
     /*return the exe status*/
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -2363,7 +2799,7 @@ static u32 bvr_cmd_add_floating_ip(struct conn_ev *ev)
     u32 ip = 0;
     int ret = 0;
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -2409,7 +2845,7 @@ ret_state:
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -2433,7 +2869,7 @@ static u32 bvr_cmd_del_floating_ip(struct conn_ev *ev)
     u32 ip = 0;
     int ret = 0;
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -2471,7 +2907,7 @@ ret_state:
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -2515,7 +2951,7 @@ static u32 bvr_cmd_add_fdb_entry(struct conn_ev *ev)
     int vni = -1;
     int ret = 0;
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -2540,33 +2976,14 @@ static u32 bvr_cmd_add_fdb_entry(struct conn_ev *ev)
         goto ret_state;
     }
     BVR_DEBUG("add fdb entry mac "MACPRINT_FMT, MACPRINT(entry.mac));
-    ret = vxlan_fdb_add_ctl(vni, &entry);
-    if (ret) {
-        if (ret == -ENXIO || ret == -ESRCH) {
-            ret = -NN_EIFNOTEXIST;
-            goto ret_state;
-        }else if (ret == -EEXIST) {
-            ret = -NN_EFDBEXIST;
-            goto ret_state;
-        }else if (ret == -ENOSPC) {
-            ret = -NN_ENOSPACE;
-            goto ret_state;
-        }else if (ret == -ENOMEM) {
-            ret = -NN_ENOMEM;
-            goto ret_state;
-        }else {
-            BVR_WARNING("unknown error code when add fdb entry return the orignal code %d", ret);
-            goto ret_state;
-        }
-    }
-
+    ret = ctl_fdb_add(vni, &entry);
 
 ret_state:
     /*return the exe status*/
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -2591,7 +3008,7 @@ static u32 bvr_cmd_del_fdb_entry(struct conn_ev *ev)
     unsigned char mac[6];
     int ret = 0;
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ret = -NN_ENOMEM;
         goto ret_state;
@@ -2614,16 +3031,163 @@ static u32 bvr_cmd_del_fdb_entry(struct conn_ev *ev)
         goto ret_state;
     }
 
-    ret = vxlan_fdb_delete_ctl(vni, (uint8_t *)mac);
+    ret = ctl_fdb_del(vni, mac);
+
+ret_state:
+    /*return the exe status*/
+    cJSON_Delete(root);
+    ev->msg_prefix.msg_len = 0;
+    ev->msg_prefix.ret_state = ret;
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    {
+        BVR_ERROR("send ret message failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * @brief enable or disable fdb learning of a vxlan interface
+ * @json param:"vni" "learning" ["ageing"]
+ * @return 0 on success,-1 return status error
+ */
+static u32 bvr_cmd_set_fdb_learning(struct conn_ev *ev)
+{
+    BVR_DEBUG("nn_cmd_set_fdb_learning called\n");
+    struct cJSON *root = NULL;
+    struct cJSON *item = NULL;
+    int vni = -1;
+    int learning = 0;
+    u32 ageing = 0;
+    int ret = 0;
+
+    root = ctl_body(ev);
+    if (!root) {
+        ret = -NN_ENOMEM;
+        goto ret_state;
+    }
+
+    item = cJSON_GetObjectItem(root, "vni");
+    if (!item) {
+        ret = -NN_EPARSECMD;
+        goto ret_state;
+    }
+    vni = item->valueint;
+
+    item = cJSON_GetObjectItem(root, "learning");
+    if (!item) {
+        ret = -NN_EPARSECMD;
+        goto ret_state;
+    }
+    learning = item->valueint ? 1 : 0;
+
+    /*ageing time in seconds is optional*/
+    item = cJSON_GetObjectItem(root, "ageing");
+    if (item) {
+        if (item->valueint <= 0) {
+            ret = -NN_EINVAL;
+            goto ret_state;
+        }
+        ageing = item->valueint;
+    }
+
+    ret = vxlan_fdb_learning_ctl(vni, learning, ageing);
+    if (ret) {
+        if (ret == -ESRCH) {
+            ret = -NN_EIFNOTEXIST;
+            goto ret_state;
+        }else if (ret == -ERANGE) {
+            ret = -NN_EOUTRANGE;
+            goto ret_state;
+        }else {
+            BVR_WARNING("unknown error code when set fdb learning return the orignal code %d", ret);
+            goto ret_state;
+        }
+    }
+
+ret_state:
+    /*return the exe status*/
+    cJSON_Delete(root);
+    ev->msg_prefix.msg_len = 0;
+    ev->msg_prefix.ret_state = ret;
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    {
+        BVR_ERROR("send ret message failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * @brief set tcp mss clamp of a bvrouter, or of one of its internal
+ *        interfaces when "ifname" is given. 0 disables the clamp
+ * @json param:"bvrouter" "mss" ["ifname"]
+ * @return 0 on success,-1 return status error
+ */
+static u32 bvr_cmd_set_mss_clamp(struct conn_ev *ev)
+{
+    BVR_DEBUG("nn_cmd_set_mss_clamp called\n");
+    struct cJSON *root = NULL;
+    struct cJSON *item = NULL;
+    struct net *net = NULL;
+    int mss = 0;
+    int ret = 0;
+
+    root = ctl_body(ev);
+    if (!root) {
+        ret = -NN_ENOMEM;
+        goto ret_state;
+    }
+
+    item = cJSON_GetObjectItem(root, "bvrouter");
+    if (!item) {
+        ret = -NN_EPARSECMD;
+        goto ret_state;
+    }
+    net = net_get(item->valuestring);
+    if (!net) {
+        ret = -NN_ENSNOTEXIST;
+        goto ret_state;
+    }
+
+    item = cJSON_GetObjectItem(root, "mss");
+    if (!item) {
+        ret = -NN_EPARSECMD;
+        goto ret_state;
+    }
+    mss = item->valueint;
+
+    /*without an interface the clamp applies to the whole bvrouter*/
+    item = cJSON_GetObjectItem(root, "ifname");
+    if (!item) {
+        if (mss != 0 && (mss < INT_VPORT_MSS_MIN || mss > INT_VPORT_MSS_MAX)) {
+            ret = -NN_EOUTRANGE;
+            goto ret_state;
+        }
+        net->mss_clamp = mss;
+        goto ret_state;
+    }
+
+    if (mss < 0 || mss > INT_VPORT_MSS_MAX) {
+        ret = -NN_EOUTRANGE;
+        goto ret_state;
+    }
+
+    ret = int_vport_mss_clamp_ctl(item->valuestring, mss, net);
     if (ret) {
-        if (ret == -ENXIO || ret == -ESRCH) {
+        if (ret == -ENXIO) {
             ret = -NN_EIFNOTEXIST;
             goto ret_state;
-        }else if (ret == -ENOENT) {
-            ret = -NN_EFDBNOTEXIST;
+        }else if (ret == -ERANGE) {
+            ret = -NN_EOUTRANGE;
+            goto ret_state;
+        }else if (ret == -EINVAL) {
+            ret = -NN_EINVAL;
             goto ret_state;
         }else {
-            BVR_WARNING("unknown error code when delete fdb entry return the orignal code %d", ret);
+            BVR_WARNING("unknown error code when set mss clamp return the orignal code %d", ret);
             goto ret_state;
         }
     }
@@ -2633,7 +3197,7 @@ ret_state:
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -2642,32 +3206,69 @@ ret_state:
 }
 
 
+static struct cJSON *pack_fdb_entry(struct cJSON *array, struct vxlan_fdb *fdb)
+{
+    struct cJSON *sub = NULL;
+
+    cJSON_AddItemToArray(array, sub = cJSON_CreateObject());
+    cJSON_AddStringToObject(sub, "mac", trans_mac(fdb->eth_addr));
+    cJSON_AddStringToObject(sub, "ip", trans_ip(fdb->remote.remote_ip, 0));
+    cJSON_AddNumberToObject(sub, "port", ntohs(fdb->remote.remote_port));
+    cJSON_AddNumberToObject(sub, "vni", fdb->remote.remote_vni);
+    cJSON_AddNumberToObject(sub, "learned", fdb->state == VXLAN_FDB_LEARNED);
+    return sub;
+}
+
 /*TODO*/
 static struct cJSON *pack_fdb_entries(struct vxlan_dev *vport)
 {
-    u32 i = 0;
-    struct cJSON *root = NULL, *sub = NULL;
+    struct cJSON *root = NULL;
     struct vxlan_fdb *fdb = NULL;
-    struct pal_hlist_node *pos = NULL;
 
     root = cJSON_CreateArray();
     if (root == NULL) {
         return NULL;
     }
-    for (i = 0; i < FDB_HASH_SIZE; i++)
+    /*receivers may learn entries meanwhile*/
+    lock_vxlan_fdb();
+    pal_list_for_each_entry(fdb, &vport->fdb_list, list)
     {
-        pal_hlist_for_each_entry(fdb, pos, vxlan_fdb_head_index(vport, i), hlist)
-        {
-            cJSON_AddItemToArray(root, sub = cJSON_CreateObject());
-            cJSON_AddStringToObject(sub, "mac", trans_mac(fdb->eth_addr));
-            cJSON_AddStringToObject(sub, "ip", trans_ip(fdb->remote.remote_ip, 0));
-            cJSON_AddNumberToObject(sub, "port", ntohs(fdb->remote.remote_port));
-            cJSON_AddNumberToObject(sub, "vni", fdb->remote.remote_vni);
-        }
+        pack_fdb_entry(root, fdb);
     }
+    unlock_vxlan_fdb();
     return root;
 }
 
+static int stream_fdb_entries(struct conn_ev *ev, struct cJSON *chunk)
+{
+    u32 n = 0, end = ev->stream_cursor + ev->stream_limit;
+    struct vxlan_fdb *fdb = NULL;
+    struct vxlan_dev *vxlan_dev;
+    int more = 0;
+
+    vxlan_dev = get_vxlan_dev(ev->stream_arg);
+    if (!vxlan_dev) {
+        return -NN_EIFNOTEXIST;
+    }
+
+    /*only hold off the learning of receivers for a chunk*/
+    lock_vxlan_fdb();
+    pal_list_for_each_entry(fdb, &vxlan_dev->fdb_list, list)
+    {
+        if (n == end) {
+            more = 1;
+            break;
+        }
+        if (n++ >= ev->stream_cursor) {
+            pack_fdb_entry(chunk, fdb);
+        }
+    }
+    unlock_vxlan_fdb();
+
+    ev->stream_cursor = end;
+    return more;
+}
+
 /*
  * @brief show all fdb entries of a bvrouter
  * @json param:"bvrouter" "interface"
@@ -2678,11 +3279,12 @@ static u32 bvr_cmd_show_fdb_entries(struct conn_ev *ev)
     BVR_DEBUG("nn_cmd_show_fdb_table_entries called\n");
 //    struct net *net = NULL;
     char *out = NULL;
+    int ret;
 
     cJSON *root = NULL;
     /*parse the bvrouter name, if bvrouter not exist return error*/
 
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
          ev->msg_prefix.msg_len = 0;
          ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -2708,6 +3310,16 @@ static u32 bvr_cmd_show_fdb_entries(struct conn_ev *ev)
         cJSON_Delete(root);
         goto ret_state;
     }
+    ret = stream_start(ev, root, stream_fdb_entries, vni, NULL);
+    if (ret) {
+        cJSON_Delete(root);
+        if (ret > 0) {
+            return 0;
+        }
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = ret;
+        goto ret_state;
+    }
     cJSON_Delete(root);
 
     /*pack interface information in cjson*/
@@ -2730,13 +3342,13 @@ static u32 bvr_cmd_show_fdb_entries(struct conn_ev *ev)
     }
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -2768,7 +3380,7 @@ static u32 bvr_cmd_list_all_ifs(struct conn_ev *ev)
     cJSON *root = NULL, *if_name = NULL, *func = NULL;
 
     /*test if the function name is right*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -2830,13 +3442,13 @@ static u32 bvr_cmd_list_all_ifs(struct conn_ev *ev)
 
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -2869,7 +3481,7 @@ static u32 bvr_cmd_show_ifs_stat(struct conn_ev *ev)
     cJSON *root = NULL, *if_stat = NULL, *func = NULL;
 
     /*test if the function name is right*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -2945,13 +3557,13 @@ static u32 bvr_cmd_show_ifs_stat(struct conn_ev *ev)
     }
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -2981,7 +3593,7 @@ static u32 bvr_cmd_show_ifs_link_status(struct conn_ev *ev)
     int i = 0;
 
     /*test if the function name is right*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -3042,13 +3654,13 @@ static u32 bvr_cmd_show_ifs_link_status(struct conn_ev *ev)
     }
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -3077,7 +3689,7 @@ static u32 bvr_cmd_set_ifs_link_status(struct conn_ev *ev)
     cJSON *root = NULL;
 
     /*test if the function name is right*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -3111,7 +3723,7 @@ ret_state:
     cJSON_Delete(root);
     ev->msg_prefix.msg_len = 0;
     ev->msg_prefix.ret_state = ret;
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         return -1;
@@ -3136,7 +3748,7 @@ static u32 bvr_cmd_show_cpu_usage(struct conn_ev *ev)
     cJSON *root = NULL, *cpu = NULL, *func = NULL;
 
     /*test if the function name is right*/
-    root = cJSON_Parse(ev->buf);
+    root = ctl_body(ev);
     if (!root) {
         ev->msg_prefix.msg_len = 0;
         ev->msg_prefix.ret_state = -NN_ENOMEM;
@@ -3195,13 +3807,13 @@ static u32 bvr_cmd_show_cpu_usage(struct conn_ev *ev)
     }
 
 ret_state:
-    if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
     {
         BVR_ERROR("send ret message failed\n");
         goto error;
     }
     if (ev->msg_prefix.msg_len) {
-        if (send_bytes(ev->ev.fd, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
         {
             BVR_ERROR("send ret message failed\n");
             goto error;
@@ -3218,60 +3830,1707 @@ error:
 
 
 
-nn_msg_handler_info_t g_msg_handler_tbl_pr[NN_CMD_ID_MAX_CMD] =
+/*
+ * @brief show ip reassembly table occupancy and counters of each receiver
+ * @json param:"function:show"
+ * @return 0 on success,-1 return status error
+ */
+static u32 bvr_cmd_show_reasm_stats(struct conn_ev *ev)
 {
-    [NN_CMD_ID_TEST]                = {bvr_cmd_test_handler,"test handler"},
-    [NN_CMD_ID_ADD_NAMESPACE]       = {bvr_cmd_create_namespace_handler, "create namespace handler"},
-    [NN_CMD_ID_DEL_NAMESPACE]       = {bvr_cmd_del_namespace_handler, "del namespace handler"},
-    [NN_CMD_ID_LIST_NAMESPACE]      = {bvr_cmd_list_namespace_handler, "list all namespace handler"},
-    [NN_CMD_ID_SHOW_NAMESPACE]      = {bvr_cmd_show_namespace_handler, "show namespace handler"},
-    [NN_CMD_ID_ADD_NF_RULE]         = {bvr_cmd_add_netfilter_rule, "add netfilter rule"},
-    [NN_CMD_ID_DEL_NF_RULE]         = {bvr_cmd_del_netfilter_rule, "del netfilter rule"},
-    [NN_CMD_ID_SHOW_NF_RULE]        = {bvr_cmd_show_netfilter_rule, "show netfilter rule"},
-    [NN_CMD_ID_FLUSH_NF_RULE]       = {bvr_cmd_flush_netfilter_rule, "flush netfilter rules in bvrouter table"},
-
-    [NN_CMD_ID_ADD_ARP_ENTRY]       = {bvr_cmd_add_arp_table_entry, "add arp entry"},
-    [NN_CMD_ID_DEL_ARP_ENTRY]       = {bvr_cmd_del_arp_table_entry, "del arp entry"},
-    [NN_CMD_ID_SHOW_ARP_ENTRIES]    = {bvr_cmd_show_arp_table_entries, "show arp entries"},
-
-    [NN_CMD_ID_ADD_INT_IF]          = {bvr_cmd_add_internal_interface, "add a internal interface to router"},
-    [NN_CMD_ID_ADD_EXT_IF]          = {bvr_cmd_add_external_interface, "add a external interface to router"},
-    [NN_CMD_ID_DEL_IF]              = {bvr_cmd_del_interface, "delete a inter"},
-    [NN_CMD_ID_SHOW_IFS]            = {bvr_cmd_show_interfaces, "show interfaces of router"},
-    [NN_CMD_ID_ADD_IP]              = {bvr_cmd_add_floating_ip, "add floating ip on interface"},
-    [NN_CMD_ID_DEL_IP]              = {bvr_cmd_del_floating_ip, "delete floating ip on interface"},
-    [NN_CMD_ID_ADD_FDB_ENTRY]       = {bvr_cmd_add_fdb_entry, "add fdb entry on vxlan interface"},
-    [NN_CMD_ID_DEL_FDB_ENTRY]       = {bvr_cmd_del_fdb_entry, "delete fdb entry on vxlan interface"},
-    [NN_CMD_ID_SHOW_FDB_ENTRIES]    = {bvr_cmd_show_fdb_entries, "show fdb entries of a vxlan interface"},
-    [NN_CMD_ID_LIST_ALL_IFS]        = {bvr_cmd_list_all_ifs, "show all interface name(used by l2 agent)"},
-    [NN_CMD_ID_SHOW_IFS_STAT]       = {bvr_cmd_show_ifs_stat, "show phy interfaces status"},
-    [NN_CMD_ID_SHOW_CPU_USAGE]      = {bvr_cmd_show_cpu_usage, "show pal cpu usage"},
-    [NN_CMD_ID_SHOW_ROUTE_TABLE]    = {bvr_cmd_show_route_table, "show bvrouter's route table"},
-    [NN_CMD_ID_GET_PORT_POLLING]    = {bvr_cmd_get_port_update_handler, "get port polling status"},
-    [NN_CMD_ID_SET_PORT_STAT_INT]   = {bvr_cmd_set_portstatus_interval_handler, "set port polling status interval"},
-    [NN_CMD_ID_SHOW_PORT_LINK_STATUS]  = {bvr_cmd_show_ifs_link_status, "show port link up or down"},
-    [NN_CMD_ID_SET_PORT_LINK_STATUS]   = {bvr_cmd_set_ifs_link_status, "set port link up or down"},
-    [NN_CMD_ID_ADD_ROUTE]           = {bvr_cmd_add_route, "add route item"},
-    [NN_CMD_ID_DEL_ROUTE]           = {bvr_cmd_del_route, "delete route item"},
-};
-
-
+    BVR_DEBUG("nn_cmd_show_reasm_stats called\n");
+    char *out = NULL;
+    char tmp[64];
+    cJSON *root = NULL, *core = NULL, *func = NULL;
+    struct pal_reasm_stats *stats = NULL;
+    u32 used = 0, max = 0;
+    u32 i = 0;
 
-/* create a tcp listen socket on specified port, bound to INADDR_ANY
- * returns the fd created, or -1 on failure */
-static int tcp_server_create(u16 port)
-{
-    int fd;
-    int reuseaddr = 1;
-    struct sockaddr_in addr;
+    /*test if the function name is right*/
+    root = ctl_body(ev);
+    if (!root) {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = -NN_ENOMEM;
+        goto ret_state;
+    }
 
-    fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (fd < 0) {
-        BVR_PANIC("Create listen socket failed: %s\n", strerror(errno));
+    func = cJSON_GetObjectItem(root, "function");
+    if (!func || strcmp(func->valuestring , "show")) {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = -NN_EPARSECMD;
+        cJSON_Delete(root);
+        goto ret_state;
     }
+    cJSON_Delete(root);
 
-    if (fcntl(fd, F_SETFL, fcntl(fd,F_GETFL) | O_NONBLOCK) < 0) {
-        BVR_PANIC("Set listen socket to nonblock failed: %s\n", strerror(errno));
+    /*create json string to return the result*/
+    root = cJSON_CreateArray();
+    if (!root) {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = -NN_ENOMEM;
+        goto ret_state;
+    }
+
+    PAL_FOR_EACH_RECEIVER(i) {
+        stats = &pal_thread_conf(i)->stats.reasm;
+        ip_frag_table_usage(i, &used, &max);
+
+        cJSON_AddItemToArray(root, core = cJSON_CreateObject());
+        cJSON_AddNumberToObject(core, "datapath_core", i);
+        cJSON_AddNumberToObject(core, "used_entries", used);
+        cJSON_AddNumberToObject(core, "max_entries", max);
+        /*use string for u64*/
+        sprintf(tmp, "%lu", stats->frag_pkts);
+        cJSON_AddStringToObject(core, "frag_pkts", tmp);
+        sprintf(tmp, "%lu", stats->reasm_pkts);
+        cJSON_AddStringToObject(core, "reasm_pkts", tmp);
+        sprintf(tmp, "%lu", stats->redirect_pkts);
+        cJSON_AddStringToObject(core, "redirect_pkts", tmp);
+        sprintf(tmp, "%lu", stats->redirect_err);
+        cJSON_AddStringToObject(core, "redirect_err", tmp);
+        sprintf(tmp, "%lu", stats->timeout_pkts);
+        cJSON_AddStringToObject(core, "timeout_pkts", tmp);
+        sprintf(tmp, "%lu", stats->evict_pkts);
+        cJSON_AddStringToObject(core, "evict_pkts", tmp);
+    }
+
+    out = cJSON_Print(root);
+    cJSON_Delete(root);
+
+    /*tell agent how many bytes to receive*/
+    if (NULL != out) {
+        ev->msg_prefix.msg_len = strlen(out);
+        ev->msg_prefix.ret_state = 0;
+    }
+    else {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = -NN_ENOMEM;
+    }
+
+ret_state:
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    {
+        BVR_ERROR("send ret message failed\n");
+        goto error;
+    }
+    if (ev->msg_prefix.msg_len) {
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        {
+            BVR_ERROR("send ret message failed\n");
+            goto error;
+        }
+        free(out);
+    }
+    return 0;
+error:
+    if (ev->msg_prefix.msg_len) {
+        free(out);
+    }
+    return -1;
+}
+
+static void pack_slab_stats(struct pal_slab *slab, void *arg)
+{
+    struct cJSON *root = arg, *item;
+    struct pal_slab_stats stats;
+    char tmp[64];
+
+    pal_slab_get_stats(slab, &stats);
+
+    cJSON_AddItemToArray(root, item = cJSON_CreateObject());
+    cJSON_AddStringToObject(item, "name", slab->name);
+    cJSON_AddNumberToObject(item, "elem_size", stats.elem_size);
+    cJSON_AddNumberToObject(item, "chunks", stats.chunks);
+    cJSON_AddNumberToObject(item, "used_entries", stats.in_use);
+    cJSON_AddNumberToObject(item, "capacity", stats.capacity);
+    cJSON_AddNumberToObject(item, "max_entries", stats.limit);
+    /*use string for u64*/
+    sprintf(tmp, "%lu", stats.bytes);
+    cJSON_AddStringToObject(item, "bytes", tmp);
+    sprintf(tmp, "%lu", stats.alloc_fail);
+    cJSON_AddStringToObject(item, "alloc_fail", tmp);
+    sprintf(tmp, "%lu", stats.grow_fail);
+    cJSON_AddStringToObject(item, "grow_fail", tmp);
+}
+
+/*
+ * @brief show the usage of the slabs, which grow by chunks up to their max
+ * @json param:"function:show"
+ * @return 0 on success,-1 return status error
+ */
+static u32 bvr_cmd_show_slab_stats(struct conn_ev *ev)
+{
+    BVR_DEBUG("nn_cmd_show_slab_stats called\n");
+    char *out = NULL;
+    cJSON *root = NULL, *func = NULL;
+
+    /*test if the function name is right*/
+    root = ctl_body(ev);
+    if (!root) {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = -NN_ENOMEM;
+        goto ret_state;
+    }
+
+    func = cJSON_GetObjectItem(root, "function");
+    if (!func || strcmp(func->valuestring , "show")) {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = -NN_EPARSECMD;
+        cJSON_Delete(root);
+        goto ret_state;
+    }
+    cJSON_Delete(root);
+
+    /*create json string to return the result*/
+    root = cJSON_CreateArray();
+    if (!root) {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = -NN_ENOMEM;
+        goto ret_state;
+    }
+
+    pal_slab_walk(pack_slab_stats, root);
+
+    out = cJSON_Print(root);
+    cJSON_Delete(root);
+
+    /*tell agent how many bytes to receive*/
+    if (NULL != out) {
+        ev->msg_prefix.msg_len = strlen(out);
+        ev->msg_prefix.ret_state = 0;
+    }
+    else {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = -NN_ENOMEM;
+    }
+
+ret_state:
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    {
+        BVR_ERROR("send ret message failed\n");
+        goto error;
+    }
+    if (ev->msg_prefix.msg_len) {
+        if (ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0)
+        {
+            BVR_ERROR("send ret message failed\n");
+            goto error;
+        }
+        free(out);
+    }
+    return 0;
+error:
+    if (ev->msg_prefix.msg_len) {
+        free(out);
+    }
+    return -1;
+}
+
+
+/*
+ * Sync of the state of a namespace, see NN_CMD_ID_SYNC_NAMESPACE.
+ *
+ * The desired entries of a table are sorted by key, and each live entry is
+ * looked up among them: a live entry found unchanged marks the desired one
+ * kept, the others are deleted, then the desired entries not kept are
+ * added. The message is parsed and the tables diffed before any change.
+ */
+struct sync_if {
+    char *name;
+    int type;                       /*VXLAN_VPORT or PHY_VPORT*/
+    struct int_vport_entry in;
+    struct phy_vport_entry ext;
+    int keep;
+};
+
+struct sync_route {
+    u32 prefix;
+    u32 plen;
+    u32 nexthop;
+    char *ifname;                   /*NULL if the route finds it*/
+    int keep;
+};
+
+struct sync_nat {
+    u32 hook;
+    struct ipt_nat_entry entry;
+    int keep;
+};
+
+struct sync_filter {
+    u32 hook;
+    struct ipt_filter_entry entry;
+    int keep;
+};
+
+struct sync_fdb {
+    u32 vni;
+    struct fdb_entry entry;
+    int keep;
+};
+
+struct sync_arp {
+    u32 vni;
+    struct vxlan_arp_entry entry;
+    int keep;
+};
+
+struct sync_state {
+    /*desired entries, n_* is -1 for a table left out of the message*/
+    struct sync_if *ifs;
+    struct sync_route *routes;
+    struct sync_nat *nats;
+    struct sync_filter *filters;
+    struct sync_fdb *fdbs;
+    struct sync_arp *arps;
+    int n_if, n_route, n_nat, n_filter, n_fdb, n_arp;
+
+    /*live entries to delete*/
+    struct vport **stale_ifs;
+    struct route_entry *stale_routes;
+    struct sync_nat *stale_nats;
+    struct sync_filter *stale_filters;
+    int n_stale_if, n_stale_route, n_stale_nat, n_stale_filter;
+
+    u32 *vnis;                      /*vnis whose fdb and arp entries are synced*/
+    int n_vni;
+    u64 vni_locks;                  /*bit n for g_ctl_vni_lock[n]*/
+
+    u32 added;
+    u32 deleted;
+    u32 failed;
+    int ret;                        /*first error*/
+};
+
+#define SYNC_IF_INT     "int"
+#define SYNC_IF_EXT     "ext"
+
+#define SYNC_CMP(x, y) do {                 \
+    if ((x) != (y)) {                       \
+        return (x) < (y) ? -1 : 1;          \
+    }                                       \
+} while (0)
+
+static int sync_if_cmp(const void *a, const void *b)
+{
+    return strcmp(((const struct sync_if *)a)->name, ((const struct sync_if *)b)->name);
+}
+
+static int sync_route_cmp(const void *a, const void *b)
+{
+    const struct sync_route *x = a, *y = b;
+
+    SYNC_CMP(x->prefix, y->prefix);
+    SYNC_CMP(x->plen, y->plen);
+    return 0;
+}
+
+/*nat rules are keyed by their original prefix*/
+static int sync_nat_cmp(const void *a, const void *b)
+{
+    const struct sync_nat *x = a, *y = b;
+
+    SYNC_CMP(x->hook, y->hook);
+    SYNC_CMP(x->entry.orig_ip, y->entry.orig_ip);
+    SYNC_CMP(x->entry.orig_plen, y->entry.orig_plen);
+    return 0;
+}
+
+/*filter rules by the fields ipt_filter_del_rule() matches*/
+static int sync_filter_cmp(const void *a, const void *b)
+{
+    const struct sync_filter *x = a, *y = b;
+    int ret;
+
+    SYNC_CMP(x->hook, y->hook);
+    SYNC_CMP(x->entry.priority, y->entry.priority);
+    SYNC_CMP(x->entry.filter_target, y->entry.filter_target);
+    ret = memcmp(&x->entry.mask_value, &y->entry.mask_value, sizeof(x->entry.mask_value));
+    if (ret) {
+        return ret;
+    }
+    return memcmp(&x->entry.key, &y->entry.key, sizeof(x->entry.key));
+}
+
+static int sync_fdb_cmp(const void *a, const void *b)
+{
+    const struct sync_fdb *x = a, *y = b;
+
+    SYNC_CMP(x->vni, y->vni);
+    return memcmp(x->entry.mac, y->entry.mac, sizeof(x->entry.mac));
+}
+
+static int sync_arp_cmp(const void *a, const void *b)
+{
+    const struct sync_arp *x = a, *y = b;
+
+    SYNC_CMP(x->vni, y->vni);
+    SYNC_CMP(x->entry.ip, y->entry.ip);
+    return 0;
+}
+
+/*
+ * @brief sort the desired entries of a table
+ * @return 0, or -NN_EPARSECMD if two entries have the same key
+ */
+static int sync_sort(void *base, int n, size_t size, int (*cmp)(const void *, const void *))
+{
+    int i;
+
+    qsort(base, n, size, cmp);
+    for (i = 1; i < n; i++) {
+        if (cmp((char *)base + (i - 1) * size, (char *)base + i * size) == 0) {
+            return -NN_EPARSECMD;
+        }
+    }
+    return 0;
+}
+
+static inline int json_has(cJSON *obj, const char *key, int type)
+{
+    cJSON *tmp = cJSON_GetObjectItem(obj, key);
+
+    return tmp && tmp->type == type;
+}
+
+static inline int json_opt(cJSON *obj, const char *key, int type)
+{
+    cJSON *tmp = cJSON_GetObjectItem(obj, key);
+
+    return !tmp || tmp->type == type;
+}
+
+/*
+ * @brief allocate the desired entries of a table from its json array
+ * @param n set to the number of entries, -1 if the table is left out
+ * @return the zeroed entries, NULL if left out or on error, see ret
+ */
+static void *sync_table(cJSON *root, const char *key, size_t size, cJSON **array,
+    int *n, int *ret)
+{
+    void *entries;
+
+    *n = -1;
+    *ret = 0;
+    *array = cJSON_GetObjectItem(root, key);
+    if (*array == NULL) {
+        return NULL;
+    }
+    if ((*array)->type != cJSON_Array) {
+        *ret = -NN_EPARSECMD;
+        return NULL;
+    }
+    *n = cJSON_GetArraySize(*array);
+    entries = calloc(*n + 1, size);
+    if (entries == NULL) {
+        *ret = -NN_ENOMEM;
+    }
+    return entries;
+}
+
+static int sync_parse_ifs(cJSON *root, struct sync_state *s)
+{
+    struct sync_if *sif;
+    cJSON *array, *item, *type;
+    int ret;
+
+    s->ifs = sync_table(root, "interfaces", sizeof(*sif), &array, &s->n_if, &ret);
+    if (s->ifs == NULL) {
+        return ret;
+    }
+    for (item = array->child, sif = s->ifs; item; item = item->next, sif++) {
+        type = cJSON_GetObjectItem(item, "type");
+        if (!type || type->type != cJSON_String || !json_has(item, "ifname", cJSON_String) ||
+            !json_has(item, "uuid", cJSON_String) || !json_has(item, "ip", cJSON_String)) {
+            return -NN_EPARSECMD;
+        }
+        if (!strcmp(type->valuestring, SYNC_IF_INT)) {
+            if (!json_has(item, "mac", cJSON_String) || !json_has(item, "vni", cJSON_Number) ||
+                parse_int_vport_entry(item, &sif->in)) {
+                return -NN_EPARSECMD;
+            }
+            sif->type = VXLAN_VPORT;
+            sif->name = sif->in.vport_name;
+        } else if (!strcmp(type->valuestring, SYNC_IF_EXT)) {
+            if (parse_ext_vport_entry(item, &sif->ext)) {
+                return -NN_EPARSECMD;
+            }
+            sif->type = PHY_VPORT;
+            sif->name = sif->ext.vport_name;
+        } else {
+            return -NN_EPARSECMD;
+        }
+        if (strlen(sif->name) > VPORT_NAME_MAX) {
+            return -NN_EPARSECMD;
+        }
+    }
+    return sync_sort(s->ifs, s->n_if, sizeof(*sif), sync_if_cmp);
+}
+
+static int sync_parse_routes(cJSON *root, struct sync_state *s)
+{
+    struct sync_route *sr;
+    cJSON *array, *item, *tmp;
+    int ret;
+
+    s->routes = sync_table(root, "routes", sizeof(*sr), &array, &s->n_route, &ret);
+    if (s->routes == NULL) {
+        return ret;
+    }
+    for (item = array->child, sr = s->routes; item; item = item->next, sr++) {
+        if (!json_has(item, "cidr", cJSON_String) || !json_opt(item, "nexthop", cJSON_String) ||
+            !json_opt(item, "ifname", cJSON_String)) {
+            return -NN_EPARSECMD;
+        }
+        if (get_ip_and_mask(cJSON_GetObjectItem(item, "cidr")->valuestring, &sr->prefix, &sr->plen)) {
+            return -NN_EPARSECMD;
+        }
+        if ((tmp = cJSON_GetObjectItem(item, "nexthop")) != NULL &&
+            !inet_aton(tmp->valuestring, (struct in_addr *)&sr->nexthop)) {
+            return -NN_EPARSECMD;
+        }
+        if ((tmp = cJSON_GetObjectItem(item, "ifname")) != NULL) {
+            sr->ifname = tmp->valuestring;
+            if (strlen(sr->ifname) > VPORT_NAME_MAX) {
+                return -NN_EPARSECMD;
+            }
+        }
+        if (sr->nexthop == 0 && sr->ifname == NULL) {
+            return -NN_EPARSECMD;
+        }
+    }
+    return sync_sort(s->routes, s->n_route, sizeof(*sr), sync_route_cmp);
+}
+
+static int sync_parse_nats(cJSON *root, struct sync_state *s)
+{
+    struct sync_nat *sn;
+    cJSON *array, *item;
+    int ret;
+
+    s->nats = sync_table(root, "nat", sizeof(*sn), &array, &s->n_nat, &ret);
+    if (s->nats == NULL) {
+        return ret;
+    }
+    for (item = array->child, sn = s->nats; item; item = item->next, sn++) {
+        if (!json_has(item, "hook_num", cJSON_Number) || !json_has(item, "orig_ip", cJSON_String) ||
+            !json_has(item, "nat_ip", cJSON_String) || !json_has(item, "nat_target", cJSON_Number)) {
+            return -NN_EPARSECMD;
+        }
+        if (parse_ip_nat_entry(item, &sn->hook, &sn->entry) || sn->hook >= NF_MAX_HOOKS) {
+            return -NN_EPARSECMD;
+        }
+        /*as ipt_nat_insert_rule() keeps them*/
+        sn->entry.orig_ip &= htonl(depth_to_mask(sn->entry.orig_plen));
+        sn->entry.nat_ip &= htonl(depth_to_mask(sn->entry.nat_plen));
+    }
+    return sync_sort(s->nats, s->n_nat, sizeof(*sn), sync_nat_cmp);
+}
+
+static int sync_parse_filters(cJSON *root, struct sync_state *s)
+{
+    struct sync_filter *sf;
+    cJSON *array, *item;
+    int ret;
+
+    s->filters = sync_table(root, "filter", sizeof(*sf), &array, &s->n_filter, &ret);
+    if (s->filters == NULL) {
+        return ret;
+    }
+    for (item = array->child, sf = s->filters; item; item = item->next, sf++) {
+        if (!json_has(item, "hook_num", cJSON_Number) || !json_has(item, "target", cJSON_Number) ||
+            !json_opt(item, "priority", cJSON_Number) || !json_opt(item, "dir", cJSON_Number) ||
+            !json_opt(item, "sip", cJSON_String) || !json_opt(item, "dip", cJSON_String) ||
+            !json_opt(item, "sport", cJSON_String) || !json_opt(item, "dport", cJSON_String) ||
+            !json_opt(item, "proto", cJSON_Number)) {
+            return -NN_EPARSECMD;
+        }
+        ret = parse_ip_filter_entry(item, &sf->hook, &sf->entry);
+        if (ret) {
+            return ret;
+        }
+        if (sf->hook >= NF_MAX_HOOKS) {
+            return -NN_EPARSECMD;
+        }
+    }
+    return sync_sort(s->filters, s->n_filter, sizeof(*sf), sync_filter_cmp);
+}
+
+static int sync_has_vni(struct sync_state *s, u32 vni)
+{
+    int i;
+
+    for (i = 0; i < s->n_vni; i++) {
+        if (s->vnis[i] == vni) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief find the vnis of the internal interfaces of the net after the
+ *        sync, and the vni locks of the ones before and after
+ */
+static int sync_vnis(struct net *net, struct sync_state *s)
+{
+    struct vport *vp;
+    u32 vni;
+    int i, n = 0;
+
+    pal_list_for_each_entry(vp, &net->dev_base_head, list_nd) {
+        n++;
+    }
+    s->vnis = calloc(n + (s->n_if > 0 ? s->n_if : 0) + 1, sizeof(*s->vnis));
+    if (s->vnis == NULL) {
+        return -NN_ENOMEM;
+    }
+
+    pal_list_for_each_entry(vp, &net->dev_base_head, list_nd) {
+        if (vp->vport_type != VXLAN_VPORT) {
+            continue;
+        }
+        vni = ((struct int_vport *)vp)->vdev->vni;
+        s->vni_locks |= 1ULL << (vni % NN_CTL_VNI_LOCKS);
+        if (s->n_if < 0 && !sync_has_vni(s, vni)) {
+            s->vnis[s->n_vni++] = vni;
+        }
+    }
+    for (i = 0; i < s->n_if; i++) {
+        if (s->ifs[i].type != VXLAN_VPORT) {
+            continue;
+        }
+        vni = s->ifs[i].in.vni;
+        s->vni_locks |= 1ULL << (vni % NN_CTL_VNI_LOCKS);
+        if (!sync_has_vni(s, vni)) {
+            s->vnis[s->n_vni++] = vni;
+        }
+    }
+    return 0;
+}
+
+static int sync_parse_fdbs(cJSON *root, struct sync_state *s)
+{
+    struct sync_fdb *sf;
+    cJSON *array, *item;
+    int ret;
+
+    s->fdbs = sync_table(root, "fdb", sizeof(*sf), &array, &s->n_fdb, &ret);
+    if (s->fdbs == NULL) {
+        return ret;
+    }
+    for (item = array->child, sf = s->fdbs; item; item = item->next, sf++) {
+        if (!json_has(item, "vni", cJSON_Number) || !json_has(item, "mac", cJSON_String) ||
+            !json_has(item, "remote_ip", cJSON_String) || !json_has(item, "remote_port", cJSON_Number)) {
+            return -NN_EPARSECMD;
+        }
+        sf->vni = cJSON_GetObjectItem(item, "vni")->valueint;
+        if (!sync_has_vni(s, sf->vni) || parse_fdb_entry(item, &sf->entry)) {
+            return -NN_EPARSECMD;
+        }
+    }
+    return sync_sort(s->fdbs, s->n_fdb, sizeof(*sf), sync_fdb_cmp);
+}
+
+static int sync_parse_arps(cJSON *root, struct sync_state *s)
+{
+    struct sync_arp *sa;
+    cJSON *array, *item;
+    int ret;
+
+    s->arps = sync_table(root, "arp", sizeof(*sa), &array, &s->n_arp, &ret);
+    if (s->arps == NULL) {
+        return ret;
+    }
+    for (item = array->child, sa = s->arps; item; item = item->next, sa++) {
+        if (!json_has(item, "vni", cJSON_Number) || !json_has(item, "ip", cJSON_String) ||
+            !json_has(item, "mac", cJSON_String)) {
+            return -NN_EPARSECMD;
+        }
+        sa->vni = cJSON_GetObjectItem(item, "vni")->valueint;
+        if (!sync_has_vni(s, sa->vni) ||
+            !inet_aton(cJSON_GetObjectItem(item, "ip")->valuestring, (struct in_addr *)&sa->entry.ip) ||
+            get_mac_addr(cJSON_GetObjectItem(item, "mac")->valuestring, sa->entry.mac_addr)) {
+            return -NN_EPARSECMD;
+        }
+    }
+    return sync_sort(s->arps, s->n_arp, sizeof(*sa), sync_arp_cmp);
+}
+
+static int sync_parse(cJSON *root, struct net *net, struct sync_state *s)
+{
+    int ret;
+
+    if ((ret = sync_parse_ifs(root, s)) != 0 ||
+        (ret = sync_parse_routes(root, s)) != 0 ||
+        (ret = sync_parse_nats(root, s)) != 0 ||
+        (ret = sync_parse_filters(root, s)) != 0 ||
+        (ret = sync_vnis(net, s)) != 0 ||
+        (ret = sync_parse_fdbs(root, s)) != 0 ||
+        (ret = sync_parse_arps(root, s)) != 0) {
+        return ret;
+    }
+    return 0;
+}
+
+static int sync_if_same(const struct sync_if *sif, struct vport *vp)
+{
+    if (sif->type != (int)vp->vport_type) {
+        return 0;
+    }
+    if (sif->type == PHY_VPORT) {
+        return vp->vport_ip == sif->ext.ext_gw_ip && vp->prefix_len == sif->ext.prefix_len;
+    }
+    return vp->vport_ip == sif->in.int_gw_ip && vp->prefix_len == sif->in.prefix_len &&
+        !memcmp(vp->vport_eth_addr, sif->in.int_gw_mac, sizeof(sif->in.int_gw_mac)) &&
+        ((struct int_vport *)vp)->vdev->vni == sif->in.vni;
+}
+
+static int sync_diff_ifs(struct net *net, struct sync_state *s)
+{
+    struct sync_if key, *sif;
+    struct vport *vp;
+    int n = 0;
+
+    if (s->n_if < 0) {
+        return 0;
+    }
+    pal_list_for_each_entry(vp, &net->dev_base_head, list_nd) {
+        n++;
+    }
+    s->stale_ifs = calloc(n + 1, sizeof(*s->stale_ifs));
+    if (s->stale_ifs == NULL) {
+        return -NN_ENOMEM;
+    }
+
+    pal_list_for_each_entry(vp, &net->dev_base_head, list_nd) {
+        key.name = vp->vport_name;
+        sif = bsearch(&key, s->ifs, s->n_if, sizeof(*sif), sync_if_cmp);
+        if (sif && sync_if_same(sif, vp)) {
+            sif->keep = 1;
+        } else {
+            s->stale_ifs[s->n_stale_if++] = vp;
+        }
+    }
+    return 0;
+}
+
+/*static routes of a table, counted if e is NULL*/
+struct sync_route_walk {
+    struct route_entry *e;
+    int n;
+    int max;
+};
+
+static void sync_walk_route(const struct route_entry *e, void *arg)
+{
+    struct sync_route_walk *w = arg;
+
+    if (e->route_type != PAL_ROUTE_COMMON) {
+        return;
+    }
+    if (w->e == NULL) {
+        w->n++;
+    } else if (w->n < w->max) {
+        w->e[w->n++] = *e;
+    }
+}
+
+/*
+ * @brief a live static route is stale if it differs from the desired one,
+ *        or goes through an interface deleted by the sync
+ */
+static int sync_route_stale(struct sync_state *s, const struct route_entry *e)
+{
+    struct sync_route key, *sr;
+    int i;
+
+    for (i = 0; i < s->n_stale_if; i++) {
+        if (e->dev == s->stale_ifs[i]) {
+            return 1;
+        }
+    }
+    if (s->n_route < 0) {
+        return 0;
+    }
+
+    key.prefix = e->prefix;
+    key.plen = e->prefixlen;
+    sr = bsearch(&key, s->routes, s->n_route, sizeof(*sr), sync_route_cmp);
+    if (!sr || sr->nexthop != e->next_hop ||
+        (sr->ifname && (!e->dev || strcmp(sr->ifname, e->dev->vport_name)))) {
+        return 1;
+    }
+    sr->keep = 1;
+    return 0;
+}
+
+static int sync_diff_routes(struct net *net, struct sync_state *s)
+{
+    struct sync_route_walk w = {NULL, 0, 0};
+    int i;
+
+    if (s->n_route < 0 && s->n_stale_if == 0) {
+        return 0;
+    }
+    pal_route_walk(net->route_table, sync_walk_route, &w);
+    w.max = w.n;
+    w.n = 0;
+    w.e = calloc(w.max + 1, sizeof(*w.e));
+    if (w.e == NULL) {
+        return -NN_ENOMEM;
+    }
+    pal_route_walk(net->route_table, sync_walk_route, &w);
+
+    s->stale_routes = w.e;
+    for (i = 0; i < w.n; i++) {
+        if (sync_route_stale(s, &w.e[i])) {
+            s->stale_routes[s->n_stale_route++] = w.e[i];
+        }
+    }
+    return 0;
+}
+
+static int sync_diff_nats(struct net *net, struct sync_state *s)
+{
+    struct xt_nat_table *nat_table = (struct xt_nat_table *)net->nat->private;
+    struct ipt_nat_entry *entry = NULL;
+    struct sync_nat key, *sn;
+    int i, n = 0;
+
+    if (s->n_nat < 0) {
+        return 0;
+    }
+    for (i = 0; nat_table && i < NF_MAX_HOOKS; i++) {
+        n += nat_table->table[i].rule_num;
+    }
+    s->stale_nats = calloc(n + 1, sizeof(*s->stale_nats));
+    if (s->stale_nats == NULL) {
+        return -NN_ENOMEM;
+    }
+
+    for (i = 0; nat_table && i < NF_MAX_HOOKS; i++) {
+        pal_list_for_each_entry(entry, &nat_table->table[i].nat_list, list) {
+            key.hook = i;
+            key.entry.orig_ip = entry->orig_ip;
+            key.entry.orig_plen = entry->orig_plen;
+            sn = bsearch(&key, s->nats, s->n_nat, sizeof(*sn), sync_nat_cmp);
+            if (sn && sn->entry.nat_ip == entry->nat_ip && sn->entry.nat_plen == entry->nat_plen &&
+                sn->entry.nat_target == entry->nat_target) {
+                sn->keep = 1;
+            } else if (!sn && s->n_stale_nat < n) {
+                /*a changed rule is replaced by the insert of the desired one*/
+                s->stale_nats[s->n_stale_nat].hook = i;
+                s->stale_nats[s->n_stale_nat].entry = *entry;
+                s->n_stale_nat++;
+            }
+        }
+    }
+    return 0;
+}
+
+static int sync_diff_filters(struct net *net, struct sync_state *s)
+{
+    struct xt_filter_table *filter_table = (struct xt_filter_table *)net->filter->private;
+    struct ipt_filter_entry *entry = NULL;
+    struct pal_hlist_node *pos = NULL;
+    struct sync_filter key, *sf;
+    int i, n = 0;
+    u32 j;
+
+    if (s->n_filter < 0) {
+        return 0;
+    }
+    for (i = 0; filter_table && i < NF_MAX_HOOKS; i++) {
+        n += filter_table->table[i].rule_num;
+    }
+    s->stale_filters = calloc(n + 1, sizeof(*s->stale_filters));
+    if (s->stale_filters == NULL) {
+        return -NN_ENOMEM;
+    }
+
+    for (i = 0; filter_table && i < NF_MAX_HOOKS; i++) {
+        for (j = 0; j < filter_hmap_size(&filter_table->table[i]); j++) {
+            pal_hlist_for_each_entry(entry, pos, &filter_table->table[i].filter_hmap[j], hlist) {
+                key.hook = i;
+                key.entry = *entry;
+                sf = bsearch(&key, s->filters, s->n_filter, sizeof(*sf), sync_filter_cmp);
+                if (sf && sf->entry.dir == entry->dir) {
+                    sf->keep = 1;
+                } else if (s->n_stale_filter < n) {
+                    s->stale_filters[s->n_stale_filter].hook = i;
+                    s->stale_filters[s->n_stale_filter].entry = *entry;
+                    s->n_stale_filter++;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int sync_diff(struct net *net, struct sync_state *s)
+{
+    int ret;
+
+    /*the routes after the interfaces, they may go through a stale one*/
+    if ((ret = sync_diff_ifs(net, s)) != 0 ||
+        (ret = sync_diff_routes(net, s)) != 0 ||
+        (ret = sync_diff_nats(net, s)) != 0 ||
+        (ret = sync_diff_filters(net, s)) != 0) {
+        return ret;
+    }
+    return 0;
+}
+
+static void sync_count(struct sync_state *s, int ret, u32 *done)
+{
+    if (ret == 0) {
+        (*done)++;
+        return;
+    }
+    s->failed++;
+    if (s->ret == 0) {
+        s->ret = ret;
+    }
+}
+
+static int sync_if_add(struct net *net, struct sync_if *sif)
+{
+    int ret;
+
+    if (sif->type == VXLAN_VPORT) {
+        ret = int_vport_add_ctl(&sif->in, net);
+    } else {
+        ret = phy_vport_add_ctl(&sif->ext, net);
+    }
+
+    switch (ret) {
+    case 0:
+        return 0;
+    case -EEXIST:
+        return -NN_EIFEXIST;
+    case -ENOMEM:
+        return -NN_ENOMEM;
+    case -ENXIO:
+        return -NN_EINVAL;
+    case -ENOSPC:
+        return -NN_ENOSPACE;
+    case -ERANGE:
+        return -NN_EOUTRANGE;
+    default:
+        BVR_WARNING("unknown error code when add interface return the orignal code %d", ret);
+        return ret;
+    }
+}
+
+static int sync_if_del(struct vport *vp)
+{
+    char name[VPORT_NAME_MAX + 1];
+    int ret;
+
+    /*the name of the vport is freed with it*/
+    strncpy(name, vp->vport_name, VPORT_NAME_MAX);
+    name[VPORT_NAME_MAX] = '\0';
+    ret = vport_delete_ctl(name);
+    if (ret == -EIO || ret == -ENXIO) {
+        return -NN_EIFNOTEXIST;
+    } else if (ret) {
+        BVR_WARNING("unknown error code when delete interface return the orignal code %d", ret);
+    }
+    return ret;
+}
+
+/*
+ * @brief sync the static fdb entries of a vni, learned ones are left alone
+ */
+static void sync_fdb_vni(struct sync_state *s, struct vxlan_dev *vdev)
+{
+    struct vxlan_fdb *f = NULL;
+    struct sync_fdb key, *sf, *stale;
+    int i, n = 0, n_stale = 0;
+
+    /*static entries only change with the vni lock held*/
+    lock_vxlan_fdb();
+    pal_list_for_each_entry(f, &vdev->fdb_list, list) {
+        n += f->state == VXLAN_FDB_STATIC;
+    }
+    unlock_vxlan_fdb();
+    stale = calloc(n + 1, sizeof(*stale));
+    if (stale == NULL) {
+        sync_count(s, -NN_ENOMEM, NULL);
+        return;
+    }
+
+    key.vni = vdev->vni;
+    lock_vxlan_fdb();
+    pal_list_for_each_entry(f, &vdev->fdb_list, list) {
+        if (f->state != VXLAN_FDB_STATIC || n_stale == n) {
+            continue;
+        }
+        memcpy(key.entry.mac, f->eth_addr, sizeof(key.entry.mac));
+        sf = bsearch(&key, s->fdbs, s->n_fdb, sizeof(*sf), sync_fdb_cmp);
+        if (sf && sf->entry.remote_ip == f->remote.remote_ip &&
+            sf->entry.remote_port == f->remote.remote_port) {
+            sf->keep = 1;
+        } else if (!sf || (f->eth_addr[0] & 1)) {
+            /*a changed unicast entry is updated by the add, but a group
+              entry would get the remote appended to its list*/
+            stale[n_stale++] = key;
+        }
+    }
+    unlock_vxlan_fdb();
+
+    for (i = 0; i < n_stale; i++) {
+        sync_count(s, ctl_fdb_del(vdev->vni, stale[i].entry.mac), &s->deleted);
+    }
+    free(stale);
+}
+
+static void sync_arp_vni(struct sync_state *s, struct vxlan_dev *vdev)
+{
+    struct vxlan_arp_entry *entry = NULL, *next = NULL;
+    struct sync_arp key, *sa;
+
+    /*the arp entries of the vni only change with its lock held*/
+    key.vni = vdev->vni;
+    pal_list_for_each_entry_safe(entry, next, &vdev->arp_list, list) {
+        key.entry.ip = entry->ip;
+        sa = bsearch(&key, s->arps, s->n_arp, sizeof(*sa), sync_arp_cmp);
+        if (sa == NULL) {
+            sync_count(s, ctl_arp_del(vdev->vni, &key.entry), &s->deleted);
+        } else if (!memcmp(sa->entry.mac_addr, entry->mac_addr, sizeof(entry->mac_addr))) {
+            sa->keep = 1;
+        }
+        /*a changed entry is updated by the add*/
+    }
+}
+
+static void sync_apply(struct net *net, struct sync_state *s)
+{
+    struct vxlan_dev *vdev;
+    int i;
+
+    for (i = 0; i < s->n_stale_filter; i++) {
+        sync_count(s, ipt_filter_del_rule(net, s->stale_filters[i].hook, s->stale_filters[i].entry),
+            &s->deleted);
+    }
+    for (i = 0; i < s->n_stale_nat; i++) {
+        sync_count(s, ipt_nat_del_rule(net, s->stale_nats[i].hook, s->stale_nats[i].entry),
+            &s->deleted);
+    }
+    for (i = 0; i < s->n_stale_route; i++) {
+        sync_count(s, ctl_route_del(net, s->stale_routes[i].prefix, s->stale_routes[i].prefixlen),
+            &s->deleted);
+    }
+    for (i = 0; i < s->n_stale_if; i++) {
+        sync_count(s, sync_if_del(s->stale_ifs[i]), &s->deleted);
+    }
+
+    for (i = 0; i < s->n_if; i++) {
+        if (!s->ifs[i].keep) {
+            sync_count(s, sync_if_add(net, &s->ifs[i]), &s->added);
+        }
+    }
+    if (s->n_stale_if || s->added) {
+        /*interface add or remove should update port_polling*/
+        g_bvrouter_conf_info.port_update = 1;
+    }
+    for (i = 0; i < s->n_route; i++) {
+        if (!s->routes[i].keep) {
+            sync_count(s, ctl_route_add(net, s->routes[i].prefix, s->routes[i].plen,
+                s->routes[i].nexthop, s->routes[i].ifname), &s->added);
+        }
+    }
+    for (i = 0; i < s->n_nat; i++) {
+        if (!s->nats[i].keep) {
+            sync_count(s, ipt_nat_insert_rule(net, s->nats[i].hook, s->nats[i].entry), &s->added);
+        }
+    }
+    for (i = 0; i < s->n_filter; i++) {
+        if (!s->filters[i].keep) {
+            sync_count(s, ipt_filter_add_rule(net, s->filters[i].hook, s->filters[i].entry), &s->added);
+        }
+    }
+
+    /*the vxlan devs of the vnis exist once the interfaces are added*/
+    for (i = 0; i < s->n_vni; i++) {
+        vdev = get_vxlan_dev(s->vnis[i]);
+        if (vdev == NULL) {
+            continue;
+        }
+        if (s->n_fdb >= 0) {
+            sync_fdb_vni(s, vdev);
+        }
+        if (s->n_arp >= 0) {
+            sync_arp_vni(s, vdev);
+        }
+    }
+    for (i = 0; i < s->n_fdb; i++) {
+        if (!s->fdbs[i].keep) {
+            sync_count(s, ctl_fdb_add(s->fdbs[i].vni, &s->fdbs[i].entry), &s->added);
+        }
+    }
+    for (i = 0; i < s->n_arp; i++) {
+        if (!s->arps[i].keep) {
+            sync_count(s, ctl_arp_add(s->arps[i].vni, &s->arps[i].entry), &s->added);
+        }
+    }
+}
+
+/*in index order, two syncs may lock some of the same vnis*/
+static void sync_lock_vnis(struct sync_state *s)
+{
+    int i;
+
+    for (i = 0; i < NN_CTL_VNI_LOCKS; i++) {
+        if (s->vni_locks & (1ULL << i)) {
+            pthread_mutex_lock(&g_ctl_vni_lock[i]);
+        }
+    }
+}
+
+static void sync_unlock_vnis(struct sync_state *s)
+{
+    int i;
+
+    for (i = NN_CTL_VNI_LOCKS - 1; i >= 0; i--) {
+        if (s->vni_locks & (1ULL << i)) {
+            pthread_mutex_unlock(&g_ctl_vni_lock[i]);
+        }
+    }
+}
+
+static void sync_free(struct sync_state *s)
+{
+    free(s->ifs);
+    free(s->routes);
+    free(s->nats);
+    free(s->filters);
+    free(s->fdbs);
+    free(s->arps);
+    free(s->stale_ifs);
+    free(s->stale_routes);
+    free(s->stale_nats);
+    free(s->stale_filters);
+    free(s->vnis);
+}
+
+/*
+ * @brief sync a bvrouter to the desired state in the message
+ * @json param:"bvrouter" "generation" "interfaces" "routes" "nat" "filter"
+ *             "fdb" "arp", see NN_CMD_ID_SYNC_NAMESPACE
+ * @return 0 on success,-1 return status error
+ */
+static u32 bvr_cmd_sync_namespace(struct conn_ev *ev)
+{
+    BVR_DEBUG("nn_cmd_sync_namespace called\n");
+    struct sync_state s;
+    struct net *net = NULL;
+    cJSON *root = NULL, *gen = NULL, *reply = NULL;
+    char *out = NULL;
+    char tmp[64];
+    int ret = 0;
+
+    memset(&s, 0, sizeof(s));
+    root = ctl_body(ev);
+    if (!root) {
+        ret = -NN_ENOMEM;
+        goto ret_state;
+    }
+    if (!json_has(root, "bvrouter", cJSON_String) || !json_opt(root, "generation", cJSON_Number)) {
+        ret = -NN_EPARSECMD;
+        goto ret_state;
+    }
+    net = net_get(cJSON_GetObjectItem(root, "bvrouter")->valuestring);
+    if (!net) {
+        ret = -NN_ENSNOTEXIST;
+        goto ret_state;
+    }
+    /*the state of an older generation is not applied*/
+    gen = cJSON_GetObjectItem(root, "generation");
+    if (gen && (gen->valuedouble < 0 || (u64)gen->valuedouble < net->sync_gen)) {
+        ret = -NN_EOUTRANGE;
+        goto ret_state;
+    }
+
+    ret = sync_parse(root, net, &s);
+    if (ret == 0) {
+        ret = sync_diff(net, &s);
+    }
+    if (ret) {
+        BVR_WARNING("sync of bvrouter %s refused %d\n", net->name, ret);
+        goto ret_state;
+    }
+
+    sync_lock_vnis(&s);
+    sync_apply(net, &s);
+    sync_unlock_vnis(&s);
+    if (s.ret == 0 && gen) {
+        net->sync_gen = (u64)gen->valuedouble;
+    }
+    ret = s.ret;
+
+    reply = cJSON_CreateObject();
+    if (reply == NULL) {
+        ret = ret ? ret : -NN_ENOMEM;
+        goto ret_state;
+    }
+    /*use string for u64*/
+    sprintf(tmp, "%lu", net->sync_gen);
+    cJSON_AddStringToObject(reply, "generation", tmp);
+    cJSON_AddNumberToObject(reply, "added", s.added);
+    cJSON_AddNumberToObject(reply, "deleted", s.deleted);
+    cJSON_AddNumberToObject(reply, "failed", s.failed);
+    out = cJSON_Print(reply);
+    cJSON_Delete(reply);
+    if (out == NULL) {
+        ret = ret ? ret : -NN_ENOMEM;
+    }
+
+ret_state:
+    cJSON_Delete(root);
+    sync_free(&s);
+    ev->msg_prefix.msg_len = out ? strlen(out) : 0;
+    ev->msg_prefix.ret_state = ret;
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0) {
+        BVR_ERROR("send ret message failed\n");
+        free(out);
+        return -1;
+    }
+    if (out && ctl_reply(ev, (u8 *)out, ev->msg_prefix.msg_len) < 0) {
+        BVR_ERROR("send ret message failed\n");
+        free(out);
+        return -1;
+    }
+    free(out);
+    return 0;
+}
+
+
+/*
+ * @brief write the snapshot now, see bvr_snapshot.h
+ * @json param:none
+ * @return 0 on success,-1 return status error
+ */
+static u32 bvr_cmd_save_snapshot(struct conn_ev *ev)
+{
+    BVR_DEBUG("nn_cmd_save_snapshot called\n");
+    int ret = 0;
+
+    if (g_bvrouter_conf_info.snapshot_file[0] == '\0') {
+        ret = -NN_EINVAL;
+    } else if (bvr_snapshot_save(g_bvrouter_conf_info.snapshot_file)) {
+        ret = -NN_EEXCERR;
+    }
+
+    ev->msg_prefix.msg_len = 0;
+    ev->msg_prefix.ret_state = ret;
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0)
+    {
+        BVR_ERROR("send ret message failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @brief drain the data path and exit, with the control lock held for
+ *        write so that no command runs after the snapshot
+ */
+static void bvr_ctl_exit(const char *why)
+{
+    pal_ports_stop();
+    BVR_WARNING("exit on %s\n", why);
+    exit(0);
+}
+
+static u32 bvr_cmd_batch(struct conn_ev *ev);
+
+nn_msg_handler_info_t g_msg_handler_tbl_pr[NN_CMD_ID_MAX_CMD] =
+{
+    [NN_CMD_ID_TEST]                = {bvr_cmd_test_handler,"test handler", NN_CTL_LOCK_GLOBAL},
+    [NN_CMD_ID_ADD_NAMESPACE]       = {bvr_cmd_create_namespace_handler, "create namespace handler", NN_CTL_LOCK_GLOBAL},
+    [NN_CMD_ID_DEL_NAMESPACE]       = {bvr_cmd_del_namespace_handler, "del namespace handler", NN_CTL_LOCK_GLOBAL},
+    [NN_CMD_ID_LIST_NAMESPACE]      = {bvr_cmd_list_namespace_handler, "list all namespace handler", NN_CTL_LOCK_SHARED},
+    [NN_CMD_ID_SHOW_NAMESPACE]      = {bvr_cmd_show_namespace_handler, "show namespace handler", NN_CTL_LOCK_NS},
+    [NN_CMD_ID_ADD_NF_RULE]         = {bvr_cmd_add_netfilter_rule, "add netfilter rule", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_DEL_NF_RULE]         = {bvr_cmd_del_netfilter_rule, "del netfilter rule", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_SHOW_NF_RULE]        = {bvr_cmd_show_netfilter_rule, "show netfilter rule", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_FLUSH_NF_RULE]       = {bvr_cmd_flush_netfilter_rule, "flush netfilter rules in bvrouter table", NN_CTL_LOCK_NET},
+
+    [NN_CMD_ID_ADD_ARP_ENTRY]       = {bvr_cmd_add_arp_table_entry, "add arp entry", NN_CTL_LOCK_VNI},
+    [NN_CMD_ID_DEL_ARP_ENTRY]       = {bvr_cmd_del_arp_table_entry, "del arp entry", NN_CTL_LOCK_VNI},
+    [NN_CMD_ID_SHOW_ARP_ENTRIES]    = {bvr_cmd_show_arp_table_entries, "show arp entries", NN_CTL_LOCK_VNI},
+
+    [NN_CMD_ID_ADD_INT_IF]          = {bvr_cmd_add_internal_interface, "add a internal interface to router", NN_CTL_LOCK_NET_VNI},
+    [NN_CMD_ID_ADD_EXT_IF]          = {bvr_cmd_add_external_interface, "add a external interface to router", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_DEL_IF]              = {bvr_cmd_del_interface, "delete a inter", NN_CTL_LOCK_NET_IF},
+    [NN_CMD_ID_SHOW_IFS]            = {bvr_cmd_show_interfaces, "show interfaces of router", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_ADD_IP]              = {bvr_cmd_add_floating_ip, "add floating ip on interface", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_DEL_IP]              = {bvr_cmd_del_floating_ip, "delete floating ip on interface", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_ADD_FDB_ENTRY]       = {bvr_cmd_add_fdb_entry, "add fdb entry on vxlan interface", NN_CTL_LOCK_VNI},
+    [NN_CMD_ID_DEL_FDB_ENTRY]       = {bvr_cmd_del_fdb_entry, "delete fdb entry on vxlan interface", NN_CTL_LOCK_VNI},
+    [NN_CMD_ID_SHOW_FDB_ENTRIES]    = {bvr_cmd_show_fdb_entries, "show fdb entries of a vxlan interface", NN_CTL_LOCK_VNI},
+    [NN_CMD_ID_LIST_ALL_IFS]        = {bvr_cmd_list_all_ifs, "show all interface name(used by l2 agent)", NN_CTL_LOCK_GLOBAL},
+    [NN_CMD_ID_SHOW_IFS_STAT]       = {bvr_cmd_show_ifs_stat, "show phy interfaces status", NN_CTL_LOCK_SHARED},
+    [NN_CMD_ID_SHOW_CPU_USAGE]      = {bvr_cmd_show_cpu_usage, "show pal cpu usage", NN_CTL_LOCK_SHARED},
+    [NN_CMD_ID_SHOW_ROUTE_TABLE]    = {bvr_cmd_show_route_table, "show bvrouter's route table", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_GET_PORT_POLLING]    = {bvr_cmd_get_port_update_handler, "get port polling status", NN_CTL_LOCK_GLOBAL},
+    [NN_CMD_ID_SET_PORT_STAT_INT]   = {bvr_cmd_set_portstatus_interval_handler, "set port polling status interval", NN_CTL_LOCK_GLOBAL},
+    [NN_CMD_ID_SHOW_PORT_LINK_STATUS]  = {bvr_cmd_show_ifs_link_status, "show port link up or down", NN_CTL_LOCK_SHARED},
+    [NN_CMD_ID_SET_PORT_LINK_STATUS]   = {bvr_cmd_set_ifs_link_status, "set port link up or down", NN_CTL_LOCK_GLOBAL},
+    [NN_CMD_ID_ADD_ROUTE]           = {bvr_cmd_add_route, "add route item", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_DEL_ROUTE]           = {bvr_cmd_del_route, "delete route item", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_SET_FDB_LEARNING]    = {bvr_cmd_set_fdb_learning, "set fdb learning of a vxlan interface", NN_CTL_LOCK_VNI},
+    [NN_CMD_ID_SET_MSS_CLAMP]       = {bvr_cmd_set_mss_clamp, "set tcp mss clamp of a bvrouter or internal interface", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_SHOW_REASM_STATS]    = {bvr_cmd_show_reasm_stats, "show ip reassembly stats of datapath cores", NN_CTL_LOCK_SHARED},
+    [NN_CMD_ID_BATCH]               = {bvr_cmd_batch, "run a batch of commands", NN_CTL_LOCK_NONE},
+    [NN_CMD_ID_SYNC_NAMESPACE]      = {bvr_cmd_sync_namespace, "sync a bvrouter to a desired state", NN_CTL_LOCK_NET},
+    [NN_CMD_ID_SAVE_SNAPSHOT]       = {bvr_cmd_save_snapshot, "write the snapshot of the control state", NN_CTL_LOCK_GLOBAL},
+    [NN_CMD_ID_SHOW_SLAB_STATS]     = {bvr_cmd_show_slab_stats, "show usage of the slabs", NN_CTL_LOCK_SHARED},
+};
+
+
+/*
+ * Binary encoding of the bulk commands, see NN_CTL_VERSION_BIN
+ */
+
+/*a name field must hold its terminating nul*/
+static inline int bin_name_valid(const char *name, u32 size)
+{
+    return memchr(name, '\0', size) != NULL;
+}
+
+static int bin_fdb_add(const void *rec)
+{
+    const struct nn_bin_fdb *r = rec;
+    struct fdb_entry entry;
+    int ret;
+
+    memcpy(entry.mac, r->mac, sizeof(entry.mac));
+    entry.remote_ip = r->remote_ip;
+    entry.remote_port = htons(r->remote_port);
+    pthread_mutex_lock(ctl_vni_lock(r->vni));
+    ret = ctl_fdb_add(r->vni, &entry);
+    pthread_mutex_unlock(ctl_vni_lock(r->vni));
+    return ret;
+}
+
+static int bin_fdb_del(const void *rec)
+{
+    const struct nn_bin_fdb *r = rec;
+    u8 mac[6];
+    int ret;
+
+    memcpy(mac, r->mac, sizeof(mac));
+    pthread_mutex_lock(ctl_vni_lock(r->vni));
+    ret = ctl_fdb_del(r->vni, mac);
+    pthread_mutex_unlock(ctl_vni_lock(r->vni));
+    return ret;
+}
+
+static int bin_arp_add(const void *rec)
+{
+    const struct nn_bin_arp *r = rec;
+    struct vxlan_arp_entry entry;
+    int ret;
+
+    entry.ip = r->ip;
+    memcpy(entry.mac_addr, r->mac, sizeof(entry.mac_addr));
+    pthread_mutex_lock(ctl_vni_lock(r->vni));
+    ret = ctl_arp_add(r->vni, &entry);
+    pthread_mutex_unlock(ctl_vni_lock(r->vni));
+    return ret;
+}
+
+static int bin_arp_del(const void *rec)
+{
+    const struct nn_bin_arp *r = rec;
+    struct vxlan_arp_entry entry;
+    int ret;
+
+    entry.ip = r->ip;
+    pthread_mutex_lock(ctl_vni_lock(r->vni));
+    ret = ctl_arp_del(r->vni, &entry);
+    pthread_mutex_unlock(ctl_vni_lock(r->vni));
+    return ret;
+}
+
+static int bin_route_add(const void *rec)
+{
+    const struct nn_bin_route *r = rec;
+    char ifname[NN_BIN_IF_NAME_SIZE];
+    struct net *net;
+    int ret;
+
+    if (!bin_name_valid(r->bvrouter, sizeof(r->bvrouter)) ||
+        !bin_name_valid(r->ifname, sizeof(r->ifname))) {
+        return -NN_EPARSECMD;
+    }
+    if (r->prefix == 0 || r->prefixlen == 0 || r->prefixlen > 32 ||
+        (r->ifname[0] == '\0' && r->nexthop == 0)) {
+        return -NN_EPARSECMD;
+    }
+    net = net_get((char *)r->bvrouter);
+    if (!net) {
+        return -NN_ENSNOTEXIST;
+    }
+
+    memcpy(ifname, r->ifname, sizeof(ifname));
+    pthread_mutex_lock(&net->ctl_lock);
+    ret = ctl_route_add(net, r->prefix, r->prefixlen, r->nexthop,
+        ifname[0] ? ifname : NULL);
+    pthread_mutex_unlock(&net->ctl_lock);
+    return ret;
+}
+
+static int bin_route_del(const void *rec)
+{
+    const struct nn_bin_route *r = rec;
+    struct net *net;
+    int ret;
+
+    if (!bin_name_valid(r->bvrouter, sizeof(r->bvrouter))) {
+        return -NN_EPARSECMD;
+    }
+    if (r->prefix == 0 || r->prefixlen == 0 || r->prefixlen > 32) {
+        return -NN_EPARSECMD;
+    }
+    net = net_get((char *)r->bvrouter);
+    if (!net) {
+        return -NN_ENSNOTEXIST;
+    }
+    pthread_mutex_lock(&net->ctl_lock);
+    ret = ctl_route_del(net, r->prefix, r->prefixlen);
+    pthread_mutex_unlock(&net->ctl_lock);
+    return ret;
+}
+
+static int bin_nat_entry(const struct nn_bin_nf_rule *r, struct ipt_nat_entry *entry)
+{
+    if (r->plen[0] == 0 || r->plen[0] > NAT_PLEN_MAX ||
+        r->plen[1] == 0 || r->plen[1] > NAT_PLEN_MAX) {
+        return -NN_EPARSECMD;
+    }
+    memset(entry, 0, sizeof(*entry));
+    entry->orig_ip = r->ip[0];
+    entry->orig_plen = r->plen[0];
+    entry->nat_ip = r->ip[1];
+    entry->nat_plen = r->plen[1];
+    entry->nat_target = r->target;
+    return 0;
+}
+
+/*same rule as parse_ip_filter_entry builds*/
+static int bin_filter_entry(const struct nn_bin_nf_rule *r, struct ipt_filter_entry *entry)
+{
+    u32 mask;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->filter_target = r->target;
+    entry->priority = r->priority ? r->priority : NF_FILTER_PRIO_MAX;
+    if (entry->priority > NF_FILTER_PRIO_MAX || r->dir > 1) {
+        return -NN_EOUTRANGE;
+    }
+    entry->dir = r->dir;
+
+    if (r->plen[0] > 32 || r->plen[1] > 32) {
+        return -NN_EPARSECMD;
+    }
+    if (r->plen[0]) {
+        mask = htonl(depth_to_mask(r->plen[0]));
+        entry->mask_value.sip = mask;
+        entry->key.sip = r->ip[0] & mask;
+    }
+    if (r->plen[1]) {
+        mask = htonl(depth_to_mask(r->plen[1]));
+        entry->mask_value.dip = mask;
+        entry->key.dip = r->ip[1] & mask;
+    }
+
+    if (r->flags & NN_BIN_NF_SPORT) {
+        entry->key.sport[0] = RTE_MIN(r->sport[0], r->sport[1]);
+        entry->key.sport[1] = RTE_MAX(r->sport[0], r->sport[1]);
+        entry->mask_value.sport = 1;
+    }
+    if (r->flags & NN_BIN_NF_DPORT) {
+        entry->key.dport[0] = RTE_MIN(r->dport[0], r->dport[1]);
+        entry->key.dport[1] = RTE_MAX(r->dport[0], r->dport[1]);
+        entry->mask_value.dport = 1;
+    }
+    if (r->flags & NN_BIN_NF_PROTO) {
+        entry->key.proto = r->proto;
+        entry->mask_value.proto = 1;
+    }
+    return 0;
+}
+
+static int bin_nf_rule(const void *rec, int add)
+{
+    const struct nn_bin_nf_rule *r = rec;
+    struct ipt_nat_entry nat_entry;
+    struct ipt_filter_entry filter_entry;
+    struct net *net;
+    int ret;
+
+    if (!bin_name_valid(r->bvrouter, sizeof(r->bvrouter))) {
+        return -NN_EPARSECMD;
+    }
+    net = net_get((char *)r->bvrouter);
+    if (!net) {
+        return -NN_ENSNOTEXIST;
+    }
+
+    if (r->table == NN_BIN_TABLE_NAT) {
+        ret = bin_nat_entry(r, &nat_entry);
+        if (ret) {
+            return ret;
+        }
+        pthread_mutex_lock(&net->ctl_lock);
+        ret = add ? ipt_nat_insert_rule(net, r->hook_num, nat_entry) :
+            ipt_nat_del_rule(net, r->hook_num, nat_entry);
+        pthread_mutex_unlock(&net->ctl_lock);
+        return ret;
+    } else if (r->table == NN_BIN_TABLE_FILTER) {
+        ret = bin_filter_entry(r, &filter_entry);
+        if (ret) {
+            return ret;
+        }
+        pthread_mutex_lock(&net->ctl_lock);
+        ret = add ? ipt_filter_add_rule(net, r->hook_num, filter_entry) :
+            ipt_filter_del_rule(net, r->hook_num, filter_entry);
+        pthread_mutex_unlock(&net->ctl_lock);
+        return ret;
+    }
+
+    BVR_WARNING("table is neither nat nor filter\n");
+    return -NN_EINVAL;
+}
+
+static int bin_nf_rule_add(const void *rec)
+{
+    return bin_nf_rule(rec, 1);
+}
+
+static int bin_nf_rule_del(const void *rec)
+{
+    return bin_nf_rule(rec, 0);
+}
+
+/*
+ * @brief show the stats of the phy interfaces as nn_bin_if_stat records
+ * @return 0 on success,-1 return status error
+ */
+static u32 bin_show_ifs_stat(struct conn_ev *ev)
+{
+    struct nn_bin_if_stat *recs = NULL, *r;
+    struct rte_eth_stats stats;
+    bound_interface_t *bi = NULL;
+    u32 n = 0;
+    int ret = 0;
+
+    list_for_each_entry(bi, &g_bvrouter_conf_info.bound_interfaces, l) {
+        n++;
+    }
+    if (n) {
+        recs = calloc(n, sizeof(*recs));
+        if (recs == NULL) {
+            n = 0;
+        }
+    }
+
+    r = recs;
+    if (recs != NULL) {
+        list_for_each_entry(bi, &g_bvrouter_conf_info.bound_interfaces, l) {
+            if (bi->port_id >= rte_eth_dev_count())
+                break;
+            rte_eth_stats_get(bi->port_id, &stats);
+            r->port_id = bi->port_id;
+            r->rxpkts = stats.ipackets;
+            r->rxbytes = stats.ibytes;
+            r->rxmissed = stats.imissed;
+            r->rxbadcrc = stats.ibadcrc;
+            r->rxbadlen = stats.ibadlen;
+            r->rxerrors = stats.ierrors;
+            r->txpkts = stats.opackets;
+            r->txbytes = stats.obytes;
+            r->txerrors = stats.oerrors;
+            r++;
+        }
+    }
+
+    ev->msg_prefix.msg_len = (char *)r - (char *)recs;
+    ev->msg_prefix.ret_state = (n && recs == NULL) ? (u32)-NN_ENOMEM : 0;
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0 ||
+        (ev->msg_prefix.msg_len &&
+        ctl_reply(ev, (u8 *)recs, ev->msg_prefix.msg_len) < 0)) {
+        BVR_ERROR("send ret message failed\n");
+        ret = -1;
+    }
+    free(recs);
+    return ret;
+}
+
+/*
+ * @brief fill the records of the interfaces of net from r on
+ * @return the record after the last one filled
+ */
+static struct nn_bin_vport_stat *bin_pack_vport_stats(struct net *net,
+        struct nn_bin_vport_stat *r)
+{
+    struct vport *pos = NULL;
+    struct vport_stats stats;
+
+    pal_list_for_each_entry(pos, &net->dev_base_head, list_nd) {
+        memset(r, 0, sizeof(*r));
+        snprintf(r->bvrouter, sizeof(r->bvrouter), "%s", net->name);
+        snprintf(r->ifname, sizeof(r->ifname), "%s", pos->vport_name);
+        r->type = pos->vport_type;
+        if (pos->vport_type == PHY_VPORT) {
+            pal_pcpu_sum(&stats, ((struct phy_vport *)pos)->stats, sizeof(stats));
+        } else if (pos->vport_type == VXLAN_VPORT) {
+            r->vni = ((struct int_vport *)pos)->vdev->vni;
+            pal_pcpu_sum(&stats, ((struct int_vport *)pos)->stats, sizeof(stats));
+        } else {
+            continue;
+        }
+        r->rx_packets = stats.rx_packets;
+        r->tx_packets = stats.tx_packets;
+        r->rx_bytes = stats.rx_bytes;
+        r->tx_bytes = stats.tx_bytes;
+        r->rx_errors = stats.rx_errors;
+        r->tx_errors = stats.tx_errors;
+        r->rx_dropped = stats.rx_dropped;
+        r->tx_dropped = stats.tx_dropped;
+        r++;
+    }
+    return r;
+}
+
+/*
+ * @brief show the stats of the interfaces of all the routers as
+ *        nn_bin_vport_stat records
+ * @return 0 on success,-1 return status error
+ */
+static u32 bin_show_ifs(struct conn_ev *ev)
+{
+    struct nn_bin_vport_stat *recs = NULL, *tmp;
+    struct pal_hlist_node *node = NULL;
+    struct net *net = NULL;
+    struct vport *pos = NULL;
+    u32 i, n = 0, cnt, size = 0;
+    int ret = 0, err = 0;
+
+    /*namespaces do not come and go under the control lock, their interfaces may*/
+    for (i = 0; i < NAMESPACE_TABLE_SIZE && !err; i++) {
+        pal_hlist_for_each_entry(net, node, &namespace_hash_table[i], hlist) {
+            pthread_mutex_lock(&net->ctl_lock);
+            cnt = 0;
+            pal_list_for_each_entry(pos, &net->dev_base_head, list_nd) {
+                cnt++;
+            }
+            if (n + cnt > size) {
+                size = (n + cnt) * 2;
+                tmp = realloc(recs, size * sizeof(*recs));
+                if (tmp == NULL) {
+                    err = 1;
+                } else {
+                    recs = tmp;
+                }
+            }
+            if (!err && cnt) {
+                n = bin_pack_vport_stats(net, recs + n) - recs;
+            }
+            pthread_mutex_unlock(&net->ctl_lock);
+            if (err) {
+                break;
+            }
+        }
+    }
+
+    ev->msg_prefix.msg_len = err ? 0 : n * sizeof(*recs);
+    ev->msg_prefix.ret_state = err ? (u32)-NN_ENOMEM : 0;
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0 ||
+        (ev->msg_prefix.msg_len &&
+        ctl_reply(ev, (u8 *)recs, ev->msg_prefix.msg_len) < 0)) {
+        BVR_ERROR("send ret message failed\n");
+        ret = -1;
+    }
+    free(recs);
+    return ret;
+}
+
+nn_bin_handler_info_t g_msg_bin_handler_tbl[NN_CMD_ID_MAX_CMD] =
+{
+    [NN_CMD_ID_ADD_FDB_ENTRY]   = {sizeof(struct nn_bin_fdb), bin_fdb_add, NULL, "add fdb entries"},
+    [NN_CMD_ID_DEL_FDB_ENTRY]   = {sizeof(struct nn_bin_fdb), bin_fdb_del, NULL, "delete fdb entries"},
+    [NN_CMD_ID_ADD_ARP_ENTRY]   = {sizeof(struct nn_bin_arp), bin_arp_add, NULL, "add arp entries"},
+    [NN_CMD_ID_DEL_ARP_ENTRY]   = {sizeof(struct nn_bin_arp), bin_arp_del, NULL, "delete arp entries"},
+    [NN_CMD_ID_ADD_ROUTE]       = {sizeof(struct nn_bin_route), bin_route_add, NULL, "add routes"},
+    [NN_CMD_ID_DEL_ROUTE]       = {sizeof(struct nn_bin_route), bin_route_del, NULL, "delete routes"},
+    [NN_CMD_ID_ADD_NF_RULE]     = {sizeof(struct nn_bin_nf_rule), bin_nf_rule_add, NULL, "add netfilter rules"},
+    [NN_CMD_ID_DEL_NF_RULE]     = {sizeof(struct nn_bin_nf_rule), bin_nf_rule_del, NULL, "delete netfilter rules"},
+    [NN_CMD_ID_SHOW_IFS]        = {0, NULL, bin_show_ifs, "show interfaces stats of all routers"},
+    [NN_CMD_ID_SHOW_IFS_STAT]   = {0, NULL, bin_show_ifs_stat, "show phy interfaces status"},
+};
+
+/*
+ * @brief run the records of a binary message in order and answer their
+ *        statuses, written over the records already run
+ * @return 0 on success,-1 return status error
+ */
+static u32 bin_run_records(struct conn_ev *ev, const nn_bin_handler_info_t *info)
+{
+    char *body = ev->buf;
+    u32 n, i, failed = 0;
+    int32_t status;
+
+    BUILD_BUG_ON(sizeof(struct nn_bin_fdb) < sizeof(status));
+    BUILD_BUG_ON(sizeof(struct nn_bin_arp) < sizeof(status));
+    BUILD_BUG_ON(NN_BIN_NS_NAME_SIZE != NAMESPACE_NAME_SIZE);
+    BUILD_BUG_ON(NN_BIN_IF_NAME_SIZE != VPORT_NAME_MAX);
+
+    if (ev->msg_prefix.msg_len % info->rec_size) {
+        ev->msg_prefix.msg_len = 0;
+        ev->msg_prefix.ret_state = -NN_EPARSECMD;
+        n = 0;
+    } else {
+        n = ev->msg_prefix.msg_len / info->rec_size;
+        for (i = 0; i < n; i++) {
+            status = info->apply(body + i * info->rec_size);
+            if (status) {
+                failed++;
+            }
+            memcpy(body + i * sizeof(status), &status, sizeof(status));
+        }
+        ev->msg_prefix.msg_len = n * sizeof(status);
+        ev->msg_prefix.ret_state = failed;
+    }
+
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0 ||
+        (n && ctl_reply(ev, (u8 *)body, ev->msg_prefix.msg_len) < 0)) {
+        BVR_ERROR("send ret message failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/* create a tcp listen socket on specified port, bound to INADDR_ANY
+ * returns the fd created, or -1 on failure */
+static int tcp_server_create(u16 port)
+{
+    int fd;
+    int reuseaddr = 1;
+    struct sockaddr_in addr;
+
+    fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) {
+        BVR_PANIC("Create listen socket failed: %s\n", strerror(errno));
+    }
+
+    if (fcntl(fd, F_SETFL, fcntl(fd,F_GETFL) | O_NONBLOCK) < 0) {
+        BVR_PANIC("Set listen socket to nonblock failed: %s\n", strerror(errno));
     }
 
     if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuseaddr, sizeof(reuseaddr)) < 0) {
@@ -3300,22 +5559,39 @@ static int tcp_server_create(u16 port)
  * @brief Read n bytes from a conn_ev. if error occurs or peer closed the connection
  *      before all data are read, the connection is closed.
  */
-static inline void recv_until(struct conn_ev *ev, void *buf, u32 len, int needfree,
+static inline void recv_until(struct conn_ev *ev, void *buf, u32 len,
                 int (* cb)(struct conn_ev *ev))
 {
     ev->buf = buf;
     ev->toread = len;
     ev->rcvd = 0;
     ev->cb = cb;
-    ev->needfree = needfree;
 }
 
+static int handle_prefix(struct conn_ev *ev);
+static int handle_msg(struct conn_ev *ev);
+static void bvr_ctl_do_send(struct ev_loop *loop, ev_io *ev, int events);
+
+/*
+ * close a connection, its reply being streamed if any is dropped
+ */
+static void conn_close(struct ev_loop *loop, struct conn_ev *conn_ev)
+{
+    ev_io_stop(loop, &conn_ev->ev);
+
+    close(conn_ev->ev.fd);
+    free(conn_ev->msg_buf);
+    free(conn_ev->reply);
+
+    conn_ev->listen_ev->n_conn--;
+    BVR_DEBUG("close connection, now %u connections\n", conn_ev->listen_ev->n_conn);
+    free(conn_ev);
+}
 
 static void bvr_ctl_do_recv(struct ev_loop *loop, ev_io *ev, int events)
 {
     int rcvd;
-    u32 tot_rcvd;
-    u32 left;
+    int corked = 0;
     struct conn_ev *conn_ev = (struct conn_ev *)ev;
 
     if (events & EV_ERROR) {
@@ -3325,126 +5601,294 @@ static void bvr_ctl_do_recv(struct ev_loop *loop, ev_io *ev, int events)
     if ((events & EV_READ) == 0)
         return;
 
-    tot_rcvd = conn_ev->rcvd;
-    left = conn_ev->toread;
-    while (left > 0) {
-        rcvd = recv(ev->fd, (char *)conn_ev->buf + tot_rcvd, left, 0);
-        if (rcvd < 0) {
-            if(errno == EAGAIN) {
-                break;
+    /*handle all the messages already received, the client may pipeline them*/
+    while (1) {
+        while (conn_ev->toread > 0) {
+            rcvd = recv(ev->fd, (char *)conn_ev->buf + conn_ev->rcvd, conn_ev->toread, 0);
+            if (rcvd < 0) {
+                if (errno == EAGAIN) {
+                    goto out;
+                } else if (errno == EINTR) {
+                    continue;
+                } else {
+                    BVR_ERROR("recv error: %s\n", strerror(errno));
+                    goto recv_error;
+                }
+            } else if (rcvd > 0) {
+                conn_ev->toread -= rcvd;
+                conn_ev->rcvd += rcvd;
             } else {
-                BVR_ERROR("recv error: %s\n", strerror(errno));
+                if (conn_ev->cb == handle_prefix && conn_ev->rcvd == 0) {
+                    BVR_DEBUG("Connection closed by client.\n");
+                } else {
+                    BVR_ERROR("Connection closed by client in a message.\n");
+                }
                 goto recv_error;
             }
-        } else if (rcvd > 0) {
-            left -= rcvd;
-            tot_rcvd += rcvd;
-        } else {
-            BVR_ERROR("Connection closed by client.\n");
-            goto recv_error;
         }
-    }
 
-    if (left == 0) {
+        if (conn_ev->cb == handle_msg && !corked) {
+            set_cork(ev->fd, 1);
+            corked = 1;
+        }
+
         switch(conn_ev->cb(conn_ev)) {
             case NN_EVCB_RET_CLOSE:
                 goto recv_error;
             case NN_EVCB_RET_RECV:
                     break;
-            /* TODO: currently, this return value is not used.*/
-            /* case BGW_EVCB_RET_SEND:
+            /*a reply is streamed, the next messages wait for its end*/
+            case NN_EVCB_RET_SEND:
                 ev_io_stop(loop, ev);
+                ev_set_cb(ev, bvr_ctl_do_send);
                 ev_io_set(ev, ev->fd, EV_WRITE);
                 ev_io_start(loop, ev);
-                break; */
+                goto out;
             default:
                 BVR_ERROR("cb returned a invalid value\n");
                 goto recv_error;
         }
-    } else {
-        conn_ev->toread = left;
-        conn_ev->rcvd = tot_rcvd;
     }
 
+out:
+    if (corked) {
+        set_cork(ev->fd, 0);
+    }
     return;
 
 recv_error:
-    ev_io_stop(loop, ev);
+    conn_close(loop, conn_ev);
+    return;
+}
 
-    close(ev->fd);
-    if (conn_ev->needfree) {
-        free(conn_ev->buf);
+
+/*
+ * send a chunk of the streamed reply of a connection each time it can be
+ * written, other connections are served in between. at the end of the
+ * stream, go back to reading messages
+ */
+static void bvr_ctl_do_send(struct ev_loop *loop, ev_io *ev, int events)
+{
+    struct conn_ev *conn_ev = (struct conn_ev *)ev;
+
+    if (events & EV_ERROR) {
+        conn_close(loop, conn_ev);
+        return;
     }
 
-    conn_ev->listen_ev->n_conn--;
-    BVR_DEBUG("close connection, now %u connections\n", conn_ev->listen_ev->n_conn);
-    free(ev);
+    if ((events & EV_WRITE) == 0)
+        return;
 
+    set_cork(ev->fd, 1);
+    if (stream_next(conn_ev) < 0) {
+        conn_close(loop, conn_ev);
+        return;
+    }
+    set_cork(ev->fd, 0);
 
-    return;
+    if (conn_ev->stream == NULL) {
+        recv_until(conn_ev, &conn_ev->msg_prefix, sizeof(conn_ev->msg_prefix), handle_prefix);
+        ev_io_stop(loop, ev);
+        ev_set_cb(ev, bvr_ctl_do_recv);
+        ev_io_set(ev, ev->fd, EV_READ);
+        ev_io_start(loop, ev);
+    }
 }
 
 
+/*
+ * @brief check the fields of a message prefix, but its length
+ * @return 0 if the prefix is valid
+ */
+static int check_prefix(nn_msg_prefix_t *prefix)
+{
+    if (prefix->magic_num != NN_MSG_MAGIC_NUM) {
+        BVR_WARNING("Messsage magic number incorrect, %d\n",prefix->magic_num );
+        return -1;
+    }
+
+    if (prefix->version != NN_CTL_VERSION && prefix->version != NN_CTL_VERSION_BIN) {
+        BVR_WARNING("Message version unrecognised: %u\n", prefix->version);
+        return -1;
+    }
+
+    if (prefix->cmd_id == NN_CMD_ID_NO_CMD || prefix->cmd_id >= NN_CMD_ID_MAX_CMD) {
+        BVR_WARNING("Message cmd id unrecognised: %u\n", prefix->cmd_id);
+        return -1;
+    }
+
+    return 0;
+}
+
 
 /*
- * event callback. handles the entire message body, including all the commands
+ * @brief run the command of the message in ev, its handler sends the reply
+ *        or starts streaming it, see stream_start(). the reply goes out after
+ *        the locks of the command are released, see ctl_reply()
  */
-static int handle_msg(struct conn_ev *ev)
+static void dispatch_msg(struct conn_ev *ev)
 {
     int cmd_id;
+    const nn_bin_handler_info_t *bin;
+    const nn_msg_handler_info_t *info;
+    struct ctl_held held;
 
     cmd_id = ev->msg_prefix.cmd_id;
 
-    if (g_msg_handler_tbl_pr[cmd_id].handler) {
-        g_msg_handler_tbl_pr[cmd_id].handler(ev);
-    } else {
-        ev->msg_prefix.msg_len = 0;
-        ev->msg_prefix.ret_state = NN_CMD_ID_NO_CMD;
-        BVR_WARNING("no cmd find,cmd id %d\n",ev->msg_prefix.cmd_id);
-        if (send_bytes(ev->ev.fd, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0) {
-            BVR_ERROR("send ret message failed\n");
+    /*a batch holds messages of both encodings*/
+    if (ev->msg_prefix.version == NN_CTL_VERSION_BIN && cmd_id != NN_CMD_ID_BATCH) {
+        bin = &g_msg_bin_handler_tbl[cmd_id];
+        if (bin->handler || bin->apply) {
+            /*each record locks its namespace or vni*/
+            pthread_rwlock_rdlock(&g_ctl_lock);
+            ev->reply_defer = 1;
+            if (bin->handler) {
+                bin->handler(ev);
+            } else {
+                bin_run_records(ev, bin);
+            }
+            pthread_rwlock_unlock(&g_ctl_lock);
+            ctl_reply_flush(ev);
+            return;
         }
+    } else if (g_msg_handler_tbl_pr[cmd_id].handler) {
+        info = &g_msg_handler_tbl_pr[cmd_id];
+        if (info->lock == NN_CTL_LOCK_NONE) {
+            info->handler(ev);
+            return;
+        }
+        ctl_lock(ev, info->lock, &held);
+        ev->reply_defer = 1;
+        info->handler(ev);
+        ctl_unlock(&held);
+        ctl_reply_flush(ev);
+        /*a body the handler did not take*/
+        cJSON_Delete(ev->root);
+        ev->root = NULL;
+        return;
     }
-    return NN_EVCB_RET_CLOSE;
 
+    ev->msg_prefix.msg_len = 0;
+    ev->msg_prefix.ret_state = NN_CMD_ID_NO_CMD;
+    BVR_WARNING("no cmd find,cmd id %d\n",ev->msg_prefix.cmd_id);
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0) {
+        BVR_ERROR("send ret message failed\n");
+    }
 }
 
 
 /*
- * event callback. handles message prefix
+ * @brief run the commands of a batch in order, see NN_CMD_ID_BATCH
+ * @return 0 on success, -1 return status error
  */
-static int handle_prefix(struct conn_ev *ev)
+static u32 bvr_cmd_batch(struct conn_ev *ev)
 {
-    nn_msg_prefix_t *prefix = &ev->msg_prefix;
+    nn_msg_prefix_t batch = ev->msg_prefix;
+    char *body = ev->buf;
+    u32 off = 0, len, failed = 0;
+    int ret = 0;
+    char next;
 
-    if (prefix->magic_num != NN_MSG_MAGIC_NUM) {
-        BVR_WARNING("Messsage magic number incorrect, %d\n",prefix->magic_num );
-        return NN_EVCB_RET_CLOSE;
+    while (off < batch.msg_len) {
+        if (batch.msg_len - off < sizeof(nn_msg_prefix_t)) {
+            ret = -NN_EPARSECMD;
+            break;
+        }
+        memcpy(&ev->msg_prefix, body + off, sizeof(nn_msg_prefix_t));
+        off += sizeof(nn_msg_prefix_t);
+        len = ev->msg_prefix.msg_len;
+        if (check_prefix(&ev->msg_prefix) || ev->msg_prefix.cmd_id == NN_CMD_ID_BATCH
+            || len > batch.msg_len - off) {
+            ret = -NN_EPARSECMD;
+            break;
+        }
+
+        /*terminate the json body in place, over the next prefix for a while*/
+        ev->buf = body + off;
+        next = body[off + len];
+        body[off + len] = '\0';
+        dispatch_msg(ev);
+        /*the items after a streamed reply wait for its end*/
+        while (ev->stream != NULL) {
+            if (stream_next(ev) < 0) {
+                break;
+            }
+        }
+        body[off + len] = next;
+
+        if (ev->msg_prefix.ret_state != 0) {
+            failed++;
+        }
+        off += len;
     }
 
-    if (prefix->msg_len == 0 || prefix->msg_len > NN_CTL_MAX_MSG_LENGTH) {
-        BVR_WARNING("Message len too small or too large: %u\n", prefix->msg_len);
-        return NN_EVCB_RET_CLOSE;
+    ev->buf = body;
+    ev->msg_prefix = batch;
+    ev->msg_prefix.msg_len = 0;
+    ev->msg_prefix.ret_state = ret ? (u32)ret : failed;
+    if (ctl_reply(ev, (u8 *)&ev->msg_prefix, sizeof(ev->msg_prefix)) < 0) {
+        BVR_ERROR("send ret message failed\n");
+        return -1;
     }
+    return 0;
+}
 
-    if (prefix->version != NN_CTL_VERSION) {
-        BVR_WARNING("Message version unrecognised: %u\n", prefix->version);
-        return NN_EVCB_RET_CLOSE;
+
+/*
+ * event callback. handles the entire message body, including all the commands,
+ * then waits for the next message of the connection
+ */
+static int handle_msg(struct conn_ev *ev)
+{
+    /*the buffer has room for a nul after the json body*/
+    ((char *)ev->msg_buf)[ev->msg_prefix.msg_len] = '\0';
+    dispatch_msg(ev);
+
+    if (ev->msg_buf_size > NN_CTL_KEEP_BUF_SIZE) {
+        free(ev->msg_buf);
+        ev->msg_buf = NULL;
+        ev->msg_buf_size = 0;
     }
 
-    if (prefix->cmd_id == NN_CMD_ID_NO_CMD || prefix->cmd_id >= NN_CMD_ID_MAX_CMD) {
-        BVR_WARNING("Message cmd id unrecognised: %u\n", prefix->cmd_id);
-        return NN_EVCB_RET_CLOSE;
+    if (ev->stream != NULL) {
+        return NN_EVCB_RET_SEND;
     }
 
+    recv_until(ev, &ev->msg_prefix, sizeof(ev->msg_prefix), handle_prefix);
+    return NN_EVCB_RET_RECV;
+}
+
+
+/*
+ * event callback. handles message prefix
+ */
+static int handle_prefix(struct conn_ev *ev)
+{
+    nn_msg_prefix_t *prefix = &ev->msg_prefix;
+
+    if (check_prefix(prefix)) {
+        return NN_EVCB_RET_CLOSE;
+    }
 
-    ev->buf = malloc(prefix->msg_len);
-    if(ev->buf == NULL) {
-        BVR_ERROR("Malloc buf for receiving message failed\n");
+    /*binary show commands have no body*/
+    if ((prefix->msg_len == 0 && prefix->version != NN_CTL_VERSION_BIN) ||
+        prefix->msg_len > NN_CTL_MAX_MSG_LENGTH) {
+        BVR_WARNING("Message len too small or too large: %u\n", prefix->msg_len);
         return NN_EVCB_RET_CLOSE;
     }
 
-    recv_until(ev, ev->buf, prefix->msg_len, 1, handle_msg);
+    if (prefix->msg_len + 1 > ev->msg_buf_size) {
+        free(ev->msg_buf);
+        ev->msg_buf_size = 0;
+        ev->msg_buf = malloc(prefix->msg_len + 1);
+        if(ev->msg_buf == NULL) {
+            BVR_ERROR("Malloc buf for receiving message failed\n");
+            return NN_EVCB_RET_CLOSE;
+        }
+        ev->msg_buf_size = prefix->msg_len + 1;
+    }
+
+    recv_until(ev, ev->msg_buf, prefix->msg_len, handle_msg);
 
     return NN_EVCB_RET_RECV;
 }
@@ -3475,7 +5919,10 @@ static void bvr_ctl_do_accept(struct ev_loop *loop, ev_io *ev, int events)
 
     conn = accept(ev->fd, (struct sockaddr *)&addr, &addr_size);
     if (conn < 0) {
-        BVR_ERROR("accept failed\n");
+        /*another control thread took the connection*/
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            BVR_ERROR("accept failed\n");
+        }
         return;
     }
 
@@ -3505,7 +5952,15 @@ static void bvr_ctl_do_accept(struct ev_loop *loop, ev_io *ev, int events)
         return;
     }
     new_ev->listen_ev = listen_ev;
-    recv_until(new_ev, &new_ev->msg_prefix, sizeof(new_ev->msg_prefix), 0, handle_prefix);
+    new_ev->msg_buf = NULL;
+    new_ev->msg_buf_size = 0;
+    new_ev->stream = NULL;
+    new_ev->root = NULL;
+    new_ev->reply = NULL;
+    new_ev->reply_len = 0;
+    new_ev->reply_size = 0;
+    new_ev->reply_defer = 0;
+    recv_until(new_ev, &new_ev->msg_prefix, sizeof(new_ev->msg_prefix), handle_prefix);
     ev_io_init(&new_ev->ev, bvr_ctl_do_recv, conn, EV_READ);
     ev_io_start(loop, &new_ev->ev);
 
@@ -3521,13 +5976,83 @@ static void bvr_ctl_do_accept(struct ev_loop *loop, ev_io *ev, int events)
 
 
 
+static time_t g_ctl_snap_next;
+static volatile int g_ctl_snap_busy;
+
+/*
+ * @brief write the snapshot when it is due, or on SIGTERM before exiting.
+ *        one control thread does it while the others wait for the lock
+ */
+static void bvr_ctl_snapshot(void)
+{
+    const char *path = g_bvrouter_conf_info.snapshot_file;
+    u32 itl = g_bvrouter_conf_info.snapshot_itl;
+    int exiting = g_bvr_snap_exit;
+    time_t now;
+
+    if (!exiting && (path[0] == '\0' || itl == 0)) {
+        return;
+    }
+    now = time(NULL);
+    if ((!exiting && now < g_ctl_snap_next) ||
+        !__sync_bool_compare_and_swap(&g_ctl_snap_busy, 0, 1)) {
+        return;
+    }
+    if (!exiting && g_ctl_snap_next == 0) {
+        /*the state loaded at startup is on disk already*/
+        g_ctl_snap_next = now + itl;
+    } else if (exiting || now >= g_ctl_snap_next) {
+        pthread_rwlock_wrlock(&g_ctl_lock);
+        if (path[0] != '\0') {
+            bvr_snapshot_save(path);
+        }
+        if (exiting) {
+            bvr_ctl_exit("SIGTERM");
+        }
+        pthread_rwlock_unlock(&g_ctl_lock);
+        g_ctl_snap_next = now + itl;
+    }
+    g_ctl_snap_busy = 0;
+}
+
+/*
+ * drive the pal timers of the control thread, e.g. fdb ageing, free the
+ * objects whose grace period is over and write the snapshot
+ */
+static void bvr_ctl_do_timer(__unused struct ev_loop *loop, __unused ev_timer *ev,
+                __unused int events)
+{
+    lock_vxlan_timer();
+    run_timer(NN_CTL_TIMER_BUDGET);
+    unlock_vxlan_timer();
+    pal_qsbr_reclaim();
+    bvr_ctl_snapshot();
+}
+
+
+static pthread_once_t g_ctl_listen_once = PTHREAD_ONCE_INIT;
+static int g_ctl_listenfd = -1;
+
+static void bvr_ctl_listen(void)
+{
+    g_ctl_listenfd = tcp_server_create(NN_CTL_LISTEN_PORT);
+}
+
+
+/*
+ * run by each control thread. the threads share the listen socket, each
+ * one serves the connections it accepts, see g_ctl_lock for the commands
+ * running meanwhile on the others
+ */
 int bvr_controlplane_process(void)
 {
     int listenfd;
     struct ev_loop *loop;
     struct listen_ev listen_ev;
+    ev_timer timer_ev;
 
-    listenfd =  tcp_server_create(NN_CTL_LISTEN_PORT);
+    pthread_once(&g_ctl_listen_once, bvr_ctl_listen);
+    listenfd = g_ctl_listenfd;
     if (listenfd < 0) {
         return -1;
     }
@@ -3539,6 +6064,9 @@ int bvr_controlplane_process(void)
     listen_ev.n_conn = 0;
     ev_io_init(&listen_ev.ev, bvr_ctl_do_accept, listenfd, EV_READ);
     ev_io_start(loop, &listen_ev.ev);
+
+    ev_timer_init(&timer_ev, bvr_ctl_do_timer, 0., NN_CTL_TIMER_INTERVAL);
+    ev_timer_start(loop, &timer_ev);
     while (1) {
         ev_run(loop, 0);
         BVR_WARNING("ev_run returned!\n");
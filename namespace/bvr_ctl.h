@@ -28,8 +28,47 @@
 
 #define NN_MSG_MAGIC_NUM 0x20140101
 #define NN_CTL_MAX_MSG_LENGTH       (64 * 1024 * 1024)
+/*body buffers up to this size are kept by a connection for its next messages*/
+#define NN_CTL_KEEP_BUF_SIZE        (64 * 1024)
+/*sizes of the names in messages, nul included*/
+#define NN_BIN_NS_NAME_SIZE         104
+#define NN_BIN_IF_NAME_SIZE         64
 
+/*
+ * A connection carries any number of messages, each one answered in order
+ * by a reply prefix and its body. The client closes it when done.
+ *
+ * The body of a NN_CMD_ID_BATCH message is a series of messages, prefix
+ * and body, run in order. Each gets its own reply, then the batch gets a
+ * reply without body whose ret_state is the number of commands which
+ * failed, or -NN_EPARSECMD if an item is malformed: the items before it
+ * are done and answered, the ones after it are not run.
+ *
+ * The show commands of fdb entries, arp entries, interfaces and filter
+ * rules stream their reply when the json body holds "stream": n. The reply
+ * is then a series of replies of up to n entries each, a json array, the
+ * last one with ret_state 0 or an error and the others NN_CTL_RET_MORE.
+ * The router serves its other connections between them, and holds the
+ * locks of the dumped table per chunk only, so a streamed dump is not a
+ * snapshot: entries changed meanwhile may be missed or sent twice.
+ *
+ * A NN_CMD_ID_SYNC_NAMESPACE message holds the desired state of namespace
+ * "bvrouter": arrays "interfaces", "routes", "nat", "filter", "fdb" and
+ * "arp" of the bodies of the add commands, without "bvrouter" and "table",
+ * and with "type" "int" or "ext" for an interface. A table left out is not
+ * synced, an empty one is flushed. The routes are the static ones, the fdb
+ * entries the static ones, and fdb and arp entries those of the vnis of the
+ * internal interfaces of the namespace. The router changes the entries
+ * which differ only, then replies {"generation", "added", "deleted",
+ * "failed"} with ret_state 0 or the first error. Nothing is changed if the
+ * message is malformed, or if its "generation" is older than the one of
+ * the last sync fully applied. The other commands on the namespace and its
+ * vnis wait for the sync, packets see its changes one by one.
+ */
+#define NN_CTL_RET_MORE             0x40000000
+#define NN_CTL_STREAM_MAX           4096    /*entries per chunk*/
 
+struct cJSON;
 
 typedef struct nn_msg_prefix {
     u32     msg_len;        /* length of msg, not include the prefix part */
@@ -51,9 +90,37 @@ struct conn_ev {
     nn_msg_prefix_t msg_prefix;
     u32         rcvd;       /* bytes already read after read_until call */
     u32         toread;     /* bytes left to be read before calling cb */
-    int         needfree;   /* if this is 1, buf pointer must be freed on error */
     int         (* cb)(struct conn_ev *ev);
     void        *buf;
+    void        *msg_buf;   /* body buffer, kept between messages */
+    u32         msg_buf_size;
+
+    /* streamed reply in progress, see NN_CTL_RET_MORE */
+    int         (* stream)(struct conn_ev *ev, struct cJSON *chunk);
+    u32         stream_cursor;  /* entries already sent */
+    u32         stream_limit;   /* entries per chunk */
+    u32         stream_arg;     /* vni of the fdb and arp dumps */
+    char        stream_net[NN_BIN_NS_NAME_SIZE];
+
+    /* json body of the command being run, parsed once, see ctl_body() */
+    struct cJSON *root;
+    /* reply held until the locks of the command are released, see ctl_reply() */
+    char        *reply;
+    u32         reply_len;
+    u32         reply_size;
+    int         reply_defer;
+};
+
+/* locks taken for a command before its handler runs, see dispatch_msg() */
+enum {
+    NN_CTL_LOCK_GLOBAL = 0,     /* the whole router */
+    NN_CTL_LOCK_SHARED,         /* none but the whole router against GLOBAL */
+    NN_CTL_LOCK_NS,             /* and the namespace of "name" */
+    NN_CTL_LOCK_NET,            /* and the namespace of "bvrouter" */
+    NN_CTL_LOCK_VNI,            /* and the vni of "vni" */
+    NN_CTL_LOCK_NET_VNI,        /* and both */
+    NN_CTL_LOCK_NET_IF,         /* and "bvrouter", and the vni of interface "ifname" */
+    NN_CTL_LOCK_NONE,           /* the handler takes its locks */
 };
 
 #define NAME_SIZE 64
@@ -61,8 +128,17 @@ typedef struct nn_msg_handler_info_s
 {
     u32 (*handler)(struct conn_ev *ev);
     u8  name[NAME_SIZE];
+    int lock;                   /* NN_CTL_LOCK_* */
 } nn_msg_handler_info_t;
 
+typedef struct nn_bin_handler_info_s
+{
+    u32 rec_size;                       /* size of the records of the body */
+    int (*apply)(const void *rec);      /* run one record, return its status */
+    u32 (*handler)(struct conn_ev *ev); /* or handle the whole message */
+    u8  name[NAME_SIZE];
+} nn_bin_handler_info_t;
+
 enum {
 
     NN_CMD_ID_TEST              = 1,
@@ -97,6 +173,13 @@ enum {
     NN_CMD_ID_SET_PORT_LINK_STATUS = 29,
     NN_CMD_ID_ADD_ROUTE         = 30,   /*add route item*/
     NN_CMD_ID_DEL_ROUTE         = 31,   /*delete route item*/
+    NN_CMD_ID_SET_FDB_LEARNING  = 32,   /*enable/disable fdb learning of a vni*/
+    NN_CMD_ID_SET_MSS_CLAMP     = 33,   /*set tcp mss clamp of a namespace or interface*/
+    NN_CMD_ID_SHOW_REASM_STATS  = 34,   /*show ip reassembly tables of datapath cores*/
+    NN_CMD_ID_BATCH             = 35,   /*run the commands in the body in order*/
+    NN_CMD_ID_SYNC_NAMESPACE    = 36,   /*sync a namespace to the desired state in the body*/
+    NN_CMD_ID_SAVE_SNAPSHOT     = 37,   /*write the snapshot of the control state*/
+    NN_CMD_ID_SHOW_SLAB_STATS   = 38,   /*show usage of the slabs*/
 
     NN_CMD_ID_MAX_CMD,
 
@@ -112,6 +195,106 @@ enum {
 
 
 #define NN_CTL_VERSION 0x1122
+#define NN_CTL_VERSION_BIN 0x2122
+
+/*
+ * Binary encoding of the bulk commands, for controllers. A message whose
+ * version is NN_CTL_VERSION_BIN has a body made of fixed size records, one
+ * command each. Ip addresses are in network byte order, other integers in
+ * the byte order of the router, names are nul terminated.
+ *
+ * The reply body holds one s32 status per record, ret_state is the number
+ * of records which failed, or -NN_EPARSECMD if the body is not a whole
+ * number of records. Show commands take an empty body and reply records.
+ * A command without binary form is answered NN_CMD_ID_NO_CMD, the client
+ * falls back to json.
+ */
+
+/* NN_CMD_ID_ADD_FDB_ENTRY, NN_CMD_ID_DEL_FDB_ENTRY */
+struct nn_bin_fdb {
+    u32     vni;
+    u32     remote_ip;      /* ignored by delete */
+    u16     remote_port;    /* ignored by delete */
+    u8      mac[6];
+} __attribute__((packed));
+
+/* NN_CMD_ID_ADD_ARP_ENTRY, NN_CMD_ID_DEL_ARP_ENTRY */
+struct nn_bin_arp {
+    u32     vni;
+    u32     ip;
+    u8      mac[6];         /* ignored by delete */
+    u16     pad;
+} __attribute__((packed));
+
+/* NN_CMD_ID_ADD_ROUTE, NN_CMD_ID_DEL_ROUTE */
+struct nn_bin_route {
+    char    bvrouter[NN_BIN_NS_NAME_SIZE];
+    char    ifname[NN_BIN_IF_NAME_SIZE];   /* empty for none, ignored by delete */
+    u32     prefix;
+    u32     nexthop;        /* 0 for none, ignored by delete */
+    u8      prefixlen;
+    u8      pad[3];
+} __attribute__((packed));
+
+enum {
+    NN_BIN_TABLE_NAT        = 0,
+    NN_BIN_TABLE_FILTER     = 1,
+};
+
+/* fields matched by a filter rule, addresses are matched if their plen is set */
+#define NN_BIN_NF_SPORT         0x1
+#define NN_BIN_NF_DPORT         0x2
+#define NN_BIN_NF_PROTO         0x4
+
+/* NN_CMD_ID_ADD_NF_RULE, NN_CMD_ID_DEL_NF_RULE */
+struct nn_bin_nf_rule {
+    char    bvrouter[NN_BIN_NS_NAME_SIZE];
+    u8      table;          /* NN_BIN_TABLE_* */
+    u8      hook_num;
+    u8      target;         /* nat: NF_SNAT or NF_DNAT, filter: NF_DROP, NF_ACCEPT, NF_DUMP */
+    u8      flags;          /* filter: NN_BIN_NF_* */
+    u32     ip[2];          /* nat: original and nat prefixes, filter: sip and dip */
+    u8      plen[2];
+    u8      dir;            /* filter only from here */
+    u8      proto;
+    u16     priority;       /* 0 for the default */
+    u16     sport[2];       /* port ranges */
+    u16     dport[2];
+} __attribute__((packed));
+
+/* NN_CMD_ID_SHOW_IFS_STAT reply */
+struct nn_bin_if_stat {
+    u32     port_id;
+    u32     pad;
+    u64     rxpkts;
+    u64     rxbytes;
+    u64     rxmissed;
+    u64     rxbadcrc;
+    u64     rxbadlen;
+    u64     rxerrors;
+    u64     txpkts;
+    u64     txbytes;
+    u64     txerrors;
+} __attribute__((packed));
+
+/* NN_CMD_ID_SHOW_IFS reply, one record per interface of every router */
+struct nn_bin_vport_stat {
+    char    bvrouter[NN_BIN_NS_NAME_SIZE];
+    char    ifname[NN_BIN_IF_NAME_SIZE];
+    u32     vni;            /* 0 for a phy interface */
+    u8      type;           /* PHY_VPORT or VXLAN_VPORT */
+    u8      pad[3];
+    u64     rx_packets;
+    u64     tx_packets;
+    u64     rx_bytes;
+    u64     tx_bytes;
+    u64     rx_errors;
+    u64     tx_errors;
+    u64     rx_dropped;
+    u64     tx_dropped;
+} __attribute__((packed));
+
+extern nn_bin_handler_info_t g_msg_bin_handler_tbl[NN_CMD_ID_MAX_CMD];
 
 int bvr_controlplane_process(void);
 
@@ -0,0 +1,170 @@
+/**
+**********************************************************************
+*
+* Copyright (c) 2014 Baidu.com, Inc. All Rights Reserved
+* @file         $HeadURL: $
+* @brief        cache of the forwarding decisions of flows
+* @author       zhangyu(zhangyu09@baidu.com)
+* @date         $Date:$
+* @version      $Id: $
+***********************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <rte_malloc.h>
+
+#include "pal_thread.h"
+#include "pal_skb.h"
+#include "pal_pktdef.h"
+#include "pal_utils.h"
+#include "bvr_flow.h"
+
+/*cache of one packet thread, only touched by that thread*/
+struct bvr_flow_table {
+    struct bvr_flow flow[BVR_FLOW_SETS][BVR_FLOW_WAYS];
+    u8 victim[BVR_FLOW_SETS];   /*next way replaced in each set*/
+};
+
+static struct bvr_flow_table *g_bvr_flow_table[PAL_MAX_THREAD];
+static volatile u32 g_bvr_flow_epoch = 1;
+
+PAL_DEFINE_PER_THREAD(struct bvr_flow_rec, _flow_rec);
+
+static inline int bvr_flow_key_eq(const struct bvr_flow_key *a, const struct bvr_flow_key *b)
+{
+    const u64 *x = (const u64 *)a;
+    const u64 *y = (const u64 *)b;
+
+    BUILD_BUG_ON(sizeof(struct bvr_flow_key) != 3 * sizeof(u64));
+    return x[0] == y[0] && x[1] == y[1] && x[2] == y[2];
+}
+
+static inline struct bvr_flow *bvr_flow_set(struct bvr_flow_table *table,
+    const struct bvr_flow_key *key, u32 *set)
+{
+    *set = pal_hash_crc((void *)key, sizeof(*key)) & (BVR_FLOW_SETS - 1);
+    return table->flow[*set];
+}
+
+/*
+ * @brief key of a pkt, only udp, and tcp without syn, fin or rst are cached
+ * @return 0 if the pkt may be cached
+ */
+static int bvr_flow_key_init(struct bvr_flow_key *key, struct sk_buff *skb, struct vport *in)
+{
+    struct ip_hdr *iph = skb_ip_header(skb);
+    struct tcp_hdr *tcph;
+    struct udp_hdr *udph;
+
+    if (ip_is_fragment(iph)) {
+        return -1;
+    }
+
+    if (iph->protocol == PAL_IPPROTO_TCP) {
+        if (!pskb_may_pull(skb, sizeof(struct tcp_hdr))) {
+            return -1;
+        }
+        tcph = skb_tcp_header(skb);
+        if (tcph->syn || tcph->fin || tcph->rst) {
+            return -1;
+        }
+        key->sport = tcph->source;
+        key->dport = tcph->dest;
+    } else if (iph->protocol == PAL_IPPROTO_UDP) {
+        if (!pskb_may_pull(skb, sizeof(struct udp_hdr))) {
+            return -1;
+        }
+        udph = skb_udp_header(skb);
+        key->sport = udph->source;
+        key->dport = udph->dest;
+    } else {
+        return -1;
+    }
+
+    key->in = (u64)(unsigned long)in;
+    key->saddr = iph->saddr;
+    key->daddr = iph->daddr;
+    key->proto = iph->protocol;
+    memset(key->pad, 0, sizeof(key->pad));
+    return 0;
+}
+
+struct bvr_flow *bvr_flow_lookup(struct net *net, struct sk_buff *skb, struct vport *in)
+{
+    struct bvr_flow_table *table = g_bvr_flow_table[pal_thread_id()];
+    struct bvr_flow_rec *rec = &PAL_PER_THREAD(_flow_rec);
+    struct bvr_flow *set;
+    u32 i, idx;
+
+    rec->active = 0;
+    if (table == NULL || bvr_flow_key_init(&rec->flow.key, skb, in)) {
+        return NULL;
+    }
+
+    set = bvr_flow_set(table, &rec->flow.key, &idx);
+    for (i = 0; i < BVR_FLOW_WAYS; i++) {
+        if (set[i].gen == net->flow_gen && set[i].epoch == g_bvr_flow_epoch &&
+            bvr_flow_key_eq(&set[i].key, &rec->flow.key)) {
+            return &set[i];
+        }
+    }
+
+    /*the generation is read before the pipeline runs, so a change made
+      while the pkt is on its way drops the entry*/
+    rec->active = 1;
+    rec->flow.gen = net->flow_gen;
+    rec->flow.epoch = g_bvr_flow_epoch;
+    rec->flow.n_counter = 0;
+    rec->flow.out = NULL;
+    rec->flow.next_hop = 0;
+    return NULL;
+}
+
+void __bvr_flow_rec_commit(struct bvr_flow_rec *rec, struct sk_buff *skb, struct vport *out)
+{
+    struct bvr_flow_table *table = g_bvr_flow_table[pal_thread_id()];
+    struct ip_hdr *iph = skb_ip_header(skb);
+    struct bvr_flow *set, *flow = NULL;
+    u32 i, idx;
+
+    rec->active = 0;
+
+    set = bvr_flow_set(table, &rec->flow.key, &idx);
+    for (i = 0; i < BVR_FLOW_WAYS; i++) {
+        if (bvr_flow_key_eq(&set[i].key, &rec->flow.key)) {
+            flow = &set[i];
+            break;
+        }
+    }
+    if (flow == NULL) {
+        flow = &set[table->victim[idx]];
+        table->victim[idx] = (table->victim[idx] + 1) % BVR_FLOW_WAYS;
+    }
+
+    memcpy(flow, &rec->flow, sizeof(*flow));
+    flow->out = out;
+    if (out == NULL) {
+        flow->next_hop = 0;
+    }
+    flow->saddr = iph->saddr;
+    flow->daddr = iph->daddr;
+    flow->dnat = skb->dnat_flag;
+}
+
+void bvr_flow_flush(void)
+{
+    __sync_add_and_fetch(&g_bvr_flow_epoch, 1);
+}
+
+int bvr_flow_thread_init(int tid)
+{
+    g_bvr_flow_table[tid] = rte_zmalloc_socket(NULL, sizeof(struct bvr_flow_table),
+        CACHE_LINE_SIZE, pal_tid_to_numa(tid));
+    if (g_bvr_flow_table[tid] == NULL) {
+        PAL_ERROR("flow cache init error on thread %d\n", tid);
+        return -1;
+    }
+
+    return 0;
+}
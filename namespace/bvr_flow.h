@@ -0,0 +1,145 @@
+/**
+**********************************************************************
+*
+* Copyright (c) 2014 Baidu.com, Inc. All Rights Reserved
+* @file         $HeadURL: $
+* @brief        cache of the forwarding decisions of flows
+* @author       zhangyu(zhangyu09@baidu.com)
+* @date         $Date:$
+* @version      $Id: $
+***********************************************************************
+*/
+
+#ifndef BVR_FLOW_H
+#define BVR_FLOW_H
+
+#include <rte_memory.h>
+#include "pal_thread.h"
+#include "bvr_namespace.h"
+
+/*
+ * Each packet thread remembers what the pipeline did to the flows it
+ * forwards: the addresses after nat, the output vport and next hop, and
+ * the rule counters to bump. The next packets of a flow skip the hooks
+ * and the route lookup.
+ *
+ * The first packet of a flow records the decisions on its way through the
+ * pipeline and the entry is written when it is sent, or dropped by a filter
+ * rule. A stage doing anything else to the packet calls bvr_flow_rec_abort().
+ * An entry is only used at the generation of its net it was recorded at,
+ * see net_flow_invalidate().
+ *
+ * Only udp and established tcp packets are cached, no fragments, so that
+ * syn and fin still go through conntrack and mss clamping.
+ */
+
+/*entries of one packet thread*/
+#define BVR_FLOW_SETS               (1U << 12)
+#define BVR_FLOW_WAYS               4
+/*rule counters of a flow: nat in pre and post routing, filter in all three*/
+#define BVR_FLOW_COUNTERS           5
+
+struct bvr_flow_key {
+    u64 in;             /*input vport*/
+    u32 saddr;
+    u32 daddr;
+    u16 sport;
+    u16 dport;
+    u8 proto;
+    u8 pad[3];
+};
+
+struct vport;
+struct sk_buff;
+struct ipt_counter;
+
+struct bvr_flow {
+    struct bvr_flow_key key;
+    u64 gen;                    /*generation of the net, 0 if empty*/
+    u32 epoch;                  /*see bvr_flow_flush()*/
+    u32 saddr;                  /*addresses after nat*/
+    u32 daddr;
+    u32 next_hop;               /*mac looked up per pkt, 0 to keep it*/
+    u8 dnat;
+    u8 n_counter;
+    struct vport *out;          /*NULL to drop*/
+    struct ipt_counter *counter[BVR_FLOW_COUNTERS];
+} __rte_cache_aligned;
+
+/*flow of the pkt being forwarded by a thread, while it is cacheable*/
+struct bvr_flow_rec {
+    int active;
+    struct bvr_flow flow;
+};
+
+PAL_DECLARE_PER_THREAD(struct bvr_flow_rec, _flow_rec);
+
+static inline void bvr_flow_rec_abort(void)
+{
+    PAL_PER_THREAD(_flow_rec).active = 0;
+}
+
+/*
+ * @brief a rule counter bumped for the pkt, bumped again on hits
+ */
+static inline void bvr_flow_rec_counter(struct ipt_counter *counter)
+{
+    struct bvr_flow_rec *rec = &PAL_PER_THREAD(_flow_rec);
+
+    if (!rec->active) {
+        return;
+    }
+    if (rec->flow.n_counter == BVR_FLOW_COUNTERS) {
+        rec->active = 0;
+        return;
+    }
+    rec->flow.counter[rec->flow.n_counter++] = counter;
+}
+
+/*
+ * @brief the route of the pkt
+ * @param next_hop gateway whose mac is set in the pkt, 0 if none
+ */
+static inline void bvr_flow_rec_route(struct vport *out, u32 next_hop)
+{
+    struct bvr_flow_rec *rec = &PAL_PER_THREAD(_flow_rec);
+
+    rec->flow.out = out;
+    rec->flow.next_hop = next_hop;
+}
+
+void __bvr_flow_rec_commit(struct bvr_flow_rec *rec, struct sk_buff *skb, struct vport *out);
+
+/*
+ * @brief cache the decisions taken for the pkt, called when it is sent
+ * @param out output vport, NULL if a filter rule drops the pkt
+ */
+static inline void bvr_flow_rec_commit(struct sk_buff *skb, struct vport *out)
+{
+    struct bvr_flow_rec *rec = &PAL_PER_THREAD(_flow_rec);
+
+    if (rec->active) {
+        __bvr_flow_rec_commit(rec, skb, out);
+    }
+}
+
+/*
+ * @brief find the flow of a pkt in the cache of this thread. on a miss
+ *        the pkt is recorded if its flow can be cached.
+ *        skb data must point to the l4 header
+ * @return the flow, NULL on a miss
+ */
+struct bvr_flow *bvr_flow_lookup(struct net *net, struct sk_buff *skb, struct vport *in);
+
+/*
+ * @brief drop the entries of all nets, when something global to the
+ *        pipeline changes (alg helpers)
+ */
+void bvr_flow_flush(void);
+
+/*
+ * @brief create the cache of a packet thread, run on that thread
+ */
+int bvr_flow_thread_init(int tid);
+
+#endif
@@ -15,14 +15,17 @@
 #include <arpa/inet.h>
 #include "bvr_namespace.h"
 #include "pal_vport.h"
+#include "pal_vxlan.h"
 #include "pal_skb.h"
 #include "pal_pktdef.h"
+#include "pal_csum.h"
 #include "pal_route.h"
 #include "pal_byteorder.h"
 #include "pal_utils.h"
 #include "bvr_arp.h"
 #include "bvr_ipv4.h"
 #include "bvr_netfilter.h"
+#include "bvr_flow.h"
 #include "logger.h"
 //#include "logger.h"
 
@@ -94,14 +97,15 @@ static int icmp_reply(struct sk_buff *skb)
 
 	BVR_DEBUG("in icmp handler\n");
 	/* icmp content must be more then 8 bytes */
-	if (icmp_len >= 8 && icmp_len <= skb_len(skb)) {
+	if (icmp_len >= 8 && icmp_len <= skb_pkt_len(skb)) {
 		/* we only handle icmp echo request */
 		if (icmph->type == ICMP_ECHO) {
-			if (icmp_check_sum_correct((u16 *)icmph, icmp_len)) {
+			/* large echo requests may span several segments */
+			if (skb_csum_correct(skb, 0, icmp_len)) {
 				icmph->type = ICMP_ECHOREPLY;
 
 				/* update icmp check sum*/
-				icmph->checksum = icmph->checksum + htons(0x0800);
+				pal_csum_replace2(&icmph->checksum, htons(ICMP_ECHO << 8), htons(ICMP_ECHOREPLY << 8));
 
 				/* Exchange ip addresses */
 				tmp_addr = iph->saddr;
@@ -131,7 +135,94 @@ static int icmp_reply(struct sk_buff *skb)
 }
 
 
-static int ip_output_finish(struct sk_buff *skb, __unused struct vport *in, struct vport *out)
+/*
+ * @brief Get the mss clamp of a vport. Only internal vports are clamped,
+ *        their own value overrides the namespace's one.
+ * @return mss to clamp to, 0 if no clamp
+ */
+static inline u16 vport_mss_clamp(struct net *net, struct vport *vp)
+{
+    u16 mss;
+
+    if (vp == NULL || vp->vport_type != VXLAN_VPORT) {
+        return 0;
+    }
+
+    mss = ((struct int_vport *)vp)->mss_clamp;
+    return mss ? mss : net->mss_clamp;
+}
+
+/*
+ * @brief Lower the mss option of a syn or syn-ack to mss, so that full
+ *        sized segments fit in the underlay mtu after vxlan encap.
+ *        skb data must point to the tcp header.
+ * @return 1 if the option is rewritten, 0 otherwise
+ */
+static int tcp_mss_clamp(struct sk_buff *skb, struct ip_hdr *iph, u16 mss)
+{
+    struct tcp_hdr *tcph;
+    u8 *opt;
+    u32 i, optlen;
+    u16 oldmss, from, to;
+
+    /*only the first fragment carries the tcp header*/
+    if (iph->frag_off & htons(IP_OFFSET)) {
+        return 0;
+    }
+
+    if (!pskb_may_pull(skb, sizeof(struct tcp_hdr))) {
+        return 0;
+    }
+    tcph = skb_tcp_header(skb);
+    if (!tcph->syn || tcph->doff * 4 < (int)sizeof(struct tcp_hdr)) {
+        return 0;
+    }
+
+    if (!pskb_may_pull(skb, tcph->doff * 4)) {
+        return 0;
+    }
+    opt = (u8 *)(tcph + 1);
+    optlen = tcph->doff * 4 - sizeof(struct tcp_hdr);
+
+    for (i = 0; i < optlen;) {
+        if (opt[i] == TCPOPT_EOL) {
+            break;
+        }
+        if (opt[i] == TCPOPT_NOP) {
+            i++;
+            continue;
+        }
+        if (i + 1 >= optlen || opt[i + 1] < 2 || i + opt[i + 1] > optlen) {
+            break;
+        }
+        if (opt[i] == TCPOPT_MSS && opt[i + 1] == TCPOLEN_MSS) {
+            oldmss = (opt[i + 2] << 8) | opt[i + 3];
+            if (oldmss <= mss) {
+                return 0;
+            }
+            opt[i + 2] = mss >> 8;
+            opt[i + 3] = mss & 0xff;
+
+            /*hardware fills the checksum if it is offloaded (ftp alg)*/
+            if (!(skb->mbuf.ol_flags & PKT_TX_TCP_CKSUM)) {
+                from = htons(oldmss);
+                to = htons(mss);
+                /*an option at odd offset straddles two checksum words*/
+                if (i & 1) {
+                    from = (from << 8) | (from >> 8);
+                    to = (to << 8) | (to >> 8);
+                }
+                pal_csum_replace2(&tcph->check, from, to);
+            }
+            return 1;
+        }
+        i += opt[i + 1];
+    }
+
+    return 0;
+}
+
+static int ip_output_finish(struct sk_buff *skb, struct vport *in, struct vport *out)
 {
     if (out == NULL) {
         BVR_WARNING("fatal error ip_output out NULL\n");
@@ -140,9 +231,23 @@ static int ip_output_finish(struct sk_buff *skb, __unused struct vport *in, stru
     struct net *net = dev_net(out);
     struct ip_hdr *iph = skb_ip_header(skb);
     int lcore_id = rte_lcore_id();
+    u16 mss, out_mss;
+
+    /*clamp mss of syn and syn-ack crossing an internal vport*/
+    if (iph->protocol == PAL_IPPROTO_TCP) {
+        mss = vport_mss_clamp(net, in);
+        out_mss = vport_mss_clamp(net, out);
+        if (out_mss && (!mss || out_mss < mss)) {
+            mss = out_mss;
+        }
+        if (mss && tcp_mss_clamp(skb, iph, mss)) {
+            PAL_PCPU_ADD(&net->stats[lcore_id], mssclamp_pkts, 1);
+        }
+    }
 
-    net->stats[lcore_id].output_pkts++;
-    net->stats[lcore_id].output_bytes += skb_len(skb);
+    PAL_PCPU_ADD(&net->stats[lcore_id], output_pkts, 1);
+    PAL_PCPU_ADD(&net->stats[lcore_id], output_bytes, skb_pkt_len(skb));
+    bvr_flow_rec_commit(skb, out);
 
     skb_push(skb, (iph->ihl << 2) + sizeof(struct eth_hdr));
     out->vport_ops->send(skb, out);
@@ -172,12 +277,13 @@ static int ip_output(struct sk_buff *skb, struct vport *in, __unused struct vpor
     int err = pal_route_lookup(net->route_table, iph->daddr, &res);
     if(err) {
         /*why error?*/
-        net->stats[lcore_id].rterror_pkts++;
-        net->stats[lcore_id].rterror_bytes += skb_len(skb);
+        PAL_PCPU_ADD(&net->stats[lcore_id], rterror_pkts, 1);
+        PAL_PCPU_ADD(&net->stats[lcore_id], rterror_bytes, skb_pkt_len(skb));
         goto drop;
     }
     /*if route type local, should process pkt on your own*/
     if (res.route_type == PAL_ROUTE_LOCAL) {
+        bvr_flow_rec_abort();
         if (iph->protocol == PAL_IPPROTO_ICMP) {
             /*only process icmp ping for local ip*/
             if (icmp_reply(skb)) {
@@ -197,10 +303,13 @@ static int ip_output(struct sk_buff *skb, struct vport *in, __unused struct vpor
             && res.next_hop != 0
             && res.next_hop != res.sip) {
         if (unlikely(locate_eth_dst(res.port_dev, res.next_hop, ethh->dst) < 0)) {
-            net->stats[lcore_id].rterror_pkts++;
-            net->stats[lcore_id].rterror_bytes += skb_len(skb);
+            PAL_PCPU_ADD(&net->stats[lcore_id], rterror_pkts, 1);
+            PAL_PCPU_ADD(&net->stats[lcore_id], rterror_bytes, skb_pkt_len(skb));
             goto drop;
         }
+        bvr_flow_rec_route(res.port_dev, res.next_hop);
+    } else {
+        bvr_flow_rec_route(res.port_dev, 0);
     }
     /*offload the arp procesee to vport*/
     #if 0
@@ -211,8 +320,8 @@ static int ip_output(struct sk_buff *skb, struct vport *in, __unused struct vpor
             entry = find_arp_entry(net, iph->daddr);
 
             if (entry == NULL) {
-                net->stats[lcore_id].arperror_pkts++;
-                net->stats[lcore_id].arperror_bytes += skb_len(skb);
+                PAL_PCPU_ADD(&net->stats[lcore_id], arperror_pkts, 1);
+                PAL_PCPU_ADD(&net->stats[lcore_id], arperror_bytes, skb_pkt_len(skb));
                 goto drop;
             }
             /*change mac*/
@@ -249,11 +358,70 @@ static int ip_forward(struct sk_buff *skb, struct vport *in, struct vport *out)
 }
 
 
+/*
+ * @brief nat an address of a pkt, and its ip and l4 checksums as fn_nat_fn
+ *        does. the flow cache only holds tcp and udp pkts, no fragments
+ */
+static inline void ip_flow_nat(struct sk_buff *skb, struct ip_hdr *iph, u32 *addr, u32 nat_ip)
+{
+    struct udp_hdr *udph;
+
+    pal_csum_replace4(&iph->check, *addr, nat_ip);
+    if (iph->protocol == PAL_IPPROTO_TCP) {
+        pal_csum_replace4(&skb_tcp_header(skb)->check, *addr, nat_ip);
+    } else {
+        udph = skb_udp_header(skb);
+        if (udph->check != 0) {
+            pal_csum_replace4(&udph->check, *addr, nat_ip);
+        }
+    }
+    *addr = nat_ip;
+}
+
+/*
+ * @brief forward a pkt as the first pkt of its flow was, see bvr_flow.h
+ */
+static int ip_flow_forward(struct sk_buff *skb, struct vport *in, struct bvr_flow *flow)
+{
+    struct ip_hdr *iph = skb_ip_header(skb);
+    struct net *net = dev_net(in);
+    int lcore_id = rte_lcore_id();
+    u32 i;
+
+    PAL_PCPU_ADD(&net->stats[lcore_id], flow_hit_pkts, 1);
+    for (i = 0; i < flow->n_counter; i++) {
+        ADD_COUNTER(*flow->counter[i], skb_pkt_len(skb), 1, lcore_id);
+    }
+    if (flow->out == NULL) {
+        return NF_DROP;
+    }
+
+    if (iph->saddr != flow->saddr) {
+        ip_flow_nat(skb, iph, &iph->saddr, flow->saddr);
+    }
+    if (iph->daddr != flow->daddr) {
+        ip_flow_nat(skb, iph, &iph->daddr, flow->daddr);
+    }
+    if (flow->dnat) {
+        skb->dnat_flag = 1;
+    }
+
+    /*the mac of the gateway may change, it is not cached*/
+    if (flow->next_hop != 0 &&
+        unlikely(locate_eth_dst(flow->out, flow->next_hop, skb_eth_header(skb)->dst) < 0)) {
+        PAL_PCPU_ADD(&net->stats[lcore_id], rterror_pkts, 1);
+        PAL_PCPU_ADD(&net->stats[lcore_id], rterror_bytes, skb_pkt_len(skb));
+        return NF_DROP;
+    }
+
+    return ip_output_finish(skb, in, flow->out);
+}
 
 static int ip_rcv(struct sk_buff *skb, struct vport *dev)
 {
     struct ip_hdr *iph;
     struct net *net;
+    struct bvr_flow *flow;
     u32 len = 0;
     int lcore_id = rte_lcore_id();
 
@@ -290,13 +458,15 @@ static int ip_rcv(struct sk_buff *skb, struct vport *dev)
     }
     len = ntohs(iph->tot_len);
 
-    /*don't test ip len,cause if ip fragment in vxlan level, the inner ip
-     lengh maybe longer than skb len.*/
-
-    if (len < (u32)(iph->ihl << 2)) {
+    /*inner packets reassembled at vxlan level or received as jumbo frames
+      are mbuf chains, so test against the total length, not skb_len*/
+    if (len < (u32)(iph->ihl << 2) || len > skb_pkt_len(skb)) {
         goto hdr_error;
     }
 
+    /*strip ethernet padding added by the vm*/
+    pskb_trim(skb, len);
+
     /*pull the ip header and set eth l4 header (useful for filter)*/
     skb_pull(skb, ((iph->ihl) << 2));
     skb_reset_l4_header(skb);
@@ -313,14 +483,19 @@ static int ip_rcv(struct sk_buff *skb, struct vport *dev)
         BVR_WARNING("ip csum check error\n");
         goto hdr_error;
     }
-    net->stats[lcore_id].input_pkts++;
-    net->stats[lcore_id].input_bytes += skb_len(skb);
+    PAL_PCPU_ADD(&net->stats[lcore_id], input_pkts, 1);
+    PAL_PCPU_ADD(&net->stats[lcore_id], input_bytes, skb_pkt_len(skb));
+
+    flow = bvr_flow_lookup(net, skb, dev);
+    if (flow != NULL) {
+        return ip_flow_forward(skb, dev, flow);
+    }
     return nf_hook_iterate(NFPROTO_IPV4, NF_PREROUTING, skb, dev,
         NULL, ip_forward);
 
 hdr_error:
-    net->stats[lcore_id].hdrerror_pkts++;
-    net->stats[lcore_id].hdrerror_bytes += skb_len(skb);
+    PAL_PCPU_ADD(&net->stats[lcore_id], hdrerror_pkts, 1);
+    PAL_PCPU_ADD(&net->stats[lcore_id], hdrerror_bytes, skb_pkt_len(skb));
     return NF_DROP;
 
 }
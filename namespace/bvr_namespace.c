@@ -15,9 +15,10 @@
 #include "pal_malloc.h"
 #include "pal_slab.h"
 #include "pal_list.h"
+#include "pal_qsbr.h"
 #include "logger.h"
 //#include "util.h"
-/*only used in control plane, no lock to protect this hash table*/
+/*only used in control plane, written under the control lock held for write*/
 struct pal_hlist_head namespace_hash_table[NAMESPACE_TABLE_SIZE]; //need to be initialized before used
 //struct rte_rwlock_t namespace_hash_lock_array[NAMESPACE_TABLE_SIZE];//need to be initialized before used
 
@@ -25,6 +26,9 @@ struct pal_hlist_head namespace_hash_table[NAMESPACE_TABLE_SIZE]; //need to be i
 static PAL_LIST_HEAD(pernet_list);
 
 struct pal_slab *g_namespace_slab = NULL;
+static int namespace_numa_id;
+/*last generation given to the cached flows of a net*/
+u64 g_net_flow_gen = 0;
 
 
 /*
@@ -74,7 +78,7 @@ undo:
 }
 
 /*
- * @brief: get a net by name,used by control thread,no lock protected
+ * @brief: get a net by name,used by control threads holding the control lock
  * @return if found return net or NULL
  */
 
@@ -107,7 +111,8 @@ struct net *net_get(char *name)
 
 
 /*
- * @brief: create a net named by param,used by control thread,no lock protected
+ * @brief: create a net named by param,used by control threads holding the
+ *         control lock for write
  * @return 0 if success ,error number for error
  */
 
@@ -146,16 +151,33 @@ int net_create(char *name)
     /*initialize net*/
     memset(net, 0, sizeof(*net));
     strncpy(net->name, name, NAMESPACE_NAME_SIZE);
+    net->arena = pal_arena_create(name, namespace_numa_id);
+    if (!net->arena) {
+        BVR_WARNING("alloc arena of namespace %s error\n", name);
+        pal_slab_free(net);
+        return -NN_ENOMEM;
+    }
+    net->stats = pal_pcpu_alloc(sizeof(struct statistics), namespace_numa_id);
+    if (!net->stats) {
+        BVR_WARNING("alloc statistics of namespace %s error\n", name);
+        pal_arena_destroy(net->arena);
+        pal_slab_free(net);
+        return -NN_ENOMEM;
+    }
     PAL_INIT_LIST_HEAD(&net->dev_base_head);
+    net_flow_invalidate(net);
 
     atomic_set(&net->if_count, 0);
 //    atomic_set(&net->user_count, 0);
     rte_rwlock_init(&net->net_lock);
+    pthread_mutex_init(&net->ctl_lock, NULL);
 
     /*initialize subsys*/
     error = net_install(net);
     if (error)
     {
+        pal_pcpu_free(net->stats);
+        pal_arena_destroy(net->arena);
         pal_slab_free(net);
         return error;
     }
@@ -169,20 +191,9 @@ int net_create(char *name)
 }
 
 
-static inline int test_counter(u8 *counter)
-{
-    u32 i;
-    for (i = 0; i < PAL_MAX_CPU; i++) {
-        if(counter[i] != 0) {
-            return 1;
-        }
-
-    }
-    return 0;
-}
-
 /*
- * @brief: del a net by name,used by control thread,no lock protected
+ * @brief: del a net by name,used by control threads holding the control
+ *         lock for write
  * @return 0 if success ,error number for error
  */
 int del_net(char *name)
@@ -192,7 +203,6 @@ int del_net(char *name)
     }
     struct net *net;
     struct pernet_operation *ops;
-    u32 i;
 
     net = net_get(name);
     if (!net) {
@@ -216,23 +226,12 @@ int del_net(char *name)
         return -NN_EREFCNT;
     }
 
-    /*try five times to make sure the net can be free*/
-    /*conisder user_count and net_lock up and down together,that means when we
-     *hold write lock no pkt pass through this net.so maybe user_count no used
-     *use the interface lock and net lock can make sure access security
-     */
-    for (i = 0; i < 5; i++) {
-       // if (atomic_read(&net->user_count))
-       if(test_counter(net->counter))
-            usleep(10);
-        else
-            break;
-    }
-
-    if(i == 5) {
-        BVR_ERROR("we try 5 times ,but still some pkt reference the net,may be something wrong\n");
-        return -NN_EREFCNT;
-    }
+    /*no vport leads to the net anymore, wait for the pkts still in it*/
+    pal_qsbr_synchronize();
+    /*rules and routes left by the exit ops go all at once*/
+    pal_arena_destroy(net->arena);
+    pal_pcpu_free(net->stats);
+    pthread_mutex_destroy(&net->ctl_lock);
     pal_slab_free(net);
     return 0;
 
@@ -259,10 +258,12 @@ int namespace_init(int numa_id)
     /*route subsys must register after dev subsys*/
     register_pernet_operations(&route_net_ops);
 
+    namespace_numa_id = numa_id;
+
     /*need more*/
     /*alloc slab*/
     /*param numa should be numa id where worker running on(the same as phy port plugged in)*/
-    g_namespace_slab = pal_slab_create("namespace", NAMESPACE_SLAB_SIZE, sizeof(struct net), numa_id, 0);
+    g_namespace_slab = pal_slab_create_multipc("namespace", NAMESPACE_SLAB_SIZE, sizeof(struct net), numa_id, 0);
 
     if (g_namespace_slab == NULL) {
         BVR_ERROR("init g_namespace_slab error\n");
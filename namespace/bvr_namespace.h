@@ -15,12 +15,15 @@
 #ifndef NAMESPACE_H
 #define NAMESPACE_H
 
+#include <pthread.h>
 #include "pal_atomic.h"
 #include "bvr_hash.h"
 #include "bvr_errno.h"
 #include "bvrouter_list.h"
 #include "pal_list.h"
 #include "pal_conf.h"
+#include "pal_arena.h"
+#include "pal_pcpu.h"
 
 
 #define NAMESPACE_TABLE_OFFSET 12
@@ -33,8 +36,9 @@
 //#define MAX_CORE_NUM 32
 
 
-/*statistics information per cpu for each namespace*/
+/*statistics information per cpu for each namespace, see pal_pcpu.h*/
 struct statistics {
+    struct pal_pcpu_head head;
     u64 hdrerror_pkts;
     u64 hdrerror_bytes;
     u64 rterror_bytes;
@@ -45,8 +49,11 @@ struct statistics {
     u64 input_bytes;
     u64 output_pkts;
     u64 output_bytes;
-    u64 pad[6];
-};
+    u64 mssclamp_pkts;      //syn and syn-ack whose mss option is clamped
+    u64 ct_hit_pkts;        //forwarded pkts which reused the filter rule of their connection
+    u64 ct_new_conns;       //connections tracked
+    u64 flow_hit_pkts;      //forwarded pkts which reused the decisions cached for their flow
+} __rte_cache_aligned;
 
 #define dev_net(dev) (struct net *)dev->private
 //struct counter {
@@ -54,6 +61,12 @@ struct statistics {
 
 //};
 
+/*stages of each netfilter hook point, see nf_net_hooks_rebuild*/
+#define NF_HOOK_POINTS 3
+#define NF_HOOK_STAGES 8
+
+struct nf_hook_ops;
+
 struct net {
     struct route_table *route_table;    /*route table*/
     struct pal_hlist_head *arp_table;   //arp table
@@ -63,18 +76,23 @@ struct net {
     struct pal_list_head dev_base_head;     //dev list
 
     struct pal_hlist_node hlist;    //link to namespace hash table
+    struct pal_arena *arena;        //rules and routes of the net, freed with it
+    struct statistics *stats;       //per cpu statistics, indexed by lcore id
+    u64 flow_gen;                   //generation of the cached flows, see bvr_flow.h
 
     /*cache line 2*/
     char name[NAMESPACE_NAME_SIZE];
-    u8 counter[PAL_MAX_CPU];
     atomic_t if_count;          //count how many interfaces referenced the net
+    u16 mss_clamp;              //tcp mss clamp of internal interfaces, 0 for none
   //atomic_t user_count;        //count how many pkt run through the net
 
     rte_rwlock_t net_lock;      //rwlock to protect resource in net(router table etc)
 
-    /*cache line 3*/
+    /*hooks having work to do in this net, NULL terminated*/
+    struct nf_hook_ops *nf_chain[NF_HOOK_POINTS][NF_HOOK_STAGES];
 
-    struct statistics stats[PAL_MAX_CPU];  //per cpu statistics
+    pthread_mutex_t ctl_lock;   //serialize the control commands on the net, see bvr_ctl.c
+    u64 sync_gen;               //generation of the last state synced, 0 if none
 };
 
 
@@ -103,21 +121,31 @@ static inline void net_if_put(struct net *net)
     atomic_dec(&net->if_count);
 }
 
-/*when a skb go through a net,increase count and hold read lock*/
+extern u64 g_net_flow_gen;
+
+/*
+ * drop the cached flows of a net, called after its rules, routes or
+ * interfaces change. generations are unique across nets, so an entry keyed
+ * on a vport freed and reused in another net never matches
+ */
+static inline void net_flow_invalidate(struct net *net)
+{
+    net->flow_gen = __sync_add_and_fetch(&g_net_flow_gen, 1);
+}
+
+/*
+ * when a skb go through a net, hold read lock against config changes.
+ * the net itself is freed after a grace period, see del_net
+ */
 static inline void net_user_hold(struct net *net)
 {
     rte_rwlock_read_lock(&net->net_lock);
-    //atomic_inc(&net->user_count);
-    net->counter[rte_lcore_id()]++;
 }
 
-/*when a skb leave a net,decrease count and release read lock*/
+/*when a skb leave a net, release read lock*/
 static inline void net_user_put(struct net *net)
 {
     rte_rwlock_read_unlock(&net->net_lock);
-    //atomic_dec(&net->user_count);
-    net->counter[rte_lcore_id()]--;
-
 }
 
 int register_pernet_operations(struct pernet_operation *ops);
@@ -125,7 +153,7 @@ int register_pernet_operations(struct pernet_operation *ops);
 void unregister_pernet_operations(struct pernet_operation *ops);
 
 
-/*the operation below only can be used by control process*/
+/*the operation below only can be used by control process, holding the control lock*/
 struct net *net_get(char *name);
 int namespace_init(int numa);
 
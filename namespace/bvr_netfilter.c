@@ -20,9 +20,15 @@
 #include "pal_skb.h"
 #include "pal_slab.h"
 #include "pal_spinlock.h"
+#include "pal_cuckoo.h"
 #include "pal_vnic.h"
+#include "pal_csum.h"
+#include "pal_qsbr.h"
 
 #include "bvr_netfilter.h"
+#include "bvr_conntrack.h"
+#include "bvr_classifier.h"
+#include "bvr_flow.h"
 #include "pal_utils.h"
 #include "logger.h"
 //#include "hash.h"
@@ -30,11 +36,169 @@
 struct pal_list_head nf_hooks[NFPROTO_NUMPROTO][NF_MAX_HOOKS];
 /*pal slab*/
 struct pal_slab *g_xt_table_slab = NULL;
-struct pal_slab *g_xt_filter_table_slab = NULL;
-struct pal_slab *g_xt_nat_table_slab = NULL;
-struct pal_slab *g_ipt_nat_entry_slab = NULL;
-struct pal_slab *g_ipt_filter_entry_slab = NULL;
-struct pal_slab *g_ipt_filter_mask_slab = NULL;
+
+/*nat rules of all namespaces, looked up without lock by the datapath*/
+static struct pal_cuckoo *g_ipt_nat_htable = NULL;
+/*serialize the writers of g_ipt_nat_htable*/
+static pal_spinlock_t g_ipt_nat_lock = PAL_SPINLOCK_INITIALIZER;
+
+struct ipt_nat_key {
+    u64 table;
+    u16 hook;
+    u16 plen;
+    u32 ip;
+};
+
+/*mask of a prefix length, network order*/
+static inline u32 ipt_nat_plen_mask(u8 plen)
+{
+    return plen ? pal_htonl(0xffffffffU << (NAT_PLEN_MAX - plen)) : 0;
+}
+
+static inline void ipt_nat_key_init(struct ipt_nat_key *key,
+        struct xt_nat_table *nat_table, u8 hook_num, u32 ip, u8 plen)
+{
+    key->table = (u64)(unsigned long)nat_table;
+    key->hook = hook_num;
+    key->plen = plen;
+    key->ip = ip & ipt_nat_plen_mask(plen);
+}
+
+static void __ipt_nat_unlink_rule(struct xt_nat_table *nat_table, u8 hook_num, struct ipt_nat_entry *entry);
+
+static void nf_net_hooks_rebuild(struct net *net);
+
+/*generation of filter tables, global so that a net reusing the memory of a
+  deleted one never matches the connections tracked for the old one. atomic,
+  the nets change in parallel*/
+static u64 g_ipt_filter_gen = 0;
+
+/*called with the net lock held for writing whenever filter rules change*/
+static inline void ipt_filter_table_changed(struct xt_filter_table *filter_table)
+{
+    filter_table->gen = __sync_add_and_fetch(&g_ipt_filter_gen, 1);
+}
+
+/*
+ * @brief: compile the rules of a hook again and swap the classifier in.
+ *         called after the rules of the hook changed, and before freeing a
+ *         rule the old classifier may still point to
+ */
+static void ipt_filter_hmap_grow(struct net *net, struct filter_rule_table *table);
+
+static void ipt_filter_table_commit(struct net *net, struct xt_filter_table *filter_table,
+    u8 hook_num)
+{
+    struct ipt_filter_cls *cls = ipt_filter_cls_build(&filter_table->table[hook_num]);
+    struct ipt_filter_cls *old = NULL;
+
+    pal_rwlock_write_lock(&net->net_lock);
+    old = filter_table->table[hook_num].cls;
+    filter_table->table[hook_num].cls = cls;
+    ipt_filter_table_changed(filter_table);
+    nf_net_hooks_rebuild(net);
+    pal_rwlock_write_unlock(&net->net_lock);
+
+    if (filter_table->table[hook_num].rule_num >
+        filter_hmap_size(&filter_table->table[hook_num])) {
+        ipt_filter_hmap_grow(net, &filter_table->table[hook_num]);
+    }
+
+    ipt_filter_cls_free(old);
+}
+
+/*insert a rule in a hash chain, after the rules of the same priority*/
+static void ipt_filter_hlist_insert(struct pal_hlist_head *head, struct ipt_filter_entry *entry)
+{
+    struct ipt_filter_entry *pos = NULL, *last = NULL;
+    struct pal_hlist_node *node = NULL;
+
+    if (pal_hlist_empty(head)) {
+        /*empty hlist, we add at head*/
+        pal_hlist_add_head(&entry->hlist, head);
+        return;
+    }
+
+    pal_hlist_for_each_entry(pos, node, head, hlist)
+    {
+        if (pos->priority > entry->priority) {
+            break;
+        }
+        last = pos;
+    }
+    if (last) {
+        /*not the highest priority add after last*/
+        pal_hlist_add_after(&last->hlist, &entry->hlist);
+    }
+    else {
+        /*highest priority add before pos*/
+        pal_hlist_add_before(&entry->hlist, &pos->hlist);
+    }
+}
+
+static struct pal_hlist_head *ipt_filter_hmap_alloc(struct net *net, u32 size)
+{
+    struct pal_hlist_head *hmap;
+    u32 i;
+
+    hmap = pal_arena_alloc(net->arena, size * sizeof(*hmap));
+    if (hmap == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < size; i++) {
+        PAL_INIT_HLIST_HEAD(&hmap[i]);
+    }
+    return hmap;
+}
+
+/*
+ * @brief: double the buckets of a hook until they are as many as its rules.
+ *         the searches by masks going on meanwhile start again, see
+ *         __ipt_filter_search()
+ */
+static void ipt_filter_hmap_grow(struct net *net, struct filter_rule_table *table)
+{
+    struct pal_hlist_head *hmap, *old = table->filter_hmap;
+    struct ipt_filter_entry *entry = NULL;
+    struct pal_hlist_node *pos = NULL, *next = NULL;
+    u32 size, old_size = filter_hmap_size(table), i, key;
+
+    if (old == NULL) {
+        return;
+    }
+    for (size = old_size; size < table->rule_num && size < FILTER_TABLE_MAX_SIZE; size <<= 1);
+    if (size == old_size) {
+        return;
+    }
+    hmap = ipt_filter_hmap_alloc(net, size);
+    if (hmap == NULL) {
+        /*the chains only get longer*/
+        return;
+    }
+
+    pal_rwlock_write_lock(&net->net_lock);
+    table->seq++;
+    rte_wmb();
+    /*the order of the rules of a chain is kept, they all go to one chain*/
+    for (i = 0; i < old_size; i++) {
+        pal_hlist_for_each_entry_safe(entry, pos, next, &old[i], hlist) {
+            pal_hlist_del(&entry->hlist);
+            key = nn_filter_rule_hash(entry->key.sip, entry->key.dip, entry->key.proto) & (size - 1);
+            ipt_filter_hlist_insert(&hmap[key], entry);
+        }
+    }
+    /*a search reading the new mask reads the new hash too*/
+    table->filter_hmap = hmap;
+    rte_wmb();
+    table->rule_mask = size - 1;
+    rte_wmb();
+    table->seq++;
+    pal_rwlock_write_unlock(&net->net_lock);
+
+    /*the searches started before may still walk the old buckets*/
+    pal_qsbr_synchronize();
+    pal_arena_free(net->arena, old, old_size * sizeof(*old));
+}
 
 
 /*
@@ -43,9 +207,13 @@ struct pal_slab *g_ipt_filter_mask_slab = NULL;
  */
 static struct xt_table *ipt_register_table(const struct xt_table *table)
 {
-    u32 i, j;
-    struct xt_table *new_table = pal_slab_alloc(g_xt_table_slab);
+    struct xt_table *new_table = NULL;
 
+    /*only nat and filter table support*/
+    if (strcmp(table->name, NAT_TABLE) && strcmp(table->name, FILTER_TABLE)) {
+        return NULL;
+    }
+    new_table = pal_slab_alloc(g_xt_table_slab);
     if (new_table == NULL) {
         return NULL;
     }
@@ -53,46 +221,60 @@ static struct xt_table *ipt_register_table(const struct xt_table *table)
     strcpy(new_table->name, table->name);
     new_table->valid_hooks = table->valid_hooks;
     new_table->af = table->af;
+    /*most nets have few rules, the rule table comes with the first one*/
     new_table->private = NULL;
+    return new_table;
+}
 
-    if (!strcmp(new_table->name, "nat")) {
-        new_table->private = pal_slab_alloc(g_xt_nat_table_slab);
-        if (new_table->private == NULL) {
-            goto free_xt;
-        }
-        struct xt_nat_table *nat_table = (struct xt_nat_table *)new_table->private;
+/*
+ * @brief: the nat rule table of a net, allocated on the first call
+ * @return the table, NULL if out of memory
+ */
+static struct xt_nat_table *ipt_nat_table_get(struct net *net)
+{
+    struct xt_nat_table *nat_table = (struct xt_nat_table *)net->nat->private;
+    u32 i;
 
-        for (i = 0; i < NF_MAX_HOOKS; i++) {
-            nat_table->table[i].rule_num = 0;
-            nat_table->table[i].rule_mask = NAT_TABLE_MASK;
-            for (j = 0; j < NAT_TABLE_SIZE; j++) {
-                PAL_INIT_HLIST_HEAD(&nat_table->table[i].nat_hmap[j]);
-            }
-        }
-    }else if (!strcmp(new_table->name, "filter")) {
-        new_table->private = pal_slab_alloc(g_xt_filter_table_slab);
-        if (new_table->private == NULL) {
-            goto free_xt;
-        }
+    if (nat_table != NULL) {
+        return nat_table;
+    }
+    nat_table = pal_arena_zalloc(net->arena, sizeof(*nat_table));
+    if (nat_table == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < NF_MAX_HOOKS; i++) {
+        PAL_INIT_LIST_HEAD(&nat_table->table[i].nat_list);
+    }
+    /*the datapath reads it without lock*/
+    rte_wmb();
+    net->nat->private = nat_table;
+    return nat_table;
+}
 
-        struct xt_filter_table *filter_table = (struct xt_filter_table *)new_table->private;
-        for (i = 0; i < NF_MAX_HOOKS; i++) {
-            PAL_INIT_LIST_HEAD(&filter_table->table[i].mask_list);
-            BVR_DEBUG("we have initialize the mask list add %p\n",&filter_table->table[i].mask_list);
-            filter_table->table[i].rule_num = 0;
-            filter_table->table[i].rule_mask = FILTER_TABLE_MASK;
-            for (j = 0; j < FILTER_TABLE_SIZE; j++) {
-                PAL_INIT_HLIST_HEAD(&filter_table->table[i].filter_hmap[j]);
-            }
-        }
-    }else {
-        /*only nat and filter table support*/
-        goto free_xt;
+/*
+ * @brief: the filter rule table of a net, allocated on the first call.
+ *         the hash of a hook comes with its first rule
+ * @return the table, NULL if out of memory
+ */
+static struct xt_filter_table *ipt_filter_table_get(struct net *net)
+{
+    struct xt_filter_table *filter_table = (struct xt_filter_table *)net->filter->private;
+    u32 i;
+
+    if (filter_table != NULL) {
+        return filter_table;
     }
-    return new_table;
-free_xt:
-    pal_slab_free(new_table);
-    return NULL;
+    filter_table = pal_arena_zalloc(net->arena, sizeof(*filter_table));
+    if (filter_table == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < NF_MAX_HOOKS; i++) {
+        PAL_INIT_LIST_HEAD(&filter_table->table[i].mask_list);
+    }
+    ipt_filter_table_changed(filter_table);
+    rte_wmb();
+    net->filter->private = filter_table;
+    return filter_table;
 }
 
 
@@ -121,16 +303,14 @@ static int nf_net_init(struct net *net)
 {
     BVR_DEBUG("initialize the netfilter module for net %s\n",net->name);
     net->filter = ipt_register_table(&filter);
-    BVR_DEBUG("filter table %p\n",net->filter->private);
     if (!net->filter)
         goto err;
     net->nat = ipt_register_table(&nat);
     if (!net->nat)
         goto free_filter;
-    BVR_DEBUG("nat table %p\n",net->nat->private);
+    nf_net_hooks_rebuild(net);
     return 0;
 free_filter:
-    pal_slab_free(net->filter->private);
     pal_slab_free(net->filter);
 err:
     return -1;
@@ -143,63 +323,44 @@ err:
 static void nf_net_exit(struct net *net)
 {
     BVR_DEBUG("destroy the netfilter module for net %s\n",net->name);
-    u32 i = 0, j = 0;
+    u32 i = 0;
     /*release rwlock as soon as possible*/
     rte_rwlock_write_lock(&net->net_lock);
     struct xt_table *filter = net->filter;
     struct xt_table *nat = net->nat;
     net->filter = NULL;
     net->nat = NULL;
+    /*all hooks drop the pkts of a net without tables*/
+    nf_net_hooks_rebuild(net);
     rte_rwlock_write_unlock(&net->net_lock);
 
     /*filter and nat table can't be NULL before destroy them*/
     ASSERT((filter != NULL) && (nat != NULL));
 
+    /*NULL if the net never had rules*/
     struct xt_filter_table *filter_table = (struct xt_filter_table *)filter->private;
     struct xt_nat_table *nat_table = (struct xt_nat_table *)nat->private;
     BVR_DEBUG("filter table %p, nat table %p\n",filter_table,nat_table);
 
-    /*filter and nat rule table can't be NULL before destroy them*/
-    ASSERT((filter_table != NULL) && (nat_table != NULL))
-    struct ipt_flow_mask *pos = NULL, *next = NULL;
-    struct ipt_filter_entry *fpos = NULL;
-    struct ipt_nat_entry *npos = NULL;
-    struct pal_hlist_node *node = NULL, *node1 = NULL;
-    /*delete all rules in filter rule table*/
-    for(i = 0; i < NF_MAX_HOOKS; i++)
-    {
-
-        pal_list_for_each_entry_safe(pos, next, &filter_table->table[i].mask_list, list)
-        {
-            pal_list_del(&pos->list);
-            pal_slab_free(pos);
-        }
+    struct ipt_nat_entry *npos = NULL, *nnext = NULL;
 
-        for (j = 0; j < FILTER_TABLE_SIZE; j++)
-        {
-            pal_hlist_for_each_entry_safe(fpos, node, node1, &filter_table->table[i].filter_hmap[j], hlist)
-            {
-                pal_hlist_del(&fpos->hlist);
-                pal_slab_free(fpos);
-            }
-        }
+    /*rule tables, rules and masks live in the arena of the net, which is
+      freed as a whole by del_net. only what is shared with other nets is
+      undone*/
+    for(i = 0; filter_table && i < NF_MAX_HOOKS; i++)
+    {
+        ipt_filter_cls_free(filter_table->table[i].cls);
     }
-    pal_slab_free(filter->private);
     pal_slab_free(filter);
 
-    /*delete all rules in nat rule table*/
-    for(i = 0; i < NF_MAX_HOOKS; i++)
+    /*the nat hash is global, drop the keys of this net*/
+    for(i = 0; nat_table && i < NF_MAX_HOOKS; i++)
     {
-        for (j = 0; j < NAT_TABLE_SIZE; j++)
+        pal_list_for_each_entry_safe(npos, nnext, &nat_table->table[i].nat_list, list)
         {
-            pal_hlist_for_each_entry_safe(npos, node, node1, &nat_table->table[i].nat_hmap[j], hlist)
-            {
-                pal_hlist_del(&npos->hlist);
-                pal_slab_free(npos);
-            }
+            __ipt_nat_unlink_rule(nat_table, i, npos);
         }
     }
-    pal_slab_free(nat->private); //xt_nat_info need mempool
     pal_slab_free(nat);
 }
 
@@ -214,16 +375,23 @@ struct pernet_operation nf_net_ops = {
 
 static struct ipt_nat_entry *__ipt_nat_hit_rule(struct xt_nat_table *nat_table, u8 hook_num, u32 ip)
 {
-    u32 key = nn_hash_4byte(ip) & nat_table->table[hook_num].rule_mask;
-    struct ipt_nat_entry *t = NULL;
-    struct pal_hlist_node *pos = NULL;
-    struct pal_hlist_head *head = &nat_table->table[hook_num].nat_hmap[key];
-
-    pal_hlist_for_each_entry(t, pos, head, hlist)
-    {
-        if (t->orig_ip == ip)
-            return t;
+    struct ipt_nat_key key;
+    struct ipt_nat_entry *entry = NULL;
+    u64 map = nat_table->table[hook_num].plen_map;
+    u8 plen;
+
+    /*the caller holds the net read lock, so the rule can't be freed
+      while it is used. probe the prefix lengths in use, longest first*/
+    while (map) {
+        plen = 63 - __builtin_clzll(map);
+        ipt_nat_key_init(&key, nat_table, hook_num, ip, plen);
+        entry = pal_cuckoo_lookup(g_ipt_nat_htable, &key);
+        if (entry != NULL) {
+            return entry;
+        }
+        map &= ~(1ULL << plen);
     }
+
     return NULL;
 }
 
@@ -235,10 +403,8 @@ static struct ipt_nat_entry *ipt_nat_hit_rule(struct xt_table *table, u8 hook_nu
 {
     struct xt_nat_table *nat_table = (struct xt_nat_table *)table->private;
 
-     /*nat_table can be NULL ,when destroy nat table,
-     but haven't free the net.pkt may get in the net,and
-     lookup nat table. when this happened return NULL,dataplane
-     will drop the pkt.*/
+     /*nat_table is NULL until the first nat rule of the net,
+     no rule is hit then*/
     if (nat_table == NULL) {
         return NULL;
     }
@@ -254,22 +420,11 @@ static struct ipt_nat_entry *ipt_nat_hit_rule(struct xt_table *table, u8 hook_nu
  */
 static struct ipt_nat_entry *__ipt_nat_find_rule(struct xt_nat_table *nat_table, u8 hook_num, struct ipt_nat_entry *entry)
 {
-    struct ipt_nat_entry *t;
-    struct pal_hlist_node *pos;
-    u32 key = nn_hash_4byte(entry->orig_ip) & nat_table->table[hook_num].rule_mask;
-    struct pal_hlist_head *head = &nat_table->table[hook_num].nat_hmap[key];
+    struct ipt_nat_key key;
 
-    pal_hlist_for_each_entry(t, pos, head, hlist)
-    {
-        BVR_DEBUG("get in hlist t->oip %x,t->nat ip %x\n",t->orig_ip,t->nat_ip);
-        if ((t->orig_ip == entry->orig_ip)) {
-            //&& (t->nat_ip == entry->nat_ip)
-            //&& (t->nat_target == entry->nat_target))
-            /*delete nat rule by orignal ip*/
-            return t;
-        }
-    }
-    return NULL;
+    /*delete nat rule by orignal prefix*/
+    ipt_nat_key_init(&key, nat_table, hook_num, entry->orig_ip, entry->orig_plen);
+    return pal_cuckoo_lookup(g_ipt_nat_htable, &key);
 }
 
 
@@ -277,26 +432,58 @@ __unused static struct ipt_nat_entry * ipt_nat_find_rule(struct xt_table *table,
 {
     struct xt_nat_table *nat_table = (struct xt_nat_table *)table->private;
 
-    ASSERT(nat_table != NULL);
+    if (nat_table == NULL) {
+        return NULL;
+    }
 
     return __ipt_nat_find_rule(nat_table, hook_num, entry);
 }
 
 
-static void __ipt_nat_insert_rule(struct xt_nat_table *nat_table, u8 hook_num, struct ipt_nat_entry * entry)
+static int __ipt_nat_insert_rule(struct xt_nat_table *nat_table, u8 hook_num, struct ipt_nat_entry * entry)
 {
-    u32 key = nn_hash_4byte(entry->orig_ip) & nat_table->table[hook_num].rule_mask;
+    struct ipt_nat_key key;
+    int ret;
+
+    ipt_nat_key_init(&key, nat_table, hook_num, entry->orig_ip, entry->orig_plen);
+    pal_spinlock_lock(&g_ipt_nat_lock);
+    ret = pal_cuckoo_add(g_ipt_nat_htable, &key, entry);
+    pal_spinlock_unlock(&g_ipt_nat_lock);
+    if (ret < 0) {
+        return ret;
+    }
+
     nat_table->table[hook_num].rule_num++;
+    if (nat_table->table[hook_num].plen_cnt[entry->orig_plen]++ == 0) {
+        nat_table->table[hook_num].plen_map |= 1ULL << entry->orig_plen;
+    }
+    pal_list_add_tail(&entry->list, &nat_table->table[hook_num].nat_list);
+    return 0;
+}
 
-    pal_hlist_add_head(&entry->hlist, &nat_table->table[hook_num].nat_hmap[key]);
 
+static void __ipt_nat_unlink_rule(struct xt_nat_table *nat_table, u8 hook_num, struct ipt_nat_entry *entry)
+{
+    struct ipt_nat_key key;
+
+    ipt_nat_key_init(&key, nat_table, hook_num, entry->orig_ip, entry->orig_plen);
+    pal_spinlock_lock(&g_ipt_nat_lock);
+    pal_cuckoo_del(g_ipt_nat_htable, &key);
+    pal_spinlock_unlock(&g_ipt_nat_lock);
+
+    nat_table->table[hook_num].rule_num--;
+    if (--nat_table->table[hook_num].plen_cnt[entry->orig_plen] == 0) {
+        nat_table->table[hook_num].plen_map &= ~(1ULL << entry->orig_plen);
+    }
+    pal_list_del(&entry->list);
 }
 
 
-static void __ipt_nat_del_rule(struct ipt_nat_entry *entry)
+static void __ipt_nat_del_rule(struct net *net, struct xt_nat_table *nat_table, u8 hook_num,
+    struct ipt_nat_entry *entry)
 {
-    pal_hlist_del(&entry->hlist);
-    pal_slab_free(entry);
+    __ipt_nat_unlink_rule(nat_table, hook_num, entry);
+    pal_arena_free(net->arena, entry, sizeof(*entry));
 }
 
 
@@ -304,6 +491,9 @@ static void __ipt_nat_del_rule(struct ipt_nat_entry *entry)
  * @brief __ipt_nat_get_conflicting_rule - Return the nat rule which conflict with @new_entry.
  *                                         Conflict means same floating IP,
  *                                         in other words, orig_ip of dnat or nat_ip of snat.
+ *                                         Prefix rules only conflict with the
+ *                                         rule of the same original prefix, so
+ *                                         that several of them can share a pool.
  * @param nat_table - Table of all nat rules.
  * @param hook_num - Hook num which locates the specified nat hash map.
  * @param new_entry - The new nat rule.
@@ -313,25 +503,23 @@ static struct ipt_nat_entry *__ipt_nat_get_conflicting_rule(
         struct xt_nat_table *nat_table,
         u8 hook_num,
         struct ipt_nat_entry new_entry) {
-    u32 key;
     struct ipt_nat_entry *t = NULL;
-    struct pal_hlist_node *pos = NULL;
-    struct pal_hlist_head *head = NULL;
 
-    for (key = 0; key < NAT_TABLE_SIZE; key++) {
-        head = &nat_table->table[hook_num].nat_hmap[key];
-        pal_hlist_for_each_entry(t, pos, head, hlist)
-        {
-            if (t->orig_ip == new_entry.orig_ip) {
-                BVR_WARNING("ip snat rule already exist, original ip "NIPQUAD_FMT", overwrite it\n",
-                    NIPQUAD(new_entry.orig_ip));
-                return t;
-            }
-            if (t->nat_ip == new_entry.nat_ip) {
-                BVR_WARNING("ip dnat rule already exist, nat ip "NIPQUAD_FMT", overwrite it\n",
-                    NIPQUAD(new_entry.nat_ip));
-                return t;
-            }
+    pal_list_for_each_entry(t, &nat_table->table[hook_num].nat_list, list)
+    {
+        if (t->orig_ip == new_entry.orig_ip && t->orig_plen == new_entry.orig_plen) {
+            BVR_WARNING("ip snat rule already exist, original ip "NIPQUAD_FMT", overwrite it\n",
+                NIPQUAD(new_entry.orig_ip));
+            return t;
+        }
+        if (t->orig_plen != NAT_PLEN_MAX || new_entry.orig_plen != NAT_PLEN_MAX
+            || t->nat_plen != NAT_PLEN_MAX || new_entry.nat_plen != NAT_PLEN_MAX) {
+            continue;
+        }
+        if (t->nat_ip == new_entry.nat_ip) {
+            BVR_WARNING("ip dnat rule already exist, nat ip "NIPQUAD_FMT", overwrite it\n",
+                NIPQUAD(new_entry.nat_ip));
+            return t;
         }
     }
     return NULL;
@@ -341,10 +529,9 @@ static struct ipt_nat_entry *__ipt_nat_get_conflicting_rule(
 /*always insert into the list tail,we need to get lock*/
 int ipt_nat_insert_rule(struct net *net, u8 hook_num, struct ipt_nat_entry entry)
 {
-    struct xt_nat_table *nat_table = (struct xt_nat_table *)net->nat->private;
+    struct xt_nat_table *nat_table = NULL;
     struct ipt_nat_entry *entry_add = NULL;
-    /*never got a NULL nat table here*/
-    ASSERT(nat_table != NULL)
+    int ret;
 
     if (!get_bit(net->nat->valid_hooks, hook_num)) {
         BVR_WARNING("hook_num is not valid\n");
@@ -356,17 +543,27 @@ int ipt_nat_insert_rule(struct net *net, u8 hook_num, struct ipt_nat_entry entry
         return -NN_EINVAL;
         //return error;
     }
+    if (entry.orig_plen > NAT_PLEN_MAX || entry.nat_plen > NAT_PLEN_MAX) {
+        BVR_WARNING("nat prefix length is not valid\n");
+        return -NN_EINVAL;
+    }
+    entry.orig_ip &= ipt_nat_plen_mask(entry.orig_plen);
+    entry.nat_ip &= ipt_nat_plen_mask(entry.nat_plen);
+    entry.host_mask = ~(ipt_nat_plen_mask(entry.orig_plen) | ipt_nat_plen_mask(entry.nat_plen));
 
+    if ((nat_table = ipt_nat_table_get(net)) == NULL) {
+        BVR_WARNING("memory is runing out\n");
+        return -NN_ENOMEM;
+    }
     if ((entry_add = __ipt_nat_get_conflicting_rule(nat_table, hook_num, entry)))
     {
         /* If there is an conflicting nat rule, delete it first */
-        nat_table->table[hook_num].rule_num--;
         pal_rwlock_write_lock(&net->net_lock);
-        __ipt_nat_del_rule(entry_add);
+        __ipt_nat_del_rule(net, nat_table, hook_num, entry_add);
+        nf_net_hooks_rebuild(net);
         pal_rwlock_write_unlock(&net->net_lock);
     }
-    /*maybe should use pal slab*/
-    entry_add = pal_slab_alloc(g_ipt_nat_entry_slab);
+    entry_add = pal_arena_alloc(net->arena, sizeof(*entry_add));
     if (!entry_add)
     {
         BVR_WARNING("memory is runing out\n");
@@ -375,8 +572,14 @@ int ipt_nat_insert_rule(struct net *net, u8 hook_num, struct ipt_nat_entry entry
     *entry_add = entry;
     memset(&entry_add->counter, 0, sizeof(entry_add->counter));
     pal_rwlock_write_lock(&net->net_lock);
-    __ipt_nat_insert_rule(nat_table, hook_num, entry_add);
+    ret = __ipt_nat_insert_rule(nat_table, hook_num, entry_add);
+    nf_net_hooks_rebuild(net);
     pal_rwlock_write_unlock(&net->net_lock);
+    if (ret < 0) {
+        BVR_WARNING("nat rule table is full\n");
+        pal_arena_free(net->arena, entry_add, sizeof(*entry_add));
+        return -NN_ENOMEM;
+    }
 
     return 0;
 }
@@ -391,7 +594,6 @@ int ipt_nat_del_rule(struct net *net, u8 hook_num, struct ipt_nat_entry entry)
 
     struct xt_nat_table *nat_table = (struct xt_nat_table *)net->nat->private;
     struct ipt_nat_entry *entry_del = NULL;
-    ASSERT(nat_table != NULL);
 
     if (!get_bit(net->nat->valid_hooks, hook_num)) {
         //return error
@@ -405,14 +607,15 @@ int ipt_nat_del_rule(struct net *net, u8 hook_num, struct ipt_nat_entry entry)
         //return error
     }
     #endif
-    if ((entry_del = __ipt_nat_find_rule(nat_table, hook_num, &entry)) == NULL)
+    if (nat_table == NULL ||
+        (entry_del = __ipt_nat_find_rule(nat_table, hook_num, &entry)) == NULL)
     {
         BVR_WARNING("no available nat rule find\n");
         return -NN_ENFNOTEXIST;
     }
-    nat_table->table[hook_num].rule_num--;
     pal_rwlock_write_lock(&net->net_lock);
-    __ipt_nat_del_rule(entry_del);
+    __ipt_nat_del_rule(net, nat_table, hook_num, entry_del);
+    nf_net_hooks_rebuild(net);
     pal_rwlock_write_unlock(&net->net_lock);
     return 0;
 
@@ -431,7 +634,9 @@ static struct ipt_filter_entry *ipt_filter_find_rule(struct xt_table *table, u8
     u32 key = 0;
     struct xt_filter_table *filter_table = (struct xt_filter_table *)table->private;
 
-    ASSERT(filter_table != NULL);
+    if (filter_table == NULL || filter_table->table[hook_num].filter_hmap == NULL) {
+        return NULL;
+    }
 
     key = nn_filter_rule_hash(entry->key.sip, entry->key.dip, entry->key.proto) &
         filter_table->table[hook_num].rule_mask;
@@ -468,48 +673,24 @@ static int __ipt_filter_add_rule(struct xt_filter_table *filter_table, u8 hook_n
 {
     u32 sip = 0, dip = 0, key = 0;
     u8 proto = 0;
-    struct ipt_filter_entry *pos = NULL, *last = NULL;
-    struct pal_hlist_node *node = NULL;
-    struct pal_hlist_head *head = NULL;
     sip = entry->key.sip;
     dip = entry->key.dip;
     proto = entry->key.proto;
 
     key = nn_filter_rule_hash(sip, dip, proto) & filter_table->table[hook_num].rule_mask;
     filter_table->table[hook_num].rule_num++;
-    head = &filter_table->table[hook_num].filter_hmap[key];
 
     BVR_DEBUG("sip %u,dip %u.proto %u, key %u",entry->key.sip,entry->key.dip,entry->key.proto,key);
-    if (pal_hlist_empty(head)) {
-        /*empty hlist, we add at head*/
-        pal_hlist_add_head(&entry->hlist, head);
-    }else {
-
-        pal_hlist_for_each_entry(pos, node, head, hlist)
-        {
-            if (pos->priority > entry->priority) {
-                break;
-            }
-            last = pos;
-        }
-        if (last) {
-            /*not the highest priority add after last*/
-            pal_hlist_add_after(&last->hlist, &entry->hlist);
-        }
-        else {
-            /*highest priority add before pos*/
-            pal_hlist_add_before(&entry->hlist, &pos->hlist);
-        }
-    }
+    ipt_filter_hlist_insert(&filter_table->table[hook_num].filter_hmap[key], entry);
 
     return 0;
 }
 
 
-static int __ipt_filter_del_rule(struct ipt_filter_entry *entry)
+static int __ipt_filter_del_rule(struct net *net, struct ipt_filter_entry *entry)
 {
     pal_hlist_del(&entry->hlist);
-    pal_slab_free(entry);
+    pal_arena_free(net->arena, entry, sizeof(*entry));
     return 0;
 }
 
@@ -519,9 +700,7 @@ static int __ipt_filter_del_rule(struct ipt_filter_entry *entry)
  */
 int ipt_filter_add_rule(struct net *net, u8 hook_num, struct ipt_filter_entry entry)
 {
-    struct xt_filter_table *filter_table = (struct xt_filter_table *)net->filter->private;
-
-    ASSERT(filter_table != NULL);
+    struct xt_filter_table *filter_table = NULL;
 
     if (!get_bit(net->filter->valid_hooks, hook_num)) {
         BVR_WARNING("no valid hooks for filter\n");
@@ -534,9 +713,21 @@ int ipt_filter_add_rule(struct net *net, u8 hook_num, struct ipt_filter_entry en
         BVR_WARNING("filter target error %d\n",entry.filter_target);
         return -NN_EINVAL;
     }
+    if ((filter_table = ipt_filter_table_get(net)) == NULL) {
+        BVR_WARNING("alloc filter table error\n");
+        return -NN_ENOMEM;
+    }
     struct filter_rule_table *mask_table = &filter_table->table[hook_num];
+    if (mask_table->filter_hmap == NULL) {
+        mask_table->filter_hmap = ipt_filter_hmap_alloc(net, FILTER_TABLE_MIN_SIZE);
+        if (mask_table->filter_hmap == NULL) {
+            BVR_WARNING("alloc filter hash error\n");
+            return -NN_ENOMEM;
+        }
+        mask_table->rule_mask = FILTER_TABLE_MIN_SIZE - 1;
+    }
     struct ipt_flow_mask *mask;
-    struct ipt_filter_entry *entry_add = pal_slab_alloc(g_ipt_filter_entry_slab);
+    struct ipt_filter_entry *entry_add = pal_arena_alloc(net->arena, sizeof(*entry_add));
 
     if (!entry_add) {
         BVR_WARNING("alloc ip filter entry error\n");
@@ -554,13 +745,14 @@ int ipt_filter_add_rule(struct net *net, u8 hook_num, struct ipt_filter_entry en
             pal_rwlock_write_lock(&net->net_lock);
             __ipt_filter_add_rule(filter_table, hook_num, entry_add);
             pal_rwlock_write_unlock(&net->net_lock);
+            ipt_filter_table_commit(net, filter_table, hook_num);
             return 0;
         }
     }
-    mask = pal_slab_alloc(g_ipt_filter_mask_slab);
+    mask = pal_arena_alloc(net->arena, sizeof(*mask));
     if (!mask) {
         BVR_WARNING("alloc ip mask error\n");
-        __ipt_filter_del_rule(entry_add);
+        pal_arena_free(net->arena, entry_add, sizeof(*entry_add));
         return -NN_ENOMEM;
     }
 
@@ -572,6 +764,7 @@ int ipt_filter_add_rule(struct net *net, u8 hook_num, struct ipt_filter_entry en
     pal_list_add(&mask->list, &mask_table->mask_list);
     __ipt_filter_add_rule(filter_table, hook_num, entry_add);
     pal_rwlock_write_unlock(&net->net_lock);
+    ipt_filter_table_commit(net, filter_table, hook_num);
     return 0;
 }
 
@@ -582,7 +775,6 @@ int ipt_filter_add_rule(struct net *net, u8 hook_num, struct ipt_filter_entry en
 int ipt_filter_del_rule(struct net *net, u8 hook_num, struct ipt_filter_entry entry)
 {
     struct xt_filter_table *filter_table = (struct xt_filter_table *)net->filter->private;
-    ASSERT(filter_table != NULL);
     struct ipt_filter_entry *entry_del = NULL;
 
     /*make some safe check*/
@@ -609,13 +801,16 @@ int ipt_filter_del_rule(struct net *net, u8 hook_num, struct ipt_filter_entry en
         pal_rwlock_write_lock(&net->net_lock);
         pal_list_del(&entry_del->mask->list);
         pal_rwlock_write_unlock(&net->net_lock);
-        pal_slab_free(entry_del->mask);
+        pal_arena_free(net->arena, entry_del->mask, sizeof(*entry_del->mask));
     }
 
     filter_table->table[hook_num].rule_num--;
     pal_rwlock_write_lock(&net->net_lock);
-    __ipt_filter_del_rule(entry_del);
+    pal_hlist_del(&entry_del->hlist);
     pal_rwlock_write_unlock(&net->net_lock);
+    /*the old classifier may still hit the rule until it is swapped out*/
+    ipt_filter_table_commit(net, filter_table, hook_num);
+    pal_arena_free(net->arena, entry_del, sizeof(*entry_del));
     return 0;
 
 }
@@ -626,7 +821,7 @@ int ipt_filter_del_rule(struct net *net, u8 hook_num, struct ipt_filter_entry en
  */
 void ipt_nf_nat_rules_flush(struct net *net)
 {
-    u32 i = 0, j = 0;
+    u32 i = 0;
     /*we really lock the net lock for a long time£¬
       we'd better not flush tables too offen*/
     rte_rwlock_write_lock(&net->net_lock);
@@ -634,26 +829,20 @@ void ipt_nf_nat_rules_flush(struct net *net)
 
     /*filter and nat table can't be NULL before destroy them*/
     ASSERT((nat != NULL));
+    /*NULL if the net never had nat rules*/
     struct xt_nat_table *nat_table = (struct xt_nat_table *)nat->private;
 
-    /*filter and nat rule table can't be NULL before destroy them*/
-    ASSERT((nat_table != NULL));
-
-    struct pal_hlist_node *node = NULL, *node1 = NULL;
-    struct ipt_nat_entry *npos = NULL;
+    struct ipt_nat_entry *npos = NULL, *next = NULL;
 
     /*delete all rules in nat rule table*/
-    for(i = 0; i < NF_MAX_HOOKS; i++)
+    for(i = 0; nat_table && i < NF_MAX_HOOKS; i++)
     {
-        for (j = 0; j < NAT_TABLE_SIZE; j++)
+        pal_list_for_each_entry_safe(npos, next, &nat_table->table[i].nat_list, list)
         {
-            pal_hlist_for_each_entry_safe(npos, node, node1, &nat_table->table[i].nat_hmap[j], hlist)
-            {
-                pal_hlist_del(&npos->hlist);
-                pal_slab_free(npos);
-            }
+            __ipt_nat_del_rule(net, nat_table, i, npos);
         }
     }
+    nf_net_hooks_rebuild(net);
     rte_rwlock_write_unlock(&net->net_lock);
 }
 
@@ -673,12 +862,16 @@ void ipt_nf_filter_rules_flush(struct net *net)
     ASSERT((filter != NULL));
     struct xt_filter_table *filter_table = (struct xt_filter_table *)filter->private;
 
-    /*filter rule table can't be NULL before destroy them*/
-    ASSERT((filter_table != NULL));
+    /*the net never had filter rules*/
+    if (filter_table == NULL) {
+        rte_rwlock_write_unlock(&net->net_lock);
+        return;
+    }
 
     struct ipt_flow_mask *pos = NULL, *next = NULL;
     struct ipt_filter_entry *fpos = NULL;
     struct pal_hlist_node *node = NULL, *node1 = NULL;
+    struct ipt_filter_cls *cls[NF_MAX_HOOKS];
 
     /*delete all rules in filter rule table*/
     for(i = 0; i < NF_MAX_HOOKS; i++)
@@ -687,19 +880,28 @@ void ipt_nf_filter_rules_flush(struct net *net)
         pal_list_for_each_entry_safe(pos, next, &filter_table->table[i].mask_list, list)
         {
             pal_list_del(&pos->list);
-            pal_slab_free(pos);
+            pal_arena_free(net->arena, pos, sizeof(*pos));
         }
 
-        for (j = 0; j < FILTER_TABLE_SIZE; j++)
+        for (j = 0; j < filter_hmap_size(&filter_table->table[i]); j++)
         {
             pal_hlist_for_each_entry_safe(fpos, node, node1, &filter_table->table[i].filter_hmap[j], hlist)
             {
-                pal_hlist_del(&fpos->hlist);
-                pal_slab_free(fpos);
+                __ipt_filter_del_rule(net, fpos);
             }
         }
+        filter_table->table[i].rule_num = 0;
+        cls[i] = filter_table->table[i].cls;
+        filter_table->table[i].cls = NULL;
     }
+    ipt_filter_table_changed(filter_table);
+    nf_net_hooks_rebuild(net);
     rte_rwlock_write_unlock(&net->net_lock);
+
+    for(i = 0; i < NF_MAX_HOOKS; i++)
+    {
+        ipt_filter_cls_free(cls[i]);
+    }
 }
 
 
@@ -707,84 +909,44 @@ void ipt_nf_filter_rules_flush(struct net *net)
 
 
 /*
- * @brief: test if hit a filter rule, used for datapath
- * @return ipt_filter_entry for success, NULL for error
+ * @brief: search the rules of a hook for the best match of a pkt, by the
+ *         compiled classifier if any, or mask by mask
+ * @return ipt_filter_entry of the highest priority, NULL if no rule matches
  */
-static struct ipt_filter_entry *ipt_filter_hit_rule(struct xt_table *table, u8 hook_num, struct sk_buff *skb)
+static struct ipt_filter_entry *__ipt_filter_search(struct xt_filter_table *filter_table,
+    u8 hook_num, u8 protocol, u32 sip, u32 dip, u16 sport, u16 dport)
 {
-
-    struct ip_hdr *iph = skb_ip_header(skb);
-    struct tcp_hdr *tcph = NULL;
-    struct udp_hdr *udph = NULL;
-    struct icmp_hdr *icmph = NULL;
-    u32 hdr_len;
-    u16 sport;
-    u16 dport;
-    u32 key;
-
-    u32 sip = iph->saddr;
-    u32 dip = iph->daddr;
-    u8 is_syn = 0;
-    u8 is_req = 0;
-    u8 is_udp = 0;
-
-    switch (iph->protocol) {
-        case PAL_IPPROTO_TCP:
-            tcph = skb_l4_header(skb);
-            hdr_len = tcph->doff << 2;
-            if (likely(pskb_may_pull(skb, hdr_len))) {
-                sport = tcph->source;
-                dport = tcph->dest;
-                is_syn = tcph->syn && (!tcph->ack);
-            }else {
-                return NULL;
-            }
-            break;
-        case PAL_IPPROTO_UDP:
-            udph = skb_l4_header(skb);
-            hdr_len = sizeof(*udph);
-            is_udp = 1;
-            if (likely(pskb_may_pull(skb, hdr_len))) {
-                sport = udph->source;
-                dport = udph->dest;
-            }else {
-                return NULL;
-            }
-            break;
-         case PAL_IPPROTO_ICMP:
-            icmph = skb_l4_header(skb);
-            hdr_len = sizeof(*icmph);
-            /*icmp sport and dport set to 0*/
-            sport = 0;
-            dport = 0;
-            if (likely(pskb_may_pull(skb, hdr_len))) {
-                is_req = (icmph->type == ICMP_ECHO) ? 1 : 0;
-            }else {
-                return NULL;
-            }
-            /*no pull, no push*/
-            break;
-         default:
-            /*only filter icmp,tcp,udp*/
-            return NULL;
-    }
-
-    struct xt_filter_table *filter_table = (struct xt_filter_table *)table->private;
-
-    if (filter_table == NULL)
-        return NULL;
-
+    struct filter_rule_table *table = &filter_table->table[hook_num];
     struct ipt_flow_mask *mask = NULL;
     struct ipt_filter_entry *tmp = NULL, *result = NULL;
     struct pal_hlist_node *pos = NULL;
+    struct pal_hlist_head *hmap;
+    u32 key, seq, rule_mask;
+
+    if (likely(table->cls != NULL)) {
+        return ipt_filter_cls_search(table->cls, protocol,
+            sip, dip, sport, dport);
+    }
 
-    pal_list_for_each_entry(mask, &filter_table->table[hook_num].mask_list, list)
+    /*the rules may move to a larger hash meanwhile, then search again*/
+retry:
+    seq = *(volatile u32 *)&table->seq;
+    if (unlikely(seq & 1)) {
+        goto retry;
+    }
+    rte_rmb();
+    rule_mask = table->rule_mask;
+    rte_rmb();
+    hmap = table->filter_hmap;
+    result = NULL;
+
+    pal_list_for_each_entry(mask, &table->mask_list, list)
     {
-        u8 proto = mask->mask.proto ? iph->protocol : 0;
+        u8 proto = mask->mask.proto ? protocol : 0;
         key = nn_filter_rule_hash(sip & mask->mask.sip, dip & mask->mask.dip,
-            proto) & filter_table->table[hook_num].rule_mask;
+            proto) & rule_mask;
 
-        struct pal_hlist_head *head = &filter_table->table[hook_num].filter_hmap[key];
+        struct pal_hlist_head *head = &hmap[key];
 
         pal_hlist_for_each_entry(tmp, pos, head, hlist)
         {
@@ -811,258 +973,175 @@ static struct ipt_filter_entry *ipt_filter_hit_rule(struct xt_table *table, u8 h
             }
         }
     }
-    /*directionary filter only effect on DROP entry*/
-    if (result != NULL) {
-        if (result->dir && result->filter_target == NF_DROP) {
-            if (is_syn || is_req || is_udp) {
-                return result;
-            }else {
-                return NULL;
-            }
-        }
-    }
-
-    return result;
-
-}
-
-
-#define ASM
-#ifdef ASM
-static inline unsigned short from32to16(unsigned a)
-{
-    unsigned short b = a >> 16;
-    asm("addw %w2,%w0\n\t"
-        "adcw $0,%w0\n"
-        : "=r" (b)
-        : "0" (b), "r" (a));
-    return b;
-}
-
-static inline unsigned add32_with_carry(unsigned a, unsigned b)
-{
-    asm("addl %2,%0\n\t"
-        "adcl $0,%0"
-        : "=r" (a)
-        : "0" (a), "r" (b));
-    return a;
-}
 
-
-/*
- * Do a 64-bit checksum on an arbitrary memory area.
- * Returns a 32bit checksum.
- *
- * This isn't as time critical as it used to be because many NICs
- * do hardware checksumming these days.
- *
- * Things tried and found to not make it faster:
- * Manual Prefetching
- * Unrolling to an 128 bytes inner loop.
- * Using interleaving with more registers to break the carry chains.
- */
-static unsigned do_csum(unsigned char *buff, unsigned len)
-{
-    unsigned odd, count;
-    unsigned long result = 0;
-
-    if (unlikely(len == 0))
-        return result;
-    odd = 1 & (unsigned long) buff;
-    if (unlikely(odd)) {
-        result = *buff << 8;
-        len--;
-        buff++;
-    }
-    count = len >> 1;       /* nr of 16-bit words.. */
-    if (count) {
-        if (2 & (unsigned long) buff) {
-            result += *(unsigned short *)buff;
-            count--;
-            len -= 2;
-            buff += 2;
-        }
-        count >>= 1;        /* nr of 32-bit words.. */
-        if (count) {
-            unsigned long zero;
-            unsigned count64;
-            if (4 & (unsigned long) buff) {
-                result += *(unsigned int *) buff;
-                count--;
-                len -= 4;
-                buff += 4;
-            }
-            count >>= 1;    /* nr of 64-bit words.. */
-
-            /* main loop using 64byte blocks */
-            zero = 0;
-            count64 = count >> 3;
-            while (count64) {
-                asm("addq 0*8(%[src]),%[res]\n\t"
-                    "adcq 1*8(%[src]),%[res]\n\t"
-                    "adcq 2*8(%[src]),%[res]\n\t"
-                    "adcq 3*8(%[src]),%[res]\n\t"
-                    "adcq 4*8(%[src]),%[res]\n\t"
-                    "adcq 5*8(%[src]),%[res]\n\t"
-                    "adcq 6*8(%[src]),%[res]\n\t"
-                    "adcq 7*8(%[src]),%[res]\n\t"
-                    "adcq %[zero],%[res]"
-                    : [res] "=r" (result)
-                    : [src] "r" (buff), [zero] "r" (zero),
-                    "[res]" (result));
-                buff += 64;
-                count64--;
-            }
-
-            /* last upto 7 8byte blocks */
-            count %= 8;
-            while (count) {
-                asm("addq %1,%0\n\t"
-                    "adcq %2,%0\n"
-                        : "=r" (result)
-                    : "m" (*(unsigned long *)buff),
-                    "r" (zero),  "0" (result));
-                --count;
-                    buff += 8;
-            }
-            result = add32_with_carry(result>>32,
-                          result&0xffffffff);
-
-            if (len & 4) {
-                result += *(unsigned int *) buff;
-                buff += 4;
-            }
-        }
-        if (len & 2) {
-            result += *(unsigned short *) buff;
-            buff += 2;
-        }
-    }
-    if (len & 1)
-        result += *buff;
-    result = add32_with_carry(result>>32, result & 0xffffffff);
-    if (unlikely(odd)) {
-        result = from32to16(result);
-        result = ((result >> 8) & 0xff) | ((result & 0xff) << 8);
+    rte_rmb();
+    if (unlikely(*(volatile u32 *)&table->seq != seq)) {
+        goto retry;
     }
     return result;
 }
 
 /*
- * computes the checksum of a memory block at buff, length len,
- * and adds in "sum" (32-bit)
- *
- * returns a 32-bit number suitable for feeding into itself
- * or csum_tcpudp_magic
- *
- * this function must be called with even lengths, except
- * for the last fragment, which may be odd
- *
- * it's best to have buff aligned on a 64-bit boundary
+ * @brief: directionary filter only effect on DROP entry, it only drops the
+ *         pkts which may start a connection
  */
-static u32 csum_partial(void *buff, int len, u32 sum)
+static inline struct ipt_filter_entry *ipt_filter_dir_check(struct ipt_filter_entry *result,
+    u8 is_new)
 {
-    return (u32)add32_with_carry(do_csum(buff, len),
-                        (u32)sum);
-}
-
+    if (result != NULL && result->dir && result->filter_target == NF_DROP && !is_new) {
+        return NULL;
+    }
 
-static inline u32 csum_unfold(u16 n)
-{
-    return (u32)n;
+    return result;
 }
 
 /*
- *  Fold a partial checksum
+ * @brief: search the forwarding rules through conntrack. each direction of
+ *         a connection is classified once, its later pkts reuse the rule as
+ *         long as the filter table is unchanged. only connections whose
+ *         first pkt passes are tracked.
+ * @return ipt_filter_entry for hit, NULL for no rule matches
  */
-
-static inline u16 csum_fold(u32 sum)
+static struct ipt_filter_entry *ipt_filter_ct_search(struct net *net,
+    struct xt_filter_table *filter_table, struct ip_hdr *iph, struct tcp_hdr *tcph,
+    u16 sport, u16 dport, u16 ct_sport, u16 ct_dport)
 {
-    asm("addl %1, %0        ;\n"
-        "adcl $0xffff, %0   ;\n"
-        : "=r" (sum)
-        : "r" ((u32)sum << 16),
-          "0" ((u32)sum & 0xffff0000));
-    return (u16)(~(u32)sum >> 16);
-}
+    struct nf_conn_key key;
+    struct nf_conn *ct = NULL;
+    struct ipt_filter_entry *result = NULL;
+    u32 lcore_id = rte_lcore_id();
+    int dir;
+
+    nf_ct_key_init(&key, net, iph->protocol, iph->saddr, iph->daddr, ct_sport, ct_dport);
+    ct = nf_ct_find(&key);
+    if (ct != NULL) {
+        dir = nf_ct_dir(ct, iph->saddr, ct_sport);
+        nf_ct_refresh(ct, dir, tcph);
+        if (likely(ct->gen[dir] == filter_table->gen)) {
+            PAL_PCPU_ADD(&net->stats[lcore_id], ct_hit_pkts, 1);
+            return ct->rule[dir];
+        }
 
+        result = __ipt_filter_search(filter_table, NF_FORWARDING, iph->protocol,
+            iph->saddr, iph->daddr, sport, dport);
+        ct->gen[dir] = filter_table->gen;
+        ct->rule[dir] = result;
+        return result;
+    }
 
-static inline void csum_replace4(u16 *sum, u32 from, u32 to)
-{
-    u32 diff[] = { ~from, to };
+    result = __ipt_filter_search(filter_table, NF_FORWARDING, iph->protocol,
+        iph->saddr, iph->daddr, sport, dport);
+    if (result != NULL && result->filter_target == NF_DROP) {
+        return result;
+    }
 
-    *sum = csum_fold(csum_partial(diff, sizeof(diff), ~csum_unfold(*sum)));
-}
+    ct = nf_ct_new(&key, iph->saddr, ct_sport);
+    if (ct != NULL) {
+        ct->gen[NF_CT_DIR_ORIGINAL] = filter_table->gen;
+        ct->rule[NF_CT_DIR_ORIGINAL] = result;
+        nf_ct_refresh(ct, NF_CT_DIR_ORIGINAL, tcph);
+        PAL_PCPU_ADD(&net->stats[lcore_id], ct_new_conns, 1);
+    }
 
-static inline void csum_replace2(u16 *sum, u16 from, u16 to)
-{
-    csum_replace4(sum, (u32)from, (u32)to);
+    return result;
 }
 
-
-#else
-
-
 /*
- * Fold a partial checksum
+ * @brief: test if hit a filter rule, used for datapath
+ * @return ipt_filter_entry for success, NULL for error
  */
-static inline u16 csum_fold(u32 csum)
-{
-    u32 sum = csum;
-    sum = (sum & 0xffff) + (sum >> 16);
-    sum = (sum & 0xffff) + (sum >> 16);
-    return (u16)~sum;
-}
-
-
-
-static unsigned do_csum(const unsigned short *buff, unsigned len)
+static struct ipt_filter_entry *ipt_filter_hit_rule(struct net *net, struct xt_table *table,
+    u8 hook_num, struct sk_buff *skb)
 {
-    /*do csum for 8 bytes*/
-    unsigned result = 0;
-    result += buff[0];
-    result += buff[1];
-    result += buff[2];
-    result += buff[3];
-    return result;
-}
 
+    struct ip_hdr *iph = skb_ip_header(skb);
+    struct tcp_hdr *tcph = NULL;
+    struct udp_hdr *udph = NULL;
+    struct icmp_hdr *icmph = NULL;
+    u32 hdr_len;
+    u16 sport;
+    u16 dport;
+    u16 ct_sport = 0;
+    u16 ct_dport = 0;
 
+    u8 is_syn = 0;
+    u8 is_req = 0;
+    u8 is_udp = 0;
+    u8 track = 0;
 
-static inline u32 csum_unfold(u16 n)
-{
-    return (u32)n;
-}
+    switch (iph->protocol) {
+        case PAL_IPPROTO_TCP:
+            tcph = skb_l4_header(skb);
+            hdr_len = tcph->doff << 2;
+            if (likely(pskb_may_pull(skb, hdr_len))) {
+                sport = tcph->source;
+                dport = tcph->dest;
+                is_syn = tcph->syn && (!tcph->ack);
+                ct_sport = sport;
+                ct_dport = dport;
+                track = 1;
+            }else {
+                return NULL;
+            }
+            break;
+        case PAL_IPPROTO_UDP:
+            udph = skb_l4_header(skb);
+            hdr_len = sizeof(*udph);
+            is_udp = 1;
+            if (likely(pskb_may_pull(skb, hdr_len))) {
+                sport = udph->source;
+                dport = udph->dest;
+                ct_sport = sport;
+                ct_dport = dport;
+                track = 1;
+            }else {
+                return NULL;
+            }
+            break;
+         case PAL_IPPROTO_ICMP:
+            icmph = skb_l4_header(skb);
+            hdr_len = sizeof(*icmph);
+            /*icmp sport and dport set to 0*/
+            sport = 0;
+            dport = 0;
+            if (likely(pskb_may_pull(skb, hdr_len))) {
+                is_req = (icmph->type == ICMP_ECHO) ? 1 : 0;
+                /*only echo is tracked, both directions carry the same id*/
+                if (icmph->type == ICMP_ECHO || icmph->type == ICMP_ECHOREPLY) {
+                    ct_sport = icmph->un.echo.id;
+                    ct_dport = icmph->un.echo.id;
+                    track = 1;
+                }
+            }else {
+                return NULL;
+            }
+            /*no pull, no push*/
+            break;
+         default:
+            /*only filter icmp,tcp,udp*/
+            return NULL;
+    }
 
-u32 csum_partial(const void *buff, int len, u32 wsum)
-{
-    /*do csum partial for 8 bytes and add to the wsum*/
-    unsigned int sum = (unsigned int)wsum;
-    unsigned int result = do_csum(buff, len);
-
-    /* add in old sum, and carry.. */
-    result += sum;
-    if (sum > result)
-        result += 1;
-    return result;
-}
+    struct xt_filter_table *filter_table = (struct xt_filter_table *)table->private;
 
+    if (filter_table == NULL)
+        return NULL;
 
-static inline void csum_replace4(u16 *sum, u32 from, u32 to)
-{
-    u32 diff[] = { ~from, to };
+    struct ipt_filter_entry *result = NULL;
 
-    *sum = csum_fold(csum_partial(diff, 8, ~csum_unfold(*sum)));
-}
+    if (track && hook_num == NF_FORWARDING) {
+        result = ipt_filter_ct_search(net, filter_table, iph, tcph,
+            sport, dport, ct_sport, ct_dport);
+    } else {
+        result = __ipt_filter_search(filter_table, hook_num, iph->protocol,
+            iph->saddr, iph->daddr, sport, dport);
+    }
 
+    return ipt_filter_dir_check(result, is_syn || is_req || is_udp);
 
-static inline void csum_replace2(u16 *sum, u16 from, u16 to)
-{
-    csum_replace4(sum, (u32)from, (u32)to);
 }
 
 
-#endif
 
 #define	BVR_IP_HDR_MF_SHIFT	13
 //#define	BVR_IP_HDR_MF_FLAG	(1 << BVR_IP_HDR_MF_SHIFT)
@@ -1087,16 +1166,18 @@ static int udpcsum_need_update(struct ip_hdr *iph)
 static unsigned int fn_nat_fn(struct sk_buff *skb, struct ipt_nat_entry *entry)
 {
     struct ip_hdr *iph = skb_ip_header(skb);
+    u32 nat_ip;
 
     if(entry->nat_target == NF_SNAT) {
+        nat_ip = entry->nat_ip | (iph->saddr & entry->host_mask);
         /*update csum for ip checksum*/
-        csum_replace4(&iph->check, iph->saddr, entry->nat_ip);
+        pal_csum_replace4(&iph->check, iph->saddr, nat_ip);
         if (iph->protocol == PAL_IPPROTO_TCP) {
             struct tcp_hdr *tcph = skb_tcp_header(skb);
             /*make sure we can access tcp header*/
             if (likely(pskb_may_pull(skb, sizeof(*tcph)))) {
                 /*update csum for pseudo header */
-                csum_replace4(&tcph->check, iph->saddr, entry->nat_ip);
+                pal_csum_replace4(&tcph->check, iph->saddr, nat_ip);
             }else {
                 return NF_DROP;
             }
@@ -1108,26 +1189,27 @@ static unsigned int fn_nat_fn(struct sk_buff *skb, struct ipt_nat_entry *entry)
             if (udph->check != 0) {
                 if (likely(pskb_may_pull(skb, sizeof(*udph)))) {
                     /*update csum for pseudo header */
-                    csum_replace4(&udph->check, iph->saddr, entry->nat_ip);
+                    pal_csum_replace4(&udph->check, iph->saddr, nat_ip);
                 }else {
                     return NF_DROP;
                 }
             }
         }
 
-        BVR_DEBUG("snat sip from %s to %s\n",trans_ip(iph->saddr, 0), trans_ip(entry->nat_ip, 0));
-        iph->saddr = entry->nat_ip;
+        BVR_DEBUG("snat sip from %s to %s\n",trans_ip(iph->saddr, 0), trans_ip(nat_ip, 0));
+        iph->saddr = nat_ip;
          /*that depends*/
         //skb->snat_flag = 1;
 
     }
     else if(entry->nat_target == NF_DNAT) {
+        nat_ip = entry->nat_ip | (iph->daddr & entry->host_mask);
 
-        csum_replace4(&iph->check, iph->daddr, entry->nat_ip);
+        pal_csum_replace4(&iph->check, iph->daddr, nat_ip);
         if (iph->protocol == PAL_IPPROTO_TCP) {
             struct tcp_hdr *tcph = skb_tcp_header(skb);
             if (pskb_may_pull(skb, sizeof(*tcph))) {
-                csum_replace4(&tcph->check, iph->daddr, entry->nat_ip);
+                pal_csum_replace4(&tcph->check, iph->daddr, nat_ip);
             }else {
                 return NF_DROP;
             }
@@ -1137,18 +1219,19 @@ static unsigned int fn_nat_fn(struct sk_buff *skb, struct ipt_nat_entry *entry)
             struct udp_hdr *udph = skb_udp_header(skb);
             if (udph->check != 0) {
                 if (pskb_may_pull(skb, sizeof(*udph))) {
-                    csum_replace4(&udph->check, iph->daddr, entry->nat_ip);
+                    pal_csum_replace4(&udph->check, iph->daddr, nat_ip);
                 }else {
                     return NF_DROP;
                 }
             }
         }
-        BVR_DEBUG("dnat dip from %s to %s\n",trans_ip(iph->daddr, 0), trans_ip(entry->nat_ip, 0));
-        iph->daddr = entry->nat_ip;
+        BVR_DEBUG("dnat dip from %s to %s\n",trans_ip(iph->daddr, 0), trans_ip(nat_ip, 0));
+        iph->daddr = nat_ip;
         /*that depends*/
         skb->dnat_flag = 1;
     }
-    ADD_COUNTER(entry->counter, skb_len(skb), 1, rte_lcore_id());
+    ADD_COUNTER(entry->counter, skb_pkt_len(skb), 1, rte_lcore_id());
+    bvr_flow_rec_counter(&entry->counter);
  //   entry->hit_pkts++;
  //   entry->hit_bytes += skb_len(skb);
     return NF_ACCEPT;
@@ -1189,11 +1272,48 @@ static unsigned int fn_nat_pre(u8 hooknum, struct sk_buff* skb, struct vport *in
     return fn_nat_fn(skb, entry);
 }
 
+/*
+ * @brief: a hook has work to do if its table has rules. a net without
+ *         tables is being destroyed, its hooks must run to drop the pkts
+ */
+static inline int nf_nat_active(struct net *net, u8 hook_num)
+{
+    struct xt_nat_table *nat_table;
+
+    if (net->nat == NULL) {
+        return 1;
+    }
+    nat_table = (struct xt_nat_table *)net->nat->private;
+    return nat_table != NULL && nat_table->table[hook_num].rule_num > 0;
+}
+
+static inline int nf_filter_active(struct net *net, u8 hook_num)
+{
+    struct xt_filter_table *filter_table;
+
+    if (net->filter == NULL) {
+        return 1;
+    }
+    filter_table = (struct xt_filter_table *)net->filter->private;
+    return filter_table != NULL && filter_table->table[hook_num].rule_num > 0;
+}
+
+static int nf_dnat_active(struct net *net)
+{
+    return nf_nat_active(net, NF_PREROUTING);
+}
+
+int nf_snat_active(struct net *net)
+{
+    return nf_nat_active(net, NF_POSTROUTING);
+}
+
 struct nf_hook_ops nf_nat_pre_ops = {
     .hook = fn_nat_pre,
     .pf = NFPROTO_IPV4,
     .hooknum = NF_PREROUTING,
     .priority = NF_IP_PRI_NAT_DST,
+    .active = nf_dnat_active,
 
 };
 
@@ -1237,6 +1357,7 @@ struct nf_hook_ops nf_nat_post_ops = {
     .pf = NFPROTO_IPV4,
     .hooknum = NF_POSTROUTING,
     .priority = NF_IP_PRI_NAT_SRC,
+    .active = nf_snat_active,
 
 };
 
@@ -1264,16 +1385,21 @@ static unsigned int fn_filter(u8 hooknum, struct sk_buff* skb, struct vport *in,
 
     struct ipt_filter_entry *entry = NULL;
 
-    entry = ipt_filter_hit_rule(table, hooknum, skb);
+    entry = ipt_filter_hit_rule(net, table, hooknum, skb);
     if(NULL == entry) {
         return NF_ACCEPT;
     }
     /*should be optimized. for SMP it may lead cache reponse*/
-    ADD_COUNTER(entry->counter, skb_len(skb), 1, rte_lcore_id());
+    ADD_COUNTER(entry->counter, skb_pkt_len(skb), 1, rte_lcore_id());
+    bvr_flow_rec_counter(&entry->counter);
 
     /*dump pkt*/
     struct ip_hdr *iph = skb_ip_header(skb);
-    if (entry->filter_target == NF_DUMP) {
+    if (entry->filter_target == NF_DROP) {
+        bvr_flow_rec_commit(skb, NULL);
+    } else if (entry->filter_target == NF_DUMP) {
+        /*every pkt of the flow is dumped*/
+        bvr_flow_rec_abort();
         skb_push(skb, (iph->ihl << 2) + sizeof(struct eth_hdr));
         if (pal_dump_pkt(skb, 2000)) {
             BVR_WARNING("pkt dump error\n");
@@ -1285,11 +1411,27 @@ static unsigned int fn_filter(u8 hooknum, struct sk_buff* skb, struct vport *in,
 
 }
 
+static int nf_filter_fwd_active(struct net *net)
+{
+    return nf_filter_active(net, NF_FORWARDING);
+}
+
+static int nf_filter_pre_active(struct net *net)
+{
+    return nf_filter_active(net, NF_PREROUTING);
+}
+
+static int nf_filter_post_active(struct net *net)
+{
+    return nf_filter_active(net, NF_POSTROUTING);
+}
+
 struct nf_hook_ops nf_filter_ops = {
     .hook = fn_filter,
     .pf = NFPROTO_IPV4,
     .hooknum = NF_FORWARDING,
     .priority = NF_IP_PRI_FILTER,
+    .active = nf_filter_fwd_active,
 
 };
 
@@ -1299,6 +1441,7 @@ struct nf_hook_ops nf_pre_dump_ops = {
     .pf = NFPROTO_IPV4,
     .hooknum = NF_PREROUTING,
     .priority = NF_IP_PRI_PRE_DUMP,
+    .active = nf_filter_pre_active,
 
 };
 
@@ -1307,6 +1450,7 @@ struct nf_hook_ops nf_post_dump_ops = {
     .pf = NFPROTO_IPV4,
     .hooknum = NF_POSTROUTING,
     .priority = NF_IP_PRI_POST_DUMP,
+    .active = nf_filter_post_active,
 
 };
 
@@ -1335,12 +1479,53 @@ static void __unused nf_unregister_hook(struct nf_hook_ops *reg)
     pal_list_del(&reg->list);
 }
 
+/*
+ * @brief: compile the hooks having work to do in a net, in priority order,
+ *         so that pkts skip the stages of empty tables. called with the net
+ *         lock held for writing whenever the rules or tables of the net change
+ */
+static void nf_net_hooks_rebuild(struct net *net)
+{
+    struct nf_hook_ops *pos = NULL;
+    u32 hook, n;
+
+    BUILD_BUG_ON(NF_MAX_HOOKS != NF_HOOK_POINTS);
+
+    net_flow_invalidate(net);
+
+    for (hook = 0; hook < NF_MAX_HOOKS; hook++) {
+        n = 0;
+        pal_list_for_each_entry(pos, &nf_hooks[NFPROTO_IPV4][hook], list) {
+            if (pos->hook == NULL || (pos->active && !pos->active(net))) {
+                continue;
+            }
+            ASSERT(n < NF_HOOK_STAGES - 1);
+            net->nf_chain[hook][n++] = pos;
+        }
+        net->nf_chain[hook][n] = NULL;
+    }
+}
+
 int nf_hook_iterate(u8 pf, u8 hook, struct sk_buff *skb,
          struct vport *in, struct vport *out,
          int (*okfn)(struct sk_buff *, struct vport *, struct vport *))
 {
     struct nf_hook_ops *pos = NULL;
+    struct nf_hook_ops **stage = NULL;
+    struct vport *dev = in ? in : out;
     int ret;
+
+    /*ipv4 pkts only run the hooks their net needs*/
+    if (likely(pf == NFPROTO_IPV4 && dev != NULL)) {
+        for (stage = dev_net(dev)->nf_chain[hook]; *stage != NULL; stage++) {
+            ret = (*stage)->hook(hook, skb, in, out, (*stage)->private_data);
+            if (ret == NF_DROP) {
+                return NF_DROP;
+            }
+        }
+        return okfn(skb, in, out);
+    }
+
     pal_list_for_each_entry(pos, &nf_hooks[pf][hook], list) {
         if (pos->hook) {
             ret = pos->hook(hook, skb, in, out, pos->private_data);
@@ -1362,6 +1547,8 @@ int nf_hook_iterate(u8 pf, u8 hook, struct sk_buff *skb,
 
 
 extern struct nf_hook_ops alg_ops;
+extern struct nf_hook_ops alg_in_ops;
+extern int bvr_alg_init(int numa_id);
 
 
 /*call when bvrouter init*/
@@ -1369,6 +1556,11 @@ int nf_init(int numa_id)
 {
 
     u32 i, j;
+
+    /*rules are packed in the chunks of the net arena*/
+    BUILD_BUG_ON(sizeof(struct ipt_nat_entry) > PAL_ARENA_SMALL_MAX);
+    BUILD_BUG_ON(sizeof(struct ipt_filter_entry) > PAL_ARENA_SMALL_MAX);
+
     for (i = 0;i < NFPROTO_NUMPROTO; i++)
     {
         for (j = 0; j < NF_MAX_HOOKS; j++)
@@ -1383,28 +1575,34 @@ int nf_init(int numa_id)
     nf_register_hook(&nf_pre_dump_ops);
     nf_register_hook(&nf_post_dump_ops);
     nf_register_hook(&alg_ops);
+    nf_register_hook(&alg_in_ops);
 
     /*create slab*/
     /*param numa should be numa id where worker running on(the same as phy port plugged in)*/
-    g_xt_table_slab = pal_slab_create("xt_table", XT_TABLE_SLAB_SIZE,
+    g_xt_table_slab = pal_slab_create_multipc("xt_table", XT_TABLE_SLAB_SIZE,
         sizeof(struct xt_table), numa_id, 0);
-    g_xt_nat_table_slab = pal_slab_create("xt_nat_table", XT_NAT_TABLE_SLAB_SIZE,
-        sizeof(struct xt_nat_table), numa_id, 0);
-    g_xt_filter_table_slab = pal_slab_create("xt_filter_table", XT_FILTER_TABLE_SLAB_SIZE,
-        sizeof(struct xt_filter_table), numa_id, 0);
-    g_ipt_nat_entry_slab = pal_slab_create("ipt_nat_entry", IPT_NAT_ENTRY_SLAB_SIZE,
-        sizeof(struct ipt_nat_entry), numa_id, 0);
-    g_ipt_filter_entry_slab = pal_slab_create("ipt_filter_entry", IPT_FILTER_ENTRY_SLAB_SIZE,
-        sizeof(struct ipt_filter_entry), numa_id, 0);
-    g_ipt_filter_mask_slab = pal_slab_create("ipt_filter_mask", IPT_FILTER_ENTRY_SLAB_SIZE,
-        sizeof(struct ipt_flow_mask), numa_id, 0);
-
-    if (g_xt_table_slab == NULL || g_xt_nat_table_slab == NULL || g_xt_filter_table_slab == NULL
-        || g_ipt_nat_entry_slab == NULL || g_ipt_filter_entry_slab == NULL) {
+    /*rule tables, rules and masks are allocated from the arena of each net*/
+    g_ipt_nat_htable = pal_cuckoo_create("ipt_nat", IPT_NAT_ENTRY_SLAB_SIZE,
+        sizeof(struct ipt_nat_key), numa_id);
+
+    if (g_xt_table_slab == NULL || g_ipt_nat_htable == NULL) {
         PAL_ERROR("netfilter init error\n");
         return -1;
     }
+
+    if (bvr_alg_init(numa_id)) {
+        return -1;
+    }
     return 0;
 
 }
 
+/*call on each receiver and worker when bvrouter init*/
+int nf_thread_init(int tid)
+{
+    if (nf_ct_thread_init(tid) || bvr_flow_thread_init(tid)) {
+        return -1;
+    }
+    return 0;
+}
+
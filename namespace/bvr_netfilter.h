@@ -55,6 +55,7 @@ enum {
 };
 
 enum {
+    NF_IP_PRI_ALG_IN    = -1,   /*alg seq/ack fixup, before dnat*/
     NF_IP_PRI_NAT_DST   = 0,
     NF_IP_PRI_PRE_DUMP  = 1,
     NF_IP_PRI_FILTER    = 2,
@@ -70,13 +71,10 @@ enum {
 #define FILTER_TABLE "filter"
 
 
-/*each net has 2 xt_table*/
+/*each net has 2 xt_table, their rule tables are allocated from the arena
+  of the net with the first rule*/
 #define XT_TABLE_SLAB_SIZE (NAMESPACE_SLAB_SIZE * 2)
-/*each net has 1 xt_nat_table and 1 xt_filter_table*/
-#define XT_NAT_TABLE_SLAB_SIZE NAMESPACE_SLAB_SIZE
-#define XT_FILTER_TABLE_SLAB_SIZE NAMESPACE_SLAB_SIZE
-#define IPT_NAT_ENTRY_SLAB_SIZE ((XT_NAT_TABLE_SLAB_SIZE) * (NAT_TABLE_SIZE)/8)
-#define IPT_FILTER_ENTRY_SLAB_SIZE ((XT_NAT_TABLE_SLAB_SIZE) * (FILTER_TABLE_SIZE)/8)
+#define IPT_NAT_ENTRY_SLAB_SIZE ((NAMESPACE_SLAB_SIZE) * (NAT_TABLE_SIZE)/8)
 
 
 
@@ -86,8 +84,9 @@ enum {
  */
 static inline char *trans_ip(u32 ip, u32 mask)
 {
-    static int i = 0;
-    static char g_print_ip_buf[5][20];
+    /*per thread, control threads print in parallel*/
+    static __thread int i = 0;
+    static __thread char g_print_ip_buf[5][20];
 
     i = (i + 1) % 5;
     memset(g_print_ip_buf[i], 0, 20);
@@ -111,8 +110,8 @@ static inline char *trans_mac(unsigned char *mac)
     if (!mac) {
         return NULL;
     }
-    static int i = 0;
-    static char g_print_mac_buf[5][20];
+    static __thread int i = 0;
+    static __thread char g_print_mac_buf[5][20];
 
     i = (i + 1) % 5;
     memset(g_print_mac_buf[i], 0, 20);
@@ -140,6 +139,8 @@ struct nf_hook_ops {
     u8 hooknum;                 /*hook number*/
     int priority;               /*priority*/
     void *private_data;
+    /*whether the hook has work to do in a net, NULL for always*/
+    int (*active)(struct net *net);
 };
 
 
@@ -174,27 +175,39 @@ struct xt_table {
 /*each namespace has 1024 nat rules*/
 #define NAT_HASH_OFFSET         10
 #define NAT_TABLE_SIZE          (1UL << NAT_HASH_OFFSET)
-#define NAT_TABLE_MASK          (NAT_TABLE_SIZE - 1)
 
 
+/*rule hit counters of one cpu, see pal_pcpu.h. rules are freed without
+  a grace period, so they are written in place rather than batched*/
 struct counter {
+    struct pal_pcpu_head head;
     u64 pcnt, bcnt;
-    u64 pad[6];
-
-};
+} __rte_cache_aligned;
 
 struct ipt_counter {
     struct counter cnt[PAL_MAX_CPU];
 };
 
-#define ADD_COUNTER(c, b, p, lcoreid) do { (c).cnt[lcoreid].bcnt += (b);\
-    (c).cnt[lcoreid].pcnt += (p); } while(0)
+#define ADD_COUNTER(c, b, p, lcoreid) do { \
+    struct counter *__cnt = &(c).cnt[lcoreid]; \
+    pal_pcpu_write_begin(&__cnt->head); \
+    __cnt->bcnt += (b); \
+    __cnt->pcnt += (p); \
+    pal_pcpu_write_end(&__cnt->head); } while(0)
+
+#define SUM_COUNTER(c, sum) pal_pcpu_sum(&(sum), (c).cnt, sizeof(struct counter))
+
 
+#define NAT_PLEN_MAX            32
 
+/*rules are looked up in a cuckoo table shared by all namespaces, keyed by
+  prefix and prefix length. a lookup probes the lengths used by the hook,
+  longest first. the list is only used to walk the rules of one hook*/
 struct nat_rule_table {
     u32 rule_num;
-    u32 rule_mask;
-    struct pal_hlist_head nat_hmap[NAT_TABLE_SIZE];
+    struct pal_list_head nat_list;
+    u64 plen_map;                       /*bit n set if rules of length n exist*/
+    u32 plen_cnt[NAT_PLEN_MAX + 1];     /*number of rules of each length*/
 };
 
 struct xt_nat_table {
@@ -202,30 +215,53 @@ struct xt_nat_table {
 };
 
 
+/*
+ * orig_ip/orig_plen is the prefix matched, nat_ip/nat_plen the prefix mapped
+ * to. the host bits outside both prefixes are kept, so a /24 mapped to a /24
+ * keeps the offset, and a prefix mapped to a smaller pool or a single ip is
+ * a many-to-one nat.
+ */
 struct ipt_nat_entry {
-    struct pal_hlist_node hlist;
+    struct pal_list_head list;
     u32 orig_ip;
     u32 nat_ip;
     u32 nat_target;
-    u32 pad[9];
+    u8 orig_plen;
+    u8 nat_plen;
+    u16 pad0;
+    u32 host_mask;              /*bits kept from the original ip, network order*/
+    u32 pad[7];
     struct ipt_counter counter;
 //    volatile u64 hit_pkts;
 //    volatile u64 hit_bytes;
 };
 
-#define FILTER_HASH_OFFSET          7
-#define FILTER_TABLE_SIZE           (1UL << FILTER_HASH_OFFSET)
-#define FILTER_TABLE_MASK           (FILTER_TABLE_SIZE - 1)
+/*the rule hash of a hook is allocated with its first rule, and doubled
+  while the rules outnumber the buckets*/
+#define FILTER_TABLE_MIN_SIZE       4
+#define FILTER_TABLE_MAX_SIZE       (1UL << 12)
+
+struct ipt_filter_cls;
 
 struct filter_rule_table {
-    struct pal_list_head mask_list;     //rule table for filter
-    u32 rule_num;           //mask list
-    u32 rule_mask;          //rule number count
-    struct pal_hlist_head filter_hmap[FILTER_TABLE_SIZE];  //rule hash table
+    struct pal_list_head mask_list;     //mask list
+    u32 rule_num;           //rule number count
+    u32 rule_mask;          //number of buckets - 1
+    struct ipt_filter_cls *cls;         //compiled rules, NULL to search by masks
+    struct pal_hlist_head *filter_hmap; //rule hash table, NULL without rules
+    u32 seq;                //odd while the rules move to a larger hash
 };
 
+/*number of buckets of the rule hash of a hook*/
+static inline u32 filter_hmap_size(const struct filter_rule_table *table)
+{
+    return table->filter_hmap ? table->rule_mask + 1 : 0;
+}
+
 struct xt_filter_table {
     struct filter_rule_table table[NF_MAX_HOOKS];
+    /*changed with the rules, tells conntrack its cached rules are stale*/
+    u64 gen;
 };
 
 struct flow_key {
@@ -273,6 +309,11 @@ struct ipt_filter_entry {
 
 int nf_init(int numa);
 
+/*conntrack shard and flow cache of a receiver or worker, run on that thread*/
+int nf_thread_init(int tid);
+
+int nf_snat_active(struct net *net);
+
 int ipt_nat_insert_rule(struct net *net, u8 hook_num, struct ipt_nat_entry entry);
 int ipt_nat_del_rule(struct net *net, u8 hook_num, struct ipt_nat_entry entry);
 int ipt_filter_add_rule(struct net *net, u8 hook_num, struct ipt_filter_entry entry);
@@ -5,7 +5,7 @@
 static int route_net_init(struct net *net)
 {
     /*call pal api to alloc route table*/
-    net->route_table = pal_rtable_new();
+    net->route_table = pal_rtable_new(net->arena);
 
     if (net->route_table == NULL) {
         BVR_ERROR("run out of memory when alloc route table\n");
@@ -0,0 +1,673 @@
+/**
+**********************************************************************
+*
+* Copyright (c) 2014 Baidu.com, Inc. All Rights Reserved
+* @file         $HeadURL: $
+* @brief        binary snapshot of the control state
+* @author       zhangyu(zhangyu09@baidu.com)
+* @date         $Date:$
+* @version      $Id: $
+***********************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bvrouter_config.h"
+#include "bvr_snapshot.h"
+#include "bvr_namespace.h"
+#include "bvr_netfilter.h"
+#include "bvr_errno.h"
+#include "pal_l2_ctl.h"
+#include "pal_list.h"
+#include "pal_vxlan.h"
+#include "pal_vport.h"
+#include "pal_phy_vport.h"
+#include "pal_ip_cell.h"
+#include "pal_route.h"
+#include "logger.h"
+
+extern struct pal_hlist_head namespace_hash_table[];
+extern br_conf_t g_bvrouter_conf_info;
+
+volatile sig_atomic_t g_bvr_snap_exit = 0;
+
+#define for_each_net(net, node, i)                                          \
+    for (i = 0; i < NAMESPACE_TABLE_SIZE; i++)                              \
+        pal_hlist_for_each_entry(net, node, &namespace_hash_table[i], hlist)
+
+struct snap_writer {
+    FILE *fp;
+    struct bvr_snap_hdr hdr;
+    struct bvr_snap_sec sec;        /*section being written*/
+    long sec_pos;
+    int err;
+};
+
+static void snap_write(struct snap_writer *w, const void *buf, size_t len)
+{
+    if (!w->err && fwrite(buf, len, 1, w->fp) != 1) {
+        w->err = 1;
+    }
+}
+
+static void snap_sec_begin(struct snap_writer *w, u32 cmd_id, u32 rec_size)
+{
+    w->sec.cmd_id = cmd_id;
+    w->sec.rec_size = rec_size;
+    w->sec.n_rec = 0;
+    w->sec_pos = ftell(w->fp);
+    snap_write(w, &w->sec, sizeof(w->sec));
+}
+
+static inline void snap_rec(struct snap_writer *w, const void *rec)
+{
+    snap_write(w, rec, w->sec.rec_size);
+    w->sec.n_rec++;
+}
+
+/*the record count of a section is known once it is written*/
+static void snap_sec_end(struct snap_writer *w)
+{
+    if (w->err) {
+        return;
+    }
+    if (fseek(w->fp, w->sec_pos, SEEK_SET) ||
+        fwrite(&w->sec, sizeof(w->sec), 1, w->fp) != 1 ||
+        fseek(w->fp, 0, SEEK_END)) {
+        w->err = 1;
+        return;
+    }
+    w->hdr.n_sec++;
+}
+
+static void snap_save_nets(struct snap_writer *w)
+{
+    struct pal_hlist_node *node = NULL;
+    struct net *net = NULL;
+    struct bvr_snap_ns r;
+    u32 i;
+
+    snap_sec_begin(w, NN_CMD_ID_ADD_NAMESPACE, sizeof(r));
+    for_each_net(net, node, i) {
+        memset(&r, 0, sizeof(r));
+        snprintf(r.name, sizeof(r.name), "%s", net->name);
+        r.sync_gen = net->sync_gen;
+        r.mss_clamp = net->mss_clamp;
+        snap_rec(w, &r);
+    }
+    snap_sec_end(w);
+}
+
+static void snap_save_ifs(struct snap_writer *w)
+{
+    struct pal_hlist_node *node = NULL;
+    struct net *net = NULL;
+    struct vport *vp = NULL;
+    struct bvr_snap_if r;
+    u32 i;
+
+    snap_sec_begin(w, NN_CMD_ID_ADD_INT_IF, sizeof(r));
+    for_each_net(net, node, i) {
+        pal_list_for_each_entry(vp, &net->dev_base_head, list_nd) {
+            memset(&r, 0, sizeof(r));
+            snprintf(r.bvrouter, sizeof(r.bvrouter), "%s", net->name);
+            snprintf(r.ifname, sizeof(r.ifname), "%s", vp->vport_name);
+            snprintf(r.uuid, sizeof(r.uuid), "%s", vp->uuid ? vp->uuid : "");
+            r.ip = vp->vport_ip;
+            r.type = vp->vport_type;
+            r.prefixlen = vp->prefix_len;
+            memcpy(r.mac, vp->vport_eth_addr, sizeof(r.mac));
+            if (vp->vport_type == VXLAN_VPORT) {
+                r.vni = ((struct int_vport *)vp)->vdev->vni;
+                r.mss_clamp = ((struct int_vport *)vp)->mss_clamp;
+            }
+            snap_rec(w, &r);
+        }
+    }
+    snap_sec_end(w);
+}
+
+static void snap_save_fips(struct snap_writer *w)
+{
+    struct pal_hlist_node *node = NULL;
+    struct net *net = NULL;
+    struct vport *vp = NULL;
+    struct ip_cell *fip = NULL;
+    struct bvr_snap_fip r;
+    u32 i;
+
+    snap_sec_begin(w, NN_CMD_ID_ADD_IP, sizeof(r));
+    for_each_net(net, node, i) {
+        pal_list_for_each_entry(vp, &net->dev_base_head, list_nd) {
+            if (vp->vport_type != PHY_VPORT) {
+                continue;
+            }
+            pal_list_for_each_entry(fip, &((struct phy_vport *)vp)->floating_list, list) {
+                memset(&r, 0, sizeof(r));
+                snprintf(r.ifname, sizeof(r.ifname), "%s", vp->vport_name);
+                r.ip = fip->ip;
+                snap_rec(w, &r);
+            }
+        }
+    }
+    snap_sec_end(w);
+}
+
+static int snap_vdev_cmp(const void *a, const void *b)
+{
+    u32 x = (*(struct vxlan_dev * const *)a)->vni;
+    u32 y = (*(struct vxlan_dev * const *)b)->vni;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * @brief the vxlan devs of the internal interfaces, each one once
+ * @return the number of devs, -1 on error
+ */
+static int snap_vdevs(struct vxlan_dev ***vdevs)
+{
+    struct pal_hlist_node *node = NULL;
+    struct net *net = NULL;
+    struct vport *vp = NULL;
+    struct vxlan_dev **v;
+    int i, j, n = 0;
+    u32 k;
+
+    for_each_net(net, node, k) {
+        pal_list_for_each_entry(vp, &net->dev_base_head, list_nd) {
+            n += vp->vport_type == VXLAN_VPORT;
+        }
+    }
+    v = calloc(n + 1, sizeof(*v));
+    if (v == NULL) {
+        return -1;
+    }
+
+    n = 0;
+    for_each_net(net, node, k) {
+        pal_list_for_each_entry(vp, &net->dev_base_head, list_nd) {
+            if (vp->vport_type == VXLAN_VPORT) {
+                v[n++] = ((struct int_vport *)vp)->vdev;
+            }
+        }
+    }
+    qsort(v, n, sizeof(*v), snap_vdev_cmp);
+    for (i = 0, j = 0; i < n; i++) {
+        if (j == 0 || v[j - 1] != v[i]) {
+            v[j++] = v[i];
+        }
+    }
+
+    *vdevs = v;
+    return j;
+}
+
+static void snap_save_vnis(struct snap_writer *w, struct vxlan_dev **vdevs, int n)
+{
+    struct bvr_snap_vni r;
+    int i;
+
+    snap_sec_begin(w, NN_CMD_ID_SET_FDB_LEARNING, sizeof(r));
+    for (i = 0; i < n; i++) {
+        if (!(vdevs[i]->flags & VXLAN_F_LEARN) &&
+            vdevs[i]->ageing_time == (u64)VXLAN_FDB_AGEING_DEFAULT * HZ) {
+            continue;
+        }
+        memset(&r, 0, sizeof(r));
+        r.vni = vdevs[i]->vni;
+        r.learning = !!(vdevs[i]->flags & VXLAN_F_LEARN);
+        r.ageing = vdevs[i]->ageing_time / HZ;
+        snap_rec(w, &r);
+    }
+    snap_sec_end(w);
+}
+
+struct snap_route_walk {
+    struct snap_writer *w;
+    struct net *net;
+};
+
+static void snap_walk_route(const struct route_entry *e, void *arg)
+{
+    struct snap_route_walk *walk = arg;
+    struct nn_bin_route r;
+
+    /*connected routes come with their interfaces*/
+    if (e->route_type != PAL_ROUTE_COMMON) {
+        return;
+    }
+    memset(&r, 0, sizeof(r));
+    snprintf(r.bvrouter, sizeof(r.bvrouter), "%s", walk->net->name);
+    if (e->dev) {
+        snprintf(r.ifname, sizeof(r.ifname), "%s", e->dev->vport_name);
+    }
+    r.prefix = e->prefix;
+    r.nexthop = e->next_hop;
+    r.prefixlen = e->prefixlen;
+    snap_rec(walk->w, &r);
+}
+
+static void snap_save_routes(struct snap_writer *w)
+{
+    struct pal_hlist_node *node = NULL;
+    struct snap_route_walk walk = {w, NULL};
+    u32 i;
+
+    snap_sec_begin(w, NN_CMD_ID_ADD_ROUTE, sizeof(struct nn_bin_route));
+    for_each_net(walk.net, node, i) {
+        pal_route_walk(walk.net->route_table, snap_walk_route, &walk);
+    }
+    snap_sec_end(w);
+}
+
+static void snap_save_nats(struct snap_writer *w, struct net *net)
+{
+    struct xt_nat_table *nat_table = (struct xt_nat_table *)net->nat->private;
+    struct ipt_nat_entry *entry = NULL;
+    struct nn_bin_nf_rule r;
+    int i;
+
+    for (i = 0; nat_table && i < NF_MAX_HOOKS; i++) {
+        pal_list_for_each_entry(entry, &nat_table->table[i].nat_list, list) {
+            memset(&r, 0, sizeof(r));
+            snprintf(r.bvrouter, sizeof(r.bvrouter), "%s", net->name);
+            r.table = NN_BIN_TABLE_NAT;
+            r.hook_num = i;
+            r.target = entry->nat_target;
+            r.ip[0] = entry->orig_ip;
+            r.ip[1] = entry->nat_ip;
+            r.plen[0] = entry->orig_plen;
+            r.plen[1] = entry->nat_plen;
+            snap_rec(w, &r);
+        }
+    }
+}
+
+static inline u8 snap_mask_plen(u32 mask)
+{
+    return __builtin_popcount(mask);
+}
+
+static void snap_save_filters(struct snap_writer *w, struct net *net)
+{
+    struct xt_filter_table *filter_table = (struct xt_filter_table *)net->filter->private;
+    struct ipt_filter_entry *entry = NULL;
+    struct pal_hlist_node *pos = NULL;
+    struct nn_bin_nf_rule r;
+    int i;
+    u32 j;
+
+    for (i = 0; filter_table && i < NF_MAX_HOOKS; i++) {
+        for (j = 0; j < filter_hmap_size(&filter_table->table[i]); j++) {
+            pal_hlist_for_each_entry(entry, pos, &filter_table->table[i].filter_hmap[j], hlist) {
+                memset(&r, 0, sizeof(r));
+                snprintf(r.bvrouter, sizeof(r.bvrouter), "%s", net->name);
+                r.table = NN_BIN_TABLE_FILTER;
+                r.hook_num = i;
+                r.target = entry->filter_target;
+                r.ip[0] = entry->key.sip;
+                r.ip[1] = entry->key.dip;
+                r.plen[0] = snap_mask_plen(entry->mask_value.sip);
+                r.plen[1] = snap_mask_plen(entry->mask_value.dip);
+                r.dir = entry->dir;
+                r.priority = entry->priority;
+                if (entry->mask_value.sport) {
+                    r.flags |= NN_BIN_NF_SPORT;
+                    r.sport[0] = entry->key.sport[0];
+                    r.sport[1] = entry->key.sport[1];
+                }
+                if (entry->mask_value.dport) {
+                    r.flags |= NN_BIN_NF_DPORT;
+                    r.dport[0] = entry->key.dport[0];
+                    r.dport[1] = entry->key.dport[1];
+                }
+                if (entry->mask_value.proto) {
+                    r.flags |= NN_BIN_NF_PROTO;
+                    r.proto = entry->key.proto;
+                }
+                snap_rec(w, &r);
+            }
+        }
+    }
+}
+
+static void snap_save_nf_rules(struct snap_writer *w)
+{
+    struct pal_hlist_node *node = NULL;
+    struct net *net = NULL;
+    u32 i;
+
+    snap_sec_begin(w, NN_CMD_ID_ADD_NF_RULE, sizeof(struct nn_bin_nf_rule));
+    for_each_net(net, node, i) {
+        snap_save_nats(w, net);
+        snap_save_filters(w, net);
+    }
+    snap_sec_end(w);
+}
+
+/*static entries only, a group entry gives a record per remote*/
+static void snap_save_fdbs(struct snap_writer *w, struct vxlan_dev **vdevs, int n)
+{
+    struct vxlan_fdb *f = NULL;
+    struct vxlan_rdst *rd;
+    struct nn_bin_fdb r;
+    int i;
+
+    snap_sec_begin(w, NN_CMD_ID_ADD_FDB_ENTRY, sizeof(r));
+    for (i = 0; i < n; i++) {
+        /*learned entries are added meanwhile by the receivers*/
+        lock_vxlan_fdb();
+        pal_list_for_each_entry(f, &vdevs[i]->fdb_list, list) {
+            if (f->state != VXLAN_FDB_STATIC) {
+                continue;
+            }
+            for (rd = &f->remote; rd; rd = rd->remote_next) {
+                memset(&r, 0, sizeof(r));
+                r.vni = vdevs[i]->vni;
+                r.remote_ip = rd->remote_ip;
+                r.remote_port = ntohs(rd->remote_port);
+                memcpy(r.mac, f->eth_addr, sizeof(r.mac));
+                snap_rec(w, &r);
+            }
+        }
+        unlock_vxlan_fdb();
+    }
+    snap_sec_end(w);
+}
+
+static void snap_save_arps(struct snap_writer *w, struct vxlan_dev **vdevs, int n)
+{
+    struct vxlan_arp_entry *entry = NULL;
+    struct nn_bin_arp r;
+    int i;
+
+    snap_sec_begin(w, NN_CMD_ID_ADD_ARP_ENTRY, sizeof(r));
+    for (i = 0; i < n; i++) {
+        pal_list_for_each_entry(entry, &vdevs[i]->arp_list, list) {
+            memset(&r, 0, sizeof(r));
+            r.vni = vdevs[i]->vni;
+            r.ip = entry->ip;
+            memcpy(r.mac, entry->mac_addr, sizeof(r.mac));
+            snap_rec(w, &r);
+        }
+    }
+    snap_sec_end(w);
+}
+
+int bvr_snapshot_save(const char *path)
+{
+    struct snap_writer w;
+    struct vxlan_dev **vdevs = NULL;
+    char tmp[PATH_MAX];
+    int n_vdev;
+
+    if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)) {
+        BVR_WARNING("snapshot path %s too long\n", path);
+        return -1;
+    }
+    n_vdev = snap_vdevs(&vdevs);
+    if (n_vdev < 0) {
+        BVR_WARNING("no memory to write snapshot\n");
+        return -1;
+    }
+
+    memset(&w, 0, sizeof(w));
+    w.fp = fopen(tmp, "w");
+    if (w.fp == NULL) {
+        BVR_WARNING("open %s failed: %s\n", tmp, strerror(errno));
+        free(vdevs);
+        return -1;
+    }
+
+    w.hdr.magic = BVR_SNAP_MAGIC;
+    w.hdr.version = BVR_SNAP_VERSION;
+    w.hdr.time = time(NULL);
+    snap_write(&w, &w.hdr, sizeof(w.hdr));
+
+    /*in the order they are loaded, the namespaces and interfaces first*/
+    snap_save_nets(&w);
+    snap_save_ifs(&w);
+    snap_save_fips(&w);
+    snap_save_vnis(&w, vdevs, n_vdev);
+    snap_save_routes(&w);
+    snap_save_nf_rules(&w);
+    snap_save_fdbs(&w, vdevs, n_vdev);
+    snap_save_arps(&w, vdevs, n_vdev);
+    free(vdevs);
+
+    if (!w.err && (fseek(w.fp, 0, SEEK_SET) ||
+        fwrite(&w.hdr, sizeof(w.hdr), 1, w.fp) != 1 ||
+        fflush(w.fp) || fsync(fileno(w.fp)))) {
+        w.err = 1;
+    }
+    if (fclose(w.fp) || w.err || rename(tmp, path)) {
+        BVR_WARNING("write snapshot %s failed: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+
+/*a name field must hold its terminating nul*/
+static inline int snap_name_valid(const char *name, u32 size)
+{
+    return memchr(name, '\0', size) != NULL;
+}
+
+static int snap_ns_add(const void *rec)
+{
+    const struct bvr_snap_ns *r = rec;
+    char name[NN_BIN_NS_NAME_SIZE];
+    struct net *net;
+    int ret;
+
+    if (!snap_name_valid(r->name, sizeof(r->name))) {
+        return -NN_EPARSECMD;
+    }
+    memcpy(name, r->name, sizeof(name));
+    ret = net_create(name);
+    if (ret) {
+        return ret;
+    }
+    net = net_get(name);
+    net->sync_gen = r->sync_gen;
+    net->mss_clamp = r->mss_clamp;
+    return 0;
+}
+
+static int snap_if_add(const void *rec)
+{
+    const struct bvr_snap_if *r = rec;
+    char ifname[NN_BIN_IF_NAME_SIZE];
+    char uuid[BVR_SNAP_UUID_SIZE];
+    struct int_vport_entry in;
+    struct phy_vport_entry ext;
+    struct net *net;
+    int ret;
+
+    if (!snap_name_valid(r->bvrouter, sizeof(r->bvrouter)) ||
+        !snap_name_valid(r->ifname, sizeof(r->ifname)) ||
+        !snap_name_valid(r->uuid, sizeof(r->uuid))) {
+        return -NN_EPARSECMD;
+    }
+    net = net_get((char *)r->bvrouter);
+    if (!net) {
+        return -NN_ENSNOTEXIST;
+    }
+    memcpy(ifname, r->ifname, sizeof(ifname));
+    memcpy(uuid, r->uuid, sizeof(uuid));
+
+    if (r->type == VXLAN_VPORT) {
+        in.vport_name = ifname;
+        in.uuid = uuid;
+        memcpy(in.int_gw_mac, r->mac, sizeof(in.int_gw_mac));
+        in.int_gw_ip = r->ip;
+        in.prefix_len = r->prefixlen;
+        in.vni = r->vni;
+        ret = int_vport_add_ctl(&in, net);
+        if (ret == 0 && r->mss_clamp) {
+            ret = int_vport_mss_clamp_ctl(ifname, r->mss_clamp, net);
+        }
+    } else if (r->type == PHY_VPORT) {
+        ext.vport_name = ifname;
+        ext.uuid = uuid;
+        memcpy(ext.ext_gw_mac, r->mac, sizeof(ext.ext_gw_mac));
+        ext.ext_gw_ip = r->ip;
+        ext.prefix_len = r->prefixlen;
+        ret = phy_vport_add_ctl(&ext, net);
+    } else {
+        return -NN_EINVAL;
+    }
+    return ret;
+}
+
+static int snap_fip_add(const void *rec)
+{
+    const struct bvr_snap_fip *r = rec;
+    char ifname[NN_BIN_IF_NAME_SIZE];
+
+    if (!snap_name_valid(r->ifname, sizeof(r->ifname))) {
+        return -NN_EPARSECMD;
+    }
+    memcpy(ifname, r->ifname, sizeof(ifname));
+    return floating_ip_add_ctl(r->ip, ifname);
+}
+
+static int snap_vni_set(const void *rec)
+{
+    const struct bvr_snap_vni *r = rec;
+
+    return vxlan_fdb_learning_ctl(r->vni, r->learning, r->ageing);
+}
+
+/*
+ * @brief how the records of a section are loaded
+ * @return the size of its records, 0 if the section is unknown
+ */
+static u32 snap_loader(u32 cmd_id, int (**apply)(const void *rec))
+{
+    switch (cmd_id) {
+    case NN_CMD_ID_ADD_NAMESPACE:
+        *apply = snap_ns_add;
+        return sizeof(struct bvr_snap_ns);
+    case NN_CMD_ID_ADD_INT_IF:
+        *apply = snap_if_add;
+        return sizeof(struct bvr_snap_if);
+    case NN_CMD_ID_ADD_IP:
+        *apply = snap_fip_add;
+        return sizeof(struct bvr_snap_fip);
+    case NN_CMD_ID_SET_FDB_LEARNING:
+        *apply = snap_vni_set;
+        return sizeof(struct bvr_snap_vni);
+    case NN_CMD_ID_ADD_ROUTE:
+    case NN_CMD_ID_ADD_NF_RULE:
+    case NN_CMD_ID_ADD_FDB_ENTRY:
+    case NN_CMD_ID_ADD_ARP_ENTRY:
+        *apply = g_msg_bin_handler_tbl[cmd_id].apply;
+        return g_msg_bin_handler_tbl[cmd_id].rec_size;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * @brief check the sections of a snapshot fit in it before loading any
+ * @return 0 if the file is sound, -1 if not
+ */
+static int snap_check(const char *base, size_t size)
+{
+    const struct bvr_snap_hdr *hdr = (const struct bvr_snap_hdr *)base;
+    const struct bvr_snap_sec *sec;
+    int (*apply)(const void *rec);
+    size_t off = sizeof(*hdr);
+    u32 i;
+
+    if (size < sizeof(*hdr) || hdr->magic != BVR_SNAP_MAGIC ||
+        hdr->version != BVR_SNAP_VERSION) {
+        return -1;
+    }
+    for (i = 0; i < hdr->n_sec; i++) {
+        if (size - off < sizeof(*sec)) {
+            return -1;
+        }
+        sec = (const struct bvr_snap_sec *)(base + off);
+        off += sizeof(*sec);
+        if (sec->rec_size == 0 || sec->n_rec > (size - off) / sec->rec_size ||
+            snap_loader(sec->cmd_id, &apply) != sec->rec_size) {
+            return -1;
+        }
+        off += sec->n_rec * sec->rec_size;
+    }
+    return off == size ? 0 : -1;
+}
+
+int bvr_snapshot_load(const char *path)
+{
+    const struct bvr_snap_hdr *hdr;
+    const struct bvr_snap_sec *sec;
+    int (*apply)(const void *rec);
+    struct stat st;
+    const char *base, *rec;
+    size_t off;
+    u64 j, n_rec = 0, failed = 0;
+    u32 i;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        BVR_WARNING("open snapshot %s failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        BVR_WARNING("snapshot %s is empty\n", path);
+        return -1;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        BVR_WARNING("map snapshot %s failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (snap_check(base, st.st_size)) {
+        munmap((void *)base, st.st_size);
+        BVR_WARNING("snapshot %s is not of version %d, ignored\n", path, BVR_SNAP_VERSION);
+        return -1;
+    }
+
+    hdr = (const struct bvr_snap_hdr *)base;
+    off = sizeof(*hdr);
+    for (i = 0; i < hdr->n_sec; i++) {
+        sec = (const struct bvr_snap_sec *)(base + off);
+        rec = base + off + sizeof(*sec);
+        snap_loader(sec->cmd_id, &apply);
+        for (j = 0; j < sec->n_rec; j++, rec += sec->rec_size) {
+            failed += apply(rec) != 0;
+        }
+        n_rec += sec->n_rec;
+        off += sizeof(*sec) + sec->n_rec * sec->rec_size;
+    }
+
+    /*let the agent poll the interfaces*/
+    g_bvrouter_conf_info.port_update = 1;
+
+    BVR_WARNING("snapshot %s of %lu loaded, %lu records %lu failed\n", path,
+        (unsigned long)hdr->time, (unsigned long)n_rec, (unsigned long)failed);
+    munmap((void *)base, st.st_size);
+    return 0;
+}
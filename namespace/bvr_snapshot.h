@@ -0,0 +1,109 @@
+/**
+**********************************************************************
+*
+* Copyright (c) 2014 Baidu.com, Inc. All Rights Reserved
+* @file         $HeadURL: $
+* @brief        binary snapshot of the control state
+* @author       zhangyu(zhangyu09@baidu.com)
+* @date         $Date:$
+* @version      $Id: $
+***********************************************************************
+*/
+
+#ifndef BVR_SNAPSHOT_H
+#define BVR_SNAPSHOT_H
+
+#include <signal.h>
+#include "pal_utils.h"
+#include "bvr_ctl.h"
+
+/*
+ * A snapshot holds what the controller configured: namespaces, interfaces,
+ * floating ips, fdb learning, static routes, netfilter rules, static fdb
+ * entries and arp entries. It is written periodically, on
+ * NN_CMD_ID_SAVE_SNAPSHOT and on SIGTERM, and loaded at startup before the
+ * data path runs, so a restart does not wait for the controller to push
+ * the whole state again. The controller then sends what changed after the
+ * sync_gen of each namespace, which the snapshot keeps.
+ *
+ * The file is a header and sections of fixed size records, in the order
+ * they are loaded. A section is named by the add command of its records,
+ * which use the binary encoding of bvr_ctl.h where the command has one. A
+ * file of another version is ignored, as is a section whose records have
+ * an unexpected size.
+ */
+#define BVR_SNAP_MAGIC              0x42565253      /*"BVRS"*/
+#define BVR_SNAP_VERSION            1
+#define BVR_SNAP_UUID_SIZE          72
+
+struct bvr_snap_hdr {
+    u32     magic;
+    u32     version;
+    u64     time;           /*seconds since the epoch when written*/
+    u32     n_sec;
+    u32     pad;
+} __attribute__((packed));
+
+struct bvr_snap_sec {
+    u32     cmd_id;         /*NN_CMD_ID_* adding the records*/
+    u32     rec_size;
+    u64     n_rec;
+} __attribute__((packed));
+
+/* NN_CMD_ID_ADD_NAMESPACE */
+struct bvr_snap_ns {
+    char    name[NN_BIN_NS_NAME_SIZE];
+    u64     sync_gen;
+    u16     mss_clamp;
+    u8      pad[6];
+} __attribute__((packed));
+
+/* NN_CMD_ID_ADD_INT_IF, internal and external interfaces */
+struct bvr_snap_if {
+    char    bvrouter[NN_BIN_NS_NAME_SIZE];
+    char    ifname[NN_BIN_IF_NAME_SIZE];
+    char    uuid[BVR_SNAP_UUID_SIZE];
+    u32     ip;
+    u32     vni;            /*internal only*/
+    u8      type;           /*VXLAN_VPORT or PHY_VPORT*/
+    u8      prefixlen;
+    u8      mac[6];
+    u16     mss_clamp;      /*internal only*/
+    u8      pad[6];
+} __attribute__((packed));
+
+/* NN_CMD_ID_ADD_IP */
+struct bvr_snap_fip {
+    char    ifname[NN_BIN_IF_NAME_SIZE];
+    u32     ip;
+    u32     pad;
+} __attribute__((packed));
+
+/* NN_CMD_ID_SET_FDB_LEARNING, vnis learning or with a non default ageing */
+struct bvr_snap_vni {
+    u32     vni;
+    u32     learning;
+    u32     ageing;         /*seconds*/
+    u32     pad;
+} __attribute__((packed));
+
+/*set by the SIGTERM handler, the control threads save and exit*/
+extern volatile sig_atomic_t g_bvr_snap_exit;
+
+/*
+ * @brief write the snapshot to path, through a temporary file renamed over
+ *        it. the caller holds the control lock for write
+ * @return 0 on success, -1 on error
+ */
+int bvr_snapshot_save(const char *path);
+
+/*
+ * @brief load the snapshot at path into the empty router, before the data
+ *        path runs. run on a control thread, whose timers and object caches
+ *        are used. a missing file is not an error
+ * @return 0 on success or if there is nothing to load, -1 if the file is
+ *         not a snapshot of this version
+ */
+int bvr_snapshot_load(const char *path);
+
+#endif
@@ -0,0 +1,142 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <rte_malloc.h>
+
+#include "pal_arena.h"
+#include "pal_malloc.h"
+
+/* header of a chunk, the objects after it start on a cache line */
+struct arena_chunk {
+	struct pal_list_head list;
+	size_t size;
+} __rte_cache_aligned;
+
+static inline size_t arena_round(size_t size)
+{
+	return (size + PAL_ARENA_ALIGN - 1) & ~((size_t)PAL_ARENA_ALIGN - 1);
+}
+
+static struct arena_chunk *arena_chunk_new(struct pal_arena *arena, size_t size)
+{
+	struct arena_chunk *chunk;
+
+	chunk = rte_malloc_socket(NULL, sizeof(*chunk) + size,
+			CACHE_LINE_SIZE, arena->numa);
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->size = size;
+	pal_list_add_tail(&chunk->list, &arena->chunks);
+	arena->reserved += sizeof(*chunk) + size;
+	return chunk;
+}
+
+struct pal_arena *pal_arena_create(const char *name, int numa)
+{
+	struct pal_arena *arena;
+
+	arena = pal_malloc_numa(sizeof(*arena), numa);
+	if (arena == NULL)
+		return NULL;
+
+	memset(arena, 0, sizeof(*arena));
+	snprintf(arena->name, sizeof(arena->name), "%s", name);
+	arena->numa = numa;
+	PAL_INIT_LIST_HEAD(&arena->chunks);
+	return arena;
+}
+
+void pal_arena_destroy(struct pal_arena *arena)
+{
+	struct arena_chunk *chunk, *n;
+
+	if (arena == NULL)
+		return;
+
+	pal_list_for_each_entry_safe(chunk, n, &arena->chunks, list) {
+		pal_free(chunk);
+	}
+	pal_free(arena);
+}
+
+void *pal_arena_alloc(struct pal_arena *arena, size_t size)
+{
+	struct arena_chunk *chunk;
+	unsigned cls;
+	size_t pad = 0;
+	void *obj;
+
+	size = arena_round(size ? size : 1);
+
+	if (size > PAL_ARENA_SMALL_MAX) {
+		chunk = arena_chunk_new(arena, size);
+		if (chunk == NULL)
+			return NULL;
+		arena->used += size;
+		return chunk + 1;
+	}
+
+	cls = size / PAL_ARENA_ALIGN - 1;
+	obj = arena->free[cls];
+	if (obj != NULL) {
+		arena->free[cls] = *(void **)obj;
+		arena->used += size;
+		return obj;
+	}
+
+	/* objects of whole cache lines, e.g. per-core counters, are aligned,
+	   so are the freed ones of their class */
+	if (size % CACHE_LINE_SIZE == 0)
+		pad = -(uintptr_t)arena->cur & (CACHE_LINE_SIZE - 1);
+
+	if (arena->left < pad + size) {
+		/* the tail of the last chunk is lost, at most a small object */
+		chunk = arena_chunk_new(arena, PAL_ARENA_CHUNK_SIZE);
+		if (chunk == NULL)
+			return NULL;
+		arena->cur = (char *)(chunk + 1);
+		arena->left = PAL_ARENA_CHUNK_SIZE;
+		pad = 0;
+	}
+
+	obj = arena->cur + pad;
+	arena->cur += pad + size;
+	arena->left -= pad + size;
+	arena->used += size;
+	return obj;
+}
+
+void *pal_arena_zalloc(struct pal_arena *arena, size_t size)
+{
+	void *obj = pal_arena_alloc(arena, size);
+
+	if (obj != NULL)
+		memset(obj, 0, size);
+	return obj;
+}
+
+void pal_arena_free(struct pal_arena *arena, void *obj, size_t size)
+{
+	struct arena_chunk *chunk;
+	unsigned cls;
+
+	if (obj == NULL)
+		return;
+
+	size = arena_round(size ? size : 1);
+	arena->used -= size;
+
+	if (size > PAL_ARENA_SMALL_MAX) {
+		chunk = (struct arena_chunk *)obj - 1;
+		pal_list_del(&chunk->list);
+		arena->reserved -= sizeof(*chunk) + chunk->size;
+		pal_free(chunk);
+		return;
+	}
+
+	cls = size / PAL_ARENA_ALIGN - 1;
+	*(void **)obj = arena->free[cls];
+	arena->free[cls] = obj;
+}
@@ -12,6 +12,7 @@
 #include "ipgroup.h"
 #include "jiffies.h"
 #include "pal_ip_cell.h"
+#include "pal_slab.h"
 #include "vtep.h"
 
 static int pal_send_pkt_arp(struct sk_buff *skb, unsigned port_id);
@@ -49,7 +50,7 @@ static int pal_send_pkt_arp(struct sk_buff *skb, unsigned port_id)
 	PAL_PANIC("pal_send_pkt_arp. this function is not implemented\n");
 
 	pal_cur_thread_conf()->stats.ports[port_id].tx_pkts++;
-	pal_cur_thread_conf()->stats.ports[port_id].tx_bytes += skb_len(skb);
+	pal_cur_thread_conf()->stats.ports[port_id].tx_bytes += skb_pkt_len(skb);
 
 	if(skb->dump)
 		pal_dump_pkt(skb, 2000);
@@ -303,13 +304,19 @@ int pal_arp_init(void)
 	return 0;
 }
 
-/* should only be called once on start up. */
-static int solicit_all_gw_mac(void)
+/* gateway resolution on start up, done by the arp loop between its ticks
+ * so that jiffies go on and the traffic not sent to a gateway flows */
+#define GW_SOLICIT_RETRY_MAX	10
+#define GW_SOLICIT_INTERVAL	(HZ / 2)
+
+static unsigned gw_solicit_retry;
+static uint64_t gw_solicit_start;
+static uint64_t gw_solicit_next;
+
+static void gw_solicit_init(void)
 {
-	unsigned port_id, retry, remains;
+	unsigned port_id;
 	struct port_conf *port;
-	uint32_t sip;
-	const unsigned retry_max = 10;
 
 	/* clear valid bit of mac address of all gateways */
 	for(port_id = 0; port_id < PAL_MAX_PORT; port_id++) {
@@ -320,35 +327,54 @@ static int solicit_all_gw_mac(void)
 		port->gw_mac_valid = 0;
 	}
 
-	/* do the solicit job */
-	for(retry = 0; retry < retry_max; retry++) {
-		remains = 0;
+	/*wait 1 sec to enable bonding NIC work*/
+	gw_solicit_retry = 0;
+	gw_solicit_start = jiffies;
+	gw_solicit_next = jiffies + HZ;
+}
 
-		for(port_id = 0; port_id < PAL_MAX_PORT; port_id++) {
-			port = pal_port_conf(port_id);
-			if(port == NULL || port->gw_mac_valid)
-				continue;
+/*
+ * @brief send a round of requests to the gateways not resolved yet
+ * @return 1 while the resolution goes on, 0 once it is over
+ */
+static int gw_solicit(void)
+{
+	unsigned port_id, remains = 0;
+	struct port_conf *port;
 
-            sip = port->vnic_ip;
-			if(send_arp_request(port_id, port->mac, port->gw_ip,
-				         sip) < 0) {
-				return -1;
-			}
-			remains++;
-		}
+	if(jiffies < gw_solicit_next)
+		return 1;
 
-		/* mac addresses of all gateways are valid */
-		if(remains == 0)
-			break;
+	for(port_id = 0; port_id < PAL_MAX_PORT; port_id++) {
+		port = pal_port_conf(port_id);
+		if(port == NULL || port->gw_mac_valid)
+			continue;
 
-		/* wait for gateway to response */
-		usleep(500000);
+		remains++;
+		if(gw_solicit_retry == GW_SOLICIT_RETRY_MAX) {
+			PAL_LOG("solicit gateway "NIPQUAD_FMT" of port %d failed\n",
+				NIPQUAD(port->gw_ip), port->port_id);
+			continue;
+		}
+		/* a failed send is retried with the next round */
+		send_arp_request(port_id, port->mac, port->gw_ip, port->vnic_ip);
 	}
 
-	if(retry >= retry_max)
-		return -1;
+	/* mac addresses of all gateways are valid */
+	if(remains == 0) {
+		PAL_LOG("gateways resolved in %lu ms\n",
+			(unsigned long)(jiffies - gw_solicit_start) * 1000 / HZ);
+		return 0;
+	}
+	if(gw_solicit_retry++ == GW_SOLICIT_RETRY_MAX) {
+		/* TODO: comment this temporarily to for testing */
+		//PAL_PANIC("solicit gateway mac failed\n");
+		return 0;
+	}
 
-	return 0;
+	/* wait for gateway to response */
+	gw_solicit_next = jiffies + GW_SOLICIT_INTERVAL;
+	return 1;
 }
 
 /* debug only */
@@ -376,32 +402,25 @@ static void __unused dump_cpu_usage(void)
 
 int arp_loop(__unused void *data)
 {
-	int port_id;
+	int soliciting;
 	struct timespec ts, tsrem;
 	/* sleep 1 jiffiy each time, but no more than 1 ms */
 	const long sleep_nsec = HZ < 1000?1000000:(1000000000 / HZ);
 
 	BUILD_BUG_ON(HZ > 1000000000);
 
-	/*wait 1 sec to enable bonding NIC work*/
-	sleep(1);
-
-	if(solicit_all_gw_mac() < 0) {
-		for(port_id = 0; port_id < PAL_MAX_PORT; port_id++) {
-			if(pal_port_conf(port_id) == NULL ||
-				pal_port_conf(port_id)->gw_mac_valid)
-				continue;
-                PAL_LOG("solicit gateway "NIPQUAD_FMT" of port %d failed\n",
-				NIPQUAD(pal_port_conf(port_id)->gw_ip),
-				pal_port_conf(port_id)->port_id);
-		}
-        /* TODO: comment this temporarily to for testing */
-        //PAL_PANIC("solicit gateway mac failed\n");
-	}
+	gw_solicit_init();
+	soliciting = 1;
 
 	while(1) {
 		update_jiffies();
 
+		if(soliciting)
+			soliciting = gw_solicit();
+
+		/* chunks for the slabs the data path is filling */
+		pal_slab_grow_pending();
+
 		if(l2_enabled()) {
 			/* TODO: do arp handling */
 		}
@@ -0,0 +1,192 @@
+#include <string.h>
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "pal_csum.h"
+
+/* fold a 64 bit sum of 32 bit words, keeping the carries */
+static inline uint32_t csum_from64(uint64_t sum)
+{
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	return (uint32_t)sum;
+}
+
+/* sum the bytes left by the vector loops, at most a few dozens */
+static inline uint64_t csum_tail(const uint8_t *p, unsigned len, uint64_t sum)
+{
+	uint32_t w;
+	uint16_t h;
+
+	while (len >= 4) {
+		memcpy(&w, p, 4);
+		sum += w;
+		p += 4;
+		len -= 4;
+	}
+	if (len >= 2) {
+		memcpy(&h, p, 2);
+		sum += h;
+		p += 2;
+		len -= 2;
+	}
+	/* the last byte is the first byte of a zero padded word */
+	if (len)
+		sum += *p;
+
+	return sum;
+}
+
+static uint32_t csum_partial_scalar(const void *buf, unsigned len, uint32_t sum)
+{
+	const uint8_t *p = buf;
+	uint64_t s0 = 0, s1 = 0;
+	uint32_t w[4];
+
+	/* two accumulators to break the dependency chain */
+	while (len >= 16) {
+		memcpy(w, p, 16);
+		s0 += (uint64_t)w[0] + w[1];
+		s1 += (uint64_t)w[2] + w[3];
+		p += 16;
+		len -= 16;
+	}
+
+	return pal_csum_add(csum_from64(csum_tail(p, len, s0 + s1)), sum);
+}
+
+/* zero extend the 32 bit lanes to 64 bits and add them to the accumulator */
+static inline __m128i csum_sse_add(__m128i acc, __m128i v)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+	return _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+}
+
+__attribute__((target("sse2")))
+static uint32_t csum_partial_sse2(const void *buf, unsigned len, uint32_t sum)
+{
+	const uint8_t *p = buf;
+	__m128i a0 = _mm_setzero_si128(), a1 = _mm_setzero_si128();
+	uint64_t lane[2];
+
+	while (len >= 32) {
+		a0 = csum_sse_add(a0, _mm_loadu_si128((const __m128i *)p));
+		a1 = csum_sse_add(a1, _mm_loadu_si128((const __m128i *)(p + 16)));
+		p += 32;
+		len -= 32;
+	}
+	if (len >= 16) {
+		a0 = csum_sse_add(a0, _mm_loadu_si128((const __m128i *)p));
+		p += 16;
+		len -= 16;
+	}
+
+	_mm_storeu_si128((__m128i *)lane, _mm_add_epi64(a0, a1));
+	return pal_csum_add(csum_from64(csum_tail(p, len, lane[0] + lane[1])), sum);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i csum_avx2_add(__m256i acc, __m256i v)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	/* unpack works inside each 128 bit half, which is fine for a sum */
+	acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(v, zero));
+	return _mm256_add_epi64(acc, _mm256_unpackhi_epi32(v, zero));
+}
+
+__attribute__((target("avx2")))
+static uint32_t csum_partial_avx2(const void *buf, unsigned len, uint32_t sum)
+{
+	const uint8_t *p = buf;
+	__m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+	uint64_t lane[4];
+
+	while (len >= 64) {
+		a0 = csum_avx2_add(a0, _mm256_loadu_si256((const __m256i *)p));
+		a1 = csum_avx2_add(a1, _mm256_loadu_si256((const __m256i *)(p + 32)));
+		p += 64;
+		len -= 64;
+	}
+	if (len >= 32) {
+		a0 = csum_avx2_add(a0, _mm256_loadu_si256((const __m256i *)p));
+		p += 32;
+		len -= 32;
+	}
+
+	_mm256_storeu_si256((__m256i *)lane, _mm256_add_epi64(a0, a1));
+	return pal_csum_add(csum_from64(csum_tail(p, len,
+	                    lane[0] + lane[1] + lane[2] + lane[3])), sum);
+}
+
+pal_csum_fn pal_csum_partial_fn = csum_partial_scalar;
+
+void pal_csum_init(void)
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		pal_csum_partial_fn = csum_partial_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		pal_csum_partial_fn = csum_partial_sse2;
+	else
+		pal_csum_partial_fn = csum_partial_scalar;
+}
+
+const char *pal_csum_impl(void)
+{
+	if (pal_csum_partial_fn == csum_partial_avx2)
+		return "avx2";
+	if (pal_csum_partial_fn == csum_partial_sse2)
+		return "sse2";
+	return "scalar";
+}
+
+int pal_csum_use(const char *impl)
+{
+	if (strcmp(impl, "avx2") == 0) {
+		if (!__builtin_cpu_supports("avx2"))
+			return -1;
+		pal_csum_partial_fn = csum_partial_avx2;
+	} else if (strcmp(impl, "sse2") == 0) {
+		if (!__builtin_cpu_supports("sse2"))
+			return -1;
+		pal_csum_partial_fn = csum_partial_sse2;
+	} else if (strcmp(impl, "scalar") == 0) {
+		pal_csum_partial_fn = csum_partial_scalar;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+void pal_csum_partial_burst(const void *const bufs[], const uint16_t lens[],
+				uint32_t sums[], unsigned n)
+{
+	pal_csum_fn fn = pal_csum_partial_fn;
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		sums[i] = fn(bufs[i], lens[i], 0);
+}
+
+uint64_t pal_csum_ok_burst(const void *const bufs[], const uint16_t lens[],
+				unsigned n)
+{
+	pal_csum_fn fn = pal_csum_partial_fn;
+	uint64_t ok = 0;
+	unsigned i;
+
+	if (n > 64)
+		n = 64;
+
+	for (i = 0; i < n; i++) {
+		if (pal_csum_reduce16(fn(bufs[i], lens[i], 0)) == 0xffff)
+			ok |= 1ULL << i;
+	}
+
+	return ok;
+}
@@ -0,0 +1,300 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pal_cuckoo.h"
+#include "pal_malloc.h"
+#include "pal_error.h"
+
+/* max number of keys moved to make room for a new one */
+#define PAL_CUCKOO_MAX_PATH	32
+
+struct cuckoo_path {
+	uint32_t bkt;
+	int slot;
+};
+
+static inline uint32_t roundup_pow2(uint32_t x)
+{
+	uint32_t n = 1;
+
+	while (n < x)
+		n <<= 1;
+	return n;
+}
+
+struct pal_cuckoo *pal_cuckoo_create(const char *name, uint32_t entries,
+				uint32_t key_len, int numa)
+{
+	struct pal_cuckoo *h;
+	uint32_t n_bkt, i;
+
+	if (key_len == 0 || key_len > PAL_CUCKOO_KEY_MAX || entries == 0)
+		return NULL;
+
+	h = pal_zalloc_numa(sizeof(*h), numa);
+	if (h == NULL)
+		return NULL;
+
+	/* keep the load under 80% so that adds seldom need long paths */
+	n_bkt = roundup_pow2((entries + entries / 4) / PAL_CUCKOO_BUCKET_ENTRIES + 1);
+	if (n_bkt < 2)
+		n_bkt = 2;
+
+	h->buckets = pal_zalloc_numa(n_bkt * sizeof(struct pal_cuckoo_bucket), numa);
+	h->keys = pal_zalloc_numa((entries + 1) * sizeof(struct pal_cuckoo_key), numa);
+	h->free_slots = pal_malloc_numa(entries * sizeof(uint32_t), numa);
+	if (h->buckets == NULL || h->keys == NULL || h->free_slots == NULL) {
+		pal_cuckoo_destroy(h);
+		return NULL;
+	}
+
+	snprintf(h->name, sizeof(h->name), "%s", name);
+	h->key_len = key_len;
+	h->entries = entries;
+	h->bucket_mask = n_bkt - 1;
+	for (i = 0; i < entries; i++)
+		h->free_slots[i] = entries - i;
+	h->free_top = entries;
+
+	return h;
+}
+
+void pal_cuckoo_destroy(struct pal_cuckoo *h)
+{
+	if (h == NULL)
+		return;
+
+	if (h->buckets)
+		pal_free(h->buckets);
+	if (h->keys)
+		pal_free(h->keys);
+	if (h->free_slots)
+		pal_free(h->free_slots);
+	pal_free(h);
+}
+
+/* find the slot of a key in a bucket, writer side */
+static int bucket_find(const struct pal_cuckoo *h, const struct pal_cuckoo_bucket *b,
+				uint16_t sig, const void *key)
+{
+	int i;
+
+	for (i = 0; i < PAL_CUCKOO_BUCKET_ENTRIES; i++) {
+		if (b->sig[i] == sig && b->key_idx[i] != 0 &&
+				memcmp(h->keys[b->key_idx[i]].key, key, h->key_len) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+static int bucket_empty_slot(const struct pal_cuckoo_bucket *b)
+{
+	int i;
+
+	for (i = 0; i < PAL_CUCKOO_BUCKET_ENTRIES; i++) {
+		if (b->key_idx[i] == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/* publish a key in an empty slot: readers see either nothing or the key */
+static inline void bucket_set(struct pal_cuckoo_bucket *b, int slot,
+				uint16_t sig, uint32_t idx)
+{
+	b->sig[slot] = sig;
+	rte_wmb();
+	b->key_idx[slot] = idx;
+}
+
+/*
+ * Walk from a full bucket, kicking one key at a time to its alternative
+ * bucket, until a bucket with an empty slot is met. Then move the keys
+ * along the path backwards, the last one first, so that each key is
+ * copied before its old slot is overwritten.
+ * @return slot freed in bucket bkt, -1 if no path is found
+ */
+static int make_room(struct pal_cuckoo *h, uint32_t bkt, uint32_t hash)
+{
+	struct cuckoo_path path[PAL_CUCKOO_MAX_PATH];
+	struct pal_cuckoo_bucket *b, *nb;
+	uint32_t cur = bkt, next;
+	int depth, slot, empty = -1, i;
+
+	for (depth = 0; depth < PAL_CUCKOO_MAX_PATH; depth++) {
+		/* pick a different victim at each step to avoid short cycles */
+		slot = (hash + depth) % PAL_CUCKOO_BUCKET_ENTRIES;
+		/* a slot met twice would be overwritten before it is moved */
+		for (i = 0; i < depth; i++) {
+			if (path[i].bkt == cur && path[i].slot == slot)
+				return -1;
+		}
+		b = &h->buckets[cur];
+		path[depth].bkt = cur;
+		path[depth].slot = slot;
+
+		next = pal_cuckoo_alt(h, cur, b->sig[slot]);
+		empty = bucket_empty_slot(&h->buckets[next]);
+		if (empty >= 0)
+			break;
+		cur = next;
+	}
+
+	if (empty < 0)
+		return -1;
+
+	pal_cuckoo_write_begin(h);
+	for (; depth >= 0; depth--) {
+		b = &h->buckets[path[depth].bkt];
+		slot = path[depth].slot;
+		nb = &h->buckets[next];
+		bucket_set(nb, empty, b->sig[slot], b->key_idx[slot]);
+		h->moves++;
+
+		next = path[depth].bkt;
+		empty = slot;
+	}
+	h->buckets[bkt].key_idx[empty] = 0;
+	pal_cuckoo_write_end(h);
+
+	return empty;
+}
+
+int pal_cuckoo_add(struct pal_cuckoo *h, const void *key, void *data)
+{
+	uint32_t hash = pal_cuckoo_hash(h, key);
+	uint16_t sig = pal_cuckoo_sig(hash);
+	uint32_t prim = pal_cuckoo_prim(h, hash);
+	uint32_t alt = pal_cuckoo_alt(h, prim, sig);
+	struct pal_cuckoo_bucket *b;
+	struct pal_cuckoo_key *k;
+	uint32_t idx;
+	int slot;
+
+	/* an existing key only gets its data replaced, atomically */
+	if ((slot = bucket_find(h, &h->buckets[prim], sig, key)) >= 0) {
+		h->keys[h->buckets[prim].key_idx[slot]].data = data;
+		return 0;
+	}
+	if ((slot = bucket_find(h, &h->buckets[alt], sig, key)) >= 0) {
+		h->keys[h->buckets[alt].key_idx[slot]].data = data;
+		return 0;
+	}
+
+	if (h->free_top == 0) {
+		h->add_fail++;
+		return -ENOSPC;
+	}
+
+	b = &h->buckets[prim];
+	slot = bucket_empty_slot(b);
+	if (slot < 0) {
+		b = &h->buckets[alt];
+		slot = bucket_empty_slot(b);
+	}
+	if (slot < 0) {
+		b = &h->buckets[prim];
+		slot = make_room(h, prim, hash);
+	}
+	if (slot < 0) {
+		b = &h->buckets[alt];
+		slot = make_room(h, alt, hash >> 8);
+	}
+	if (slot < 0) {
+		h->add_fail++;
+		return -ENOSPC;
+	}
+
+	/* fill the key before it becomes visible */
+	idx = h->free_slots[--h->free_top];
+	k = &h->keys[idx];
+	memcpy(k->key, key, h->key_len);
+	k->data = data;
+	rte_wmb();
+
+	bucket_set(b, slot, sig, idx);
+	h->count++;
+
+	return 0;
+}
+
+int pal_cuckoo_del(struct pal_cuckoo *h, const void *key)
+{
+	uint32_t hash = pal_cuckoo_hash(h, key);
+	uint16_t sig = pal_cuckoo_sig(hash);
+	uint32_t prim = pal_cuckoo_prim(h, hash);
+	struct pal_cuckoo_bucket *b = &h->buckets[prim];
+	uint32_t idx;
+	int slot;
+
+	slot = bucket_find(h, b, sig, key);
+	if (slot < 0) {
+		b = &h->buckets[pal_cuckoo_alt(h, prim, sig)];
+		slot = bucket_find(h, b, sig, key);
+	}
+	if (slot < 0)
+		return -ENOENT;
+
+	idx = b->key_idx[slot];
+
+	/* readers overlapping the delete retry, so the key slot can be reused */
+	pal_cuckoo_write_begin(h);
+	b->key_idx[slot] = 0;
+	h->keys[idx].data = NULL;
+	pal_cuckoo_write_end(h);
+
+	h->free_slots[h->free_top++] = idx;
+	h->count--;
+
+	return 0;
+}
+
+int pal_cuckoo_iterate(const struct pal_cuckoo *h, uint32_t *next,
+				const void **key, void **data)
+{
+	uint32_t total = (h->bucket_mask + 1) * PAL_CUCKOO_BUCKET_ENTRIES;
+	const struct pal_cuckoo_bucket *b;
+	uint32_t pos, idx;
+
+	for (pos = *next; pos < total; pos++) {
+		b = &h->buckets[pos / PAL_CUCKOO_BUCKET_ENTRIES];
+		idx = b->key_idx[pos % PAL_CUCKOO_BUCKET_ENTRIES];
+		if (idx == 0)
+			continue;
+		*key = h->keys[idx].key;
+		*data = h->keys[idx].data;
+		*next = pos + 1;
+		return 1;
+	}
+
+	*next = total;
+	return 0;
+}
+
+uint64_t pal_cuckoo_lookup_bulk(const struct pal_cuckoo *h,
+				const void **keys, uint32_t n, void **data)
+{
+	uint32_t hash[PAL_CUCKOO_BULK_MAX];
+	uint64_t hits = 0;
+	uint32_t i;
+
+	if (n > PAL_CUCKOO_BULK_MAX)
+		n = PAL_CUCKOO_BULK_MAX;
+
+	/* hash all keys and prefetch their primary buckets first */
+	for (i = 0; i < n; i++) {
+		hash[i] = pal_cuckoo_hash(h, keys[i]);
+		rte_prefetch0(&h->buckets[pal_cuckoo_prim(h, hash[i])]);
+	}
+
+	for (i = 0; i < n; i++) {
+		data[i] = __pal_cuckoo_lookup_hash(h, keys[i], hash[i]);
+		if (data[i] != NULL)
+			hits |= 1ULL << i;
+	}
+
+	return hits;
+}
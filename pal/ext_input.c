@@ -20,19 +20,20 @@ static int rcv_vtep_icmp_process(struct sk_buff *skb)
 	uint32_t tmp_addr;
 	
 	/* icmp content must be more then 8 bytes */
-	if((icmp_len < 8 )|| (icmp_len > skb_len(skb)))
+	if((icmp_len < 8 )|| (icmp_len > skb_pkt_len(skb)))
 		goto drop;
 
 	/* we only handle icmp echo request */
 	if (icmph->type != ICMP_ECHO)
 		goto drop;
 
-	if (!icmp_check_sum_correct((uint16_t *)icmph, icmp_len))
+	if (!skb_csum_correct(skb, 0, icmp_len))
 		goto drop;
 
 	icmph->type = ICMP_ECHOREPLY;
 	/* update icmp check sum*/
-	icmph->checksum = icmph->checksum + pal_htons_constant(0x0800);
+	pal_csum_replace2(&icmph->checksum, pal_htons_constant(ICMP_ECHO << 8),
+			  pal_htons_constant(ICMP_ECHOREPLY << 8));
 	/* Exchange ip addresses */
 	tmp_addr = iph->saddr;
 	iph->saddr = iph->daddr;
@@ -92,7 +93,7 @@ drop:
 
 	dst_ip = iph->daddr;	
 	
-	vport = find_get_phy_vport(dst_ip);
+	vport = find_phy_vport(dst_ip);
 	if (unlikely(!vport)) {
 		/*if it's a vtep_ip packet*/
 		if(is_vtep_ip(dst_ip)){
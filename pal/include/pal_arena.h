@@ -0,0 +1,73 @@
+#ifndef _PAL_ARENA_H_
+#define _PAL_ARENA_H_
+#include <stdint.h>
+#include <stddef.h>
+#include <rte_memory.h>
+
+#include "pal_utils.h"
+#include "pal_list.h"
+
+/*
+ * An arena hands out objects carved from hugepage chunks, and is destroyed
+ * as a whole: the objects of an arena need not be freed one by one.
+ *
+ * Each namespace has one for its rules and routes, so that they are packed
+ * together and deleting the namespace frees a few chunks instead of
+ * thousands of slab objects. Objects freed before that are kept on free
+ * lists by size for the next allocations of the same arena.
+ *
+ * An arena is not thread safe, its writers must be serialized. Readers of
+ * the objects must be done before pal_arena_destroy(), see pal_qsbr.h.
+ */
+
+#define PAL_ARENA_NAME_MAX	32
+#define PAL_ARENA_CHUNK_SIZE	(64 * 1024)
+#define PAL_ARENA_ALIGN		16
+/* larger objects get a chunk of their own. Rules are small objects:
+   with their per-cpu counters they take a little over 1KB */
+#define PAL_ARENA_SMALL_MAX	2048
+#define PAL_ARENA_CLASSES	(PAL_ARENA_SMALL_MAX / PAL_ARENA_ALIGN)
+
+struct pal_arena {
+	char name[PAL_ARENA_NAME_MAX];
+	int numa;
+	struct pal_list_head chunks;	/* chunks and large objects */
+	char *cur;			/* free space of the last chunk */
+	size_t left;
+	void *free[PAL_ARENA_CLASSES];	/* freed small objects by size */
+
+	/* stats */
+	size_t used;			/* bytes of the live objects */
+	size_t reserved;		/* bytes taken from hugepages */
+};
+
+/*
+ * @brief Create an empty arena, no chunk is allocated yet
+ * @return The arena, or NULL on failure
+ */
+extern struct pal_arena *pal_arena_create(const char *name, int numa);
+
+/*
+ * @brief Free all the chunks of an arena and the arena itself
+ */
+extern void pal_arena_destroy(struct pal_arena *arena);
+
+/*
+ * @brief Allocate an object aligned on PAL_ARENA_ALIGN bytes, or on a
+ *        cache line if size is a multiple of it or over PAL_ARENA_SMALL_MAX
+ * @return The object, or NULL on failure
+ */
+extern void *pal_arena_alloc(struct pal_arena *arena, size_t size);
+
+/*
+ * @brief pal_arena_alloc() and zero the object
+ */
+extern void *pal_arena_zalloc(struct pal_arena *arena, size_t size);
+
+/*
+ * @brief Give an object back to its arena
+ * @param size Size the object was allocated with
+ */
+extern void pal_arena_free(struct pal_arena *arena, void *obj, size_t size);
+
+#endif
@@ -5,7 +5,6 @@
 #include <rte_kni.h>
 #include <pal_spinlock.h>
 #include <pal_list.h>
-#include "pal_ip_frag_reassemble.h"
 
 /* max number of threads */
 #define PAL_MAX_THREAD		16
@@ -29,6 +28,8 @@
 /* max length of a thread's name */
 #define PAL_THREAD_NAME_MAX	32
 
+/* needs PAL_MAX_THREAD */
+#include "pal_ip_frag_reassemble.h"
 
 /*
  * Callback functions used by custom threads
@@ -70,6 +71,8 @@ struct pal_config {
 		uint32_t ip;
 		uint32_t gw_ip;
 		uint32_t netmask;
+		/* underlay mtu, up to PAL_MAX_MTU. 0 means ETHER_MTU */
+		uint16_t mtu;
 		/* leave this zero if you want the system to set it */
 		uint8_t mac[6];
 		uint8_t port_id;
@@ -206,6 +209,15 @@ struct pal_tap_stats {
 	                           * from a wrong physical port */
 };
 
+struct pal_reasm_stats {
+	uint64_t frag_pkts;     /* fragments added to the local reassembly table */
+	uint64_t reasm_pkts;    /* datagrams reassembled */
+	uint64_t redirect_pkts; /* fragments redirected to their owner receiver */
+	uint64_t redirect_err;  /* fragments failed to redirect */
+	uint64_t timeout_pkts;  /* fragments freed as timed out or invalid */
+	uint64_t evict_pkts;    /* fragments dropped as the table is full */
+};
+
 /* NOTE: all member must be type of uint64_t,
  * or pal_get_stats_summary would go wrong*/
 struct pal_stats {
@@ -213,6 +225,7 @@ struct pal_stats {
 	struct pal_ip_stats ip;
 	struct pal_arp_stats arp;
 	struct pal_port_stats ports[PAL_MAX_PORT];
+	struct pal_reasm_stats reasm;
 };
 
 #define MAX_PKT_SEND_BURST 64
@@ -265,7 +278,8 @@ struct thread_conf {
     uint64_t flush_count;
 	int m2s[2];  /* pipe used by master to send messages to slaves */
 	int s2m[2];  /* pipe used by slaves to send messages to master */
-	struct pal_stats stats;
+	/* written by this thread only, keep it off the lines of cmd and co */
+	struct pal_stats stats __rte_cache_aligned;
 };
 
 /*
@@ -282,6 +296,9 @@ struct port_conf {
 	uint8_t port_id;
 	uint8_t gw_mac_valid;
 	uint8_t status; /* port link status 1:up 0:down */
+	uint16_t mtu; /* max ip packet size can be sent without fragmentation */
+	uint8_t sw_rx_csum; /* nic does not check ip checksums, receivers do */
+	uint8_t sw_tx_csum; /* nic does not fill checksums, pal_send_batch_pkt does */
 	uint8_t mac[6];
 	uint8_t gw_mac[6];
 	uint32_t netmask;
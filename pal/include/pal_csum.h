@@ -0,0 +1,122 @@
+#ifndef _PAL_CSUM_H_
+#define _PAL_CSUM_H_
+#include <stdint.h>
+
+/*
+ * Internet checksum helpers shared by pal and the applications.
+ *
+ * A partial checksum is a 32 bit one's complement sum of the 16 bit words
+ * of a buffer, taken in memory order. It can be fed back into
+ * pal_csum_partial() to sum more data and is turned into the checksum
+ * field by pal_csum_fold(). pal_csum_partial() uses SSE2 or AVX2 when the
+ * cpu has them, the choice is made once by pal_csum_init().
+ */
+
+typedef uint32_t (*pal_csum_fn)(const void *buf, unsigned len, uint32_t sum);
+
+extern pal_csum_fn pal_csum_partial_fn;
+
+/*
+ * @brief Pick the fastest checksum routine the cpu supports.
+ *        Called by pal_init(), before that the scalar one is used.
+ */
+extern void pal_csum_init(void);
+
+/*
+ * @brief Name of the checksum routine in use, for logs
+ */
+extern const char *pal_csum_impl(void);
+
+/*
+ * @brief Use the checksum routine of the given name, "scalar", "sse2"
+ *        or "avx2", instead of the one pal_csum_init() picked. For tests.
+ * @return 0 on success, -1 if the cpu does not support it
+ */
+extern int pal_csum_use(const char *impl);
+
+/*
+ * @brief Add the 16 bit words of len bytes at buf to the partial sum
+ * @return The partial checksum, not folded and not inverted
+ */
+static inline uint32_t pal_csum_partial(const void *buf, unsigned len, uint32_t sum)
+{
+	return pal_csum_partial_fn(buf, len, sum);
+}
+
+/*
+ * @brief Add two partial checksums
+ */
+static inline uint32_t pal_csum_add(uint32_t a, uint32_t b)
+{
+	a += b;
+	return a + (a < b);
+}
+
+/*
+ * @brief Reduce a partial checksum to 16 bits, without inverting it
+ */
+static inline uint16_t pal_csum_reduce16(uint32_t sum)
+{
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)sum;
+}
+
+/*
+ * @brief Turn a partial checksum into the value of a checksum field
+ */
+static inline uint16_t pal_csum_fold(uint32_t sum)
+{
+	return (uint16_t)~pal_csum_reduce16(sum);
+}
+
+/*
+ * @brief Check a buffer which contains its own checksum field
+ * @return 1 if the checksum is correct, 0 otherwise
+ */
+static inline int pal_csum_ok(const void *buf, unsigned len)
+{
+	return pal_csum_reduce16(pal_csum_partial(buf, len, 0)) == 0xffff;
+}
+
+/*
+ * @brief Update a checksum field after a 32 bit field changed from from
+ *        to to, as in rfc 1624. Both values in network byteorder.
+ */
+static inline void pal_csum_replace4(uint16_t *check, uint32_t from, uint32_t to)
+{
+	uint32_t sum = (uint16_t)~*check;
+
+	sum = pal_csum_add(sum, ~from);
+	sum = pal_csum_add(sum, to);
+	*check = pal_csum_fold(sum);
+}
+
+/*
+ * @brief Update a checksum field after a 16 bit field changed
+ */
+static inline void pal_csum_replace2(uint16_t *check, uint16_t from, uint16_t to)
+{
+	uint32_t sum = (uint16_t)~*check;
+
+	sum += (uint16_t)~from;
+	sum += to;
+	*check = pal_csum_fold(sum);
+}
+
+/*
+ * @brief Checksum of n buffers, in a batch so that the dispatch is paid once
+ * @param sums Partial checksums of the buffers, not folded
+ */
+extern void pal_csum_partial_burst(const void *const bufs[], const uint16_t lens[],
+				uint32_t sums[], unsigned n);
+
+/*
+ * @brief Check n buffers which contain their own checksum field,
+ *        at most 64 of them
+ * @return Bitmap of the buffers whose checksum is correct
+ */
+extern uint64_t pal_csum_ok_burst(const void *const bufs[], const uint16_t lens[],
+				unsigned n);
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef _PAL_CUCKOO_H_
+#define _PAL_CUCKOO_H_
+#include <stdint.h>
+#include <string.h>
+#include <rte_common.h>
+#include <rte_memory.h>
+#include <rte_prefetch.h>
+#include <rte_atomic.h>
+
+#include "pal_utils.h"
+
+/*
+ * A cuckoo hash with lock free lookups and a single writer.
+ *
+ * Each key has a primary and an alternative bucket of one cache line, a
+ * lookup reads at most these two lines. Writers must be serialized by the
+ * caller. Readers never take a lock: moving a key between its buckets or
+ * deleting one bumps the table sequence, and a lookup overlapping such a
+ * change is simply retried.
+ *
+ * Entries a table points to are freed by their owner right after
+ * deletion. As long as they come from slabs or pal_malloc, whose memory is
+ * never unmapped, a reader may copy fields out of an entry within
+ * pal_cuckoo_read_begin()/pal_cuckoo_read_retry() and retry if the entry
+ * was deleted or updated meanwhile. Writers updating an entry in place
+ * wrap the update with pal_cuckoo_write_begin()/pal_cuckoo_write_end().
+ */
+
+#define PAL_CUCKOO_BUCKET_ENTRIES	8
+#define PAL_CUCKOO_KEY_MAX		24
+#define PAL_CUCKOO_NAME_MAX		32
+#define PAL_CUCKOO_BULK_MAX		64
+
+/* signatures and key slots of 8 entries fit in a cache line */
+struct pal_cuckoo_bucket {
+	uint16_t sig[PAL_CUCKOO_BUCKET_ENTRIES];
+	uint32_t key_idx[PAL_CUCKOO_BUCKET_ENTRIES]; /* 0 means empty */
+} __rte_cache_aligned;
+
+struct pal_cuckoo_key {
+	void *data;
+	uint8_t key[PAL_CUCKOO_KEY_MAX];
+};
+
+struct pal_cuckoo {
+	char name[PAL_CUCKOO_NAME_MAX];
+	volatile uint32_t seq;	/* odd while a writer moves or deletes keys */
+	uint32_t key_len;
+	uint32_t entries;	/* max number of keys */
+	uint32_t count;		/* number of keys */
+	uint32_t bucket_mask;
+	uint32_t free_top;	/* free key slots are kept in a stack */
+	uint32_t *free_slots;
+	struct pal_cuckoo_key *keys;	/* keys[0] is never used */
+	struct pal_cuckoo_bucket *buckets;
+
+	/* writer side counters */
+	uint64_t add_fail;	/* adds failed as no free slot was found */
+	uint64_t moves;		/* keys moved to their alternative bucket */
+};
+
+/*
+ * @brief Create a cuckoo hash table
+ * @param name Name of the table, used mainly for debug
+ * @param entries Max number of keys the table holds
+ * @param key_len Length of the keys, no more than PAL_CUCKOO_KEY_MAX
+ * @param numa Numa node on which the table is allocated
+ * @return The new table, or NULL on failure
+ */
+extern struct pal_cuckoo *pal_cuckoo_create(const char *name, uint32_t entries,
+				uint32_t key_len, int numa);
+
+/*
+ * @brief Free a table. No reader may use it anymore.
+ */
+extern void pal_cuckoo_destroy(struct pal_cuckoo *h);
+
+/*
+ * @brief Add a key, or replace the data of an existing one. Writer only.
+ * @return 0 on success, -ENOSPC if the table is full
+ */
+extern int pal_cuckoo_add(struct pal_cuckoo *h, const void *key, void *data);
+
+/*
+ * @brief Delete a key. Writer only.
+ * @return 0 on success, -ENOENT if the key is not in the table
+ */
+extern int pal_cuckoo_del(struct pal_cuckoo *h, const void *key);
+
+/*
+ * @brief Walk all keys. Writer only, or racy.
+ * @param next Position to start from, 0 for the first call
+ * @return 1 if a key is returned, 0 at the end of the table
+ */
+extern int pal_cuckoo_iterate(const struct pal_cuckoo *h, uint32_t *next,
+				const void **key, void **data);
+
+/*
+ * @brief Find the data of up to PAL_CUCKOO_BULK_MAX keys, prefetching their
+ *        buckets first so that their cache misses overlap
+ * @param data Filled with the data of each key, NULL if not found
+ * @return Bit mask of the keys found
+ */
+extern uint64_t pal_cuckoo_lookup_bulk(const struct pal_cuckoo *h,
+				const void **keys, uint32_t n, void **data);
+
+static inline uint32_t pal_cuckoo_hash(const struct pal_cuckoo *h, const void *key)
+{
+	return pal_hash_crc((void *)key, h->key_len);
+}
+
+/* short signature of a key stored in its bucket, never 0 */
+static inline uint16_t pal_cuckoo_sig(uint32_t hash)
+{
+	return (uint16_t)(hash >> 16) | 1;
+}
+
+static inline uint32_t pal_cuckoo_prim(const struct pal_cuckoo *h, uint32_t hash)
+{
+	return hash & h->bucket_mask;
+}
+
+/* the alternative bucket is computed from the signature only, so that a
+ * key can be moved without knowing the key itself */
+static inline uint32_t pal_cuckoo_alt(const struct pal_cuckoo *h,
+				uint32_t bkt, uint16_t sig)
+{
+	return (bkt ^ ((uint32_t)sig * 0x5bd1e995)) & h->bucket_mask;
+}
+
+/*
+ * @brief Start a lock free read section
+ * @return Sequence to pass to pal_cuckoo_read_retry
+ */
+static inline uint32_t pal_cuckoo_read_begin(const struct pal_cuckoo *h)
+{
+	uint32_t seq;
+
+	while (unlikely((seq = h->seq) & 1))
+		rte_pause();
+	rte_rmb();
+
+	return seq;
+}
+
+/*
+ * @brief Check whether a read section overlapped a change of the table
+ * @return Non 0 if what was read must be dropped and read again
+ */
+static inline int pal_cuckoo_read_retry(const struct pal_cuckoo *h, uint32_t seq)
+{
+	rte_rmb();
+	return unlikely(h->seq != seq);
+}
+
+/*
+ * @brief Start moving keys, deleting one or updating an entry in place
+ */
+static inline void pal_cuckoo_write_begin(struct pal_cuckoo *h)
+{
+	h->seq++;
+	rte_wmb();
+}
+
+/*
+ * @brief End a change started by pal_cuckoo_write_begin
+ * @note This is a full barrier, so a writer can check per reader state
+ *       (such as use counts) right after it.
+ */
+static inline void pal_cuckoo_write_end(struct pal_cuckoo *h)
+{
+	rte_wmb();
+	h->seq++;
+	rte_mb();
+}
+
+/* look a key up in one bucket, no retry */
+static inline void *__pal_cuckoo_bucket_lookup(const struct pal_cuckoo *h,
+				const struct pal_cuckoo_bucket *b, uint16_t sig,
+				const void *key, int *found)
+{
+	const struct pal_cuckoo_key *k;
+	uint32_t idx;
+	int i;
+
+	for (i = 0; i < PAL_CUCKOO_BUCKET_ENTRIES; i++) {
+		if (b->sig[i] != sig)
+			continue;
+		idx = *(volatile const uint32_t *)&b->key_idx[i];
+		if (idx == 0)
+			continue;
+		k = &h->keys[idx];
+		if (memcmp(k->key, key, h->key_len) == 0) {
+			*found = 1;
+			return *(void * volatile const *)&k->data;
+		}
+	}
+
+	return NULL;
+}
+
+static inline void *__pal_cuckoo_lookup_hash(const struct pal_cuckoo *h,
+				const void *key, uint32_t hash)
+{
+	uint16_t sig = pal_cuckoo_sig(hash);
+	uint32_t prim = pal_cuckoo_prim(h, hash);
+	uint32_t seq;
+	int found;
+	void *data;
+
+	do {
+		found = 0;
+		seq = pal_cuckoo_read_begin(h);
+		data = __pal_cuckoo_bucket_lookup(h, &h->buckets[prim], sig, key, &found);
+		if (!found)
+			data = __pal_cuckoo_bucket_lookup(h,
+				&h->buckets[pal_cuckoo_alt(h, prim, sig)], sig, key, &found);
+	} while (pal_cuckoo_read_retry(h, seq));
+
+	return data;
+}
+
+/*
+ * @brief Find the data of a key, lock free
+ * @return The data, or NULL if the key is not in the table
+ */
+static inline void *pal_cuckoo_lookup(const struct pal_cuckoo *h, const void *key)
+{
+	return __pal_cuckoo_lookup_hash(h, key, pal_cuckoo_hash(h, key));
+}
+
+static inline uint32_t pal_cuckoo_count(const struct pal_cuckoo *h)
+{
+	return h->count;
+}
+
+#endif
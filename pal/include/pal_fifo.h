@@ -22,6 +22,20 @@ static inline struct pal_fifo *pal_fifo_create_spsc(const char *name,
 	                                       RING_F_SP_ENQ | RING_F_SC_DEQ);
 }
 
+/*
+ * @brief Create a fifo with multiple producers and single customer
+ * @param name Name of the fifo.
+ * @param count Maximum number of elements this ring can hold. Must be power of 2
+ * @param numa Numa node on which the ring is to be created
+ * @return Pointer to the newly created fifo, or NULL on failure
+ * @note Fifos cannot be destroyed
+ */
+static inline struct pal_fifo *pal_fifo_create_mpsc(const char *name,
+                                            unsigned count, unsigned numa)
+{
+	return (struct pal_fifo *)rte_ring_create(name, count, numa, RING_F_SC_DEQ);
+}
+
 /*
  * @brief Enqueue an object into the specified single-producer-fifo
  * @param fifo Pointer to the fifo
@@ -35,6 +49,18 @@ static inline int pal_fifo_enqueue_sp(struct pal_fifo *fifo, void *obj)
 	                                            RTE_RING_QUEUE_FIXED);
 }
 
+/*
+ * @brief Enqueue an object into the specified multi-producer-fifo
+ * @param fifo Pointer to the fifo
+ * @param obj The object to be enqueued
+ * @return 0 on success, none 0 on failure(may be > 0 or < 0)
+ */
+static inline int pal_fifo_enqueue_mp(struct pal_fifo *fifo, void *obj)
+{
+	return __rte_ring_mp_do_enqueue((struct rte_ring *)fifo, &obj, 1,
+	                                            RTE_RING_QUEUE_FIXED);
+}
+
 /*
  * @brief Dequeue an object from a single-customer-fifo
  * @param fifo Pointer to the fifo
@@ -8,6 +8,9 @@
 #include "pal_byteorder.h"
 #include "pal_atomic.h"
 #include "pal_phy_vport.h"
+#include "pal_cuckoo.h"
+#include "pal_qsbr.h"
+#include "pal_error.h"
 
 #define IP_CELL_SLAB_SIZE 20480
 
@@ -22,8 +25,8 @@ typedef enum {
 }ip_cell_type;
 
 struct ip_cell{
-	struct pal_hlist_node hlist;
 	struct pal_list_head  list;
+	struct pal_qsbr_head  qsbr;	/* deferred free */
 	__be32 	ip;
 	struct phy_vport *vp;
 
@@ -38,71 +41,32 @@ struct ip_cell_info{
 
 #define IP_CELL_NUM_MAX			10000
 
-#define IP_HASH_BITS	14
-#define IP_HASH_SIZE	(1<<IP_HASH_BITS)
-#define IP_HASH_MASK	(IP_HASH_SIZE-1)
-
-struct ip_cell_head_lock{
-	pal_rwlock_t	  hash_lock;
-	struct pal_hlist_head head;
-};
-
+/*
+ * ip cells are looked up lock free by receivers,
+ * and added or deleted by one writer at a time.
+ */
 struct ip_cell_pool {
 	unsigned int	  addrcnt;
 	unsigned int	  addrmax;
 
-	struct ip_cell_head_lock ip_cell_array[IP_HASH_SIZE];
+	pal_spinlock_t	  lock;	/* serializes writers */
+	struct pal_cuckoo *table;	/* ip -> ip_cell */
 };
 
-static inline uint32_t get_hash_index_ip(__be32 ip)
-{
-	return (pal_hash32(ip) & IP_HASH_MASK);
-}
-
-static inline struct pal_hlist_head *ip_cell_head(struct ip_cell_pool *ippool,__be32 ip)
-{
-	return &ippool->ip_cell_array[pal_hash32(ip) & IP_HASH_MASK].head;
-}
-
-static inline struct pal_hlist_head *ip_cell_head_index(struct ip_cell_pool *ippool,uint32_t index)
-{
-	return &ippool->ip_cell_array[index].head;
-}
-
-static inline void read_lock_ip_cell(uint32_t index)
-{
-	pal_rwlock_read_lock(&ip_pool.ip_cell_array[index].hash_lock);
-}
-
-static inline void read_unlock_ip_cell(uint32_t index)
-{
-	pal_rwlock_read_unlock(&ip_pool.ip_cell_array[index].hash_lock);
-}
-
-static inline void write_lock_ip_cell(uint32_t index)
-{
-	pal_rwlock_write_lock(&ip_pool.ip_cell_array[index].hash_lock);
-}
-
-static inline void write_unlock_ip_cell(uint32_t index)
-{
-	pal_rwlock_write_unlock(&ip_pool.ip_cell_array[index].hash_lock);
-}
-
-static inline void add_ip_cell_to_ippool(struct ip_cell_pool *ippool,
+static inline int add_ip_cell_to_ippool(struct ip_cell_pool *ippool,
  	struct ip_cell *ipcell)
 {
+	 if (pal_cuckoo_add(ippool->table, &ipcell->ip, ipcell))
+		 return -ENOSPC;
 	 ++ippool->addrcnt;
-	 pal_hlist_add_head(&ipcell->hlist,
-				 ip_cell_head(ippool, ipcell->ip));
+	 return 0;
 }
 
  static inline void remove_ip_cell_from_ippool(struct ip_cell_pool *ippool,
  	struct ip_cell *ipcell)
 {
 	 --ippool->addrcnt;
-	pal_hlist_del(&ipcell->hlist);
-
+	 pal_cuckoo_del(ippool->table, &ipcell->ip);
 }
 
 static inline void add_floating_ip_to_phy_vport(struct phy_vport *vport,
@@ -125,7 +89,17 @@ extern int ip_cell_add(__be32 ip, ip_cell_type type,
 				 struct phy_vport *vport);
 
 
-extern struct phy_vport *find_get_phy_vport(__be32 ip);
+/*
+ * lock free, the vport stays valid until the caller reports its next
+ * quiescent state, see pal_qsbr.h
+ */
+extern struct phy_vport *find_phy_vport(__be32 ip);
+
+/*
+ * look up the ip cells of n destination addresses at once and prefetch
+ * their vports, for the find_phy_vport() of each packet of a burst
+ */
+extern void ip_cell_prefetch_bulk(const __be32 *ips, unsigned n);
 
 extern int ip_cell_delete(__be32 ip,ip_cell_type type);
 extern int ip_cell_pool_init(void);
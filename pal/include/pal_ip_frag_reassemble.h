@@ -14,6 +14,8 @@
 
 #include <rte_ip_frag.h>
 
+#include "pal_fifo.h"
+
 struct fragment_rx_queue {
 	struct rte_mempool *direct_pool;
 	struct rte_mempool *indirect_pool;
@@ -42,8 +44,39 @@ struct ip_fragment_conf {
 /* Should be power of two. */
 #define	IP_FRAG_TBL_BUCKET_ENTRIES	16
 
+/* size of the queue receivers use to redirect fragments to their owner */
+#define	IP_FRAG_REDIRECT_Q_SIZE	1024
+
+/*
+ * Each receiver owns a reassembly table. Fragments of a datagram are
+ * steered to one owner by hashing src/dst/id/proto, and those received by
+ * another receiver of the same numa are redirected through owner's frag_q.
+ */
 struct ip_reassemble_conf {
 	struct 	rte_ip_frag_death_row death_row;
+	struct rte_ip_frag_tbl *frag_tbl;
+	struct pal_fifo *frag_q;
+	uint8_t n_owner;	/* number of receivers on this numa */
+	uint8_t owner[PAL_MAX_THREAD];	/* their thread ids */
 };
 
+struct sk_buff;
+struct ip_hdr;
+
+/*
+ * @brief Get the receiver owning the reassembly of this fragment
+ */
+extern int ip_frag_owner(const struct ip_hdr *iph);
+
+/*
+ * @brief Hand a fragment over to the receiver owning its datagram
+ * @return 0 on success, -1 if the queue is full and the fragment is freed
+ */
+extern int ip_frag_redirect(struct sk_buff *skb, int tid);
+
+/*
+ * @brief Get occupancy of the reassembly table of a receiver
+ */
+extern void ip_frag_table_usage(int tid, uint32_t *used, uint32_t *max);
+
 #endif
@@ -38,6 +38,7 @@ extern int floating_ip_add_ctl(__be32 floating_ip,
 				  char *vport_name);
 extern int floating_ip_delete_ctl(__be32 floating_ip);
 extern int floating_ip_show_ctl(char *vport_name);
+extern int int_vport_vni_ctl(char *vport_name,uint32_t *vni);
 extern int vxlan_fdb_add_ctl(uint32_t vni,struct fdb_entry *entry);
 extern int vxlan_fdb_delete_ctl(uint32_t vni,uint8_t *mac);
 extern int vxlan_fdb_show_ctl(uint32_t vni);
@@ -45,6 +46,8 @@ extern void nd_delete_vport(void *nd);
 extern struct vxlan_dev * get_vxlan_dev(uint32_t vni);
 extern int vxlan_arp_add_ctl(uint32_t vni,struct vxlan_arp_entry *entry);
 extern int vxlan_arp_delete_ctl(uint32_t vni,struct vxlan_arp_entry *entry);
+extern int vxlan_fdb_learning_ctl(uint32_t vni,int enable,uint32_t ageing);
+extern int int_vport_mss_clamp_ctl(char *vport_name,uint16_t mss,void *private);
 extern int route_entry_table_show_ctl(struct route_table *rt ,struct route_entry_table *reb);
 
 #endif
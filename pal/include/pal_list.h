@@ -264,6 +264,23 @@ static inline void pal_hlist_add_head(struct pal_hlist_node *n, struct pal_hlist
 	n->pprev = &h->first;
 }
 
+/*
+ * For lists walked by lockless readers, see pal_qsbr.h: the node is fully
+ * linked before it is published. pal_hlist_del() keeps n->next, so a reader
+ * standing on a deleted node goes on, the node is freed after a grace period.
+ */
+static inline void pal_hlist_add_head_rcu(struct pal_hlist_node *n,
+					struct pal_hlist_head *h)
+{
+	struct pal_hlist_node *first = h->first;
+	n->next = first;
+	n->pprev = &h->first;
+	__asm__ __volatile__("" : : : "memory");
+	if (first)
+		first->pprev = &n->next;
+	*(struct pal_hlist_node * volatile *)&h->first = n;
+}
+
 /* next must be != NULL */
 static inline void pal_hlist_add_before(struct pal_hlist_node *n,
 					struct pal_hlist_node *next)
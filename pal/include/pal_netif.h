@@ -47,6 +47,11 @@ extern int pal_send_raw_pkt(struct sk_buff *skb,
 extern int pal_send_batch_pkt(struct sk_buff *skb, unsigned port_id);
 extern void pal_flush_port(void);
 
+/*
+ * @brief Drain the data path and stop the nic ports, before exiting
+ */
+extern void pal_ports_stop(void);
+
 /*
  * @brief Test whether a port is enabled
  * @return 0 if this port is not enabled, 1 otherwise
@@ -98,6 +103,16 @@ static inline int pal_port_numa(int port_id)
 	return g_pal_config.port[port_id]->numa;
 }
 
+/*
+ * @brief Return the mtu of a port
+ * @note Caller must make sure that port_id falls between [0, PAL_MAX_PORT],
+ *       or there may be a segmentation fault.
+ */
+static inline unsigned pal_port_mtu(int port_id)
+{
+	return g_pal_config.port[port_id]->mtu;
+}
+
 /*
  * @brief Get hardware nic statistics
  */
@@ -0,0 +1,142 @@
+#ifndef _PAL_PCPU_H_
+#define _PAL_PCPU_H_
+#include <stdint.h>
+#include <stddef.h>
+#include <rte_common.h>
+#include <rte_memory.h>
+
+#include "pal_conf.h"
+#include "pal_thread.h"
+
+/*
+ * Per-core counters.
+ *
+ * A block holds the u64 counters of an object for one core, and only that
+ * core writes it. The blocks of an object are allocated together, each on
+ * its own cache lines, so the cores counting the same object never write
+ * the same line:
+ *
+ *	struct foo_stats {
+ *		struct pal_pcpu_head head;
+ *		uint64_t pkts;
+ *		uint64_t bytes;
+ *	} __rte_cache_aligned;
+ *
+ *	foo->stats = pal_pcpu_alloc(sizeof(struct foo_stats), numa);
+ *	PAL_PCPU_ADD(&foo->stats[rte_lcore_id()], pkts, 1);
+ *
+ * PAL_PCPU_ADD() sums into a small batch of the thread, which is written
+ * to the blocks by pal_pcpu_flush() once per round of the packet loops,
+ * before their quiescent state. So the batch may point to a block until
+ * the end of the round: blocks added to this way must be freed after a
+ * grace period, see pal_qsbr.h. Blocks of other objects are written in
+ * place between pal_pcpu_write_begin() and pal_pcpu_write_end().
+ *
+ * Writes are bracketed by the seq of the block, so that pal_pcpu_sum()
+ * sees bytes matching pkts.
+ */
+
+struct pal_pcpu_head {
+	volatile uint32_t seq;	/* odd while the owner writes the block */
+	uint32_t pad;
+};
+
+/* blocks of the objects touched by a thread during a round */
+#define PAL_PCPU_BATCH_SLOTS	4
+#define PAL_PCPU_BATCH_MAX	15	/* u64 counters, up to 128 byte blocks */
+
+struct pal_pcpu_slot {
+	struct pal_pcpu_head *head;
+	uint32_t n;		/* counters of delta in use */
+	uint64_t delta[PAL_PCPU_BATCH_MAX];
+};
+
+struct pal_pcpu_batch {
+	int n;
+	struct pal_pcpu_slot slot[PAL_PCPU_BATCH_SLOTS];
+};
+
+PAL_DECLARE_PER_THREAD(struct pal_pcpu_batch, _pcpu_batch);
+
+/* x86 keeps stores, and loads, in order: only the compiler may move them */
+#define pal_pcpu_barrier()	__asm__ __volatile__("" : : : "memory")
+
+/* index of a counter in a block of type */
+#define PAL_PCPU_IDX(type, field)	\
+	((offsetof(type, field) - sizeof(struct pal_pcpu_head)) / sizeof(uint64_t))
+
+static inline void pal_pcpu_write_begin(struct pal_pcpu_head *head)
+{
+	head->seq++;
+	pal_pcpu_barrier();
+}
+
+static inline void pal_pcpu_write_end(struct pal_pcpu_head *head)
+{
+	pal_pcpu_barrier();
+	head->seq++;
+}
+
+extern void __pal_pcpu_flush(struct pal_pcpu_batch *batch);
+
+/*
+ * @brief Write the batch of this thread to the blocks, called by the loops
+ *        of the packet threads once per round
+ */
+static inline void pal_pcpu_flush(void)
+{
+	struct pal_pcpu_batch *batch = &PAL_PER_THREAD(_pcpu_batch);
+
+	if (batch->n)
+		__pal_pcpu_flush(batch);
+}
+
+static inline uint64_t *pal_pcpu_delta(struct pal_pcpu_head *head, uint32_t idx)
+{
+	struct pal_pcpu_batch *batch = &PAL_PER_THREAD(_pcpu_batch);
+	struct pal_pcpu_slot *slot;
+	int i;
+
+	for (i = 0; i < batch->n; i++) {
+		if (batch->slot[i].head == head)
+			goto found;
+	}
+
+	if (unlikely(batch->n == PAL_PCPU_BATCH_SLOTS))
+		__pal_pcpu_flush(batch);
+	i = batch->n++;
+	batch->slot[i].head = head;
+
+found:
+	slot = &batch->slot[i];
+	if (idx >= slot->n)
+		slot->n = idx + 1;
+	return &slot->delta[idx];
+}
+
+/*
+ * @brief Add v to counter field of block, a block of the current core
+ */
+#define PAL_PCPU_ADD(block, field, v) do {					\
+	BUILD_BUG_ON(PAL_PCPU_IDX(typeof(*(block)), field)			\
+		>= PAL_PCPU_BATCH_MAX);						\
+	*pal_pcpu_delta(&(block)->head,						\
+		PAL_PCPU_IDX(typeof(*(block)), field)) += (v);			\
+} while (0)
+
+/*
+ * @brief Allocate the zeroed blocks of all the cores, each is size bytes,
+ *        a multiple of the cache line size
+ * @return The block of core 0, or NULL on failure
+ */
+extern void *pal_pcpu_alloc(size_t size, int numa);
+
+extern void pal_pcpu_free(void *blocks);
+
+/*
+ * @brief Sum the blocks of all the cores, a consistent snapshot of each
+ * @param sum Block of the same type receiving the sums, its head is zeroed
+ */
+extern void pal_pcpu_sum(void *sum, const void *blocks, size_t size);
+
+#endif
@@ -12,6 +12,7 @@
 #include "pal_utils.h"
 #include "pal_byteorder.h"
 #include "pal_atomic.h"
+#include "pal_qsbr.h"
 
 #define PHY_VPORT_SLAB_SIZE 1024*10
 
@@ -22,7 +23,7 @@
 #define PHY_VPORT_HASH_MASK	(PHY_VPORT_HASH_SIZE-1)
 
 struct phy_net {
-	unsigned int	  addrcnt;
+	unsigned int	  addrcnt;	/* atomic, buckets are locked apart */
 	unsigned int	  addrmax;
 
 	pal_rwlock_t	  hash_lock_array[PHY_VPORT_HASH_SIZE];
@@ -40,9 +41,9 @@ struct phy_vport {
 
 	unsigned long		port_state;	
 	atomic_t count;						    /*Usage count, see below. */	
-	int		 use_count[MAX_CORE_NUM];	
 
-	struct vport_stats	stats[MAX_CORE_NUM];	
+	struct vport_stats	*stats;		/* indexed by lcore id */	
+	struct pal_qsbr_head	qsbr;		/* deferred free */
 };
 
 #define phy_vport_get(x)		atomic_inc(&(x)->count)
@@ -70,7 +71,7 @@ static inline struct pal_hlist_head *phy_vport_head_index(struct phy_net *phynet
 
 static inline void add_phy_vport_to_phy_net(struct phy_net *phynet, struct phy_vport *vp)
 {
-	++phynet->addrcnt;	
+	__sync_add_and_fetch(&phynet->addrcnt, 1);
 	/*add to phy_vport net*/
 	pal_hlist_add_head(&(vp->hlist_phy_vport),
 				   phy_vport_head(phynet, vp->vp.vport_ip));
@@ -78,7 +79,7 @@ static inline void add_phy_vport_to_phy_net(struct phy_net *phynet, struct phy_v
 
 static inline void add_phy_vport_to_vport_net(struct vport_net *vpnet, struct phy_vport *vp)
 {
-	++vpnet->addrcnt;
+	__sync_add_and_fetch(&vpnet->addrcnt, 1);
 	/*add to vport net*/
 	pal_hlist_add_head(&(vp->vp.hlist),
 				  vport_head(vpnet, vp->vp.vport_name));
@@ -86,7 +87,7 @@ static inline void add_phy_vport_to_vport_net(struct vport_net *vpnet, struct ph
 
 static inline void remove_phy_vport_from_phy_net(struct phy_net *phynet, struct phy_vport *vp)
 {
-	--phynet->addrcnt;
+	__sync_sub_and_fetch(&phynet->addrcnt, 1);
 	/*delete from phy_vport net*/
 	pal_hlist_del(&(vp->hlist_phy_vport));		
 
@@ -94,7 +95,7 @@ static inline void remove_phy_vport_from_phy_net(struct phy_net *phynet, struct
 
 static inline void remove_phy_vport_from_vport_net(struct vport_net *vpnet, struct phy_vport *vp)
 {
-	--vpnet->addrcnt;
+	__sync_sub_and_fetch(&vpnet->addrcnt, 1);
 	/*delete from vport net*/
 	pal_hlist_del(&(vp->vp.hlist));		
 }
@@ -3,6 +3,7 @@
 #include <stdint.h>
 
 #include "pal_byteorder.h"
+#include "pal_csum.h"
 
 #define PAL_ETH_IP	(0x0800)  /* ip protocol type */
 #define PAL_ETH_ARP	(0x0806)  /* arp protocol type */
@@ -274,32 +275,10 @@ struct icmp_hdr {
  */
 static inline uint16_t ip_fast_csum(uint16_t *iph, uint32_t ihl)
 {
-	uint32_t opt_bytes_num = ihl - sizeof(struct ip_hdr);
-	uint16_t *p = iph;
-	uint32_t csum = *p++;/* version header tos */
-	csum += *p++; /* total length */
-	csum += *p++; /* id */
-	csum += *p++; /* fragment */
-	csum += *p++; /* ttl protocol */
-	p++;		  /* check sum */
-	csum += *p++; /* source addr high  */
-	csum += *p++; /* sourcr addr low */
-	csum += *p++; /* destnation addr high */
-	csum += *p++; /* destnation addr low */
-
-	while (opt_bytes_num>1){
-		csum += *p++;
-		opt_bytes_num -= 2;
-	}
-
-	if(opt_bytes_num){
-		csum += (*(uint8_t *)p); /*set the remain bytes to zero*/
-	}
+	uint32_t csum = pal_csum_partial(iph, ihl, 0);
 
-	csum = (csum & (uint32_t)0x0000ffffUL) + (csum>>16);
-	csum = (csum & (uint32_t)0x0000ffffUL) + (csum>>16);
-
-	return ~((uint16_t)csum);
+	/* take the check sum field out, adding ~x cancels x */
+	return pal_csum_fold(pal_csum_add(csum, (uint16_t)~iph[5]));
 }
 
 /*
@@ -323,9 +302,7 @@ static inline uint16_t ip_fast_fast_csum(uint16_t *iph)
 	csum += *p++; /* destnation addr high */
 	csum += *p++; /* destnation addr low */
 
-	csum = (csum & (uint32_t)0x0000ffffUL) + (csum>>16);
-	csum = (csum & (uint32_t)0x0000ffffUL) + (csum>>16);
-	return ~((uint16_t)csum);
+	return pal_csum_fold(csum);
 }
 
 /*
@@ -336,43 +313,7 @@ static inline uint16_t ip_fast_fast_csum(uint16_t *iph)
  */
 static inline int icmp_check_sum_correct(uint16_t *start_of_icmp, int len)
 {
-	uint32_t sum = 0;
-	int i;
-	int u16_num = len >> 1;
-	int last_byte = len & 1;
-
-	for(i = 0; i < u16_num; i++)
-	        sum += start_of_icmp[i];
-
-	if(last_byte)
-	        sum += *(uint8_t *)(start_of_icmp + i);
-
-	sum = (sum & 0x0000ffff) + (sum >> 16);
-	sum += (sum >> 16);
-	return ((uint16_t)sum == 0xffff);
-}
-
-/*
- * @brief Update the checksum after some fields are changed.
- * @param oldvalinv Inverted old value of the changed field
- * @param newval New value of the changed field.
- * @param oldcheck Old value of checksum
- * @return New value of checksum
- */
-static inline uint16_t ip_nat_check(uint32_t oldvalinv, 
-                                    uint32_t newval, uint16_t oldcheck)
-{
-	uint32_t csum = oldcheck ^ 0xFFFF;
-
-	csum += oldvalinv >> 16;
-	csum += oldvalinv & 0xFFFF;
-	csum += newval >> 16;
-	csum += newval & 0xFFFF;
-
-	csum = (csum & 0xFFFFUL) + (csum >> 16);
-	csum = (csum & 0xFFFFUL) + (csum >> 16);
-
-	return ~((uint16_t)csum);
+	return pal_csum_ok(start_of_icmp, len);
 }
 
 static inline unsigned pal_compare_ether_addr(const uint8_t *addr1, const uint8_t *addr2)
@@ -0,0 +1,107 @@
+#ifndef _PAL_QSBR_H_
+#define _PAL_QSBR_H_
+#include <stdint.h>
+#include <rte_common.h>
+#include <rte_atomic.h>
+
+#include "pal_list.h"
+#include "pal_thread.h"
+
+/*
+ * Quiescent state based reclamation.
+ *
+ * Packet threads look up vports, vxlan devs, ip cells and namespaces
+ * without a lock or a reference count, and report a quiescent state once
+ * per iteration of their main loop, where they hold no pointer to such
+ * objects. A writer unlinks an object, then waits for a grace period, after
+ * which every online thread has passed a quiescent state and can no longer
+ * see the object, and frees it.
+ *
+ * pal_qsbr_synchronize() waits for a grace period, pal_qsbr_call() defers
+ * a free to the end of one without blocking. Both are for the control
+ * plane only: a packet thread waiting for a grace period would wait for
+ * itself.
+ */
+
+struct pal_qsbr_thread {
+	volatile uint64_t seq;	/* last grace period seen, 0 when offline */
+} __rte_cache_aligned;
+
+struct pal_qsbr {
+	volatile uint64_t seq __rte_cache_aligned;	/* current grace period */
+	struct pal_qsbr_thread thread[PAL_MAX_THREAD];
+};
+
+extern struct pal_qsbr pal_qsbr;
+
+/* an object waiting for a grace period, embedded in the object */
+struct pal_qsbr_head {
+	struct pal_list_head list;
+	uint64_t seq;
+	void (*func)(struct pal_qsbr_head *head);
+};
+
+/*
+ * @brief Report a quiescent state of this thread. Called by the loops of
+ *        the packet threads, between two bursts.
+ */
+static inline void pal_qsbr_quiescent(void)
+{
+	/* the loads of the last burst are done before the store is seen */
+	rte_wmb();
+	pal_qsbr.thread[pal_thread_id()].seq = pal_qsbr.seq;
+}
+
+/*
+ * @brief Make this thread a reader, grace periods wait for it from now on
+ */
+static inline void pal_qsbr_online(void)
+{
+	pal_qsbr.thread[pal_thread_id()].seq = pal_qsbr.seq;
+	rte_mb();
+}
+
+/*
+ * @brief Stop waiting for this thread, e.g. before it blocks.
+ *        It must not hold any pointer to protected objects.
+ */
+static inline void pal_qsbr_offline(void)
+{
+	rte_wmb();
+	pal_qsbr.thread[pal_thread_id()].seq = 0;
+}
+
+/*
+ * @brief Start a grace period
+ * @return Token to pass to pal_qsbr_check()
+ */
+extern uint64_t pal_qsbr_start(void);
+
+/*
+ * @brief Test whether the grace period of token is over, never blocks
+ * @return 1 if every online thread has passed a quiescent state since
+ *         pal_qsbr_start() returned token, 0 otherwise
+ */
+extern int pal_qsbr_check(uint64_t token);
+
+/*
+ * @brief Wait until every online thread has passed a quiescent state.
+ *        Objects unlinked before the call can be freed when it returns.
+ */
+extern void pal_qsbr_synchronize(void);
+
+/*
+ * @brief Call func(head) after a grace period, head must have been unlinked.
+ *        func runs in the thread calling pal_qsbr_reclaim().
+ */
+extern void pal_qsbr_call(struct pal_qsbr_head *head,
+				void (*func)(struct pal_qsbr_head *head));
+
+/*
+ * @brief Run the deferred calls whose grace period is over, called
+ *        periodically by the control thread
+ * @return Number of calls run
+ */
+extern int pal_qsbr_reclaim(void);
+
+#endif
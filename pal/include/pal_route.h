@@ -4,6 +4,7 @@
 #include <stdint.h> 
 
 struct route_table;
+struct pal_arena;
 
 #define PAL_ROUTE_CONNECTED	0x01	/* connected route */
 #define PAL_ROUTE_COMMON	0x02	/* routes not connected */
@@ -37,8 +38,16 @@ struct route_entry_table{
 	struct route_entry r_table[MAX_ROUTE_ENTRY_NUM];
 };
 
-struct route_table *pal_rtable_new(void);
+/*
+ * @brief Create a routing table whose trie is allocated from arena,
+ *        or from an arena of its own if arena is NULL
+ */
+struct route_table *pal_rtable_new(struct pal_arena *arena);
  
+/*
+ * @brief Destroy a routing table. With a shared arena the remaining
+ *        routes are not freed one by one, they go with the arena.
+ */
 void pal_rtable_destroy(struct route_table *rtable);
  
 int pal_route_add(struct route_table *t, uint32_t prefix, uint32_t prefixlen, uint32_t nexthop);
@@ -77,5 +86,12 @@ void pal_trie_dump(const struct route_table *rtable);
 
 void pal_trie_traverse(struct route_table *rtable,struct route_entry_table *reb);
 
+/**
+ * @brief pal_route_walk - Call f on every route item of a routing table,
+ *        with no limit on their number. f must not change the table
+ */
+void pal_route_walk(struct route_table *rtable,
+		void (*f)(const struct route_entry *, void *), void *arg);
+
 
 #endif
@@ -7,17 +7,21 @@
 #include "pal_byteorder.h"
 #include "pal_pktdef.h"
 
-/* max packet size. This does not include PAL_PKT_HEADROOM.*/
-/* Note: in ixgbe_dev_rx_init, the default max packet size is 2048, because
- * RX buffer size in the BSIZEPACKET field of the SRRCTL register of the queue
- * is in 1 KB resolution, and valid values can be from 1 KB to 16 KB.
- * I guess if we receive a packet between 1600 and 2048, there may be a
- * segmentation fault.
- * So we MUST make sure that the MTU of switch is no more than 1500.
- * Note2: in an allocated skb, max pkt size is actually 1598, because we moved
+/* max data size of a single mbuf segment. This does not include
+ * PAL_PKT_HEADROOM.*/
+/* Note: in ixgbe_dev_rx_init, RX buffer size in the BSIZEPACKET field of the
+ * SRRCTL register of the queue is in 1 KB resolution, and valid values can be
+ * from 1 KB to 16 KB. So keep this a multiple of 1 KB, otherwise the tail of
+ * every buffer is wasted.
+ * Frames larger than one segment (jumbo frames, reassembled packets) are
+ * received as mbuf chains, see PAL_MAX_MTU.
+ * Note2: in an allocated skb, max pkt size is actually 2046, because we moved
  * the data pointer to make sure it's 4-byte aligned.
  */
-#define PAL_MAX_PKT_SIZE	1600
+#define PAL_MAX_PKT_SIZE	2048
+
+/* max underlay mtu a port can be configured with */
+#define PAL_MAX_MTU		9000
 
 struct sk_buff {
 	/* mbuf MUST be the first member */
@@ -79,25 +83,36 @@ static inline void *skb_data(const struct sk_buff *skb)
 }
 
 /*
- * @brief Get the length of a specified packet. Starts from data pointer.
- */
+ * @brief Get the length of data in the first segment of a packet.
+ *        Starts from data pointer. Only this part can be accessed through
+ *        the header pointers, use pskb_may_pull to extend it.
+ */
 static inline unsigned skb_len(const struct sk_buff *skb)
 {
 	return skb->mbuf.pkt.data_len;
 }
 
 /*
- * @brief Get the length of a specified packet. Starts from data pointer.
- */
+ * @brief Get the total length of a specified packet, including all chained
+ *        segments. Starts from data pointer.
+ */
 static inline unsigned skb_pkt_len(const struct sk_buff *skb)
 {
 	return skb->mbuf.pkt.pkt_len;
 }
 
+/*
+ * @brief Test whether the packet is made up of more than one segment
+ */
+static inline int skb_is_nonlinear(const struct sk_buff *skb)
+{
+	return skb->mbuf.pkt.next != NULL;
+}
+
 static inline void *skb_l2_header(const struct sk_buff *skb);
 static inline unsigned skb_l2_len(const struct sk_buff *skb)
 {
-	return skb->mbuf.pkt.data_len + 
+	return skb->mbuf.pkt.pkt_len +
 		((unsigned long)skb_data(skb) - (unsigned long)skb_l2_header(skb));
 }
 
@@ -133,13 +148,47 @@ static inline void *skb_pull(struct sk_buff *skb, unsigned int len)
 	return skb->mbuf.pkt.data;
 }
 
+extern int __pskb_pull_tail(struct sk_buff *skb, unsigned int len);
+extern int __pskb_trim(struct sk_buff *skb, unsigned int len);
+extern void skb_copy_bits(const struct sk_buff *skb, unsigned int offset,
+			void *to, unsigned int len);
+extern uint32_t skb_checksum(const struct sk_buff *skb, unsigned int offset,
+			unsigned int len, uint32_t sum);
+
+/*
+ * @brief Make sure the first len bytes of the packet are in the first
+ *        segment, moving data from the following segments if needed.
+ * @return 1 on success, 0 if the packet is shorter than len or the first
+ *         segment has not enough room
+ */
 static inline int pskb_may_pull(struct sk_buff *skb, unsigned int len)
 {
 	if(likely(len <=  skb_len(skb))){
 		return 1;
+	}else if(unlikely(len > skb_pkt_len(skb))){
+		return 0;
 	}else{
+		return __pskb_pull_tail(skb, len - skb_len(skb));
+	}
+}
+
+/*
+ * @brief Cut the packet to len bytes, freeing the segments beyond it.
+ *        Does nothing if the packet is not longer than len.
+ * @return 0 on success
+ */
+static inline int pskb_trim(struct sk_buff *skb, unsigned int len)
+{
+	if (likely(len >= skb_pkt_len(skb)))
+		return 0;
+
+	if (likely(!skb_is_nonlinear(skb))) {
+		skb->mbuf.pkt.data_len = len;
+		skb->mbuf.pkt.pkt_len = len;
 		return 0;
 	}
+
+	return __pskb_trim(skb, len);
 }
 
 static inline int skb_cow_head(void)
@@ -156,9 +205,10 @@ static inline int skb_cow_head(void)
  */
 static inline void *skb_append(struct sk_buff *skb, unsigned int len)
 {
-	void *tail = (void *)((uint8_t *)skb->mbuf.pkt.data + skb->mbuf.pkt.data_len);
+	struct rte_mbuf *last = rte_pktmbuf_lastseg(&skb->mbuf);
+	void *tail = (void *)((uint8_t *)last->pkt.data + last->pkt.data_len);
 
-	skb->mbuf.pkt.data_len += len;
+	last->pkt.data_len += len;
 	skb->mbuf.pkt.pkt_len += len;
 
 	return tail;
@@ -173,8 +223,14 @@ static inline void *skb_append(struct sk_buff *skb, unsigned int len)
  */
 static inline void *skb_adjust(struct sk_buff *skb, unsigned int len)
 {
-	skb->mbuf.pkt.data_len -= len;
-	skb->mbuf.pkt.pkt_len -= len;
+	struct rte_mbuf *last = rte_pktmbuf_lastseg(&skb->mbuf);
+
+	if (likely(last->pkt.data_len >= len)) {
+		last->pkt.data_len -= len;
+		skb->mbuf.pkt.pkt_len -= len;
+	} else {
+		pskb_trim(skb, skb_pkt_len(skb) - len);
+	}
 
 	return skb->mbuf.pkt.data;
 }
@@ -215,6 +271,7 @@ static inline void pal_skb_free(struct sk_buff *skb)
 /*
  * @brief Set the length of the packet. note that this does not change
  *        the data pointer
+ * @note Only for single segment packets, use pskb_trim to shorten a chain
  */
 static inline void skb_set_pkt_len(struct sk_buff *skb, unsigned len)
 {
@@ -318,7 +375,9 @@ static inline unsigned skb_l4_csum_ok(const struct sk_buff *skb)
  * @param name Name of the slab, must unique across the system
  * @param n_skb Number of skbs this slab contain
  * @return Pointer to the slab, or NULL on failure
- * @note If multiple threads alloc skbs from the same skb slab, caller must
+ * @note An skb slab is a bare mbuf pool of a fixed size, not a pal_slab
+ *        that grows: only pal_skb_alloc() and skb_clone() take it.
+ *        If multiple threads alloc skbs from the same skb slab, caller must
  *        use locks to avoid race condition. However, freeing skbs in multiple
  *        threads at the same time is OK.
  */
@@ -413,7 +472,14 @@ static inline int print_pkt(const struct sk_buff *skb)
 	return 0;
 }
 
+extern int __skb_clone_tail(const struct sk_buff *skb, struct sk_buff *skb2,
+			struct pal_slab *slab, unsigned int size);
+
 /*
+ * @brief Copy the first size bytes of skb, all of it if it is shorter.
+ *        Data not fitting in one clone buffer goes to more segments taken
+ *        from slab, a clone is never shorter than asked.
+ * @return The clone, or NULL if slab has not enough skbs
  * note: pointer to eth/network/transport header are invalid after clone
  */
 static inline struct sk_buff *skb_clone(const struct sk_buff *skb,
@@ -429,18 +495,30 @@ static inline struct sk_buff *skb_clone(const struct sk_buff *skb,
 
 	m = &skb->mbuf;
 	m2 = &skb2->mbuf;
-	size = min(m->pkt.data_len, size);
+	size = min((uint16_t)m->pkt.pkt_len, size);
 	m2->pkt.next = NULL;
 	m2->pkt.vlan_macip.data = m->pkt.vlan_macip.data;
 	m2->pkt.nb_segs = 1;
 	m2->pkt.in_port = m->pkt.in_port;
 	m2->ol_flags = m->ol_flags;
 	m2->pkt.data = (char *)m2->buf_addr + ((const char *)m->pkt.data - (const char *)m->buf_addr);
-	/* we don't use SG IO, so pkt_len is equal to data_len */
 	m2->pkt.pkt_len = size;
+
+	/* data past the room of the first clone buffer goes to more segments */
+	if (unlikely(size > (const char *)m2->buf_addr + m2->buf_len -
+				(const char *)m2->pkt.data)) {
+		if (__skb_clone_tail(skb, skb2, slab, size) < 0) {
+			pal_skb_free(skb2);
+			return NULL;
+		}
+		return skb2;
+	}
 	m2->pkt.data_len = size;
 
-	memcpy(m2->pkt.data, m->pkt.data, size);
+	if (likely(size <= m->pkt.data_len))
+		memcpy(m2->pkt.data, m->pkt.data, size);
+	else
+		skb_copy_bits(skb, 0, m2->pkt.data, size);
 
 	return skb2;
 }
@@ -562,6 +640,19 @@ static inline void skb_ipudp_csum_offload(struct sk_buff *skb,
 	skb->mbuf.pkt.vlan_macip.f.l3_len = iphdr_len;
 }
 
+/*
+ * @brief Checks a checksum covering len bytes of the packet, starting at
+ *        offset from the data pointer. Works on chained packets.
+ * @return 1 if the csum is correct. 0 otherwise.
+ */
+static inline int skb_csum_correct(const struct sk_buff *skb,
+			unsigned int offset, unsigned int len)
+{
+	uint32_t sum = skb_checksum(skb, offset, len, 0);
+
+	return pal_csum_reduce16(sum) == 0xffff;
+}
+
 static inline void skb_set_dump(struct sk_buff *skb)
 {
 	skb->dump = 1;
@@ -1,18 +1,65 @@
 #ifndef _PAL_SLAB_H_
 #define _PAL_SLAB_H_
+#include <stdint.h>
 #include <rte_mempool.h>
+#include <rte_branch_prediction.h>
 
 #include "pal_utils.h"
+#include "pal_list.h"
+#include "pal_spinlock.h"
+
+/*
+ * A slab is a list of chunks, each a mempool on hugepages. It starts with
+ * one chunk of a hugepage worth of elements and gets a chunk twice the size
+ * of the last one when the last one is PAL_SLAB_HIGH_WATERMARK/8 used, up to
+ * the element count given at creation. So that count is a ceiling sized for
+ * the largest deployment, memory is only taken as the elements are used.
+ *
+ * Crossing the watermark only flags the slab, the chunk is added by
+ * pal_slab_grow_pending() off the data path. An alloc finding no chunk with
+ * enough elements before that adds a chunk of that many, unless it runs on a
+ * receiver or a worker: it then fails, and asks for that chunk.
+ */
+#define PAL_SLAB_MAX_CHUNKS		16
+#define PAL_SLAB_FIRST_CHUNK_SIZE	(2 * 1024 * 1024)
+#define PAL_SLAB_FIRST_CHUNK_MIN	64
+#define PAL_SLAB_HIGH_WATERMARK		7
 
-/* just a simple wrap */
 struct pal_slab {
-	struct rte_mempool pool;
+	struct rte_mempool *chunk[PAL_SLAB_MAX_CHUNKS];
+	volatile unsigned n_chunk;
+	unsigned hint;			/* chunk the last element came from */
+	volatile int grow_wanted;	/* the last chunk crossed the watermark */
+	volatile unsigned grow_min;	/* elements an alloc found in no chunk */
+
+	unsigned elem_size;
+	unsigned capacity;		/* elements of all the chunks */
+	unsigned limit;			/* elem_cnt at creation */
+	int numa;
+	unsigned mp_flags;
+	struct pal_list_head list;	/* all the slabs, for the stats */
+	char name[RTE_MEMPOOL_NAMESIZE];
+
+	/* stats */
+	uint64_t alloc_fail;
+	uint64_t grow_fail;
+};
+
+struct pal_slab_stats {
+	unsigned chunks;
+	unsigned capacity;
+	unsigned limit;
+	unsigned in_use;
+	unsigned elem_size;
+	uint64_t bytes;			/* hugepage memory of the chunks */
+	uint64_t alloc_fail;
+	uint64_t grow_fail;
 };
 
 /*
  * @brief Create a new slab which can be used to alloc specified size of elements
  * @param name Name of this slab, used mainly for debug. Must be unique
- * @param elem_cnt Number of elements this slab can alloc. Cannot be modified.
+ * @param elem_cnt Maximum number of elements this slab can alloc
  * @param elem_size Size of one element
  * @param numa Numa id on which this slab is created
  * @param flags Only one flag currently:
@@ -21,11 +68,14 @@ struct pal_slab {
  *               flag is to optimize hugepage TLP hit rate.
  * @return The newly created slab, or NULL on failure
  * @note  1. Slabs cannot be destroyed
- *        2. All memory is alloced at slab creation and cannot be freed.
- *           So estimate your memory requirements carefully
- *        3. This function is not thread safe
+ *        2. Memory is taken from hugepages by chunks as the slab grows and
+ *           is never given back, freed elements are reused by the slab
+ *        3. Slabs of different names may be created by several threads at
+ *           once, the dpdk serializes the memory zone reservations
+ *        4. Only one thread may alloc and one may free at a time, use
+ *           pal_slab_create_multipc() for slabs shared by more threads
  */
-static inline struct pal_slab *pal_slab_create(const char* name,                
+static inline struct pal_slab *pal_slab_create(const char* name,
              unsigned elem_cnt, unsigned elem_size, int numa, unsigned flags);
 
 /*
@@ -38,7 +88,7 @@ static inline struct pal_slab *pal_slab_create(const char* name,
  *       are available, then none is alloced. If you need an "as more as possible"
  *       behavior, please contact the maintainer.
  */
-static inline int pal_slab_alloc_bulk(struct pal_slab *slab, 
+static inline int pal_slab_alloc_bulk(struct pal_slab *slab,
                                   void **obj_table, unsigned n);
 
 /*
@@ -54,53 +104,69 @@ static inline void *pal_slab_alloc(struct pal_slab *slab);
  */
 static inline void pal_slab_free(void *obj);
 
+/*
+ * @brief Create a slab, see pal_slab_create()
+ * @param mp_flags Flags of the mempools of the chunks
+ */
+extern struct pal_slab *__pal_slab_create(const char *name, unsigned elem_cnt,
+               unsigned elem_size, int numa, unsigned mp_flags);
+
+/*
+ * @brief Slow path of pal_slab_alloc_bulk(), look for n elements in all the
+ *        chunks and add one if none has them. A receiver or a worker asks
+ *        pal_slab_grow_pending() for it instead
+ * @return Index of the chunk the elements came from, or -1 on failure
+ */
+extern int __pal_slab_alloc_bulk(struct pal_slab *slab, void **obj_table, unsigned n);
+
+/*
+ * @brief Add chunks to the slabs whose last chunk crossed the watermark or
+ *        which failed an alloc. Not to be called on a data path thread, it
+ *        reserves memory zones. A call made while another one runs returns
+ */
+extern void pal_slab_grow_pending(void);
+
+/*
+ * @brief Get the usage of a slab
+ */
+extern void pal_slab_get_stats(struct pal_slab *slab, struct pal_slab_stats *stats);
+
+/*
+ * @brief Call fn on each slab, in the order they were created
+ * @note Slabs cannot be created from fn
+ */
+extern void pal_slab_walk(void (*fn)(struct pal_slab *slab, void *arg), void *arg);
+
 
-/* TODO: use simple list and PAL_SLAB_SHARED to optimize this function */
 /*
  * @brief Create a slab from which you can alloc memory chunks
  * @param name Name of this slab, musb be unique
- * @param elem_cnt Number of elements in this slab. This number is fixed after
- *        creation, the slab cannot expand and shrink dynamically.
+ * @param elem_cnt Maximum number of elements in this slab
  * @param elem_size Size of one element.
  * @param numa
  * @param flags Currently not used. You should set it to 0.
  */
-static inline struct pal_slab *pal_slab_create(const char* name, 
+static inline struct pal_slab *pal_slab_create(const char* name,
                unsigned elem_cnt, unsigned elem_size, int numa,
                __unused unsigned flags)
 {
-	struct rte_mempool *mempool;
-
-	mempool = rte_mempool_create(name, 
-	                   elem_cnt, elem_size + sizeof(struct pal_slab *), 
-	                   0, 0, NULL, NULL, NULL, NULL, 
-	                   numa, MEMPOOL_F_SP_PUT | MEMPOOL_F_SC_GET);
-
-	return (struct pal_slab *)mempool;
+	return __pal_slab_create(name, elem_cnt, elem_size, numa,
+	                         MEMPOOL_F_SP_PUT | MEMPOOL_F_SC_GET);
 }
 
-/* TODO: use simple list and PAL_SLAB_SHARED to optimize this function */
 /*
- * @brief Create a slab from which you can alloc memory chunks
+ * @brief Create a slab from which several threads may alloc and free
  * @param name Name of this slab, musb be unique
- * @param elem_cnt Number of elements in this slab. This number is fixed after
- *        creation, the slab cannot expand and shrink dynamically.
+ * @param elem_cnt Maximum number of elements in this slab
  * @param elem_size Size of one element.
  * @param numa
  * @param flags Currently not used. You should set it to 0.
  */
-static inline struct pal_slab *pal_slab_create_multipc(const char* name, 
+static inline struct pal_slab *pal_slab_create_multipc(const char* name,
                unsigned elem_cnt, unsigned elem_size, int numa,
                __unused unsigned flags)
 {
-	struct rte_mempool *mempool;
-
-	mempool = rte_mempool_create(name, 
-	                   elem_cnt, elem_size + sizeof(struct pal_slab *), 
-	                   0, 0, NULL, NULL, NULL, NULL, 
-	                   numa, 0);
-
-	return (struct pal_slab *)mempool;
+	return __pal_slab_create(name, elem_cnt, elem_size, numa, 0);
 }
 
 /*
@@ -111,18 +177,34 @@ static inline struct pal_slab *pal_slab_create_multipc(const char* name,
  * @param n Number of elements to alloc
  * @return 0 on success, -1 on failure
  */
-static inline int pal_slab_alloc_bulk(struct pal_slab *slab, 
+static inline int pal_slab_alloc_bulk(struct pal_slab *slab,
                                   void **obj_table, unsigned n)
 {
-	unsigned i;
+	struct rte_mempool *mp;
+	unsigned i, c, n_chunk;
+	int ret;
+
+	n_chunk = slab->n_chunk;
+	c = slab->hint;
+	if (unlikely(c >= n_chunk ||
+	             rte_mempool_get_bulk(slab->chunk[c], obj_table, n) != 0)) {
+		ret = __pal_slab_alloc_bulk(slab, obj_table, n);
+		if (ret < 0)
+			return -1;
+		c = ret;
+		n_chunk = slab->n_chunk;
+	}
+	mp = slab->chunk[c];
 
-	if(rte_mempool_get_bulk(&slab->pool, obj_table, n) != 0)
-		return -1;
+	/* let the last chunk fill up only while the next one is added */
+	if (c == n_chunk - 1 && !slab->grow_wanted && slab->capacity < slab->limit &&
+	    rte_mempool_count(mp) < (mp->size >> 3) * (8 - PAL_SLAB_HIGH_WATERMARK))
+		slab->grow_wanted = 1;
 
 	for(i = 0; i < n; i++) {
-		/* store pointer to the slab before the memory */
+		/* store pointer to the chunk before the memory */
 		/* @TODO performance maybe decrease? because NOT align to cache line  */
-		*((unsigned long *)(obj_table[i])) = (unsigned long)slab;
+		*((unsigned long *)(obj_table[i])) = (unsigned long)mp;
 		obj_table[i] = (void *)((unsigned long *)obj_table[i] + 1);
 
 	}
@@ -142,12 +224,12 @@ static inline void *pal_slab_alloc(struct pal_slab *slab)
 
 static inline void pal_slab_free(void *obj)
 {
-	struct pal_slab *slab;
+	struct rte_mempool *mp;
 
-	/* retrieve the pointer to the slab from the head room of the object */
+	/* retrieve the pointer to the chunk from the head room of the object */
 	obj = (unsigned long *)obj - 1;
-	slab = (struct pal_slab *) *(unsigned long *)obj;
-	rte_mempool_put_bulk(&slab->pool, &obj, 1);
+	mp = (struct rte_mempool *) *(unsigned long *)obj;
+	rte_mempool_put_bulk(mp, &obj, 1);
 }
 
 #endif
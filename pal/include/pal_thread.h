@@ -62,6 +62,12 @@ struct pal_cpu_stats {
 
 extern void pal_get_cpu_usage(struct pal_cpu_stats *cpu_stats);
 
+/*
+ * @brief Make the receivers and workers send the packets they hold and
+ *        stop polling, before the ports are stopped
+ */
+extern void pal_stop_data_threads(void);
+
 /*
  * @breif Get id of this thread
  */
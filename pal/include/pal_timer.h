@@ -100,5 +100,13 @@ static inline void add_timer(struct timer_list *timer)
  */
 extern int del_timer(struct timer_list * timer);
 
+/**
+ * @brief Test whether a timer is pending
+ * @return 1 if the timer is armed and has not run yet, 0 otherwise
+ */
+static inline int timer_pending(const struct timer_list *timer)
+{
+	return timer->base_vec != NULL;
+}
 
 #endif
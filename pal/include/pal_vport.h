@@ -12,6 +12,7 @@
 #include "pal_skb.h"
 #include "pal_spinlock.h"
 #include "pal_utils.h"
+#include "pal_pcpu.h"
 
 #define MAX_CORE_NUM PAL_MAX_CPU
 
@@ -22,16 +23,18 @@ typedef enum {
   	PHY_VPORT,  
 }vp_type;
 
+/* per core, see pal_pcpu.h */
 struct vport_stats {
-	unsigned long	rx_packets;
-	unsigned long	tx_packets;
-	unsigned long	rx_bytes;
-	unsigned long	tx_bytes;
-	unsigned long	rx_errors;
-	unsigned long	tx_errors;
-	unsigned long	rx_dropped;
-	unsigned long	tx_dropped;
-};
+	struct pal_pcpu_head head;
+	uint64_t	rx_packets;
+	uint64_t	tx_packets;
+	uint64_t	rx_bytes;
+	uint64_t	tx_bytes;
+	uint64_t	rx_errors;
+	uint64_t	tx_errors;
+	uint64_t	rx_dropped;
+	uint64_t	tx_dropped;
+} __rte_cache_aligned;
 
 #define VPORT_NAME_MAX   64
 #define VPORT_UUID_LENGTH   64
@@ -63,10 +66,15 @@ struct vport_device_ops {
 #define VPORT_HASH_SIZE	(1 << VPORT_HASH_BITS)
 #define VPORT_HASH_MASK (VPORT_HASH_SIZE - 1)
 
+/*
+* Vports are hashed by name. Adding or deleting a vport holds the lock of
+* the bucket of its name, so control threads working on vports of
+* different names run in parallel.
+*/
 struct vport_net {
-	unsigned int	  addrcnt;
+	unsigned int	  addrcnt;	/* atomic, buckets are locked apart */
 	
-	pal_spinlock_t	  hash_lock;
+	pal_spinlock_t	  hash_lock[VPORT_HASH_SIZE];
 	struct pal_hlist_head vport_list[VPORT_HASH_SIZE];
 };
 
@@ -77,6 +85,11 @@ static inline struct pal_hlist_head *vport_head(struct vport_net *vpnet,char *vp
 	return &vpnet->vport_list[key];
 }
 
+static inline pal_spinlock_t *vport_lock(struct vport_net *vpnet,char *vport_name)
+{
+	return &vpnet->hash_lock[pal_hash_str(vport_name) & VPORT_HASH_MASK];
+}
+
 extern void delete_vport_from_list(struct pal_list_head *head);
 extern int add_route_to_nd(struct vport *dev,void *nd);
 extern int delete_route_from_nd(struct vport *dev,void *nd);
@@ -160,6 +173,7 @@ static inline void add_vport_to_nd(struct vport *dev,void *nd)
 	dev->private = nd;
 	pal_list_add(&dev->list_nd,&net->dev_base_head);
 	net_if_hold(net);
+	net_flow_invalidate(net);
 }	
 
 static inline void delete_vport_from_nd(struct vport *dev,void *nd)
@@ -169,6 +183,7 @@ static inline void delete_vport_from_nd(struct vport *dev,void *nd)
 	dev->private = NULL;
 	pal_list_del(&dev->list_nd);
 	net_if_put(net);
+	net_flow_invalidate(net);
 }
 
 static inline struct pal_list_head *get_nd_vport_head(void *nd)
@@ -12,6 +12,10 @@
 #include "pal_utils.h"
 #include "pal_byteorder.h"
 #include "pal_atomic.h"
+#include "pal_timer.h"
+#include "pal_jiffies.h"
+#include "pal_cuckoo.h"
+#include "pal_qsbr.h"
 
 extern struct vxlan_dev_net vxlan_dev_nets;
 
@@ -37,6 +41,15 @@ extern struct vxlan_dev_net vxlan_dev_nets;
 #define VXLAN_F_L2MISS	0x08
 #define VXLAN_F_L3MISS	0x10
 
+/* fdb entry state */
+#define VXLAN_FDB_STATIC	0	/* added by controller, never aged */
+#define VXLAN_FDB_LEARNED	1	/* learned from data plane, aged out */
+
+/* default ageing time of learned fdb entries, in seconds */
+#define VXLAN_FDB_AGEING_DEFAULT	300
+#define VXLAN_FDB_AGEING_MAX		(24 * 3600)
+/* how often the ageing timer sweeps the fdb table */
+#define VXLAN_FDB_AGE_INTERVAL		(10 * HZ)
 
 #define VXLAN_N_VID	(1u << 24)
 #define VXLAN_VID_MASK	(VXLAN_N_VID - 1)
@@ -49,20 +62,15 @@ extern struct vxlan_dev_net vxlan_dev_nets;
 #define VNI_HASH_SIZE	(1<<VNI_HASH_BITS)
 #define VNI_HASH_MASK   (VNI_HASH_SIZE-1)
 
-#define FDB_HASH_BITS	12
-#define FDB_HASH_SIZE	(1<<FDB_HASH_BITS)
-#define FDB_HASH_MASK   (FDB_HASH_SIZE-1)
-
 #define INT_VPORT_HASH_BITS	4
 #define INT_VPORT_HASH_SIZE	(1<<INT_VPORT_HASH_BITS)
 #define INT_VPORT_HASH_MASK   (INT_VPORT_HASH_SIZE-1)
 
-#define ARP_HASH_BITS 12
-#define ARP_HASH_SIZE (1ULL << ARP_HASH_BITS)
-#define ARP_HASH_MASK (ARP_HASH_SIZE - 1)
+/* max number of remote destinations of a fdb entry a packet is sent to */
+#define VXLAN_RDST_MAX	16
 
 struct vxlan_arp_entry {
-    struct pal_hlist_node hlist;
+    struct pal_list_head list;	/*on the arp list of its vxlan_dev*/
     __be32 ip;
     unsigned char mac_addr[6];
 };
@@ -83,28 +91,21 @@ struct vxlan_rdst {
 
 /* Forwarding table entry */
 struct vxlan_fdb {
-	struct pal_hlist_node hlist;	/* linked list of entries */
+	struct pal_list_head list;	/* on the fdb list of its vxlan_dev */
 	struct vxlan_rdst remote;
+	uint64_t	  used;		/* jiffies when last seen as source, learned only */
 	uint8_t		  eth_addr[6];
+	uint8_t		  state;	/* VXLAN_FDB_STATIC or VXLAN_FDB_LEARNED */
+	struct pal_qsbr_head qsbr;	/* deferred free, with its destinations */
 };
 
 #define VXLAN_VPORT_NAME_MAX  64
 
-struct arp_head_lock
-{
-	pal_rwlock_t		  	hash_lock;
-	struct pal_hlist_head   head;
-};
-
-struct fdb_head_lock
-{
-	pal_rwlock_t		  	hash_lock;
-	struct pal_hlist_head   head;
-};
-
 /*
 * A vxlan_dev has a unique vni id and multiple int_vport,
-* and has it's own fdb table and arp table.
+* and has it's own fdb entries and arp entries. The entries of all
+* vxlan_devs are looked up in two global cuckoo tables keyed by vni,
+* the lists below are only used to walk the entries of one vxlan_dev.
 */
 struct vxlan_dev {
 	struct pal_hlist_node hlist;  /*hash on vxlan_dev table*/
@@ -117,35 +118,51 @@ struct vxlan_dev {
 	
 	atomic_t count;	
 	
-	unsigned int	 fdb_cnt;	
+	/* learned entries are inserted by receivers, so this must be atomic */
+	atomic_t		 fdb_cnt;	
 	unsigned int	 arp_cnt;
 	unsigned int	 vport_cnt;		
 	unsigned int	 vport_cnt_max;	
+
+	/* ageing of learned fdb entries, runs on a control thread's timer */
+	uint64_t		 ageing_time;	/* in jiffies */
+	struct timer_list ageing_timer;
 	
 	/* When delete int_vport element, you must first hold vxlan_dev lock,  then hold bvrouter lock*/
 	struct pal_hlist_head int_vport_head[INT_VPORT_HASH_SIZE];	
 
-	/* When delete fdb element,you need get it's own hash lock*/	
-	/* When delete arp element,you need get it's own hash lock*/	
-	struct arp_head_lock arp_array[ARP_HASH_SIZE];
-	struct fdb_head_lock fdb_array[FDB_HASH_SIZE];
+	/* fdb entries are added and deleted under vxlan_fdb_lock */
+	struct pal_list_head fdb_list;
+	/* arp entries are added and deleted under vxlan_arp_lock */
+	struct pal_list_head arp_list;
+
+	struct pal_qsbr_head qsbr;	/* deferred free */
 };
 
 #define	vxlan_dev_get(x)		atomic_inc(&(x)->count)
 #define vxlan_dev_release(x)	atomic_dec(&(x)->count)
 
+/*
+* Receivers walk the vxlan_dev and int_vport lists lock free, see pal_qsbr.h.
+* The lock serializes the control plane, deleted entries are freed after
+* a grace period.
+*/
 struct vxlan_dev_head_lock{
 	pal_rwlock_t		  	hash_lock;
 	struct pal_hlist_head   head;
 };
 
 struct vxlan_dev_net{
-	unsigned int	 addrcnt;
+	unsigned int	 addrcnt;	/* atomic, buckets are locked apart */
 	unsigned int	 addrmax;
 	
 	struct vxlan_dev_head_lock vxlan_dev_array[VNI_HASH_SIZE];
 };
 
+/* valid range of the tcp mss clamp of an int vport */
+#define INT_VPORT_MSS_MIN	536
+#define INT_VPORT_MSS_MAX	(PAL_MAX_MTU - 40)
+
 /*
 * Internal vport which is connected to bvrouter, the role of this vport is similar with phy_vport.
 */
@@ -155,9 +172,11 @@ struct int_vport{
 	struct vxlan_dev *vdev;
 
 	__be16		  	src_port;
+	uint16_t		mss_clamp;	/*tcp mss clamp, 0 to follow the namespace*/
 	uint32_t vni_hash_index;  
 	
-	struct vport_stats	stats[MAX_CORE_NUM];	
+	struct vport_stats	*stats;		/* indexed by lcore id */	
+	struct pal_qsbr_head	qsbr;		/* deferred free */
 };
 
 static inline uint32_t get_hash_index_vni(uint32_t vni)
@@ -170,72 +189,59 @@ static inline uint32_t get_hash_index_mac_int_vport(uint8_t *mac)
 	return (pal_hash_crc((void *)mac,6) & INT_VPORT_HASH_MASK);
 }
 
-static inline uint32_t get_hash_index_mac(uint8_t *mac)
-{
-	return (pal_hash_crc((void *)mac,6) & FDB_HASH_MASK);
-}
-
-static inline uint32_t get_hash_index_arp(uint32_t ip)
-{
-	return (pal_hash32(ip) & ARP_HASH_MASK);
-}
-
-static inline struct pal_hlist_head *vxlan_fdb_head(struct vxlan_dev *vdev,
-						uint8_t *mac)
-{	
-	return &vdev->fdb_array[pal_hash_crc((void *)mac,6) & FDB_HASH_MASK].head;
-}
-
-static inline struct pal_hlist_head *vxlan_fdb_head_index(struct vxlan_dev *vdev,
-						uint32_t index)
-{
-	return &vdev->fdb_array[index].head;
-}
+/*
+* Serializes the writers of the fdb table: the control thread and the
+* receivers learning source macs. Lookups take no lock.
+*/
+extern pal_spinlock_t vxlan_fdb_lock;
 
-static inline struct pal_hlist_head *vxlan_arp_head_index(struct vxlan_dev *vdev,
-						uint32_t index)
+static inline void lock_vxlan_fdb(void)
 {
-	return &vdev->arp_array[index].head;
+	pal_spinlock_lock(&vxlan_fdb_lock);
 }
 
-static inline void read_lock_vxlan_arp(struct vxlan_dev *vdev,uint32_t index)
+static inline void unlock_vxlan_fdb(void)
 {
-	pal_rwlock_read_lock(&vdev->arp_array[index].hash_lock); 
+	pal_spinlock_unlock(&vxlan_fdb_lock);
 }
 
-static inline void read_unlock_vxlan_arp(struct vxlan_dev *vdev,uint32_t index)
+/*used by the data plane, which must never wait for the control plane*/
+static inline int trylock_vxlan_fdb(void)
 {
-	pal_rwlock_read_unlock(&vdev->arp_array[index].hash_lock); 
+	return pal_spinlock_trylock(&vxlan_fdb_lock);
 }
 
-static inline void write_lock_vxlan_arp(struct vxlan_dev *vdev,uint32_t index)
-{
-	pal_rwlock_write_lock(&vdev->arp_array[index].hash_lock); 
-}
+/*
+* Serializes the control threads writing the arp table, which is shared by
+* the vxlan_devs of all vnis. Lookups take no lock.
+*/
+extern pal_spinlock_t vxlan_arp_lock;
 
-static inline void write_unlock_vxlan_arp(struct vxlan_dev *vdev,uint32_t index)
+static inline void lock_vxlan_arp(void)
 {
-	pal_rwlock_write_unlock(&vdev->arp_array[index].hash_lock); 
+	pal_spinlock_lock(&vxlan_arp_lock);
 }
 
-static inline void read_lock_vxlan_fdb(struct vxlan_dev *vdev,uint32_t index)
+static inline void unlock_vxlan_arp(void)
 {
-	pal_rwlock_read_lock(&vdev->fdb_array[index].hash_lock); 
+	pal_spinlock_unlock(&vxlan_arp_lock);
 }
 
-static inline void read_unlock_vxlan_fdb(struct vxlan_dev *vdev,uint32_t index)
-{
-	pal_rwlock_read_unlock(&vdev->fdb_array[index].hash_lock); 
-}
+/*
+* Ageing timers move to the timer base of the control thread arming them,
+* so the control threads run their timers and arm or stop ageing timers
+* under this lock. It is taken before the fdb lock.
+*/
+extern pal_spinlock_t vxlan_timer_lock;
 
-static inline void write_lock_vxlan_fdb(struct vxlan_dev *vdev,uint32_t index)
+static inline void lock_vxlan_timer(void)
 {
-	pal_rwlock_write_lock(&vdev->fdb_array[index].hash_lock); 
+	pal_spinlock_lock(&vxlan_timer_lock);
 }
 
-static inline void write_unlock_vxlan_fdb(struct vxlan_dev *vdev,uint32_t index)
+static inline void unlock_vxlan_timer(void)
 {
-	pal_rwlock_write_unlock(&vdev->fdb_array[index].hash_lock); 
+	pal_spinlock_unlock(&vxlan_timer_lock);
 }
 
 static inline struct pal_hlist_head *vxlan_dev_head(struct vxlan_dev_net *vxlan,uint32_t vni)
@@ -270,15 +276,15 @@ static inline void write_unlock_vxlan_dev(uint32_t index)
 
 static inline void add_vxlan_dev_to_vxlan_net(struct vxlan_dev_net *vxlan, struct vxlan_dev *vdev)
 {
-	++vxlan->addrcnt;	
+	__sync_add_and_fetch(&vxlan->addrcnt, 1);
 	/*add to vxlan_dev net*/
-	pal_hlist_add_head(&(vdev->hlist),
+	pal_hlist_add_head_rcu(&(vdev->hlist),
 				   vxlan_dev_head(vxlan, vdev->vni));
 }
 
 static inline void add_int_vport_to_vport_net(struct vport_net *vpnet, struct int_vport *vp)
 {
-	++vpnet->addrcnt;
+	__sync_add_and_fetch(&vpnet->addrcnt, 1);
 	/*add to vport net*/
 	pal_hlist_add_head(&(vp->vp.hlist),
 				  vport_head(vpnet, vp->vp.vport_name));
@@ -288,13 +294,13 @@ static inline void add_int_vport_to_vxlan_dev(struct vxlan_dev *vdev, struct int
 {
 	++vdev->vport_cnt;
 	/*add to vxlan_dev*/	
-	pal_hlist_add_head(&(vp->hlist),
+	pal_hlist_add_head_rcu(&(vp->hlist),
 		&vdev->int_vport_head[get_hash_index_mac_int_vport(vp->vp.vport_eth_addr)]);
 }
 
 static inline void remove_vxlan_dev_from_vxlan_net(struct vxlan_dev_net *vxlan, struct vxlan_dev *vdev)
 {
-	--vxlan->addrcnt;
+	__sync_sub_and_fetch(&vxlan->addrcnt, 1);
 	/*delete from vxlan_dev net*/
 	pal_hlist_del(&(vdev->hlist));		
 
@@ -302,7 +308,7 @@ static inline void remove_vxlan_dev_from_vxlan_net(struct vxlan_dev_net *vxlan,
 
 static inline void remove_int_vport_from_vport_net(struct vport_net *vpnet, struct int_vport *vp)
 {
-	--vpnet->addrcnt;
+	__sync_sub_and_fetch(&vpnet->addrcnt, 1);
 	/*delete from vport net*/
 	pal_hlist_del(&(vp->vp.hlist));		
 }
@@ -314,7 +320,7 @@ static inline void remove_int_vport_from_vxlan_dev(struct vxlan_dev *vdev, struc
 	pal_hlist_del(&(vp->hlist));		
 }
 
-extern struct vxlan_dev *find_lock_vxlan_dev(uint32_t vni,uint32_t index);
+extern struct vxlan_dev *find_vxlan_dev(uint32_t vni,uint32_t index);
 extern struct int_vport *__find_int_vport_nolock(struct vxlan_dev *vdev,uint8_t *mac);
 extern int int_vport_delete(struct vport_net *vpnet,struct int_vport *vp);
 extern int int_vport_add(char *vport_name,char *uuid,
@@ -329,6 +335,11 @@ extern int vxlan_fdb_add( struct vxlan_dev *vport,
 extern int vxlan_fdb_delete(struct vxlan_dev *vport,
 			     unsigned char *mac);
 extern int vxlan_fdb_flush(struct vxlan_dev *vdev);
+extern void vxlan_fdb_snoop(struct vxlan_dev *vdev,
+			 uint8_t *src_mac, __be32 src_ip);
+extern int vxlan_fdb_learning_set(struct vxlan_dev *vdev,
+			 int enable, uint32_t ageing);
+extern void vxlan_fdb_cleanup(unsigned long data);
 extern int vxlan_arp_flush(struct vxlan_dev *vdev);
 extern int del_vxlan_arp_entry(struct vxlan_dev *vdev, __be32 ip);
 extern int add_vxlan_arp_entry(struct vxlan_dev *vdev, struct vxlan_arp_entry *entry);
@@ -79,7 +79,8 @@ static int icmp_handler(struct sk_buff *skb)
 				icmph->type = ICMP_ECHOREPLY;
 
 				/* update icmp check sum*/
-				icmph->checksum = icmph->checksum + pal_htons_constant(0x0800);
+				pal_csum_replace2(&icmph->checksum, pal_htons_constant(ICMP_ECHO << 8),
+						  pal_htons_constant(ICMP_ECHOREPLY << 8));
 
 				/* Exchange ip addresses */
 				tmp_addr = iph->saddr;
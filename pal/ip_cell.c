@@ -16,87 +16,86 @@ static struct pal_slab *ip_cell_slab = NULL;
 */
 struct ip_cell_pool ip_pool;
 
-/* Look up ip cell in ip_pool */
+/* Look up ip cell in ip_pool, for writers holding ip_pool.lock */
 static struct ip_cell *__find_ip_cell_nolock(__be32 ip)
 {
-	struct ip_cell *ipcell;
-	struct pal_hlist_node *hnode;
-
-	pal_hlist_for_each_entry(ipcell,hnode,ip_cell_head(&ip_pool,ip), hlist) {
-		if (ipcell->ip == ip)
-			return ipcell;
-	}
-
-	return NULL;
-}
-
-static struct ip_cell * __bvrouter __find_ip_cell_nolock_index(__be32 ip,uint32_t index)
-{
-	struct ip_cell *ipcell;
-	struct pal_hlist_node *hnode;
-
-	pal_hlist_for_each_entry(ipcell,hnode,ip_cell_head_index(&ip_pool,index), hlist) {
-		if (ipcell->ip == ip)
-			return ipcell;
-	}
-
-	return NULL;
+	return pal_cuckoo_lookup(ip_pool.table, &ip);
 }
 
 int find_ip_cell_info(__be32 ip,struct ip_cell_info *info)
 {
-	uint32_t index;
 	struct ip_cell *ipcell;
-
-	index = get_hash_index_ip(ip);
-	read_lock_ip_cell(index);
-	ipcell = __find_ip_cell_nolock_index(ip,index);
-	if(!ipcell){
-		read_unlock_ip_cell(index);
-		return -1;
-	}else{
+	struct phy_vport *vp;
+	uint32_t seq;
+
+	/*lock free, copy what we need and retry if the cell changed meanwhile*/
+	do {
+		seq = pal_cuckoo_read_begin(ip_pool.table);
+		ipcell = pal_cuckoo_lookup(ip_pool.table, &ip);
+		if (!ipcell)
+			continue;
 		info->ip = ipcell->ip;
 		info->type = ipcell->type;
-		if(ipcell->vp){
-			mac_copy(info->eth_addr,ipcell->vp->vp.vport_eth_addr);
+		vp = ipcell->vp;
+		if(vp){
+			mac_copy(info->eth_addr,vp->vp.vport_eth_addr);
 		}else if(info->type == LOCAL_IP){
 			mac_copy(info->eth_addr,get_vtep_mac());
 		}
-	 }
-	read_unlock_ip_cell(index);
+	} while (pal_cuckoo_read_retry(ip_pool.table, seq));
 
-	return 0;
+	return ipcell ? 0 : -1;
 }
 
-struct phy_vport * __bvrouter find_get_phy_vport(__be32 ip)
+struct phy_vport * __bvrouter find_phy_vport(__be32 ip)
 {
-	 uint32_t index;
 	 struct ip_cell *ipcell;
 	 struct phy_vport *vport;
-	 int lcore_id = rte_lcore_id();
-
-	 index = get_hash_index_ip(ip);
-
-	 read_lock_ip_cell(index);
-	 ipcell = __find_ip_cell_nolock_index(ip,index);
-	 if(unlikely(!ipcell)){
-		read_unlock_ip_cell(index);
+	 uint32_t seq;
+
+	 /*
+	  * phy_vport_delete removes the ip cells of a vport and waits for a
+	  * grace period before freeing it, no reference is needed
+	  */
+	 do {
+		seq = pal_cuckoo_read_begin(ip_pool.table);
+		ipcell = pal_cuckoo_lookup(ip_pool.table, &ip);
+		vport = ipcell ? ipcell->vp : NULL;
+	 } while (unlikely(pal_cuckoo_read_retry(ip_pool.table, seq)));
+
+	 if (unlikely(!vport || !(vport->port_state & PHY_VPORT_USEING)))
 		return NULL;
-	 }else{
-	 	vport = ipcell->vp;
-	 	if(likely((long)vport)){
-			if(unlikely(!(vport->port_state & PHY_VPORT_USEING))){
-				read_unlock_ip_cell(index);
-				return NULL;
-			}
-			vport->use_count[lcore_id]++;
-	 	}
-	 }
-	 read_unlock_ip_cell(index);
 
 	 return vport;
 }
 
+void __bvrouter ip_cell_prefetch_bulk(const __be32 *ips, unsigned n)
+{
+	const void *keys[PAL_CUCKOO_BULK_MAX];
+	void *cells[PAL_CUCKOO_BULK_MAX];
+	struct ip_cell *ipcell;
+	uint64_t hits;
+	unsigned i;
+
+	if (n > PAL_CUCKOO_BULK_MAX)
+		n = PAL_CUCKOO_BULK_MAX;
+	for (i = 0; i < n; i++)
+		keys[i] = &ips[i];
+
+	/*
+	 * only a hint: a cell deleted meanwhile is freed after a grace period,
+	 * so reading it is safe, and find_phy_vport() looks it up again
+	 */
+	hits = pal_cuckoo_lookup_bulk(ip_pool.table, keys, n, cells);
+	while (hits) {
+		i = __builtin_ctzll(hits);
+		hits &= hits - 1;
+		ipcell = cells[i];
+		if (ipcell->vp)
+			rte_prefetch0(ipcell->vp);
+	}
+}
+
 static void __ip_cell_destroy(struct ip_cell_pool *ippool, struct ip_cell *ipcell);
 
 
@@ -123,6 +122,9 @@ static int __ip_cell_create(struct ip_cell_pool *ippool,
     if (ippool->addrmax && ippool->addrcnt >= ippool->addrmax) {
         return -ENOSPC;
     }
+    if (type == FLOATING_IP && !vport) {
+        return -EFAULT;
+    }
 
     PAL_DEBUG("add ip cell %pI4\n",&ip);
     ipcell = pal_slab_alloc(ip_cell_slab);
@@ -136,9 +138,6 @@ static int __ip_cell_create(struct ip_cell_pool *ippool,
 
     switch(type) {
         case FLOATING_IP:
-            if(!vport) {
-                goto error;
-            }
             add_floating_ip_to_phy_vport(vport,ipcell);
             phy_vport_get(vport);
             break;
@@ -155,11 +154,24 @@ static int __ip_cell_create(struct ip_cell_pool *ippool,
             break;
     }
 
-    add_ip_cell_to_ippool(ippool,ipcell);
+    if (add_ip_cell_to_ippool(ippool,ipcell)) {
+        goto error;
+    }
     return 0;
 error:
+    switch(type) {
+        case FLOATING_IP:
+            remove_floating_ip_from_phy_vport(vport,ipcell);
+            phy_vport_release(vport);
+            break;
+        case EXT_GW_IP:
+            phy_vport_release(vport);
+            break;
+        default :
+            break;
+    }
     pal_slab_free(ipcell);
-    return -EFAULT;
+    return -ENOSPC;
 }
 
 /* Add static entry  */
@@ -167,21 +179,25 @@ int ip_cell_add(__be32 ip, ip_cell_type type,
 				 struct phy_vport *vport)
 {
 	 int err;
-	 uint32_t index;
 	 struct ip_cell_pool *ippool = &ip_pool;
 
-	 index = get_hash_index_ip(ip);
-	 write_lock_ip_cell(index);
+	 pal_spinlock_lock(&ippool->lock);
 	 err = __ip_cell_create(ippool,ip,type,vport);
-	 write_unlock_ip_cell(index);
+	 pal_spinlock_unlock(&ippool->lock);
 
 	 return err;
 }
 
+static void ip_cell_free_qsbr(struct pal_qsbr_head *head)
+{
+	 pal_slab_free(container_of(head, struct ip_cell, qsbr));
+}
+
+/*receivers may still read the cell, free it after a grace period*/
 static void ip_cell_free(struct ip_cell *ipcell)
 {
 	 if(ipcell) {
-		 pal_slab_free(ipcell);
+		 pal_qsbr_call(&ipcell->qsbr, ip_cell_free_qsbr);
 	 }
 }
 
@@ -209,22 +225,20 @@ static void __ip_cell_destroy(struct ip_cell_pool *ippool, struct ip_cell *ipcel
 int ip_cell_delete(__be32 ip,ip_cell_type type)
 {
 	 int err = -ENOENT;
-	 uint32_t index;
 	 struct ip_cell *ipcell;
 	 struct ip_cell_pool *ippool = &ip_pool;
 
-	 index = get_hash_index_ip(ip);
-	 write_lock_ip_cell(index);
+	 pal_spinlock_lock(&ippool->lock);
 	 ipcell = __find_ip_cell_nolock(ip);
 	 if (ipcell) {
 	 	if(ipcell->type != type){
-			write_unlock_ip_cell(index);
+			pal_spinlock_unlock(&ippool->lock);
 			 return -EIO;
 		}
 		 __ip_cell_destroy(ippool,ipcell);
 		 err = 0;
 	 }
-	 write_unlock_ip_cell(index);
+	 pal_spinlock_unlock(&ippool->lock);
 
 	 return err;
 }
@@ -236,25 +250,27 @@ void dump_ip_cell(struct ip_cell *ipcell)
 
 int ip_cell_pool_init(void)
 {
-	uint16_t h;
 	struct ip_cell_pool *ippool = &ip_pool;
 
 	ippool->addrcnt = 0;
 	ippool->addrmax = IP_CELL_NUM_MAX;
+	pal_spinlock_init(&ippool->lock);
 
-	for (h = 0; h < IP_HASH_SIZE; ++h){
-		pal_rwlock_init(&ippool->ip_cell_array[h].hash_lock);
-		PAL_INIT_HLIST_HEAD(&ippool->ip_cell_array[h].head);
-	}
 	return 0;
 }
 
 void ip_cell_slab_init(int numa_id)
 {
-    ip_cell_slab = pal_slab_create("ip_cell", IP_CELL_SLAB_SIZE,
+    ip_cell_slab = pal_slab_create_multipc("ip_cell", IP_CELL_SLAB_SIZE,
 		sizeof(struct ip_cell), numa_id, 0);
 
 	if (!ip_cell_slab) {
 		PAL_PANIC("create ip_cell slab failed\n");
 	}
+
+	ip_pool.table = pal_cuckoo_create("ip_cell", IP_CELL_NUM_MAX,
+		sizeof(__be32), numa_id);
+	if (!ip_pool.table) {
+		PAL_PANIC("create ip_cell table failed\n");
+	}
 }
@@ -5,17 +5,14 @@
 #include <rte_kni.h>
 #include <rte_ethdev.h>
 #include <rte_eth_bond.h>
+#include <rte_jhash.h>
 
 #include "pal_error.h"
 #include "vtep.h"
 #include "pal_netif.h"
-#include "pal_spinlock.h"
+#include "pal_thread.h"
 #include "pal_ip_frag_reassemble.h"
 
-static pal_rwlock_t	fragment_table_lock;
-
-static struct rte_ip_frag_tbl *frag_tbl = NULL;
-
 static uint32_t max_flow_num = DEF_FLOW_NUM;
 static uint32_t max_flow_ttl = DEF_FLOW_TTL;
 
@@ -41,7 +38,7 @@ int ip_fragment_send(struct sk_buff *skb)
 	len = rte_ipv4_fragment_packet(m,
 			&qconf->tx_mbuf.m_table[0],
 			(uint16_t)(MBUF_TABLE_SIZE),
-			IPV4_MTU_DEFAULT,
+			pal_port_mtu(port_out),
 			rxq->direct_pool, rxq->indirect_pool);
 
 	/* Free input packet */
@@ -73,6 +70,43 @@ int ip_fragment_send(struct sk_buff *skb)
 	return 0;	
 }
 
+/*
+*  All fragments of a datagram must be reassembled by the same receiver.
+*  Pick it among the receivers of our numa by hashing src/dst/id/proto.
+*/
+int ip_frag_owner(const struct ip_hdr *iph)
+{
+	const struct ip_reassemble_conf *qconf = &(pal_cur_thread_conf()->ip_reassemble_config);
+	uint32_t hash;
+
+	if (qconf->n_owner <= 1)
+		return pal_thread_id();
+
+	hash = rte_jhash_3words(iph->saddr, iph->daddr,
+				((uint32_t)iph->id << 16) | iph->protocol, 0);
+
+	return qconf->owner[hash % qconf->n_owner];
+}
+
+/*
+*  Queue a fragment to the receiver owning its datagram.
+*  Please Notes that the skb->data must be the pointer of iph_hdr.
+*/
+int ip_frag_redirect(struct sk_buff *skb, int tid)
+{
+	struct pal_reasm_stats *stats = &(pal_cur_thread_conf()->stats.reasm);
+	struct pal_fifo *q = pal_thread_conf(tid)->ip_reassemble_config.frag_q;
+
+	if (unlikely(pal_fifo_enqueue_mp(q, skb) != 0)) {
+		stats->redirect_err++;
+		pal_skb_free(skb);
+		return -1;
+	}
+
+	stats->redirect_pkts++;
+	return 0;
+}
+
 extern  struct rte_mbuf * ip_frag_reassemble_packet(struct sk_buff *skb,struct ip_hdr  *iph);
 
 /*
@@ -85,6 +119,9 @@ extern  struct rte_mbuf * ip_frag_reassemble_packet(struct sk_buff *skb,struct i
 	struct rte_mbuf *mo = NULL;
 	struct rte_ip_frag_death_row *dr = NULL;
 	struct ip_reassemble_conf *qconf = &(pal_cur_thread_conf()->ip_reassemble_config);
+	struct pal_reasm_stats *stats = &(pal_cur_thread_conf()->stats.reasm);
+	struct rte_ip_frag_tbl *tbl = qconf->frag_tbl;
+	uint32_t cnt;
 
 	m = &skb->mbuf;	
 	dr = &(qconf->death_row);
@@ -93,40 +130,86 @@ extern  struct rte_mbuf * ip_frag_reassemble_packet(struct sk_buff *skb,struct i
 	m->pkt.vlan_macip.f.l2_len = sizeof(struct eth_hdr);
 	m->pkt.vlan_macip.f.l3_len = sizeof(struct ip_hdr);
 
-	/* All update/lookup operations on Fragmen Table are not thread safe.
-	*  So, we need use lock to protect it.*/
-	pal_rwlock_write_lock(&fragment_table_lock);
-	mo = rte_ipv4_frag_reassemble_packet(frag_tbl, dr, m, rte_rdtsc(), 
+	/* The table is only used by its owner receiver, so no lock is needed */
+	cnt = dr->cnt;
+	mo = rte_ipv4_frag_reassemble_packet(tbl, dr, m, rte_rdtsc(), 
 				(struct ipv4_hdr *)iph);
-	pal_rwlock_write_unlock(&fragment_table_lock);
+	stats->frag_pkts++;
+
+	if (mo != NULL) {
+		stats->reasm_pkts++;
+	} else if (dr->cnt == cnt + 1 && dr->row[cnt] == m &&
+			tbl->use_entries >= tbl->max_entries) {
+		/* only this fragment is freed: no room for a new datagram */
+		stats->evict_pkts++;
+	} else {
+		/* timed out datagrams, or invalid ones */
+		stats->timeout_pkts += dr->cnt - cnt;
+	}
 	
 	return mo;
 }
 
+/*
+*  Get occupancy of the reassembly table of a receiver
+*/
+void ip_frag_table_usage(int tid, uint32_t *used, uint32_t *max)
+{
+	struct rte_ip_frag_tbl *tbl = pal_thread_conf(tid)->ip_reassemble_config.frag_tbl;
+
+	if (tbl == NULL) {
+		*used = 0;
+		*max = 0;
+		return;
+	}
+
+	*used = tbl->use_entries;
+	*max = tbl->max_entries;
+}
+
 /*create Fragmen Table*/
-static int setup_frg_tbl(int numa_id)
+static struct rte_ip_frag_tbl *setup_frg_tbl(int numa_id)
 {
+	struct rte_ip_frag_tbl *tbl;
 	uint64_t frag_cycles;
 	frag_cycles = (rte_get_tsc_hz() + MS_PER_S - 1) / MS_PER_S *
 		max_flow_ttl;
 
-	if ((frag_tbl = rte_ip_frag_table_create(max_flow_num,
+	if ((tbl = rte_ip_frag_table_create(max_flow_num,
 			IP_FRAG_TBL_BUCKET_ENTRIES, max_flow_num, frag_cycles,
 			numa_id)) == NULL) {
 		PAL_PANIC("ip_frag_tbl_create failed\n");
-		return -1;
+		return NULL;
 	}
 	
-	return 0;
+	return tbl;
 }
 
-extern void ip_frag_reassemble_init(int numa_id);
+extern void ip_frag_reassemble_init(int tid);
 /* 
-*  Init Fragmen Table and lock, etc.
+*  Init the Fragmen Table and the redirect queue of a receiver, and let
+*  it know the owners it steers fragments to.
 */
-void ip_frag_reassemble_init(int numa_id)
+void ip_frag_reassemble_init(int tid)
 {
-	pal_rwlock_init(&fragment_table_lock);
-
-	setup_frg_tbl(numa_id);
+	int owner, numa;
+	char name[PAL_FIFO_NAME_MAX];
+	struct ip_reassemble_conf *qconf;
+
+	numa = pal_tid_to_numa(tid);
+	qconf = &(pal_thread_conf(tid)->ip_reassemble_config);
+	qconf->frag_tbl = setup_frg_tbl(numa);
+
+	snprintf(name, sizeof(name), "fragq_%d@%d", tid, numa);
+	qconf->frag_q = pal_fifo_create_mpsc(name, IP_FRAG_REDIRECT_Q_SIZE, numa);
+	if (qconf->frag_q == NULL)
+		PAL_PANIC("create fragment queue of receiver %d failed\n", tid);
+
+	/* owners are the receivers on the same numa, in thread id order */
+	qconf->n_owner = 0;
+	PAL_FOR_EACH_RECEIVER(owner) {
+		if (pal_tid_to_numa(owner) != numa)
+			continue;
+		qconf->owner[qconf->n_owner++] = owner;
+	}
 }
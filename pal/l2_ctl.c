@@ -61,7 +61,7 @@ int vport_delete_ctl(char *vport_name)
 	if(strlen(vport_name) > VPORT_NAME_MAX)
 		return -ENXIO;
 	
-	pal_spinlock_lock(&vpnet->hash_lock);
+	pal_spinlock_lock(vport_lock(vpnet,vport_name));
 	vp= __find_vport_nolock(vport_name);
 	if (vp) {
 		if(vp->vport_type == VXLAN_VPORT){
@@ -78,13 +78,13 @@ int vport_delete_ctl(char *vport_name)
 			err = -ENXIO;
 			goto error;
 	}
-	pal_spinlock_unlock(&vpnet->hash_lock);	
+	pal_spinlock_unlock(vport_lock(vpnet,vport_name));	
 	
 	/*delete a default route entry*/
 	return 0;
 
 error:
-	pal_spinlock_unlock(&vpnet->hash_lock);
+	pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 	return err;
 }
 
@@ -99,15 +99,15 @@ int floating_ip_add_ctl(__be32 floating_ip,
 	if(strlen(vport_name) > VPORT_NAME_MAX)
 		return -ENXIO;
 	
-	pal_spinlock_lock(&vpnet->hash_lock);
+	pal_spinlock_lock(vport_lock(vpnet,vport_name));
 	vp= __find_vport_nolock(vport_name);
 	if(!vp||vp->vport_type!=PHY_VPORT){
-		pal_spinlock_unlock(&vpnet->hash_lock);
+		pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 		return -ESRCH;
 	}else{
 		err = ip_cell_add(floating_ip,FLOATING_IP,(struct phy_vport *)vp);
 	}
-	pal_spinlock_unlock(&vpnet->hash_lock);
+	pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 
 	return err;
 }
@@ -127,19 +127,41 @@ int floating_ip_show_ctl(char *vport_name)
 	if(strlen(vport_name) > VPORT_NAME_MAX)
 		return -ENXIO;
 	
-	pal_spinlock_lock(&vpnet->hash_lock);
+	pal_spinlock_lock(vport_lock(vpnet,vport_name));
 	vp= __find_vport_nolock(vport_name);
 	if(!vp||vp->vport_type!=PHY_VPORT){
-		pal_spinlock_unlock(&vpnet->hash_lock);
+		pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 		return -ESRCH;
 	}else{
 		show_floating_ip((struct phy_vport *)vp);
 	}
-	pal_spinlock_unlock(&vpnet->hash_lock);
+	pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 
 	return 0;
 }
 
+/*6.1 vni of an int vport*/
+int int_vport_vni_ctl(char *vport_name,uint32_t *vni)
+{
+	int err = 0;
+	struct vport_net *vpnet = &vport_nets;
+	struct vport *vp;
+
+	if(strlen(vport_name) > VPORT_NAME_MAX)
+		return -ENXIO;
+
+	pal_spinlock_lock(vport_lock(vpnet,vport_name));
+	vp = __find_vport_nolock(vport_name);
+	if(!vp || vp->vport_type != VXLAN_VPORT){
+		err = -ESRCH;
+	}else{
+		*vni = ((struct int_vport *)vp)->vdev->vni;
+	}
+	pal_spinlock_unlock(vport_lock(vpnet,vport_name));
+
+	return err;
+}
+
 static int _vxlan_fdb_add_ctl(uint32_t vni,
 					 uint8_t *mac, __be32 remote_ip,
 					__be16 remote_port)
@@ -147,7 +169,7 @@ static int _vxlan_fdb_add_ctl(uint32_t vni,
 	struct vxlan_dev *vdev;
 	int err;	
 	
-	vdev = __find_vxlan_dev_nolock(vni);	
+	vdev = get_vxlan_dev(vni);
 	if(!vdev){
 		return -ESRCH;
 	}else{
@@ -171,7 +193,7 @@ int vxlan_fdb_delete_ctl(uint32_t vni,uint8_t *mac)
 	struct vxlan_dev *vdev;
 	int err;	
 	
-	vdev = __find_vxlan_dev_nolock(vni);	
+	vdev = get_vxlan_dev(vni);
 	if(!vdev){
 		return -ESRCH;
 	}else{
@@ -186,7 +208,7 @@ int vxlan_fdb_show_ctl(uint32_t vni)
 {
 	struct vxlan_dev *vdev;
 	
-	vdev = __find_vxlan_dev_nolock(vni);	
+	vdev = get_vxlan_dev(vni);
 	if(!vdev){
 		return -ESRCH;
 	}else{
@@ -204,7 +226,7 @@ struct vxlan_dev * get_vxlan_dev(uint32_t vni)
 	
 	index = get_hash_index_vni(vni);	
 	read_lock_vxlan_dev(index);
-	vdev = __find_vxlan_dev_nolock(vni);	
+	vdev = __find_vxlan_dev_nolock(vni);
 	read_unlock_vxlan_dev(index);
 
 	return vdev;
@@ -234,7 +256,7 @@ int vxlan_arp_add_ctl(uint32_t vni,struct vxlan_arp_entry *entry)
 	struct vxlan_dev *vdev;
 	int err;	
 	
-	vdev = __find_vxlan_dev_nolock(vni);	
+	vdev = get_vxlan_dev(vni);
 	if(!vdev){
 		return -ESRCH;
 	}else{
@@ -250,7 +272,7 @@ int vxlan_arp_delete_ctl(uint32_t vni,struct vxlan_arp_entry *entry)
 	struct vxlan_dev *vdev;
 	int err;	
 	
-	vdev = __find_vxlan_dev_nolock(vni);	
+	vdev = get_vxlan_dev(vni);
 	if(!vdev){
 		return -ESRCH;
 	}else{
@@ -260,3 +282,47 @@ int vxlan_arp_delete_ctl(uint32_t vni,struct vxlan_arp_entry *entry)
 	return err;
 }
 
+
+/*15. enable/disable fdb learning on a vni*/
+int vxlan_fdb_learning_ctl(uint32_t vni,int enable,uint32_t ageing)
+{
+	struct vxlan_dev *vdev;
+	int err;	
+	
+	vdev = get_vxlan_dev(vni);
+	if(!vdev){
+		return -ESRCH;
+	}else{
+		err = vxlan_fdb_learning_set(vdev,enable,ageing);
+	}
+	
+	return err;
+}
+
+
+/*16. set tcp mss clamp of an int vport, 0 to follow the namespace*/
+int int_vport_mss_clamp_ctl(char *vport_name,uint16_t mss,void *private)
+{
+	int err = 0;
+	struct vport_net *vpnet = &vport_nets;
+	struct vport *vp;
+
+	if(strlen(vport_name) > VPORT_NAME_MAX)
+		return -ENXIO;
+
+	if(mss != 0 && (mss < INT_VPORT_MSS_MIN || mss > INT_VPORT_MSS_MAX))
+		return -ERANGE;
+
+	pal_spinlock_lock(vport_lock(vpnet,vport_name));
+	vp = __find_vport_nolock(vport_name);
+	if(!vp || vp->private != private){
+		err = -ENXIO;
+	}else if(vp->vport_type != VXLAN_VPORT){
+		err = -EINVAL;
+	}else{
+		((struct int_vport *)vp)->mss_clamp = mss;
+	}
+	pal_spinlock_unlock(vport_lock(vpnet,vport_name));
+
+	return err;
+}
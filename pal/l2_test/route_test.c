@@ -29,7 +29,7 @@ static void normal_case_test(void){
 	struct route_table *rt;
 	
 	printf("---------------------Test case 0--------------------------\n");
-	rt = pal_rtable_new();		
+	rt = pal_rtable_new(NULL);		
 	assert(rt != NULL);
 
 	/*create local route*/
@@ -111,7 +111,7 @@ static void case_1_test(void)
 	struct route_table *rt;
 	
 	printf("---------------------Test case 1--------------------------\n");
-	rt = pal_rtable_new();		
+	rt = pal_rtable_new(NULL);		
 	assert(rt != NULL);
 	
 	/*create local route*/
@@ -156,7 +156,7 @@ static void case_2_test(void)
 	struct route_table *rt;
 	
 	printf("---------------------Test case 2--------------------------\n");
-	rt = pal_rtable_new();		
+	rt = pal_rtable_new(NULL);		
 	assert(rt != NULL);
 	
 	/*create local route*/
@@ -218,7 +218,7 @@ static void case_3_test(void)
 	struct route_entry_table reb;
 	
 	printf("---------------------Test case 3--------------------------\n");
-	rt = pal_rtable_new();		
+	rt = pal_rtable_new(NULL);		
 	assert(rt != NULL);
 	
 	/*create local route*/
@@ -26,6 +26,54 @@ static int pal_send_pkt_gw(struct sk_buff *skb, unsigned port_id);
 /* function used to send a packet */
 int (* pal_send_pkt)(struct sk_buff *skb, unsigned port_id) = pal_send_pkt_gw;
 
+#define PAL_TX_CSUM_CAPA (DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_UDP_CKSUM | \
+                          DEV_TX_OFFLOAD_TCP_CKSUM)
+
+/*
+ * @brief Fill the checksums a burst asks the nic for, on a port which can't.
+ *        The ip headers are summed in one batch, l4 checksums go through
+ *        skb_checksum() which walks chained packets.
+ */
+static void __bvrouter pal_tx_csum_fill(struct rte_mbuf **m, unsigned n)
+{
+	const void *bufs[MAX_PKT_SEND_BURST];
+	uint16_t lens[MAX_PKT_SEND_BURST];
+	uint32_t sums[MAX_PKT_SEND_BURST];
+	struct ip_hdr *iphs[MAX_PKT_SEND_BURST];
+	struct ip_hdr *iph;
+	uint16_t *check;
+	unsigned i, k = 0, off;
+
+	for (i = 0; i < n; i++) {
+		off = m[i]->pkt.vlan_macip.f.l2_len;
+		iph = (struct ip_hdr *)((char *)m[i]->pkt.data + off);
+		off += m[i]->pkt.vlan_macip.f.l3_len;
+
+		if (m[i]->ol_flags & PKT_TX_L4_MASK) {
+			if ((m[i]->ol_flags & PKT_TX_L4_MASK) == PKT_TX_TCP_CKSUM)
+				check = &((struct tcp_hdr *)((char *)m[i]->pkt.data + off))->check;
+			else
+				check = &((struct udp_hdr *)((char *)m[i]->pkt.data + off))->check;
+			/* the field holds the pseudo header sum */
+			*check = pal_csum_fold(skb_checksum((struct sk_buff *)m[i], off,
+			                       m[i]->pkt.pkt_len - off, 0));
+			if ((m[i]->ol_flags & PKT_TX_L4_MASK) == PKT_TX_UDP_CKSUM && *check == 0)
+				*check = 0xffff;
+		}
+		if (m[i]->ol_flags & PKT_TX_IP_CKSUM) {
+			bufs[k] = iph;
+			lens[k] = m[i]->pkt.vlan_macip.f.l3_len;
+			iphs[k++] = iph;
+		}
+		m[i]->ol_flags &= ~(uint16_t)(PKT_TX_L4_MASK | PKT_TX_IP_CKSUM);
+	}
+
+	/* the check fields were zeroed by skb_ip_csum_offload() */
+	pal_csum_partial_burst(bufs, lens, sums, k);
+	for (i = 0; i < k; i++)
+		iphs[i]->check = pal_csum_fold(sums[i]);
+}
+
 /*
  * @brief Build ether header and transmit a packet to gatewayt
  * @param port_id Port used to transmit the packet
@@ -49,11 +97,13 @@ static int pal_send_pkt_gw(struct sk_buff *skb, unsigned port_id)
 	eth->type = pal_htons_constant(PAL_ETH_IP);
 
 	pal_cur_thread_conf()->stats.ports[port_id].tx_pkts++;
-	pal_cur_thread_conf()->stats.ports[port_id].tx_bytes += skb_len(skb);
+	pal_cur_thread_conf()->stats.ports[port_id].tx_bytes += skb_pkt_len(skb);
 
 	if (skb->dump)
 		pal_dump_pkt(skb, 2000);
 
+	if (port->sw_tx_csum)
+		pal_tx_csum_fill(&mbuf, 1);
 	for (i = 0; i < 3; i++) {
 		if (rte_eth_tx_burst(port_id, txq_id, &mbuf, 1) == 1) {
 			return 0;
@@ -67,7 +117,8 @@ static int pal_send_pkt_gw(struct sk_buff *skb, unsigned port_id)
 
 /*
  * @brief Transmit a packet from a specified port.
- *        Data to be sent starts from skb->data, and ends at skb-data + skb_len(skb)
+ *        Data to be sent starts from skb->data, and spans skb_pkt_len(skb)
+ *        bytes, which may be chained in several segments
  * @param port_id Port used to transmit the packet
  * @param skb The packet to be sent
  * @param txq_id The id of tx queue to be used for transmit
@@ -81,9 +132,11 @@ int pal_send_raw_pkt(struct sk_buff *skb, unsigned port_id)
 	struct rte_mbuf *mbuf;
 
 	pal_cur_thread_conf()->stats.ports[port_id].tx_pkts++;
-	pal_cur_thread_conf()->stats.ports[port_id].tx_bytes += skb_len(skb);
+	pal_cur_thread_conf()->stats.ports[port_id].tx_bytes += skb_pkt_len(skb);
 
 	mbuf = &skb->mbuf;
+	if (pal_port_conf(port_id)->sw_tx_csum)
+		pal_tx_csum_fill(&mbuf, 1);
 	if (rte_eth_tx_burst(port_id, txq_id, &mbuf, 1) == 1) {
 		return 0;
 	}
@@ -109,11 +162,13 @@ int pal_send_batch_pkt(struct sk_buff *skb, unsigned port_id)
     unsigned n, i, error = 0;
     unsigned txq_id = pal_cur_thread_conf()->txq[port_id];
 	pal_cur_thread_conf()->stats.ports[port_id].tx_pkts++;
-	pal_cur_thread_conf()->stats.ports[port_id].tx_bytes += skb_len(skb);
+	pal_cur_thread_conf()->stats.ports[port_id].tx_bytes += skb_pkt_len(skb);
     unsigned *len = &pal_cur_thread_conf()->tx_mbuf[port_id].len;
     struct rte_mbuf **buffer = pal_cur_thread_conf()->tx_mbuf[port_id].m_table;
     buffer[(*len)++] = mbuf;
     if(unlikely(*len == MAX_PKT_SEND_BURST)) {
+        if (pal_port_conf(port_id)->sw_tx_csum)
+            pal_tx_csum_fill(buffer, MAX_PKT_SEND_BURST);
 	    n = rte_eth_tx_burst(port_id, txq_id, buffer, MAX_PKT_SEND_BURST);
 
         for (i = n; i < MAX_PKT_SEND_BURST; i++) {
@@ -149,6 +204,8 @@ void pal_flush_port(void)
         txq_id = pal_cur_thread_conf()->txq[i];
         buffer = pal_cur_thread_conf()->tx_mbuf[i].m_table;
 
+        if (pal_port_conf(i)->sw_tx_csum)
+            pal_tx_csum_fill(buffer, len);
         n =  rte_eth_tx_burst(i, txq_id, buffer, len);
         for (j = n; j < len; j++) {
         /*if can not send the pkts in a batch,try to send one by one*/
@@ -320,7 +377,8 @@ static int pal_port_txq_init(unsigned port_id, unsigned n_txq)
  * This function allocates a tx ring for each thread.
  */
 static int pal_port_init(unsigned port_id, uint32_t ip, uint32_t gw,
-                                           uint32_t netmask, uint8_t *mac,
+                                           uint32_t netmask, uint16_t mtu,
+					   uint8_t *mac,
 					   uint8_t slaves_cnt, uint8_t *slaves)
 {
 	int i;
@@ -329,6 +387,7 @@ static int pal_port_init(unsigned port_id, uint32_t ip, uint32_t gw,
 	unsigned rxq, txq;
 	/* TODO optimize the paramerters */
 	struct rte_eth_conf port_conf;
+	struct rte_eth_dev_info dev_info;
 	struct port_conf *port;
 
 	BUILD_BUG_ON(PAL_MAX_PORT > 127);
@@ -358,6 +417,11 @@ static int pal_port_init(unsigned port_id, uint32_t ip, uint32_t gw,
 	if ((ip & netmask) != (gw & netmask))
 		PAL_PANIC("ip and gw are not in the same subnet\n");
 
+	if (mtu == 0)
+		mtu = ETHER_MTU;
+	if (mtu < ETHER_MTU || mtu > PAL_MAX_MTU)
+		PAL_PANIC("mtu %u of port %u out of range\n", mtu, port_id);
+
 	/* alloc configuration strucutre first */
 	port = (struct port_conf *)pal_zalloc_numa(sizeof(* port), numa);
 	if (port == NULL)
@@ -369,6 +433,7 @@ static int pal_port_init(unsigned port_id, uint32_t ip, uint32_t gw,
 	port->vnic_ip = ip;
 	port->gw_ip = gw;
 	port->netmask = netmask;
+	port->mtu = mtu;
 
 	if (ipg_add_ip(get_pal_ipg(numa), ip, port_id, PAL_DIP_VNIC, 0) < 0)
 		PAL_PANIC("add gateway ip of port %u failed\n", port_id);
@@ -376,7 +441,7 @@ static int pal_port_init(unsigned port_id, uint32_t ip, uint32_t gw,
 	if (ipg_add_ip(get_pal_ipg(numa), gw, port_id, PAL_DIP_GW, 0) < 0)
 		PAL_PANIC("add gateway ip of port %u failed\n", port_id);
 
-	/* header_split, hw_vlan_filter, hw_vlan_extend, jumbo_frame are disabled */
+	/* header_split, hw_vlan_filter, hw_vlan_extend are disabled */
 	memset(&port_conf, 0, sizeof(port_conf));
 	if(slaves_cnt == 0)
 	{
@@ -402,6 +467,13 @@ static int pal_port_init(unsigned port_id, uint32_t ip, uint32_t gw,
 						  ETH_RSS_IPV4_UDP;
 	}
 
+	/* jumbo frames do not fit in one mbuf, the pmd switches to scattered
+	 * rx and hands them to us as mbuf chains */
+	if (mtu > ETHER_MTU) {
+		port_conf.rxmode.jumbo_frame = 1;
+		port_conf.rxmode.max_rx_pkt_len = mtu + ETHER_HDR_LEN + ETHER_CRC_LEN;
+	}
+
 	/* one rxq for each receiver. one txq for each thread */
 	rxq = g_pal_config.numa[numa]->n_receiver;
 	txq = g_pal_config.sys.n_thread;
@@ -435,6 +507,15 @@ static int pal_port_init(unsigned port_id, uint32_t ip, uint32_t gw,
 	    //TODO: delete these code when Fortille is ok for bonding
 	}
 
+	/* checksums the nic can't do are done in software, a burst at a time */
+	memset(&dev_info, 0, sizeof(dev_info));
+	rte_eth_dev_info_get(port_id, &dev_info);
+	port->sw_rx_csum = !(dev_info.rx_offload_capa & DEV_RX_OFFLOAD_IPV4_CKSUM);
+	port->sw_tx_csum = (dev_info.tx_offload_capa & PAL_TX_CSUM_CAPA) != PAL_TX_CSUM_CAPA;
+	if (port->sw_rx_csum || port->sw_tx_csum)
+		PAL_LOG("port %u checksums in software: rx %u, tx %u\n", (unsigned)port_id,
+		        port->sw_rx_csum, port->sw_tx_csum);
+
 	/* Setup receive queues */
 	pal_port_rxq_init(port_id, rxq);
 
@@ -522,6 +603,7 @@ void pal_ports_init(struct pal_config *conf)
 		pal_port_init(conf->port[idx].port_id, conf->port[idx].ip,
 		                       conf->port[idx].gw_ip,
 		                       conf->port[idx].netmask,
+		                       conf->port[idx].mtu,
 		                       conf->port[idx].mac,
 							   conf->port[idx].slaves_cnt,
 							   conf->port[idx].slaves);
@@ -548,6 +630,20 @@ void pal_ports_init(struct pal_config *conf)
 }
 
 
+void pal_ports_stop(void)
+{
+	int port_id;
+
+	pal_stop_data_threads();
+
+	/* bonding ports stop their slaves */
+	for (port_id = 0; port_id < PAL_MAX_PORT; port_id++) {
+		if (pal_port_enabled(port_id))
+			rte_eth_dev_stop(port_id);
+	}
+}
+
+
 void pal_port_get_stats(int port_id, struct pal_port_hw_stats *stats)
 {
 	unsigned i;
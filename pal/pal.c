@@ -17,6 +17,7 @@
 #include "vnic.h"
 #include "jiffies.h"
 #include "timer.h"
+#include "pal_csum.h"
 
 #include <sys/prctl.h>
 
@@ -105,6 +106,10 @@ void pal_init(struct pal_config *conf)
 		PAL_PANIC("pal_config not initialized, call pal_conf_init first\n");
 
 	pal_glb_conf_init();
+
+	/* pick the checksum routine before any packet is seen */
+	pal_csum_init();
+	PAL_LOG("checksum routine: %s\n", pal_csum_impl());
 	
 	/* Initialize underlying platform */
 	platform_init(conf);
@@ -203,7 +208,7 @@ void pal_get_stats_summary(struct pal_stats *stats)
 		/* perfoemance here is not critical but we can still consider 
 		 * using AVX instrunctions */
 		for (i = 0; i < (sizeof(*stats) / sizeof(*p)); i++) {
-			*p += *q;
+			p[i] += q[i];
 		}
 	}
 }
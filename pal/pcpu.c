@@ -0,0 +1,77 @@
+#include <string.h>
+#include <stdint.h>
+#include <rte_malloc.h>
+
+#include "pal_pcpu.h"
+
+PAL_DEFINE_PER_THREAD(struct pal_pcpu_batch, _pcpu_batch);
+
+void __pal_pcpu_flush(struct pal_pcpu_batch *batch)
+{
+	struct pal_pcpu_slot *slot;
+	uint64_t *cnt;
+	uint32_t j;
+	int i;
+
+	for (i = 0; i < batch->n; i++) {
+		slot = &batch->slot[i];
+		cnt = (uint64_t *)(slot->head + 1);
+
+		pal_pcpu_write_begin(slot->head);
+		for (j = 0; j < slot->n; j++) {
+			cnt[j] += slot->delta[j];
+			slot->delta[j] = 0;
+		}
+		pal_pcpu_write_end(slot->head);
+
+		slot->n = 0;
+	}
+
+	batch->n = 0;
+}
+
+void *pal_pcpu_alloc(size_t size, int numa)
+{
+	if (size % CACHE_LINE_SIZE)
+		return NULL;
+
+	return rte_zmalloc_socket(NULL, size * PAL_MAX_CPU, CACHE_LINE_SIZE, numa);
+}
+
+void pal_pcpu_free(void *blocks)
+{
+	rte_free(blocks);
+}
+
+void pal_pcpu_sum(void *sum, const void *blocks, size_t size)
+{
+	size_t n = (size - sizeof(struct pal_pcpu_head)) / sizeof(uint64_t);
+	uint64_t *s = (uint64_t *)((struct pal_pcpu_head *)sum + 1);
+	uint64_t snap[n];
+	const struct pal_pcpu_head *head;
+	uint32_t seq;
+	size_t j;
+	int cpu;
+
+	memset(sum, 0, size);
+
+	for (cpu = 0; cpu < PAL_MAX_CPU; cpu++) {
+		head = (const struct pal_pcpu_head *)((const char *)blocks + cpu * size);
+
+		/* the owner holds the block odd for a few stores only */
+		for (;;) {
+			seq = head->seq;
+			if (!(seq & 1)) {
+				pal_pcpu_barrier();
+				memcpy(snap, head + 1, sizeof(snap));
+				pal_pcpu_barrier();
+				if (head->seq == seq)
+					break;
+			}
+			rte_pause();
+		}
+
+		for (j = 0; j < n; j++)
+			s[j] += snap[j];
+	}
+}
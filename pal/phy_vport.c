@@ -31,9 +31,6 @@ static int phy_vport_init(struct vport *dev)
 		return err;
 	}
 
-    memset(vport->stats, 0, sizeof(vport->stats));
-    memset(vport->use_count, 0, sizeof(vport->use_count));
-
 	/*init floating ip list*/
 	PAL_INIT_LIST_HEAD(&vport->floating_list);
 	vport->fl_ip_count = 0;
@@ -56,8 +53,8 @@ static int __bvrouter phy_vport_send(struct sk_buff *skb, struct vport *dev)
 	struct phy_vport *vport = (struct phy_vport *)dev;
    	int lcore_id = rte_lcore_id();
     struct ip_hdr *iph;
-	vport->stats[lcore_id].tx_packets++;
-	vport->stats[lcore_id].tx_bytes += skb_len(skb);
+	PAL_PCPU_ADD(&vport->stats[lcore_id], tx_packets, 1);
+	PAL_PCPU_ADD(&vport->stats[lcore_id], tx_bytes, skb_pkt_len(skb));
 	eth	= skb_eth_header(skb);
 	mac_copy(eth->dst, get_nn_gw_mac());
 	mac_copy(eth->src, get_vtep_mac());
@@ -77,7 +74,7 @@ static int __bvrouter phy_vport_send(struct sk_buff *skb, struct vport *dev)
 			goto tx_error;
 
 tx_error:
-		vport->stats[lcore_id].tx_errors += ret;
+		PAL_PCPU_ADD(&vport->stats[lcore_id], tx_errors, ret);
 		//pal_skb_free(skb);
 		return -EFAULT;
 }
@@ -89,8 +86,8 @@ static int __bvrouter phy_vport_recv(struct sk_buff *skb,struct vport *dev)
 	struct phy_vport *vport = (struct phy_vport *)dev;
     int lcore_id = rte_lcore_id();
 
-	vport->stats[lcore_id].rx_packets++;
-	vport->stats[lcore_id].rx_bytes += skb_len(skb);
+	PAL_PCPU_ADD(&vport->stats[lcore_id], rx_packets, 1);
+	PAL_PCPU_ADD(&vport->stats[lcore_id], rx_bytes, skb_pkt_len(skb));
 
 	iph = skb_ip_header(skb);
 	skb_push(skb, ((iph->ihl) << 2));
@@ -100,8 +97,6 @@ static int __bvrouter phy_vport_recv(struct sk_buff *skb,struct vport *dev)
 	ret = bvr_pkt_handler(skb,dev);
 	read_unlock_namespace(dev->private);
 
-	vport->use_count[lcore_id]--;
-
 	if(unlikely(ret == BVROUTER_DROP)){
 		pal_skb_free(skb);
 		return -EFAULT;
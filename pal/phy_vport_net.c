@@ -8,10 +8,12 @@
 #include "pal_error.h"
 #include "pal_malloc.h"
 #include "pal_slab.h"
+#include "pal_qsbr.h"
 
 struct phy_net phy_vport_net;
 
 static struct pal_slab *phy_vport_slab = NULL;
+static int phy_vport_numa;
 
 /*hold the read lock which protect the phy_vport*/
 void get_phy_vport(struct phy_vport *vport)
@@ -81,6 +83,14 @@ static int __phy_vport_create(struct vport_net *vpnet,
 			return -ENOMEM;
 		}
 
+		vp->stats = pal_pcpu_alloc(sizeof(struct vport_stats), phy_vport_numa);
+		if (!vp->stats){
+			pal_free(vp->vp.uuid);
+			pal_free(vp->vp.vport_name);
+			pal_slab_free(vp);
+			return -ENOMEM;
+		}
+
 		vp->vp.vport_ip = ext_gw_ip;		
 		vp->vp.prefix_len = (prefix_len != 0 && prefix_len < 32) ? prefix_len : 24;
 		strcpy(vp->vp.vport_name, vport_name);		
@@ -114,6 +124,7 @@ static int __phy_vport_create(struct vport_net *vpnet,
 	return 0;
 	
 error:	
+	pal_pcpu_free(vp->stats);
 	pal_free(vp->vp.uuid);
 	pal_free(vp->vp.vport_name);
 	pal_slab_free(vp);
@@ -144,16 +155,16 @@ int phy_vport_add(char *vport_name,char *uuid,
 	if (!pal_is_valid_ether_addr(ext_gw_mac))
 		return -ENXIO;
 	
-	pal_spinlock_lock(&vpnet->hash_lock);
+	pal_spinlock_lock(vport_lock(vpnet,vport_name));
 	vp= __find_vport_nolock(vport_name);
 	if (vp) {	
-			pal_spinlock_unlock(&vpnet->hash_lock);
+			pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 			return -EEXIST;
 	} else {
 		head = get_nd_vport_head(nd); 
 		if(find_vport_ip_from_list(head,ext_gw_ip) == 1){
 			PAL_DEBUG("repeat ip in the namespace %x!\n",ext_gw_ip);
-			pal_spinlock_unlock(&vpnet->hash_lock);
+			pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 			return -EEXIST;
 		}
 		index = get_hash_index_ext_ip(ext_gw_ip);
@@ -161,7 +172,7 @@ int phy_vport_add(char *vport_name,char *uuid,
 		err = __phy_vport_create(vpnet,phynet,vport_name,uuid,ext_gw_mac,ext_gw_ip,prefix_len,nd);			
 		pal_rwlock_write_unlock(&phynet->hash_lock_array[index]);
 	}	
-	pal_spinlock_unlock(&vpnet->hash_lock);
+	pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 
 	return err;
 }
@@ -173,11 +184,18 @@ static void phy_vport_free(struct phy_vport *vp)
 			pal_free(vp->vp.vport_name);
 		if(vp->vp.uuid)
 			pal_free(vp->vp.uuid);
+		pal_pcpu_free(vp->stats);
 		pal_slab_free(vp);
 	}
 }
 
-static void __phy_vport_destroy(struct vport_net *vpnet,struct phy_net *phynet, struct phy_vport *vp)
+static void phy_vport_free_qsbr(struct pal_qsbr_head *head)
+{
+	phy_vport_free(container_of(head, struct phy_vport, qsbr));
+}
+
+/*unlink a phy vport, it is freed by the caller after a grace period*/
+static void __phy_vport_unlink(struct vport_net *vpnet,struct phy_net *phynet, struct phy_vport *vp)
 {
 	PAL_DEBUG("delete phy vport %pM\n", vp->vport_cfg.ext_gw_eth_addr);
 	
@@ -188,8 +206,6 @@ static void __phy_vport_destroy(struct vport_net *vpnet,struct phy_net *phynet,
 		
 	remove_phy_vport_from_phy_net(phynet,vp);
 	remove_phy_vport_from_vport_net(vpnet,vp);
-
-	phy_vport_free(vp);
 }
 
 static void shrink_ip_cell(struct phy_vport *vport)
@@ -208,43 +224,12 @@ static void shrink_ip_cell(struct phy_vport *vport)
 	}
 }
 
-static int get_phy_vport_use_count(struct phy_vport *vp)
-{
-	int core_id,count = 0;
-	
-	for(core_id = 0; core_id < MAX_CORE_NUM; core_id++){
-		count += vp->use_count[core_id];
-	}
-	
-	return count;
-}
-
-/* 
- * Wait for a phy port .
- * When a phy_port->count equal to 1, get lock and return
- */
-static void wait_on_phy_port(struct vport_net *vpnet,struct phy_net *phynet,
-	struct phy_vport *vp)
-{	
-	uint8_t index;	
-	do {
-		if (get_phy_vport_use_count(vp) == 0)
-			break;
-		usleep(1);
-	} while (1);
-	index = get_hash_index_ext_ip(vp->vp.vport_ip);
-	
-	pal_spinlock_lock(&vpnet->hash_lock); 
-	pal_rwlock_write_lock(&phynet->hash_lock_array[index]);		
-}
-
 /*
-* delete a phy_vport, and vpnet->hash_lock must be held 
+* delete a phy_vport, the lock of the bucket of its name must be held 
 */
 int phy_vport_delete(struct vport_net *vpnet,struct phy_vport *vp)
 {
 	int err = -ENOENT;
-	int count;	
 	uint8_t index;	
 	void *nd;
 	struct phy_net *phynet = &phy_vport_net;
@@ -263,24 +248,16 @@ int phy_vport_delete(struct vport_net *vpnet,struct phy_vport *vp)
 	shrink_ip_cell(vp);
 	
 	nd = vp->vp.private;
-	count = get_phy_vport_use_count(vp);
-	if(!count){
-		write_lock_namespace(nd);
-		__phy_vport_destroy(vpnet,phynet,vp);		
-		write_unlock_namespace(nd);
-	}else if(count > 0){
-		pal_rwlock_write_unlock(&phynet->hash_lock_array[index]);		
-		pal_spinlock_unlock(&vpnet->hash_lock); 
-		wait_on_phy_port(vpnet,phynet,vp);	
-
-		write_lock_namespace(nd);
-		__phy_vport_destroy(vpnet,phynet,vp);		
-		write_unlock_namespace(nd);
-	}else{
-		PAL_PANIC("error phy_vport->count\n");
-	}
+	write_lock_namespace(nd);
+	__phy_vport_unlink(vpnet,phynet,vp);		
+	write_unlock_namespace(nd);
 	pal_rwlock_write_unlock(&phynet->hash_lock_array[index]);
 
+	/*receivers which found the vport before its ip cells were removed may
+	  still use it, it is freed after a grace period. The bucket lock of its
+	  name is held, so nothing here waits for one*/
+	pal_qsbr_call(&vp->qsbr, phy_vport_free_qsbr);
+
 	return 0;
 }
 
@@ -302,7 +279,8 @@ int phy_net_init(void)
 
 void phy_vport_slab_init(int numa_id)
 {
-    phy_vport_slab = pal_slab_create("phy_vport", PHY_VPORT_SLAB_SIZE, 
+	phy_vport_numa = numa_id;
+    phy_vport_slab = pal_slab_create_multipc("phy_vport", PHY_VPORT_SLAB_SIZE, 
 		sizeof(struct phy_vport), numa_id, 0);
 	
 	if (!phy_vport_slab) {
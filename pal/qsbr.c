@@ -0,0 +1,90 @@
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "pal_qsbr.h"
+#include "pal_spinlock.h"
+
+struct pal_qsbr pal_qsbr = {
+	.seq = 1,
+};
+
+/* deferred calls, in the order of their grace periods */
+static PAL_LIST_HEAD(qsbr_pending);
+static pal_spinlock_t qsbr_lock = PAL_SPINLOCK_INITIALIZER;
+
+uint64_t pal_qsbr_start(void)
+{
+	/* a full barrier, the unlinks before are seen before the new seq */
+	return __sync_add_and_fetch(&pal_qsbr.seq, 1);
+}
+
+/* the oldest grace period an online thread may still be in */
+static uint64_t qsbr_oldest(void)
+{
+	uint64_t oldest = UINT64_MAX, seq;
+	int tid;
+
+	for (tid = 0; tid < PAL_MAX_THREAD; tid++) {
+		seq = pal_qsbr.thread[tid].seq;
+		if (seq && seq < oldest)
+			oldest = seq;
+	}
+
+	return oldest;
+}
+
+int pal_qsbr_check(uint64_t token)
+{
+	return qsbr_oldest() >= token;
+}
+
+void pal_qsbr_synchronize(void)
+{
+	uint64_t token = pal_qsbr_start();
+
+	while (!pal_qsbr_check(token))
+		usleep(1);
+}
+
+void pal_qsbr_call(struct pal_qsbr_head *head,
+				void (*func)(struct pal_qsbr_head *head))
+{
+	head->func = func;
+
+	pal_spinlock_lock(&qsbr_lock);
+	head->seq = pal_qsbr_start();
+	pal_list_add_tail(&head->list, &qsbr_pending);
+	pal_spinlock_unlock(&qsbr_lock);
+}
+
+int pal_qsbr_reclaim(void)
+{
+	PAL_LIST_HEAD(done);
+	struct pal_qsbr_head *head, *n;
+	uint64_t oldest;
+	int count = 0;
+
+	pal_spinlock_lock(&qsbr_lock);
+	if (pal_list_empty(&qsbr_pending)) {
+		pal_spinlock_unlock(&qsbr_lock);
+		return 0;
+	}
+	oldest = qsbr_oldest();
+	pal_list_for_each_entry_safe(head, n, &qsbr_pending, list) {
+		if (head->seq > oldest)
+			break;
+		pal_list_del(&head->list);
+		pal_list_add_tail(&head->list, &done);
+	}
+	pal_spinlock_unlock(&qsbr_lock);
+
+	/* run without the lock, a call may defer another one */
+	pal_list_for_each_entry_safe(head, n, &done, list) {
+		pal_list_del(&head->list);
+		head->func(head);
+		count++;
+	}
+
+	return count;
+}
@@ -17,9 +17,12 @@
 #include "ip.h"
 #include "vnic.h"
 #include "thread.h"
+#include "timer.h"
 #include "pal_phy_vport.h"
 #include "pal_vxlan.h"
 #include "pal_ip_cell.h"
+#include "pal_qsbr.h"
+#include "pal_pcpu.h"
 #include "route.h"
 
 
@@ -126,71 +129,13 @@ void pal_disq_init(void)
 extern struct rte_mbuf * ip_frag_reassemble_packet(struct sk_buff *skb,struct ip_hdr  *iph);
 
 /*
-* distinguish whether it is a vxlan packet or non-vxlan packet and deliver it
-* to proper process function.
+* strip the ip header, check l4 checksum and deliver the packet to the
+* internal or external network process function.
 */
-static inline int __bvrouter rcv_pkt_ipv4_process(struct sk_buff *skb)
+static inline int __bvrouter rcv_pkt_l4_process(struct sk_buff *skb, struct ip_hdr *iph)
 {
-	struct ip_hdr  *iph;
 	struct udp_hdr * udphdr;
 	int is_vxlan = NO_VXLAN;
-	uint32_t len ;
-
-	/*check ip sum*/
-	if(unlikely(!skb_ip_csum_ok(skb)))
-		goto drop;
-
-	/*check ip header len*/
-	if (unlikely(!pskb_may_pull(skb, sizeof(struct ip_hdr))))
-		goto drop;
-	iph = skb_ip_header(skb);
-	if (unlikely(!pskb_may_pull(skb, ((iph->ihl) << 2))))
-		goto drop;
-
-	/*check ip total len*/
-	len = pal_ntohs(iph->tot_len);
-	if (unlikely((skb_len(skb) < len) || (len < (uint32_t)(iph->ihl*4)))) {
-		goto drop;
-	}
-
-    /*dst for local ip send to vnic*/
-    if(is_local_ip(iph->daddr)) {
-        skb_push(skb, sizeof(struct eth_hdr));
-        pal_send_to_vnic(skb->recv_if, skb);
-	    goto drop;
-    }
-
-	/* if it is a fragmented packet and dest for vtep ip(vxlan pkt or vxlan fragment pkt),
-	    then try to reassemble. */
-	if (unlikely(ip_is_fragment(iph)) && is_vtep_ip(iph->daddr)) {
-		struct rte_mbuf *m;
-		struct rte_mbuf *mo;
-		uint8_t port_out;
-
-		m = &skb->mbuf;
-		port_out = skb->recv_if;
-		skb_push(skb, sizeof(struct eth_hdr));
-
-		/* process this fragment. */
-		mo = ip_frag_reassemble_packet(skb,iph);
-		if (mo == NULL){/* no packet to send out. */
-			return -1;
-		}
-
-		/* we have our packet reassembled. */
-		if (mo != m) {
-			m = mo;
-            /*ip frag reassemble will set PKT_TX_IP_CKSUM, set it back*/
-            m->ol_flags &= (~PKT_TX_IP_CKSUM);
-		}
-
-		skb = (struct sk_buff *)m;
-		skb->recv_if = port_out;
-		skb_reset_eth_header(skb);
-		skb_pull(skb, sizeof(struct eth_hdr));
-		skb_reset_network_header(skb);
-		iph = skb_ip_header(skb);
-	}
 
 	skb_pull(skb, ((iph->ihl) << 2));
 	skb_reset_l4_header(skb);
@@ -229,6 +174,114 @@ drop:
 	return -EFAULT;
 }
 
+/*
+* add a fragment to our reassembly table, and go on with the datagram if it
+* is complete. skb->data must point to the ip header.
+*/
+static inline int __bvrouter rcv_pkt_frag_process(struct sk_buff *skb)
+{
+	struct ip_hdr  *iph = skb_ip_header(skb);
+	struct rte_mbuf *m;
+	struct rte_mbuf *mo;
+	uint8_t port_out;
+
+	m = &skb->mbuf;
+	port_out = skb->recv_if;
+	skb_push(skb, sizeof(struct eth_hdr));
+
+	/* process this fragment. */
+	mo = ip_frag_reassemble_packet(skb,iph);
+	if (mo == NULL){/* no packet to send out. */
+		return -1;
+	}
+
+	/* we have our packet reassembled. */
+	if (mo != m) {
+		m = mo;
+        /*ip frag reassemble will set PKT_TX_IP_CKSUM, set it back*/
+        m->ol_flags &= (~PKT_TX_IP_CKSUM);
+	}
+
+	skb = (struct sk_buff *)m;
+	skb->recv_if = port_out;
+	skb_reset_eth_header(skb);
+	skb_pull(skb, sizeof(struct eth_hdr));
+	skb_reset_network_header(skb);
+
+	return rcv_pkt_l4_process(skb, skb_ip_header(skb));
+}
+
+/*
+* reassemble the fragments other receivers steered to us
+*/
+static inline void __bvrouter rcv_pkt_frag_redirected(struct thread_conf *thconf)
+{
+	struct pal_fifo *q = thconf->ip_reassemble_config.frag_q;
+	struct sk_buff *skb;
+	int n;
+
+	for (n = 0; n < PAL_RCV_BURST; n++) {
+		skb = pal_fifo_dequeue_sc(q);
+		if (skb == NULL)
+			break;
+		rcv_pkt_frag_process(skb);
+	}
+}
+
+/*
+* distinguish whether it is a vxlan packet or non-vxlan packet and deliver it
+* to proper process function.
+*/
+static inline int __bvrouter rcv_pkt_ipv4_process(struct sk_buff *skb)
+{
+	struct ip_hdr  *iph;
+	uint32_t len ;
+	int owner;
+
+	/*check ip sum*/
+	if(unlikely(!skb_ip_csum_ok(skb)))
+		goto drop;
+
+	/*check ip header len*/
+	if (unlikely(!pskb_may_pull(skb, sizeof(struct ip_hdr))))
+		goto drop;
+	iph = skb_ip_header(skb);
+	if (unlikely(!pskb_may_pull(skb, ((iph->ihl) << 2))))
+		goto drop;
+
+	/*check ip total len*/
+	len = pal_ntohs(iph->tot_len);
+	if (unlikely((skb_pkt_len(skb) < len) || (len < (uint32_t)(iph->ihl*4)))) {
+		goto drop;
+	}
+
+	/*strip ethernet padding, the rest of the path relies on pkt_len*/
+	pskb_trim(skb, len);
+
+    /*dst for local ip send to vnic*/
+    if(is_local_ip(iph->daddr)) {
+        skb_push(skb, sizeof(struct eth_hdr));
+        pal_send_to_vnic(skb->recv_if, skb);
+	    goto drop;
+    }
+
+	/* if it is a fragmented packet and dest for vtep ip(vxlan pkt or vxlan fragment pkt),
+	    then try to reassemble on the receiver owning the datagram. */
+	if (unlikely(ip_is_fragment(iph)) && is_vtep_ip(iph->daddr)) {
+		owner = ip_frag_owner(iph);
+		if (owner != pal_thread_id())
+			return ip_frag_redirect(skb, owner);
+
+		return rcv_pkt_frag_process(skb);
+	}
+
+	return rcv_pkt_l4_process(skb, iph);
+
+drop:
+	pal_skb_free(skb);
+	return -EFAULT;
+}
+
 /* this function frees packet in any case */
 int  __bvrouter l2_handler(struct sk_buff *skb)
 {
@@ -300,23 +353,41 @@ void l2_init(uint32_t vtep_ip,uint32_t local_ip,uint8_t *vtep_mac,uint32_t gw_ip
 	nn_arp_init(gw_ip);
 }
 
-extern void ip_frag_reassemble_init(int numa_id);
-void l2_slab_init(int numa_id)
+/* independent of each other, the largest first */
+static void (* const l2_slab_inits[])(int numa_id) = {
+	vxlan_fdb_slab_init,
+	vxlan_arp_slab_init,
+	vxlan_slab_init,
+	vxlan_skb_slab_init,
+	ip_cell_slab_init,
+	phy_vport_slab_init,
+	route_slab_init,
+};
+
+unsigned l2_slab_init_steps(void)
 {
-	vxlan_slab_init(numa_id);
-	vxlan_fdb_slab_init(numa_id);
-	vxlan_arp_slab_init(numa_id);
-	vxlan_skb_slab_init(numa_id);
-	phy_vport_slab_init(numa_id);
-	ip_cell_slab_init(numa_id);
-	route_slab_init(numa_id);
-	ip_frag_reassemble_init(numa_id);
+	return ARRAY_SIZE(l2_slab_inits);
+}
 
+void l2_slab_init_step(unsigned step, int numa_id)
+{
+	l2_slab_inits[step](numa_id);
+}
+
+void l2_addr_init(void)
+{
 	ip_cell_add(get_vtep_ip(),VTEP_IP,NULL);
     ip_cell_add(get_local_ip(),LOCAL_IP,NULL);
 	ip_cell_add(get_nn_gw_ip(),GATEWAY_IP,NULL);
 }
 
+extern void ip_frag_reassemble_init(int tid);
+void l2_thread_init(int tid)
+{
+	if (pal_thread_conf(tid)->mode == PAL_THREAD_RECEIVER)
+		ip_frag_reassemble_init(tid);
+}
+
 /*
  * @brief Dispatch packet to cresponding worker or handle it ourself
  */
@@ -344,6 +415,70 @@ int dispatch_pkt(struct sk_buff *skb, const struct pal_dip *dip)
 	return 0;
 }
 
+/*
+* look up the destinations of the ip packets of a burst together, the
+* lookup of each packet then finds its ip cell and vport in the cache
+*/
+static inline void __bvrouter rcv_burst_prefetch(struct sk_buff **skbs, int n)
+{
+	__be32 dips[PAL_RCV_BURST];
+	const struct eth_hdr *eth;
+	const struct ip_hdr *iph;
+	int i, k = 0;
+
+	for (i = 0; i < n; i++) {
+		if (unlikely(skbs[i]->mbuf.pkt.data_len <
+				sizeof(struct eth_hdr) + sizeof(struct ip_hdr)))
+			continue;
+		eth = (const struct eth_hdr *)skbs[i]->mbuf.pkt.data;
+		if (eth->type != pal_htons_constant(PAL_ETH_IP))
+			continue;
+		iph = (const struct ip_hdr *)(eth + 1);
+		dips[k++] = iph->daddr;
+	}
+
+	if (k > 1)
+		ip_cell_prefetch_bulk(dips, k);
+}
+
+/*
+* check the ip headers of a burst in one batch, on ports whose nic does not.
+* a bad header is flagged as the nic would flag it, skb_ip_csum_ok() drops it
+*/
+static inline void __bvrouter rcv_burst_ip_csum(struct sk_buff **skbs, int n)
+{
+	const void *hdrs[PAL_RCV_BURST];
+	uint16_t lens[PAL_RCV_BURST];
+	struct sk_buff *ips[PAL_RCV_BURST];
+	const struct eth_hdr *eth;
+	const struct ip_hdr *iph;
+	uint64_t ok;
+	int i, k = 0;
+
+	for (i = 0; i < n; i++) {
+		if (unlikely(skbs[i]->mbuf.pkt.data_len <
+				sizeof(struct eth_hdr) + sizeof(struct ip_hdr)))
+			continue;
+		eth = (const struct eth_hdr *)skbs[i]->mbuf.pkt.data;
+		if (eth->type != pal_htons_constant(PAL_ETH_IP))
+			continue;
+		iph = (const struct ip_hdr *)(eth + 1);
+		/*a header past the segment is dropped by rcv_pkt_ipv4_process()*/
+		if (unlikely(sizeof(struct eth_hdr) + (iph->ihl << 2) >
+				skbs[i]->mbuf.pkt.data_len))
+			continue;
+		hdrs[k] = iph;
+		lens[k] = iph->ihl << 2;
+		ips[k++] = skbs[i];
+	}
+
+	ok = pal_csum_ok_burst(hdrs, lens, k);
+	for (i = 0; i < k; i++) {
+		if (!(ok & (1ULL << i)))
+			ips[i]->mbuf.ol_flags |= PKT_RX_IP_CKSUM_BAD;
+	}
+}
+
 /* Configure how many packets ahead to prefetch, when reading packets */
 #define PREFETCH_OFFSET	3
 int __bvrouter receiver_loop(__unused void *arg)
@@ -373,6 +508,7 @@ int __bvrouter receiver_loop(__unused void *arg)
 		ports[n_port++] = pal_port_conf(i);
 	}
 
+	pal_qsbr_online();
 	pal_cpu_idle();
 	while (1) {
 		for (i = 0; i < n_port; i++) {
@@ -384,6 +520,9 @@ int __bvrouter receiver_loop(__unused void *arg)
 			rte_ip_frag_free_death_row(&thconf->ip_reassemble_config.death_row,
 						PREFETCH_OFFSET);
 
+			/*fragments steered to us by other receivers*/
+			rcv_pkt_frag_redirected(thconf);
+
             if(unlikely(thconf->flush_count == PAL_TX_FLUSH_COUNT)) {
                 pal_flush_port();
                 thconf->flush_count = 0;
@@ -400,9 +539,12 @@ int __bvrouter receiver_loop(__unused void *arg)
 
 			pal_cpu_work();
 			thconf->stats.ports[port_id].rx_pkts += n_rx;
+			rcv_burst_prefetch(skbs, n_rx);
+			if (ports[i]->sw_rx_csum)
+				rcv_burst_ip_csum(skbs, n_rx);
 
 			for (j = 0; j < n_rx; j++) {
-				thconf->stats.ports[port_id].rx_bytes += skb_len(skbs[j]);
+				thconf->stats.ports[port_id].rx_bytes += skb_pkt_len(skbs[j]);
 			//	rte_prefetch0((void *)skbs[j]);
 				skb_reset_eth_header(skbs[j]);
 				skbs[j]->recv_if = port_id;
@@ -417,6 +559,13 @@ int __bvrouter receiver_loop(__unused void *arg)
 			thconf->cmd = 0;
 			pal_cpu_idle();
 		}
+
+		/*timers armed by the packets of this thread, such as conntrack*/
+		run_timer(100);
+
+		/*no vport, vxlan_dev or namespace is held between two rounds*/
+		pal_pcpu_flush();
+		pal_qsbr_quiescent();
 	}
 
 	return 0;
@@ -29,7 +29,20 @@ static inline struct pal_fifo *pal_dispatch_fifo(int tid)
 }
 
 extern void l2_init(uint32_t vtep_ip, uint32_t local_ip, uint8_t *vtep_mac,uint32_t gw_ip);
-extern void l2_slab_init(int numa_id);
+
+/*
+ * @brief create the slabs of the l2 framework in steps, which may run on
+ *        several threads at once. l2_addr_init() adds the local addresses
+ *        once all steps are done
+ */
+extern unsigned l2_slab_init_steps(void);
+extern void l2_slab_init_step(unsigned step, int numa_id);
+extern void l2_addr_init(void);
+
+/*
+ * @brief create the objects of a thread, run on that thread
+ */
+extern void l2_thread_init(int tid);
 extern 	int l2_handler(struct sk_buff *skb);
 
 #endif
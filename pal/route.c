@@ -8,10 +8,10 @@
 #include "pal_byteorder.h"
 #include "pal_malloc.h"
 #include "pal_slab.h"
+#include "pal_arena.h"
 
 static struct pal_slab *route_table_slab = NULL;
-static struct pal_slab *leaf_info_slab = NULL;
-static struct pal_slab *leaf_slab = NULL;
+static int route_numa_id = 0;
 
 #define WARN_ON(cond) \
 	do { \
@@ -96,9 +96,15 @@ static inline int tkey_equals(t_key a, t_key b)
 	return a == b;
 }
 
-static struct leaf_info *leaf_info_new(uint32_t plen)
+/* the trie root is embedded in its route table */
+static inline struct pal_arena *trie_arena(struct rt_trie_node **t)
 {
-	struct leaf_info *li = pal_slab_alloc(leaf_info_slab);
+	return container_of(t, struct route_table, trie)->arena;
+}
+
+static struct leaf_info *leaf_info_new(struct pal_arena *a, uint32_t plen)
+{
+	struct leaf_info *li = pal_arena_alloc(a, sizeof(struct leaf_info));
 	if (li) {
 		li->plen = plen;
 		li->mask_plen = pal_ntohl(inet_make_mask(plen));
@@ -127,11 +133,11 @@ static void insert_leaf_info(struct pal_hlist_head *head, struct leaf_info *new)
 	}
 }
 
-static struct leaf *leaf_new(void)
+static struct leaf *leaf_new(struct pal_arena *a)
 {
 	struct leaf *l;
 
-	l = (struct leaf *)pal_slab_alloc(leaf_slab);
+	l = (struct leaf *)pal_arena_alloc(a, sizeof(struct leaf));
 	if (l) {
 		l->node.parent = T_LEAF;
 		PAL_INIT_HLIST_HEAD(&l->list);
@@ -139,9 +145,9 @@ static struct leaf *leaf_new(void)
 	return l;
 }
 
-static inline void free_leaf(struct leaf *l)
+static inline void free_leaf(struct pal_arena *a, struct leaf *l)
 {
-	pal_slab_free(l);
+	pal_arena_free(a, l, sizeof(struct leaf));
 }
 
 /* Same as rcu_assign_pointer
@@ -216,20 +222,19 @@ static inline int tkey_mismatch(t_key a, int offset, t_key b)
 	return i;
 }
 
-static struct tnode *tnode_alloc(size_t size)
+static inline size_t tnode_size(int bits)
 {
-	struct tnode *n;
-	n = pal_malloc(size);
-	if(n){
-		memset(n,0,size);
-	}
-	return n;
+	return sizeof(struct tnode) + (sizeof(struct rt_trie_node *) << bits);
 }
 
-static struct tnode *tnode_new(t_key key, int pos, int bits)
+static struct tnode *tnode_alloc(struct pal_arena *a, size_t size)
 {
-	size_t sz = sizeof(struct tnode) + (sizeof(struct rt_trie_node *) << bits);
-	struct tnode *tn = tnode_alloc(sz);
+	return pal_arena_zalloc(a, size);
+}
+
+static struct tnode *tnode_new(struct pal_arena *a, t_key key, int pos, int bits)
+{
+	struct tnode *tn = tnode_alloc(a, tnode_size(bits));
 
 	if (tn) {
 		tn->node.parent = T_TNODE;
@@ -243,9 +248,9 @@ static struct tnode *tnode_new(t_key key, int pos, int bits)
 	return tn;
 }
 
-static inline void free_leaf_info(struct leaf_info *leaf)
+static inline void free_leaf_info(struct pal_arena *a, struct leaf_info *leaf)
 {
-	pal_slab_free(leaf);
+	pal_arena_free(a, leaf, sizeof(struct leaf_info));
 }
 
 static inline int tnode_child_length(const struct tnode *tn)
@@ -253,25 +258,25 @@ static inline int tnode_child_length(const struct tnode *tn)
 	return 1 << tn->bits;
 }
 
-static void tnode_free_safe(struct tnode *tn)
+static void tnode_free_safe(struct pal_arena *a, struct tnode *tn)
 {
 	BUG_ON(IS_LEAF(tn));
-	pal_free(tn);
+	pal_arena_free(a, tn, tnode_size(tn->bits));
 	//tn->tnode_free = tnode_free_head;
 	//tnode_free_head = tn;
 	//tnode_free_size += sizeof(struct tnode) +
 	//		   (sizeof(struct rt_trie_node *) << tn->bits);
 }
 
-static inline void tnode_free(struct tnode *tn)
+static inline void tnode_free(struct pal_arena *a, struct tnode *tn)
 {
 	if (IS_LEAF(tn))
-		free_leaf((struct leaf *) tn);
+		free_leaf(a, (struct leaf *) tn);
 	else
-		pal_free(tn);
+		pal_arena_free(a, tn, tnode_size(tn->bits));
 }
 
-static void tnode_clean_free(struct tnode *tn)
+static void tnode_clean_free(struct pal_arena *a, struct tnode *tn)
 {
 	int i;
 	struct tnode *tofree;
@@ -279,18 +284,19 @@ static void tnode_clean_free(struct tnode *tn)
 	for (i = 0; i < tnode_child_length(tn); i++) {
 		tofree = (struct tnode *)tn->child[i];
 		if (tofree)
-			tnode_free(tofree);
+			tnode_free(a, tofree);
 	}
-	tnode_free(tn);
+	tnode_free(a, tn);
 }
 
 static struct tnode *inflate(struct rt_trie_node **t, struct tnode *tn)
 {
+	struct pal_arena *a = trie_arena(t);
 	struct tnode *oldtnode = tn;
 	int olen = tnode_child_length(tn);
 	int i;
 
-	tn = tnode_new(oldtnode->node.key, oldtnode->pos, oldtnode->bits + 1);
+	tn = tnode_new(a, oldtnode->node.key, oldtnode->pos, oldtnode->bits + 1);
 
 	if (!tn)
 		return NULL;
@@ -313,16 +319,16 @@ static struct tnode *inflate(struct rt_trie_node **t, struct tnode *tn)
 			struct tnode *left, *right;
 			t_key m = ~0U << (KEYLENGTH - 1) >> inode->pos;
 
-			left = tnode_new(inode->node.key&(~m), inode->pos + 1,
+			left = tnode_new(a, inode->node.key&(~m), inode->pos + 1,
 					 inode->bits - 1);
 			if (!left)
 				goto nomem;
 
-			right = tnode_new(inode->node.key|m, inode->pos + 1,
+			right = tnode_new(a, inode->node.key|m, inode->pos + 1,
 					  inode->bits - 1);
 
 			if (!right) {
-				tnode_free(left);
+				tnode_free(a, left);
 				goto nomem;
 			}
 
@@ -361,7 +367,7 @@ static struct tnode *inflate(struct rt_trie_node **t, struct tnode *tn)
 			put_child(tn, 2*i, inode->child[0]);
 			put_child(tn, 2*i+1, inode->child[1]);
 
-			tnode_free_safe(inode);
+			tnode_free_safe(a, inode);
 			continue;
 		}
 
@@ -406,23 +412,24 @@ static struct tnode *inflate(struct rt_trie_node **t, struct tnode *tn)
 		put_child(tn, 2*i, resize(t, left));
 		put_child(tn, 2*i+1, resize(t, right));
 
-		tnode_free_safe(inode);
+		tnode_free_safe(a, inode);
 	}
-	tnode_free_safe(oldtnode);
+	tnode_free_safe(a, oldtnode);
 	return tn;
 nomem:
-	tnode_clean_free(tn);
+	tnode_clean_free(a, tn);
 	return NULL;
 }
 
 static struct tnode *halve(struct rt_trie_node **t, struct tnode *tn)
 {
+	struct pal_arena *a = trie_arena(t);
 	struct tnode *oldtnode = tn;
 	struct rt_trie_node *left, *right;
 	int i;
 	int olen = tnode_child_length(tn);
 
-	tn = tnode_new(oldtnode->node.key, oldtnode->pos, oldtnode->bits - 1);
+	tn = tnode_new(a, oldtnode->node.key, oldtnode->pos, oldtnode->bits - 1);
 
 	if (!tn)
 		return NULL;
@@ -442,7 +449,7 @@ static struct tnode *halve(struct rt_trie_node **t, struct tnode *tn)
 		if (left && right) {
 			struct tnode *newn;
 
-			newn = tnode_new(left->key, tn->pos + tn->bits, 1);
+			newn = tnode_new(a, left->key, tn->pos + tn->bits, 1);
 
 			if (!newn)
 				goto nomem;
@@ -478,10 +485,10 @@ static struct tnode *halve(struct rt_trie_node **t, struct tnode *tn)
 		put_child(newBinNode, 1, right);
 		put_child(tn, i/2, resize(t, newBinNode));
 	}
-	tnode_free_safe(oldtnode);
+	tnode_free_safe(a, oldtnode);
 	return tn;
 nomem:
-	tnode_clean_free(tn);
+	tnode_clean_free(a, tn);
 	return NULL;
 }
 
@@ -489,6 +496,7 @@ nomem:
 #define MAX_WORK 10
 static struct rt_trie_node *resize(struct rt_trie_node **t, struct tnode *tn)
 {
+	struct pal_arena *a = trie_arena(t);
 	int i;
 	struct tnode *old_tn;
 	int inflate_threshold_use;
@@ -500,7 +508,7 @@ static struct rt_trie_node *resize(struct rt_trie_node **t, struct tnode *tn)
 
 	/* No children */
 	if (tn->empty_children == (unsigned)tnode_child_length(tn)) {
-		tnode_free_safe(tn);
+		tnode_free_safe(a, tn);
 		return NULL;
 	}
 	/* One child */
@@ -635,7 +643,7 @@ one_child:
 			/* compress one level */
 
 			node_set_parent(n, NULL);
-			tnode_free_safe(tn);
+			tnode_free_safe(a, tn);
 			return n;
 		}
 	}
@@ -684,11 +692,13 @@ static struct leaf_info *fib_insert_node(struct rt_trie_node **t, uint32_t key,
 	struct leaf *l;
 	int missbit;
 	struct leaf_info *li, *li_ret = NULL;
+	struct pal_arena *a;
 	t_key cindex;
 
 	if(!t)
 		return NULL;
 	
+	a = trie_arena(t);
 	pos = 0;
 	n = *t;
 
@@ -740,7 +750,7 @@ static struct leaf_info *fib_insert_node(struct rt_trie_node **t, uint32_t key,
 
 	if (n != NULL && IS_LEAF(n) && tkey_equals(key, n->key)) {
 		l = (struct leaf *) n;
-		li = leaf_info_new(plen);
+		li = leaf_info_new(a, plen);
 
 		if (!li)
 			return NULL;
@@ -750,16 +760,16 @@ static struct leaf_info *fib_insert_node(struct rt_trie_node **t, uint32_t key,
 		insert_leaf_info(&l->list, li);
 		goto done;
 	}
-	l = leaf_new();
+	l = leaf_new(a);
 
 	if (!l)
 		return NULL;
 
 	l->node.key = key;
-	li = leaf_info_new(plen);
+	li = leaf_info_new(a, plen);
 
 	if (!li) {
-		free_leaf(l);
+		free_leaf(a, l);
 		return NULL;
 	}
 
@@ -788,15 +798,15 @@ static struct leaf_info *fib_insert_node(struct rt_trie_node **t, uint32_t key,
 
 		if (n) {
 			newpos = tkey_mismatch(key, pos, n->key);
-			tn = tnode_new(n->key, newpos, 1);
+			tn = tnode_new(a, n->key, newpos, 1);
 		} else {
 			newpos = 0;
-			tn = tnode_new(key, newpos, 1); /* First tnode */
+			tn = tnode_new(a, key, newpos, 1); /* First tnode */
 		}
 
 		if (!tn) {
-			free_leaf_info(li);
-			free_leaf(l);
+			free_leaf_info(a, li);
+			free_leaf(a, l);
 			return NULL;
 		}
 
@@ -862,7 +872,7 @@ static inline t_key mask_pfx(t_key k, unsigned int l)
  * @brief Create a new routing table.
  * @return Pointer to the new routing table, or NULL on failure
  */
-struct route_table *pal_rtable_new(void)
+struct route_table *pal_rtable_new(struct pal_arena *arena)
 {
 	struct route_table *rt;
 	rt = pal_slab_alloc(route_table_slab);
@@ -870,6 +880,16 @@ struct route_table *pal_rtable_new(void)
 		rt->trie = NULL;
 		rt->route_entry_count = 0;
 		rt->default_route_flag = 0;
+		rt->arena = arena;
+		rt->own_arena = 0;
+		if(!arena){
+			rt->arena = pal_arena_create("route", route_numa_id);
+			rt->own_arena = 1;
+			if(!rt->arena){
+				pal_slab_free(rt);
+				return NULL;
+			}
+		}
 	}
 	
 	return rt;
@@ -877,8 +897,12 @@ struct route_table *pal_rtable_new(void)
 
 void pal_rtable_destroy(struct route_table *rtable)
 {
-	if(rtable->route_entry_count != 0)
-		PAL_PANIC("route BUG\n");
+	/*the trie of a shared arena goes away with the arena*/
+	if(rtable->own_arena){
+		if(rtable->route_entry_count != 0)
+			PAL_PANIC("route BUG\n");
+		pal_arena_destroy(rtable->arena);
+	}
 
 	pal_slab_free(rtable);
 }
@@ -1269,6 +1293,7 @@ static struct leaf_info *find_leaf_info(struct leaf *l, uint32_t plen,int route_
  */
 static void trie_leaf_remove(struct rt_trie_node **t, struct leaf *l)
 {
+	struct pal_arena *a = trie_arena(t);
 	struct tnode *tp = node_parent((struct rt_trie_node *) l);
 
 	if (tp) {
@@ -1278,11 +1303,11 @@ static void trie_leaf_remove(struct rt_trie_node **t, struct leaf *l)
 	} else
 		*t = NULL;
 
-	free_leaf(l);
+	free_leaf(a, l);
 }
 
-extern  int trie_flush_leaf(struct leaf *l);
-int trie_flush_leaf(struct leaf *l)
+extern  int trie_flush_leaf(struct route_table *t, struct leaf *l);
+int trie_flush_leaf(struct route_table *t, struct leaf *l)
 {
 	int found = 0;
 	struct pal_hlist_head *lih = &l->list;
@@ -1292,7 +1317,7 @@ int trie_flush_leaf(struct leaf *l)
 
 	pal_hlist_for_each_entry_safe(li, node,tmp, lih, hlist) {
 		pal_hlist_del(&li->hlist);
-		free_leaf_info(li);
+		free_leaf_info(t->arena, li);
 		found++;
 	}
 
@@ -1319,7 +1344,7 @@ static int common_route_leaf_info_destroy(struct route_table *t,struct leaf *l,s
 {
 	remove_leaf_info_from_connect(li);
 	remove_leaf_info_from_leaf(li);
-	free_leaf_info(li);
+	free_leaf_info(t->arena, li);
 
 		
 	/*delete leaf if leaf is empty*/
@@ -1333,7 +1358,7 @@ static int common_route_leaf_info_destroy(struct route_table *t,struct leaf *l,s
 static int local_route_leaf_info_destroy(struct route_table *t,struct leaf *l,struct leaf_info *li)
 {
 	remove_leaf_info_from_leaf(li);
-	free_leaf_info(li);
+	free_leaf_info(t->arena, li);
 
 		
 	/*delete leaf if leaf is empty*/
@@ -1371,7 +1396,7 @@ static void delete_connect_leaf_info(struct route_table *t,struct leaf_info *con
 		/*this route entry may valid,so route_add again*/
 		pal_route_add(t,li->prefix,li->plen,li->next_hop);
 		
-		free_leaf_info(li);
+		free_leaf_info(t->arena, li);
 		t->route_entry_count--;		
 
 	}	
@@ -1384,7 +1409,7 @@ static int connect_route_leaf_info_destroy(struct route_table *t,struct leaf *l,
 		trie_leaf_remove(&t->trie, l);
 
 	delete_connect_leaf_info(t,li);	
-	free_leaf_info(li);
+	free_leaf_info(t->arena, li);
 		
 
 	t->route_entry_count--;
@@ -1623,8 +1648,8 @@ int pal_route_del_from_net(void *net,
     t = get_nd_router_table(net);
     return pal_route_del(t, prefix, prefixlen);
 }
-/* Add a static route with nexthop and to_vport.
- * Lock of vport_net will be held. */
+/* Add a static route with nexthop and to_vport, to_vport may be NULL.
+ * Lock of the bucket of to_vport will be held. */
 int route_add_static(struct route_table *t,
                      uint32_t prefix,
                      uint32_t prefixlen,
@@ -1633,23 +1658,26 @@ int route_add_static(struct route_table *t,
     uint32_t err;
 	struct vport *to_vport = NULL;
 	struct vport_net *vpnet = &vport_nets;
+	pal_spinlock_t *lock;
 
+	if (vport_name == NULL) {
+		return _pal_route_add(t, prefix, prefixlen, nexthop, NULL);
+	}
 	if(strlen(vport_name) > VPORT_NAME_MAX) {
 		return -ENXIO;
     }
-    /* TODO: Lock to keep vport existing during route item adding.
-     *       Here all vport and route operations would be locked.
-     *       Lock of every vport maybe more reasonable. */
-    pal_spinlock_lock(&vpnet->hash_lock);
-    if (vport_name != NULL) {
-        to_vport = __find_vport_nolock(vport_name);
-        if (!to_vport) {
-            pal_spinlock_unlock(&vpnet->hash_lock);
-            return -ENXIO;
-        }
+    /* Lock the bucket of the vport to keep it existing during route item
+     * adding. Writers of the route table of a namespace are serialized by
+     * the control plane. */
+    lock = vport_lock(vpnet, vport_name);
+    pal_spinlock_lock(lock);
+    to_vport = __find_vport_nolock(vport_name);
+    if (!to_vport) {
+        pal_spinlock_unlock(lock);
+        return -ENXIO;
     }
     err = _pal_route_add(t, prefix, prefixlen, nexthop, to_vport);
-    pal_spinlock_unlock(&vpnet->hash_lock);
+    pal_spinlock_unlock(lock);
 
     return err;
 }
@@ -1793,27 +1821,51 @@ void pal_trie_traverse(struct route_table *rtable,struct route_entry_table *reb)
 	traverse_trie(rtable->trie,reb,dump_route_entry);
 }
 
+struct route_walk_arg {
+	void (*f)(const struct route_entry *, void *);
+	void *arg;
+};
+
+static void walk_route_entry(const struct rt_trie_node *n, __unused int level, void *arg)
+{
+	const struct leaf *l;
+	const struct pal_hlist_node *hnode;
+	const struct leaf_info *li;
+	struct route_walk_arg *w = arg;
+	struct route_entry e;
+
+	if (!IS_LEAF(n))
+		return;
+
+	l = (const struct leaf *)n;
+	pal_hlist_for_each_entry_constant (li, hnode, &l->list, hlist) {
+		e.prefix = li->prefix;
+		e.prefixlen = li->plen;
+		e.next_hop = li->next_hop;
+		e.route_type = li->type;
+		e.dev = li->port_dev;
+		w->f(&e, w->arg);
+	}
+}
+
+void pal_route_walk(struct route_table *rtable,
+			void (*f)(const struct route_entry *, void *), void *arg)
+{
+	struct route_walk_arg w = {f, arg};
+
+	traverse_trie(rtable->trie, &w, walk_route_entry);
+}
+
 void route_slab_init(int numa_id)
 {
-	route_table_slab = pal_slab_create("route_table", ROUTE_TABLE_SLAB_SIZE, 
+	route_table_slab = pal_slab_create_multipc("route_table", ROUTE_TABLE_SLAB_SIZE, 
 		 sizeof(struct route_table), numa_id, 0);
 	 
 	 if (!route_table_slab) {
 		 PAL_PANIC("create route_table slab failed\n");
 	 }
 
-	leaf_info_slab = pal_slab_create("leaf_info", LEAF_INFO_SLAB_SIZE, 
-		 sizeof(struct leaf_info), numa_id, 0);
-	 
-	 if (!leaf_info_slab) {
-		 PAL_PANIC("create leaf info slab failed\n");
-	 }
-
-	leaf_slab = pal_slab_create("leaf", LEAF_SLAB_SIZE, 
-		 max(sizeof(struct leaf), sizeof(struct leaf_info)), numa_id, 0);
-	 
-	 if (!leaf_slab) {
-		 PAL_PANIC("create leaf slab failed\n");
-	 }
+	/*leaves and tnodes come from the arena of each table*/
+	route_numa_id = numa_id;
 }
 
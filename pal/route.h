@@ -7,11 +7,10 @@
 #include "pal_list.h"
 #include "pal_vport.h"
 #include "pal_vxlan.h"
+#include "pal_arena.h"
 
 
 #define ROUTE_TABLE_SLAB_SIZE 1024*10
-#define LEAF_INFO_SLAB_SIZE 1024*10*5
-#define LEAF_SLAB_SIZE 10240*5
 
 #define LOCAL_TYPE_PRELEN 32
 
@@ -89,11 +88,14 @@ struct leaf_info {
 
 /*
  * Routing table, pointer to the root of a trie tree;
+ * the nodes and leaves are allocated from the arena of the table.
  */
 struct route_table {
 	struct rt_trie_node *trie;  /* points to the root of a tree */	
 	int default_route_flag;
 	int route_entry_count;
+	struct pal_arena *arena;
+	int own_arena;		/* arena created with the table */
 };
 
 /*
@@ -0,0 +1,178 @@
+#include <string.h>
+#include <stdint.h>
+#include "skb.h"
+#include "utils.h"
+#include "pal_csum.h"
+
+/*
+ * @brief Move len bytes from the following segments to the tail of the
+ *        first one. Segments drained empty are freed.
+ * @return 1 on success, 0 if the first segment has not enough tailroom
+ * @note Caller must make sure the packet is long enough.
+ */
+int __pskb_pull_tail(struct sk_buff *skb, unsigned int len)
+{
+	struct rte_mbuf *head = &skb->mbuf;
+	struct rte_mbuf *seg, *next;
+	uint8_t *tail;
+	unsigned int n;
+
+	if (unlikely(rte_pktmbuf_tailroom(head) < len))
+		return 0;
+
+	tail = (uint8_t *)head->pkt.data + head->pkt.data_len;
+	seg = head->pkt.next;
+	while (len > 0 && seg != NULL) {
+		n = min(len, (unsigned int)seg->pkt.data_len);
+		memcpy(tail, seg->pkt.data, n);
+		tail += n;
+		len -= n;
+		head->pkt.data_len += n;
+
+		seg->pkt.data = (char *)seg->pkt.data + n;
+		seg->pkt.data_len -= n;
+		next = seg->pkt.next;
+		if (seg->pkt.data_len == 0) {
+			head->pkt.next = next;
+			head->pkt.nb_segs--;
+			seg->pkt.next = NULL;
+			rte_pktmbuf_free_seg(seg);
+		}
+		seg = next;
+	}
+
+	return len == 0;
+}
+
+/*
+ * @brief Cut a chained packet to len bytes and free the segments beyond it.
+ * @note Caller must make sure len is smaller than the packet length.
+ */
+int __pskb_trim(struct sk_buff *skb, unsigned int len)
+{
+	struct rte_mbuf *head = &skb->mbuf;
+	struct rte_mbuf *seg = head;
+	struct rte_mbuf *next;
+	unsigned int off = 0;
+
+	while (off + seg->pkt.data_len < len) {
+		off += seg->pkt.data_len;
+		seg = seg->pkt.next;
+	}
+
+	seg->pkt.data_len = len - off;
+	head->pkt.pkt_len = len;
+
+	next = seg->pkt.next;
+	seg->pkt.next = NULL;
+	while (next != NULL) {
+		seg = next;
+		next = seg->pkt.next;
+		seg->pkt.next = NULL;
+		head->pkt.nb_segs--;
+		rte_pktmbuf_free_seg(seg);
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Copy len bytes starting at offset from the data pointer to a flat
+ *        buffer, walking through the segments of the packet.
+ * @note Caller must make sure the packet is long enough.
+ */
+void skb_copy_bits(const struct sk_buff *skb, unsigned int offset,
+			void *to, unsigned int len)
+{
+	const struct rte_mbuf *seg = &skb->mbuf;
+	uint8_t *p = (uint8_t *)to;
+	unsigned int n;
+
+	while (seg != NULL && offset >= seg->pkt.data_len) {
+		offset -= seg->pkt.data_len;
+		seg = seg->pkt.next;
+	}
+
+	while (seg != NULL && len > 0) {
+		n = min(len, seg->pkt.data_len - offset);
+		memcpy(p, (const uint8_t *)seg->pkt.data + offset, n);
+		p += n;
+		len -= n;
+		offset = 0;
+		seg = seg->pkt.next;
+	}
+}
+
+/*
+ * @brief Fill skb2, the first segment of a clone of size bytes of skb, and
+ *        chain segments from slab for the data past its room. skb2 has its
+ *        data pointer and pkt_len set.
+ * @return 0 on success, -1 if slab ran out, the segments chained so far
+ *         are then freed with skb2
+ */
+int __skb_clone_tail(const struct sk_buff *skb, struct sk_buff *skb2,
+			struct pal_slab *slab, unsigned int size)
+{
+	struct rte_mbuf *last = &skb2->mbuf, *seg;
+	struct sk_buff *skb3;
+	unsigned int off, n;
+
+	n = (char *)last->buf_addr + last->buf_len - (char *)last->pkt.data;
+	last->pkt.data_len = n;
+	skb_copy_bits(skb, 0, last->pkt.data, n);
+
+	for (off = n; off < size; off += n) {
+		skb3 = pal_skb_alloc(slab);
+		if (skb3 == NULL)
+			return -1;
+		seg = &skb3->mbuf;
+		/* no headroom needed past the first segment */
+		seg->pkt.data = seg->buf_addr;
+		n = min(size - off, (unsigned int)seg->buf_len);
+		seg->pkt.data_len = n;
+		seg->pkt.pkt_len = n;
+		skb_copy_bits(skb, off, seg->pkt.data, n);
+
+		last->pkt.next = seg;
+		last = seg;
+		skb2->mbuf.pkt.nb_segs++;
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Calculate the partial checksum of len bytes starting at offset from
+ *        the data pointer, walking through the segments of the packet.
+ * @param sum Partial checksum to add to
+ * @return The partial checksum, not folded and not inverted
+ */
+uint32_t skb_checksum(const struct sk_buff *skb, unsigned int offset,
+			unsigned int len, uint32_t sum)
+{
+	const struct rte_mbuf *seg = &skb->mbuf;
+	unsigned int n, odd = 0;
+	uint32_t block;
+
+	while (seg != NULL && offset >= seg->pkt.data_len) {
+		offset -= seg->pkt.data_len;
+		seg = seg->pkt.next;
+	}
+
+	while (seg != NULL && len > 0) {
+		n = min(len, seg->pkt.data_len - offset);
+		block = pal_csum_reduce16(pal_csum_partial(
+				(const uint8_t *)seg->pkt.data + offset, n, 0));
+		/* a block starting at an odd position has its bytes swapped */
+		if (odd)
+			block = ((block & 0xff) << 8) | (block >> 8);
+		sum = pal_csum_add(sum, block);
+
+		odd ^= n & 1;
+		len -= n;
+		offset = 0;
+		seg = seg->pkt.next;
+	}
+
+	return sum;
+}
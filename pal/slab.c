@@ -0,0 +1,266 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <rte_atomic.h>
+#include <rte_common.h>
+
+#include "pal_slab.h"
+#include "pal_malloc.h"
+#include "pal_thread.h"
+
+/* all the slabs, for the stats and the pending grows */
+static PAL_LIST_HEAD(slab_list);
+static pal_spinlock_t slab_list_lock = PAL_SPINLOCK_INITIALIZER;
+
+/* slabs grown per pass of pal_slab_grow_pending(), the others wait */
+#define SLAB_GROW_BATCH		16
+/* set while a thread adds chunks, the chunks are built without a lock */
+static rte_atomic32_t slab_growing = RTE_ATOMIC32_INIT(0);
+
+static inline unsigned slab_obj_size(const struct pal_slab *slab)
+{
+	/* the chunk of an element is stored before it */
+	return slab->elem_size + sizeof(struct rte_mempool *);
+}
+
+/*
+ * @brief Add a chunk of at least min_cnt elements. Only one thread adds chunks
+ *        to a slab, at its creation then with slab_growing set
+ * @return 0 on success, -1 if the slab is at its limit or out of memory
+ */
+static int slab_add_chunk(struct pal_slab *slab, unsigned min_cnt)
+{
+	char name[RTE_MEMPOOL_NAMESIZE];
+	struct rte_mempool *mp;
+	unsigned i = slab->n_chunk, cnt;
+
+	if (i == PAL_SLAB_MAX_CHUNKS || slab->capacity >= slab->limit)
+		return -1;
+
+	if (i == 0) {
+		cnt = PAL_SLAB_FIRST_CHUNK_SIZE / slab_obj_size(slab);
+		if (cnt < PAL_SLAB_FIRST_CHUNK_MIN)
+			cnt = PAL_SLAB_FIRST_CHUNK_MIN;
+	} else {
+		cnt = slab->chunk[i - 1]->size * 2;
+	}
+	if (cnt < min_cnt)
+		cnt = min_cnt;
+	/* the last chunk takes what is left up to the limit */
+	if (i == PAL_SLAB_MAX_CHUNKS - 1 || cnt > slab->limit - slab->capacity)
+		cnt = slab->limit - slab->capacity;
+	if (cnt < min_cnt)
+		return -1;
+
+	/* the first chunk keeps the name of the slab, the length of the
+	   others is checked at creation */
+	if (i == 0)
+		snprintf(name, sizeof(name), "%s", slab->name);
+	else
+		snprintf(name, sizeof(name), "%s.%u", slab->name, i);
+
+	mp = rte_mempool_create(name, cnt, slab_obj_size(slab),
+	                        0, 0, NULL, NULL, NULL, NULL,
+	                        slab->numa, slab->mp_flags);
+	if (mp == NULL) {
+		/* logged once, the watermark asks again on each alloc */
+		if (__sync_fetch_and_add(&slab->grow_fail, 1) == 0)
+			PAL_ERROR("slab %s: no memory for a chunk of %u elements\n",
+			          slab->name, cnt);
+		return -1;
+	}
+
+	/* the chunk is published under the list lock, for pal_slab_walk() */
+	pal_spinlock_lock(&slab_list_lock);
+	slab->chunk[i] = mp;
+	slab->capacity += cnt;
+	/* allocs see the chunk before they may pick it */
+	rte_wmb();
+	slab->n_chunk = i + 1;
+	pal_spinlock_unlock(&slab_list_lock);
+	return 0;
+}
+
+/* the last chunk is still over the watermark, the flag may be stale */
+static int slab_over_watermark(const struct pal_slab *slab)
+{
+	const struct rte_mempool *mp = slab->chunk[slab->n_chunk - 1];
+
+	return rte_mempool_count(mp) < (mp->size >> 3) * (8 - PAL_SLAB_HIGH_WATERMARK);
+}
+
+struct pal_slab *__pal_slab_create(const char *name, unsigned elem_cnt,
+               unsigned elem_size, int numa, unsigned mp_flags)
+{
+	struct pal_slab *slab;
+	int len;
+
+	if (elem_cnt == 0)
+		return NULL;
+	if (strlen(name) >= RTE_MEMPOOL_NAMESIZE) {
+		PAL_ERROR("slab %s: name longer than %d\n", name, RTE_MEMPOOL_NAMESIZE - 1);
+		return NULL;
+	}
+
+	slab = pal_zalloc_numa(sizeof(*slab), numa);
+	if (slab == NULL)
+		return NULL;
+
+	snprintf(slab->name, sizeof(slab->name), "%s", name);
+	slab->elem_size = elem_size;
+	slab->limit = elem_cnt;
+	slab->numa = numa;
+	slab->mp_flags = mp_flags;
+
+	if (slab_add_chunk(slab, 0) < 0) {
+		pal_free(slab);
+		return NULL;
+	}
+
+	/* no room for the index in the names of the other chunks */
+	len = snprintf(NULL, 0, "%s.%u", name, PAL_SLAB_MAX_CHUNKS - 1);
+	if (len >= RTE_MEMPOOL_NAMESIZE && slab->capacity < slab->limit) {
+		PAL_ERROR("slab %s: name too long for more chunks, "
+		          "limited to %u elements\n", name, slab->capacity);
+		slab->limit = slab->capacity;
+	}
+
+	pal_spinlock_lock(&slab_list_lock);
+	pal_list_add_tail(&slab->list, &slab_list);
+	pal_spinlock_unlock(&slab_list_lock);
+
+	return slab;
+}
+
+/*
+ * @brief Test whether this thread is a receiver or a worker. The threads
+ *        pal did not start have no thread conf
+ */
+static inline int slab_on_data_path(void)
+{
+	struct thread_conf *thconf = pal_cur_thread_conf();
+
+	return thconf != NULL && (thconf->mode == PAL_THREAD_RECEIVER ||
+	                          thconf->mode == PAL_THREAD_WORKER);
+}
+
+/*
+ * @brief Add a chunk of at least min_cnt elements unless one was added since
+ *        the caller saw n_chunk. Waits for pal_slab_grow_pending() if it runs
+ * @return 0 if there is a new chunk to look at, -1 otherwise
+ */
+static int slab_grow(struct pal_slab *slab, unsigned n_chunk, unsigned min_cnt)
+{
+	int ret = 0;
+
+	while (!rte_atomic32_test_and_set(&slab_growing))
+		rte_pause();
+	if (slab->n_chunk == n_chunk)
+		ret = slab_add_chunk(slab, min_cnt);
+	rte_atomic32_clear(&slab_growing);
+
+	return ret;
+}
+
+int __pal_slab_alloc_bulk(struct pal_slab *slab, void **obj_table, unsigned n)
+{
+	unsigned c, n_chunk;
+
+	for (;;) {
+		n_chunk = slab->n_chunk;
+		rte_rmb();
+
+		for (c = 0; c < n_chunk; c++) {
+			if (rte_mempool_get_bulk(slab->chunk[c], obj_table, n) == 0) {
+				slab->hint = c;
+				return c;
+			}
+		}
+
+		if (slab->capacity >= slab->limit)
+			break;
+
+		/* every chunk is short of n elements. a data path thread does
+		   not create the chunk, it asks pal_slab_grow_pending() for it */
+		if (slab_on_data_path()) {
+			if (slab->grow_min < n)
+				slab->grow_min = n;
+			break;
+		}
+		if (slab_grow(slab, n_chunk, n) < 0)
+			break;
+	}
+
+	__sync_fetch_and_add(&slab->alloc_fail, 1);
+	return -1;
+}
+
+void pal_slab_grow_pending(void)
+{
+	struct pal_slab *slab, *todo[SLAB_GROW_BATCH];
+	unsigned i, n = 0, min_cnt;
+
+	if (!rte_atomic32_test_and_set(&slab_growing))
+		return;
+
+	pal_spinlock_lock(&slab_list_lock);
+	pal_list_for_each_entry(slab, &slab_list, list) {
+		if (!slab->grow_wanted && !slab->grow_min)
+			continue;
+		todo[n++] = slab;
+		if (n == SLAB_GROW_BATCH)
+			break;
+	}
+	pal_spinlock_unlock(&slab_list_lock);
+
+	/* the memory zones are reserved without the list lock, which the
+	   stats take */
+	for (i = 0; i < n; i++) {
+		slab = todo[i];
+		min_cnt = slab->grow_min;
+		slab->grow_min = 0;
+		slab->grow_wanted = 0;
+		if (min_cnt || slab_over_watermark(slab))
+			slab_add_chunk(slab, min_cnt);
+	}
+
+	rte_atomic32_clear(&slab_growing);
+}
+
+void pal_slab_get_stats(struct pal_slab *slab, struct pal_slab_stats *stats)
+{
+	struct rte_mempool *mp;
+	unsigned c, n_chunk, free = 0;
+
+	memset(stats, 0, sizeof(*stats));
+
+	n_chunk = slab->n_chunk;
+	rte_rmb();
+	for (c = 0; c < n_chunk; c++) {
+		mp = slab->chunk[c];
+		stats->capacity += mp->size;
+		stats->bytes += (uint64_t)mp->size *
+		        (mp->header_size + mp->elt_size + mp->trailer_size);
+		free += rte_mempool_count(mp);
+	}
+
+	stats->chunks = n_chunk;
+	/* the counts are read while the slab is in use */
+	stats->in_use = stats->capacity > free ? stats->capacity - free : 0;
+	stats->limit = slab->limit;
+	stats->elem_size = slab->elem_size;
+	stats->alloc_fail = slab->alloc_fail;
+	stats->grow_fail = slab->grow_fail;
+}
+
+void pal_slab_walk(void (*fn)(struct pal_slab *slab, void *arg), void *arg)
+{
+	struct pal_slab *slab;
+
+	pal_spinlock_lock(&slab_list_lock);
+	pal_list_for_each_entry(slab, &slab_list, list) {
+		fn(slab, arg);
+	}
+	pal_spinlock_unlock(&slab_list_lock);
+}
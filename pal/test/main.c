@@ -25,6 +25,9 @@
 #include "pal_timer.h"
 #include "pal_jiffies.h"
 #include "pal_vnic.h"
+#include "pal_cuckoo.h"
+#include "bvr_netfilter.h"
+#include "bvr_classifier.h"
 
 extern int pal_start(void);
 
@@ -285,6 +288,424 @@ static void __unused slab_test(void)
 	PAL_PANIC("slab test passed\n");
 }
 
+struct cuckoo_test_key {
+	uint32_t id;
+	uint32_t salt;
+};
+
+static void cuckoo_test_key_init(struct cuckoo_test_key *key, uint32_t id)
+{
+	key->id = id;
+	key->salt = id * 2654435761u;
+}
+
+/* every key of [0, n) is found with data id + 1 + gen, the bulk lookup agrees */
+static void cuckoo_test_check(const struct pal_cuckoo *h, uint32_t n, uint32_t gen)
+{
+	struct cuckoo_test_key keys[PAL_CUCKOO_BULK_MAX];
+	const void *kp[PAL_CUCKOO_BULK_MAX];
+	void *data[PAL_CUCKOO_BULK_MAX];
+	uint64_t hits;
+	uint32_t i, j, cnt;
+
+	for (i = 0; i < n; i += cnt) {
+		cnt = min(n - i, (uint32_t)PAL_CUCKOO_BULK_MAX);
+		for (j = 0; j < cnt; j++) {
+			cuckoo_test_key_init(&keys[j], i + j);
+			kp[j] = &keys[j];
+			if (pal_cuckoo_lookup(h, &keys[j]) !=
+					(void *)(uintptr_t)(i + j + 1 + gen))
+				PAL_PANIC("cuckoo key %u lost\n", i + j);
+		}
+		hits = pal_cuckoo_lookup_bulk(h, kp, cnt, data);
+		if (hits != (cnt == 64 ? ~0ULL : (1ULL << cnt) - 1))
+			PAL_PANIC("cuckoo bulk lookup missed keys at %u\n", i);
+		for (j = 0; j < cnt; j++) {
+			if (data[j] != (void *)(uintptr_t)(i + j + 1 + gen))
+				PAL_PANIC("cuckoo bulk lookup of key %u is wrong\n", i + j);
+		}
+	}
+}
+
+/*
+ * Fill a table to its capacity, at nearly the highest load the bucket
+ * sizing allows so that adds displace keys, and check that every key stays
+ * findable through replaces, deletes and iteration.
+ */
+static void __unused cuckoo_test(void)
+{
+	const uint32_t entries = 6500;
+	struct cuckoo_test_key key;
+	struct pal_cuckoo *h;
+	const void *kp;
+	void *data;
+	uint8_t *seen;
+	uint32_t i, next, n;
+
+	h = pal_cuckoo_create("cuckoo test", entries, sizeof(key), 0);
+	seen = pal_zalloc_numa(entries, 0);
+	if (h == NULL || seen == NULL)
+		PAL_PANIC("cuckoo test create failed\n");
+
+	for (i = 0; i < entries; i++) {
+		cuckoo_test_key_init(&key, i);
+		if (pal_cuckoo_add(h, &key, (void *)(uintptr_t)(i + 1)) < 0)
+			PAL_PANIC("cuckoo add of key %u failed, %u keys moved\n",
+			          i, (unsigned)h->moves);
+	}
+	if (pal_cuckoo_count(h) != entries || h->moves == 0)
+		PAL_PANIC("cuckoo count %u, %u keys moved\n",
+		          pal_cuckoo_count(h), (unsigned)h->moves);
+	cuckoo_test_check(h, entries, 0);
+
+	/* full: a new key fails, an existing one is still replaced */
+	cuckoo_test_key_init(&key, entries);
+	if (pal_cuckoo_add(h, &key, (void *)1) != -ENOSPC || h->add_fail != 1)
+		PAL_PANIC("cuckoo add to a full table did not fail\n");
+	if (pal_cuckoo_lookup(h, &key) != NULL)
+		PAL_PANIC("cuckoo key of a failed add found\n");
+	for (i = 0; i < entries; i++) {
+		cuckoo_test_key_init(&key, i);
+		if (pal_cuckoo_add(h, &key, (void *)(uintptr_t)(i + 2)) < 0)
+			PAL_PANIC("cuckoo replace of key %u failed\n", i);
+	}
+	if (pal_cuckoo_count(h) != entries)
+		PAL_PANIC("cuckoo replace changed the count\n");
+	cuckoo_test_check(h, entries, 1);
+
+	/* delete the odd keys, then add them back into the freed slots */
+	for (i = 1; i < entries; i += 2) {
+		cuckoo_test_key_init(&key, i);
+		if (pal_cuckoo_del(h, &key) < 0)
+			PAL_PANIC("cuckoo del of key %u failed\n", i);
+		if (pal_cuckoo_del(h, &key) != -ENOENT)
+			PAL_PANIC("cuckoo key %u deleted twice\n", i);
+	}
+	for (i = 0; i < entries; i++) {
+		cuckoo_test_key_init(&key, i);
+		data = pal_cuckoo_lookup(h, &key);
+		if ((i & 1) ? data != NULL : data != (void *)(uintptr_t)(i + 2))
+			PAL_PANIC("cuckoo key %u wrong after deletes\n", i);
+	}
+	for (i = 1; i < entries; i += 2) {
+		cuckoo_test_key_init(&key, i);
+		if (pal_cuckoo_add(h, &key, (void *)(uintptr_t)(i + 2)) < 0)
+			PAL_PANIC("cuckoo add back of key %u failed\n", i);
+	}
+	cuckoo_test_check(h, entries, 1);
+
+	/* the walk returns each key once, with its data */
+	next = 0;
+	n = 0;
+	while (pal_cuckoo_iterate(h, &next, &kp, &data)) {
+		memcpy(&key, kp, sizeof(key));
+		if (key.id >= entries || seen[key.id]++ ||
+				data != (void *)(uintptr_t)(key.id + 2))
+			PAL_PANIC("cuckoo walk returned key %u wrongly\n", key.id);
+		n++;
+	}
+	if (n != entries)
+		PAL_PANIC("cuckoo walk returned %u of %u keys\n", n, entries);
+
+	PAL_LOG("cuckoo test passed, %u keys moved\n", (unsigned)h->moves);
+	pal_free(seen);
+	pal_cuckoo_destroy(h);
+}
+
+#define CLS_TEST_BUCKETS	1024
+
+/* the rules of one hook, linked as ipt_filter_add_rule() does */
+static struct filter_rule_table cls_test_table;
+
+static uint32_t cls_test_prefix(int plen)
+{
+	return plen ? pal_htonl(~0u << (32 - plen)) : 0;
+}
+
+/* an address of a few overlapping subnets */
+static uint32_t cls_test_addr(void)
+{
+	static const uint32_t base[] = {0x0a000000, 0x0a000100, 0x0a010000, 0xc0a80000};
+
+	return pal_htonl(base[rand() % 4] | (rand() & 0x1ff));
+}
+
+static void cls_test_port(uint16_t *range)
+{
+	range[0] = rand() % 64;
+	range[1] = range[0] + rand() % 32;
+	/* an empty range never matches */
+	if (range[0] && rand() % 16 == 0)
+		range[1] = range[0] - 1;
+}
+
+static void cls_test_add(uint32_t priority)
+{
+	static const uint8_t protos[] = {IPPROTO_TCP, IPPROTO_UDP, IPPROTO_ICMP};
+	static const int plens[] = {0, 8, 16, 23, 24, 32};
+	struct filter_rule_table *table = &cls_test_table;
+	struct ipt_filter_entry *entry;
+	struct ipt_flow_mask *mask;
+	uint16_t range[2];
+	uint32_t key;
+
+	entry = pal_malloc(sizeof(*entry));
+	if (entry == NULL)
+		PAL_PANIC("classifier test alloc failed\n");
+	memset(entry, 0, sizeof(*entry));
+
+	entry->priority = priority;
+	entry->mask_value.sip = cls_test_prefix(plens[rand() % 6]);
+	entry->mask_value.dip = cls_test_prefix(plens[rand() % 6]);
+	entry->key.sip = cls_test_addr() & entry->mask_value.sip;
+	entry->key.dip = cls_test_addr() & entry->mask_value.dip;
+	if (rand() % 4) {
+		entry->mask_value.proto = 0xff;
+		entry->key.proto = protos[rand() % 3];
+	} else if (rand() % 8 == 0) {
+		/* a proto without its mask never matches */
+		entry->key.proto = IPPROTO_TCP;
+	}
+	if (rand() % 2) {
+		entry->mask_value.sport = 1;
+		cls_test_port(range);
+		memcpy(entry->key.sport, range, sizeof(range));
+	}
+	if (rand() % 2) {
+		entry->mask_value.dport = 1;
+		cls_test_port(range);
+		memcpy(entry->key.dport, range, sizeof(range));
+	}
+
+	pal_list_for_each_entry(mask, &table->mask_list, list) {
+		if (memcmp(&mask->mask, &entry->mask_value, sizeof(mask->mask)) == 0)
+			break;
+	}
+	if (&mask->list == &table->mask_list) {
+		mask = pal_malloc(sizeof(*mask));
+		if (mask == NULL)
+			PAL_PANIC("classifier test alloc failed\n");
+		mask->mask = entry->mask_value;
+		mask->ref_cnt = 0;
+		pal_list_add(&mask->list, &table->mask_list);
+	}
+	mask->ref_cnt++;
+	entry->mask = mask;
+
+	key = nn_filter_rule_hash(entry->key.sip, entry->key.dip, entry->key.proto) &
+	      table->rule_mask;
+	pal_hlist_add_head(&entry->hlist, &table->filter_hmap[key]);
+	table->rule_num++;
+}
+
+static void cls_test_flush(void)
+{
+	struct filter_rule_table *table = &cls_test_table;
+	struct ipt_flow_mask *mask, *next;
+	struct ipt_filter_entry *entry;
+	struct pal_hlist_node *pos, *n;
+	uint32_t i;
+
+	for (i = 0; i < filter_hmap_size(table); i++) {
+		pal_hlist_for_each_entry_safe(entry, pos, n, &table->filter_hmap[i], hlist) {
+			pal_hlist_del(&entry->hlist);
+			pal_free(entry);
+		}
+	}
+	pal_list_for_each_entry_safe(mask, next, &table->mask_list, list) {
+		pal_list_del(&mask->list);
+		pal_free(mask);
+	}
+	table->rule_num = 0;
+}
+
+/* the search mask by mask of __ipt_filter_search() */
+static struct ipt_filter_entry *cls_test_mask_search(uint8_t protocol, uint32_t sip,
+		uint32_t dip, uint16_t sport, uint16_t dport)
+{
+	struct filter_rule_table *table = &cls_test_table;
+	struct ipt_filter_entry *tmp, *result = NULL;
+	struct ipt_flow_mask *mask;
+	struct pal_hlist_node *pos;
+	uint32_t key;
+	uint8_t proto;
+
+	pal_list_for_each_entry(mask, &table->mask_list, list) {
+		proto = mask->mask.proto ? protocol : 0;
+		key = nn_filter_rule_hash(sip & mask->mask.sip, dip & mask->mask.dip,
+		                          proto) & table->rule_mask;
+		pal_hlist_for_each_entry(tmp, pos, &table->filter_hmap[key], hlist) {
+			if (tmp->mask != mask || (sip & mask->mask.sip) != tmp->key.sip ||
+					(dip & mask->mask.dip) != tmp->key.dip ||
+					proto != tmp->key.proto)
+				continue;
+			if (mask->mask.sport && (ntohs(sport) < tmp->key.sport[0] ||
+					ntohs(sport) > tmp->key.sport[1]))
+				continue;
+			if (mask->mask.dport && (ntohs(dport) < tmp->key.dport[0] ||
+					ntohs(dport) > tmp->key.dport[1]))
+				continue;
+			if (result == NULL || result->priority > tmp->priority)
+				result = tmp;
+		}
+	}
+
+	return result;
+}
+
+/* compile the rules, the classifier must pick the rule the mask search picks */
+static uint32_t cls_test_check(int compiled)
+{
+	static const uint8_t protos[] = {IPPROTO_TCP, IPPROTO_UDP, IPPROTO_ICMP,
+	                                 IPPROTO_GRE};
+	struct ipt_filter_cls *cls;
+	struct ipt_filter_entry *expect;
+	uint32_t i, sip, dip, hits = 0;
+	uint16_t sport, dport;
+	uint8_t proto;
+
+	cls = ipt_filter_cls_build(&cls_test_table);
+	if ((cls != NULL) != compiled)
+		PAL_PANIC("classifier of %u rules %scompiled\n", cls_test_table.rule_num,
+		          compiled ? "not " : "");
+	if (cls == NULL)
+		return 0;
+
+	for (i = 0; i < 4096; i++) {
+		proto = protos[rand() % 4];
+		sip = cls_test_addr();
+		dip = cls_test_addr();
+		sport = pal_htons(rand() % 96);
+		dport = pal_htons(rand() % 96);
+		expect = cls_test_mask_search(proto, sip, dip, sport, dport);
+		if (ipt_filter_cls_search(cls, proto, sip, dip, sport, dport) != expect)
+			PAL_PANIC("classifier of %u rules disagrees with the mask search\n",
+			          cls_test_table.rule_num);
+		hits += expect != NULL;
+	}
+
+	ipt_filter_cls_free(cls);
+	return hits;
+}
+
+/*
+ * Random rule sets of overlapping subnets, port ranges, protos and tied
+ * priorities: the compiled classifier returns the rule of the mask search,
+ * and a hook of more than IPT_CLS_MAX_RULES rules is left to the mask search.
+ */
+static void __unused classifier_test(void)
+{
+	struct filter_rule_table *table = &cls_test_table;
+	uint32_t round, n, i, hits = 0;
+
+	PAL_INIT_LIST_HEAD(&table->mask_list);
+	table->filter_hmap = pal_malloc(CLS_TEST_BUCKETS * sizeof(*table->filter_hmap));
+	if (table->filter_hmap == NULL)
+		PAL_PANIC("classifier test alloc failed\n");
+	for (i = 0; i < CLS_TEST_BUCKETS; i++)
+		PAL_INIT_HLIST_HEAD(&table->filter_hmap[i]);
+	table->rule_mask = CLS_TEST_BUCKETS - 1;
+
+	for (round = 0; round < 64; round++) {
+		n = round ? 1 + rand() % 512 : IPT_CLS_MAX_RULES;
+		for (i = 0; i < n; i++)
+			cls_test_add(rand() % 16);
+		hits += cls_test_check(1);
+		if (round == 0) {
+			cls_test_add(rand() % 16);
+			cls_test_check(0);
+		}
+		cls_test_flush();
+	}
+
+	PAL_LOG("classifier test passed, %u of %u packets matched\n",
+	        hits, round * 4096);
+	pal_free(table->filter_hmap);
+	table->filter_hmap = NULL;
+}
+
+/*
+ * The sse2 and avx2 routines give the sums of the scalar one for every
+ * length up to a few hundred bytes and from every misaligned start, and
+ * so do the burst helpers.
+ */
+static void __unused csum_test(void)
+{
+	static const char *const impls[] = {"scalar", "sse2", "avx2"};
+	const unsigned size = 4096;
+	const void *bufs[64];
+	uint16_t lens[64];
+	uint32_t sums[64], ref, seed;
+	uint16_t check;
+	uint8_t *buf, *hdr;
+	uint64_t ok, expect;
+	unsigned i, j, off, len, n = 0;
+
+	buf = pal_malloc(size + 64);
+	hdr = pal_malloc(64 * 128);
+	if (buf == NULL || hdr == NULL)
+		PAL_PANIC("csum test alloc failed\n");
+	for (i = 0; i < size + 64; i++)
+		buf[i] = rand();
+
+	for (off = 0; off < 32; off++) {
+		for (len = 0; len <= size; len += len < 512 ? 1 : 37) {
+			seed = len & 1 ? 0 : 0xffff1234;
+			pal_csum_use("scalar");
+			ref = pal_csum_partial(buf + off, len, seed);
+			for (i = 1; i < sizeof(impls) / sizeof(impls[0]); i++) {
+				if (pal_csum_use(impls[i]) < 0)
+					continue;
+				if (pal_csum_partial(buf + off, len, seed) != ref)
+					PAL_PANIC("%s csum of %u bytes at offset %u is wrong\n",
+					          impls[i], len, off);
+				n++;
+			}
+		}
+	}
+
+	for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		if (pal_csum_use(impls[i]) < 0)
+			continue;
+
+		/* odd lengths from misaligned starts */
+		for (j = 0; j < 64; j++) {
+			bufs[j] = buf + rand() % 64;
+			lens[j] = (rand() % size) | 1;
+		}
+		pal_csum_partial_burst(bufs, lens, sums, 64);
+		for (j = 0; j < 64; j++) {
+			if (sums[j] != pal_csum_partial(bufs[j], lens[j], 0))
+				PAL_PANIC("%s burst csum %u is wrong\n", impls[i], j);
+		}
+
+		/* headers carrying their checksum, every third one corrupted */
+		expect = 0;
+		for (j = 0; j < 64; j++) {
+			memcpy(hdr + j * 128, buf + j * 61, 64);
+			bufs[j] = hdr + j * 128 + (j & 7);
+			lens[j] = 20 + 2 * (j % 20);
+			memset((uint8_t *)bufs[j] + 10, 0, 2);
+			check = pal_csum_fold(pal_csum_partial(bufs[j], lens[j], 0));
+			memcpy((uint8_t *)bufs[j] + 10, &check, 2);
+			if (j % 3 == 0)
+				((uint8_t *)bufs[j])[lens[j] - 1] ^= 0x40;
+			else
+				expect |= 1ULL << j;
+		}
+		ok = pal_csum_ok_burst(bufs, lens, 64);
+		if (ok != expect)
+			PAL_PANIC("%s burst check gave %llx instead of %llx\n", impls[i],
+			          (unsigned long long)ok, (unsigned long long)expect);
+	}
+
+	/* back to the routine pal_init() picked */
+	pal_csum_init();
+	PAL_LOG("csum test passed, %u sums compared, using %s\n", n, pal_csum_impl());
+	pal_free(hdr);
+	pal_free(buf);
+}
+
 static int multi_thread_malloc_test(__unused void *arg)
 {
 	const int size = 8 * 1024;
@@ -622,6 +1043,13 @@ int main(__unused int argc, __unused char * argv[])
 	ipg_rtc_rss_test();
 	ipg_rtc_fdir_test();
 
+	/* lookup tables */
+	cuckoo_test();
+	classifier_test();
+
+	/* checksum routines */
+	csum_test();
+
 	/* heap/slab test */
 	//slab_test();
 	//heap_test();
@@ -648,7 +1076,7 @@ int main(void)
 	struct route_table *rt;
 	struct fib_result res;
 
-	rt = pal_rtable_new();
+	rt = pal_rtable_new(NULL);
 	if (rt == NULL)
 		PAL_PANIC("rtable failed\n");
 
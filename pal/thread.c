@@ -16,6 +16,8 @@
 #include "arp.h"
 #include "vnic.h"
 #include "malloc.h"
+#include "netif.h"
+#include "pal_pcpu.h"
 
 /**
  * State of an thread.
@@ -402,9 +404,10 @@ int pal_wait_thread(int tid)
 	if (thconf->state == PAL_THREAD_WAIT)
 		return 0;
 
+	/* start up jobs take a few ms, do not sleep much longer */
 	while (thconf->state != PAL_THREAD_WAIT &&
 	       thconf->state != PAL_THREAD_FINISHED)
-		usleep(100000);
+		usleep(1000);
 
 	rte_rmb();
 
@@ -501,6 +504,40 @@ void pal_thread_handle_cmd(uint8_t cmd, void *arg)
 		thconf->work_cycles = 0;
 		thconf->idle_cycles = 0;
 		thconf->start_cycle = tsc;
+	} else if (cmd == PAL_THCMD_STOP) {
+		/* send what this thread holds and poll no more, the ports are
+		 * stopped by the thread which asked */
+		pal_flush_port();
+		pal_pcpu_flush();
+		pal_mb();
+		pal_cur_thread_conf()->cmd = PAL_THCMD_NOCMD;
+		for (;;)
+			usleep(1000);
 	}
 }
 
+static void pal_thread_cmd_wait(int tid)
+{
+	while (pal_thread_conf(tid)->cmd != PAL_THCMD_NOCMD)
+		usleep(100);
+}
+
+/*
+ * @brief Stop the receivers, then the workers fed by them. Each one sends
+ *        the packets it holds and stops polling, see pal_ports_stop()
+ */
+void pal_stop_data_threads(void)
+{
+	int tid;
+
+	PAL_FOR_EACH_RECEIVER (tid)
+		pal_thread_conf(tid)->cmd = PAL_THCMD_STOP;
+	PAL_FOR_EACH_RECEIVER (tid)
+		pal_thread_cmd_wait(tid);
+
+	PAL_FOR_EACH_WORKER (tid)
+		pal_thread_conf(tid)->cmd = PAL_THCMD_STOP;
+	PAL_FOR_EACH_WORKER (tid)
+		pal_thread_cmd_wait(tid);
+}
+
@@ -5,6 +5,7 @@
 
 #define PAL_THCMD_NOCMD		0
 #define PAL_THCMD_GET_CPUUSAGE	1
+#define PAL_THCMD_STOP		2
 
 extern void pal_thread_handle_cmd(uint8_t cmd, void *arg);
 
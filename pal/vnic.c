@@ -64,7 +64,10 @@ int pal_send_to_vnic(unsigned vnic_id, struct sk_buff *skb)
 	thconf->stats.tap.totap_pkts++;
 	thconf->stats.tap.totap_bytes += skb_l2_len(skb);
 
-	skb2 = skb_clone(skb, port->vnic_skbpool, 2000);
+	/* the kni hands one segment to the kernel, never send it a short copy */
+	skb2 = NULL;
+	if (skb_pkt_len(skb) <= 2000)
+		skb2 = skb_clone(skb, port->vnic_skbpool, 2000);
 
 	if (skb2 != NULL) {
 		if (rte_kni_tx_burst(port->vnic,
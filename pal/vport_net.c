@@ -9,7 +9,7 @@
 
 struct vport_net vport_nets; 
 
-/* Look up vport in vport_net, must lock held*/
+/* Look up vport in vport_net, the lock of the bucket of its name held*/
 struct vport *__find_vport_nolock(char *vport_name)
 {
 	struct vport *vp;	
@@ -27,20 +27,22 @@ void delete_vport_from_list(struct pal_list_head *head)
 {
 	struct pal_list_head *element;
 	struct vport_net *vpnet = &vport_nets;
+	pal_spinlock_t *lock;
 
-	pal_spinlock_lock(&vpnet->hash_lock);
 	/*delete all vport which belongs to one namespace*/
 	while (!pal_list_empty(head)) {
 		struct vport *vp;
 		element = head->next;
 		vp = pal_list_entry(element, struct vport, list_nd);
+		lock = vport_lock(vpnet, vp->vport_name);
+		pal_spinlock_lock(lock);
 		if(vp->vport_type == VXLAN_VPORT){
 			int_vport_delete(vpnet,(struct int_vport *)vp);
 		}else{
 			phy_vport_delete(vpnet,(struct phy_vport *)vp);
 		}		
+		pal_spinlock_unlock(lock);
 	}	
-	pal_spinlock_unlock(&vpnet->hash_lock);
 }
 
 int find_vport_ip_from_list(struct pal_list_head *head,__be32 ip)
@@ -67,9 +69,10 @@ int vport_net_init(void)
 	struct vport_net *vpnet = &vport_nets;
 
 	vpnet->addrcnt = 0;	
-	pal_spinlock_init(&vpnet->hash_lock);	
-	for (h = 0; h < VPORT_HASH_SIZE; ++h)
+	for (h = 0; h < VPORT_HASH_SIZE; ++h) {
+		pal_spinlock_init(&vpnet->hash_lock[h]);	
 		PAL_INIT_HLIST_HEAD(&vpnet->vport_list[h]);
+	}
 	
 	return 0;
 }
@@ -77,8 +77,9 @@ static int __bvrouter vtep_send(struct sk_buff *skb, struct vxlan_dev *vdev,
 	iph->frag_off = pal_htons(0x0000);	//set DF=0 and MF=0
 	iph->id = id;
 
-	/* if we don't need to do any fragmentation */
-	if (likely (IPV4_MTU_DEFAULT >= skb_pkt_len(skb))) {
+	/* if we don't need to do any fragmentation. the packet may be a chain
+	 * of segments, so compare the total length with the underlay mtu */
+	if (likely (pal_port_mtu(skb->recv_if) >= skb_pkt_len(skb))) {
 		/*set hardware checksum*/
 		skb_ip_csum_offload(skb,20);
 
@@ -201,7 +202,7 @@ static int __bvrouter vtep_rcv(struct sk_buff  *skb_p){
 
 	/*1. find vxlan_dev*/
 	index = get_hash_index_vni(vni);
-	vdev = find_lock_vxlan_dev(vni,index);
+	vdev = find_vxlan_dev(vni,index);
 	if (unlikely(!vdev)) {
 		pal_cur_thread_conf()->stats.ip.unknown_dst++;
 		PAL_DEBUG("unknown vni %d\n", vni);
@@ -209,31 +210,27 @@ static int __bvrouter vtep_rcv(struct sk_buff  *skb_p){
 	}
 
 	/*2. check eth header*/
-	if (unlikely(!pskb_may_pull(skb_p, ETH_HLEN))) {
-		read_unlock_vxlan_dev(index);
+	if (unlikely(!pskb_may_pull(skb_p, ETH_HLEN)))
 		goto drop;
-	}
 	skb_reset_eth_header(skb_p);
 	eth = skb_eth_header(skb_p);
 
+	/*learn inner source mac, network header still points to the outer ip*/
+	if (vdev->flags & VXLAN_F_LEARN)
+		vxlan_fdb_snoop(vdev, eth->src, skb_ip_header(skb_p)->saddr);
+
     /*3. for arp request, vxlan_dev used as arpproxy*/
     if (unlikely(eth->type == pal_htons(PAL_ETH_ARP))) {
-        if (vxlan_arp_rcv(skb_p, vdev)){
-			read_unlock_vxlan_dev(index);
+        if (vxlan_arp_rcv(skb_p, vdev))
             goto drop;
-        }else{
-			read_unlock_vxlan_dev(index);
-            return 0;
-        }
+        return 0;
     }
 
     /*TODO what if a broadcast or multicast pkts?*/
 	/*4. find int_vport*/
 	vport = __find_int_vport_nolock(vdev,eth->dst);
-	if (unlikely(!vport)) {
-		read_unlock_vxlan_dev(index);
+	if (unlikely(!vport))
 		goto drop;
-	}
 
 	vport->vp.vport_ops->recv(skb_p,(struct vport *)vport);
 
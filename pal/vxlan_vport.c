@@ -13,57 +13,97 @@ static struct pal_slab *vxlan_fdb_slab = NULL;
 static struct pal_slab *vxlan_arp_slab = NULL;
 static struct pal_slab *vxlan_skb_slab = NULL;
 
-static __be16 vxlan_src_port(struct sk_buff *);
+/*fdb and arp entries of all vxlan_devs, looked up without lock*/
+static struct pal_cuckoo *vxlan_fdb_table = NULL;
+static struct pal_cuckoo *vxlan_arp_table = NULL;
+
+pal_spinlock_t vxlan_fdb_lock = PAL_SPINLOCK_INITIALIZER;
+pal_spinlock_t vxlan_arp_lock = PAL_SPINLOCK_INITIALIZER;
+pal_spinlock_t vxlan_timer_lock = PAL_SPINLOCK_INITIALIZER;
+
+struct vxlan_fdb_key {
+	uint32_t vni;
+	uint8_t  mac[6];
+	uint16_t pad;
+};
 
+struct vxlan_arp_key {
+	uint32_t vni;
+	__be32   ip;
+};
 
-/* Look up Ethernet address in forwarding table, no lock*/
-static struct vxlan_fdb *__vxlan_find_mac(struct vxlan_dev *vdev,
-					uint8_t *mac)
+static __be16 vxlan_src_port(struct sk_buff *);
 
+static inline void vxlan_fdb_key_init(struct vxlan_fdb_key *key,
+					uint32_t vni, uint8_t *mac)
 {
-	struct pal_hlist_head *head = vxlan_fdb_head(vdev, mac);
-	struct vxlan_fdb *f;
-	struct pal_hlist_node *hnode;
-
-	pal_hlist_for_each_entry(f,hnode, head, hlist) {
-		if (pal_compare_ether_addr(mac, f->eth_addr) == 0)
-			return f;
-	}
-
-	return NULL;
+	key->vni = vni;
+	mac_copy(key->mac, mac);
+	key->pad = 0;
 }
 
-static struct vxlan_fdb *__bvrouter __vxlan_find_mac_index(struct vxlan_dev *vdev,
-					uint8_t *mac,uint32_t index)
-
+static inline void vxlan_arp_key_init(struct vxlan_arp_key *key,
+					uint32_t vni, __be32 ip)
 {
-	struct pal_hlist_head *head = vxlan_fdb_head_index(vdev, index);
-	struct vxlan_fdb *f;
-	struct pal_hlist_node *hnode;
+	key->vni = vni;
+	key->ip = ip;
+}
 
-	pal_hlist_for_each_entry(f,hnode, head, hlist) {
-		if (pal_compare_ether_addr(mac, f->eth_addr) == 0)
-			return f;
-	}
+/* Look up Ethernet address in forwarding table, writer side*/
+static struct vxlan_fdb *__vxlan_find_mac(struct vxlan_dev *vdev,
+					uint8_t *mac)
+{
+	struct vxlan_fdb_key key;
 
-	return NULL;
+	vxlan_fdb_key_init(&key, vdev->vni, mac);
+	return pal_cuckoo_lookup(vxlan_fdb_table, &key);
 }
 
-static struct vxlan_fdb *__bvrouter vxlan_find_lock_mac(struct vxlan_dev *vdev,
-					 uint8_t *mac,uint32_t index)
+/*
+* Copy the remote destinations of a mac, lock free. An entry may be
+* deleted or updated while it is read, the copy is then dropped and
+* done again.
+* @return number of destinations copied, 0 if the mac is unknown
+*/
+static int __bvrouter vxlan_fdb_get_rdst(struct vxlan_dev *vdev,
+					uint8_t *mac, struct vxlan_rdst *rdst)
 {
+	struct vxlan_fdb_key key;
 	struct vxlan_fdb *f;
+	struct vxlan_rdst *rd;
+	uint32_t seq;
+	int n;
+
+	vxlan_fdb_key_init(&key, vdev->vni, mac);
+	do {
+		n = 0;
+		seq = pal_cuckoo_read_begin(vxlan_fdb_table);
+		f = pal_cuckoo_lookup(vxlan_fdb_table, &key);
+		if (unlikely(!f))
+			return 0;
 
-	read_lock_vxlan_fdb(vdev,index);
-	f = __vxlan_find_mac_index(vdev, mac,index);
+		rd = &f->remote;
+		while (rd && n < VXLAN_RDST_MAX) {
+			rdst[n] = *rd;
+			/*the next pointer may only be followed if nothing changed*/
+			if (pal_cuckoo_read_retry(vxlan_fdb_table, seq))
+				break;
+			rd = rdst[n++].remote_next;
+		}
+	} while (pal_cuckoo_read_retry(vxlan_fdb_table, seq));
 
-	return f;
+	return n;
 }
 
+/*
+* fdb lock held. An entry has at most VXLAN_RDST_MAX destinations, the
+* number a packet is sent to.
+*/
 static int vxlan_fdb_append(struct vxlan_fdb *f,
-			    __be32 ip, __be16 port, uint32_t vni, uint32_t ifindex,struct vxlan_dev *vdev,uint32_t index)
+			    __be32 ip, __be16 port, uint32_t vni, uint32_t ifindex)
 {
 	struct vxlan_rdst *rd_prev, *rd;
+	int n = 0;
 
 	rd_prev = NULL;
 	for (rd = &f->remote; rd; rd = rd->remote_next) {
@@ -73,7 +113,10 @@ static int vxlan_fdb_append(struct vxlan_fdb *f,
 		    rd->remote_ifindex == ifindex)
 			return 0;
 		rd_prev = rd;
+		n++;
 	}
+	if (n >= VXLAN_RDST_MAX)
+		return -ENOSPC;
 	rd = pal_malloc(sizeof(*rd));
 	if (rd == NULL)
 		return -ENOMEM;
@@ -83,41 +126,45 @@ static int vxlan_fdb_append(struct vxlan_fdb *f,
 	rd->remote_ifindex = ifindex;
 	rd->remote_next = NULL;
 
-	write_lock_vxlan_fdb(vdev,index);
+	pal_cuckoo_write_begin(vxlan_fdb_table);
 	rd_prev->remote_next = rd;
-	write_unlock_vxlan_fdb(vdev,index);
+	pal_cuckoo_write_end(vxlan_fdb_table);
 
 	return 1;
 }
 
+/*fdb lock held*/
 static int __vxlan_fdb_create(struct vxlan_dev *vdev,
 					uint8_t *mac, __be32 ip,
-					__be16 port, uint32_t vni, uint32_t ifindex,uint32_t index)
+					__be16 port, uint32_t vni, uint32_t ifindex)
 
 {
+	struct vxlan_fdb_key key;
 	struct vxlan_fdb *f;
 
 	f = __vxlan_find_mac(vdev, mac);
 	if (f) {
 		if (pal_is_multicast_ether_addr(f->eth_addr)||
 				pal_is_broadcast_ether_addr(f->eth_addr)) {
-			int rc = vxlan_fdb_append(f, ip, port, vni, ifindex,vdev,index);
+			int rc = vxlan_fdb_append(f, ip, port, vni, ifindex);
 			if (rc < 0)
 				return rc;
 		}else {
             /*if fdb exists and nothing to update ignore it*/
-            if (f->remote.remote_ip == ip && f->remote.remote_port == port &&
+            if (f->state == VXLAN_FDB_STATIC &&
+		        f->remote.remote_ip == ip && f->remote.remote_port == port &&
 		        f->remote.remote_vni == vni && f->remote.remote_ifindex == ifindex) {
 			    return -EEXIST;
             }
-            /*update the fdb entry*/
-            write_lock_vxlan_fdb(vdev,index);
+            /*update the fdb entry, a learned entry becomes static*/
+            pal_cuckoo_write_begin(vxlan_fdb_table);
+            f->state = VXLAN_FDB_STATIC;
             f->remote.remote_ip = ip;
             f->remote.remote_port = port;
             f->remote.remote_vni = vni;
             f->remote.remote_ifindex = ifindex;
             f->remote.remote_next = NULL;
-            write_unlock_vxlan_fdb(vdev,index);
+            pal_cuckoo_write_end(vxlan_fdb_table);
             return 0;
         }
 	} else {
@@ -130,13 +177,17 @@ static int __vxlan_fdb_create(struct vxlan_dev *vdev,
 		f->remote.remote_vni = vni;
 		f->remote.remote_ifindex = ifindex;
 		f->remote.remote_next = NULL;
+		f->used = 0;
+		f->state = VXLAN_FDB_STATIC;
 		rte_memcpy(f->eth_addr, mac, 6);
 
-		write_lock_vxlan_fdb(vdev,index);
-		++vdev->fdb_cnt;
-		pal_hlist_add_head(&f->hlist,
-				   vxlan_fdb_head(vdev, mac));
-		write_unlock_vxlan_fdb(vdev,index);
+		vxlan_fdb_key_init(&key, vdev->vni, mac);
+		if (pal_cuckoo_add(vxlan_fdb_table, &key, f) < 0) {
+			pal_slab_free(f);
+			return -ENOSPC;
+		}
+		atomic_inc(&vdev->fdb_cnt);
+		pal_list_add(&f->list, &vdev->fdb_list);
 	}
 
 	return 0;
@@ -148,16 +199,18 @@ int vxlan_fdb_add( struct vxlan_dev *vdev,
 			 __be32 ip, __be16 port, uint32_t vni,uint32_t ifindex)
 {
 	int err;
-	uint32_t index;
 
-	index = get_hash_index_mac(mac);
+	lock_vxlan_fdb();
 	err = __vxlan_fdb_create(vdev, mac, ip,
-			       port, vni, ifindex, index);
+			       port, vni, ifindex);
+	unlock_vxlan_fdb();
 	return err;
 }
 
-static void vxlan_fdb_free(struct vxlan_fdb *f)
+static void vxlan_fdb_free_qsbr(struct pal_qsbr_head *head)
 {
+	struct vxlan_fdb *f = container_of(head, struct vxlan_fdb, qsbr);
+
 	while (f->remote.remote_next) {
 		struct vxlan_rdst *rd = f->remote.remote_next;
 
@@ -167,28 +220,199 @@ static void vxlan_fdb_free(struct vxlan_fdb *f)
 	pal_slab_free(f);
 }
 
-static void __vxlan_fdb_destroy(struct vxlan_dev *vdev, struct vxlan_fdb *f, uint32_t index)
+/*
+* Free an unlinked entry once the receivers which may have looked it up,
+* and may still refresh it or walk its destinations, are done.
+*/
+static void vxlan_fdb_free(struct vxlan_fdb *f)
+{
+	pal_qsbr_call(&f->qsbr, vxlan_fdb_free_qsbr);
+}
+
+/*
+* Unlink an entry, fdb lock held. Readers overlapping the deletion retry,
+* and the entry is only freed after a grace period, see vxlan_fdb_free().
+*/
+static void __vxlan_fdb_unlink(struct vxlan_dev *vdev, struct vxlan_fdb *f)
+{
+	struct vxlan_fdb_key key;
+
+	vxlan_fdb_key_init(&key, vdev->vni, f->eth_addr);
+	pal_cuckoo_del(vxlan_fdb_table, &key);
+	pal_list_del(&f->list);
+	atomic_dec(&vdev->fdb_cnt);
+}
+
+static void __vxlan_fdb_destroy(struct vxlan_dev *vdev, struct vxlan_fdb *f)
 {
-	write_lock_vxlan_fdb(vdev,index);
-	--vdev->fdb_cnt;
-	pal_hlist_del(&f->hlist);
-	write_unlock_vxlan_fdb(vdev,index);
+	lock_vxlan_fdb();
+	__vxlan_fdb_unlink(vdev, f);
+	unlock_vxlan_fdb();
 
 	vxlan_fdb_free(f);
 }
 
+/*
+* Learn inner source mac -> outer source vtep, called by receivers.
+* Receivers never wait on the fdb lock: if it is busy the entry is
+* simply learned from one of the following packets.
+*/
+void __bvrouter vxlan_fdb_snoop(struct vxlan_dev *vdev,
+			 uint8_t *src_mac, __be32 src_ip)
+{
+	struct vxlan_fdb_key key;
+	struct vxlan_fdb *f;
+	__be32 remote_ip = 0;
+	uint8_t state = VXLAN_FDB_STATIC;
+	uint32_t seq;
+
+	if (unlikely(!pal_is_valid_ether_addr(src_mac)))
+		return;
+
+	vxlan_fdb_key_init(&key, vdev->vni, src_mac);
+
+	/*fast path, refresh an existing entry*/
+	do {
+		seq = pal_cuckoo_read_begin(vxlan_fdb_table);
+		f = pal_cuckoo_lookup(vxlan_fdb_table, &key);
+		if (!f)
+			break;
+		state = f->state;
+		remote_ip = f->remote.remote_ip;
+	} while (pal_cuckoo_read_retry(vxlan_fdb_table, seq));
+
+	if (likely(f)) {
+		if (state == VXLAN_FDB_STATIC)
+			return;
+		if (likely(remote_ip == src_ip)) {
+			/*avoid dirtying the cache line on every packet. An entry
+			 * aged out meanwhile is only freed after this receiver's
+			 * quiescent state, the write is then lost*/
+			if (f->used != jiffies)
+				f->used = jiffies;
+			return;
+		}
+
+		/*the vm has migrated to another vtep*/
+		if (!trylock_vxlan_fdb())
+			return;
+		f = pal_cuckoo_lookup(vxlan_fdb_table, &key);
+		if (f && f->state == VXLAN_FDB_LEARNED) {
+			pal_cuckoo_write_begin(vxlan_fdb_table);
+			f->remote.remote_ip = src_ip;
+			pal_cuckoo_write_end(vxlan_fdb_table);
+			f->used = jiffies;
+		}
+		unlock_vxlan_fdb();
+		return;
+	}
+
+	if (atomic_read(&vdev->fdb_cnt) >= FDB_NUM_MAX_PER_VPORT)
+		return;
+
+	f = pal_slab_alloc(vxlan_fdb_slab);
+	if (unlikely(!f))
+		return;
+
+	f->remote.remote_ip = src_ip;
+	f->remote.remote_port = vdev->dst_port;
+	f->remote.remote_vni = vdev->vni;
+	f->remote.remote_ifindex = 0;
+	f->remote.remote_next = NULL;
+	f->used = jiffies;
+	f->state = VXLAN_FDB_LEARNED;
+	mac_copy(f->eth_addr, src_mac);
+
+	if (!trylock_vxlan_fdb()) {
+		pal_slab_free(f);
+		return;
+	}
+	/*learning may have been stopped by a delete of the vxlan_dev, which
+	  clears the flag under the lock, or another receiver may have learned
+	  it in the meantime*/
+	if (!(vdev->flags & VXLAN_F_LEARN) ||
+			pal_cuckoo_lookup(vxlan_fdb_table, &key) ||
+			pal_cuckoo_add(vxlan_fdb_table, &key, f) < 0) {
+		unlock_vxlan_fdb();
+		pal_slab_free(f);
+		return;
+	}
+	atomic_inc(&vdev->fdb_cnt);
+	pal_list_add(&f->list, &vdev->fdb_list);
+	unlock_vxlan_fdb();
+}
+
+/*
+* Ageing timer of a vxlan_dev, runs on a control thread with the timer lock
+* held. Receivers may learn new entries meanwhile, so the list is walked
+* under the fdb lock.
+*/
+void vxlan_fdb_cleanup(unsigned long data)
+{
+	struct vxlan_dev *vdev = (struct vxlan_dev *)data;
+	struct vxlan_fdb *f, *n;
+	uint64_t now = jiffies;
+	uint64_t next_timer = now + VXLAN_FDB_AGE_INTERVAL;
+	uint64_t timeout;
+	int learned = 0;
+
+	lock_vxlan_fdb();
+	pal_list_for_each_entry_safe(f, n, &vdev->fdb_list, list) {
+		if (f->state != VXLAN_FDB_LEARNED)
+			continue;
+		learned = 1;
+		timeout = f->used + vdev->ageing_time;
+		if (timeout <= now) {
+			PAL_DEBUG("fdb "MACPRINT_FMT" of vni %u expired\n",
+				MACPRINT(f->eth_addr), vdev->vni);
+			__vxlan_fdb_unlink(vdev, f);
+			vxlan_fdb_free(f);
+		} else if (timeout < next_timer) {
+			next_timer = timeout;
+		}
+	}
+	unlock_vxlan_fdb();
+
+	/*keep ageing the remaining learned entries after learning is disabled*/
+	if ((vdev->flags & VXLAN_F_LEARN) || learned)
+		mod_timer(&vdev->ageing_timer, next_timer);
+}
+
+/*
+* Enable or disable data plane learning on a vxlan_dev, control plane only.
+* @ageing: ageing time in seconds, 0 means keep the current one.
+*/
+int vxlan_fdb_learning_set(struct vxlan_dev *vdev, int enable, uint32_t ageing)
+{
+	if (ageing > VXLAN_FDB_AGEING_MAX)
+		return -ERANGE;
+
+	if (ageing)
+		vdev->ageing_time = (uint64_t)ageing * HZ;
+
+	if (enable) {
+		vdev->flags |= VXLAN_F_LEARN;
+		lock_vxlan_timer();
+		mod_timer(&vdev->ageing_timer, jiffies + VXLAN_FDB_AGE_INTERVAL);
+		unlock_vxlan_timer();
+	} else {
+		/*learned entries are left to the ageing timer*/
+		vdev->flags &= ~VXLAN_F_LEARN;
+	}
+
+	return 0;
+}
+
 /* Delete fdb entry  */
 int vxlan_fdb_delete(struct vxlan_dev *vdev,
 			     unsigned char *mac)
 {
-	uint32_t index;
 	struct vxlan_fdb *f;
 	int err = -ENOENT;
 
-	index = get_hash_index_mac(mac);
 	f = __vxlan_find_mac(vdev, mac);
 	if (f) {
-		__vxlan_fdb_destroy(vdev, f,index);
+		__vxlan_fdb_destroy(vdev, f);
 		err = 0;
 	}
 
@@ -198,15 +422,11 @@ int vxlan_fdb_delete(struct vxlan_dev *vdev,
 /*flush fdb table*/
 int vxlan_fdb_flush(struct vxlan_dev *vdev)
 {
-	unsigned int h;
-
-	for (h = 0; h < FDB_HASH_SIZE; ++h) {
-		struct vxlan_fdb *f;
+	struct vxlan_fdb *f;
 
-		while (!pal_hlist_empty(&vdev->fdb_array[h].head)) {
-			f = pal_hlist_entry(vdev->fdb_array[h].head.first, struct vxlan_fdb, hlist);
-			__vxlan_fdb_destroy(vdev,f,h);
-		}
+	while (!pal_list_empty(&vdev->fdb_list)) {
+		f = pal_list_first_entry(&vdev->fdb_list, struct vxlan_fdb, list);
+		__vxlan_fdb_destroy(vdev,f);
 	}
 
 	return 0;
@@ -233,79 +453,71 @@ static void vxlan_fdb_dump(struct vxlan_fdb *f)
 
 int vxlan_fdb_show(struct vxlan_dev *vdev)
 {
-	unsigned int h;
-
-	for (h = 0; h < FDB_HASH_SIZE; ++h) {
-		struct vxlan_fdb *f;
-		struct pal_hlist_node *hnode;
+	struct vxlan_fdb *f;
 
-		read_lock_vxlan_fdb(vdev,h);
-		pal_hlist_for_each_entry(f,hnode,vxlan_fdb_head_index(vdev,h), hlist) {
-			vxlan_fdb_dump(f);
-		}
-		read_unlock_vxlan_fdb(vdev,h);
+	lock_vxlan_fdb();
+	pal_list_for_each_entry(f, &vdev->fdb_list, list) {
+		vxlan_fdb_dump(f);
 	}
+	unlock_vxlan_fdb();
 
 	return 0;
 }
 
 void vxlan_fdb_slab_init(int numa_id)
 {
-    vxlan_fdb_slab = pal_slab_create("vxlan_fdb", VXLAN_FDB_SLAB_SIZE,
+    /*learned entries are allocated by all receivers*/
+    vxlan_fdb_slab = pal_slab_create_multipc("vxlan_fdb", VXLAN_FDB_SLAB_SIZE,
 		sizeof(struct vxlan_fdb), numa_id, 0);
 
 	if (!vxlan_fdb_slab) {
 		PAL_PANIC("create vxlan_fdb slab failed\n");
 	}
+
+	vxlan_fdb_table = pal_cuckoo_create("vxlan_fdb", VXLAN_FDB_SLAB_SIZE,
+		sizeof(struct vxlan_fdb_key), numa_id);
+	if (!vxlan_fdb_table) {
+		PAL_PANIC("create vxlan_fdb table failed\n");
+	}
 }
 
-/*find arp entry, no lock*/
+/*find arp entry, writer side*/
 static inline struct vxlan_arp_entry *__find_arp_entry(struct vxlan_dev *vdev,
-	__be32 ip,uint32_t index)
+	__be32 ip)
 {
-    struct vxlan_arp_entry *tmp;
-    struct pal_hlist_node *pos;
+	struct vxlan_arp_key key;
 
-    pal_hlist_for_each_entry(tmp, pos, vxlan_arp_head_index(vdev,index), hlist){
-        if (tmp->ip == ip)
-            return tmp;
-    }
-
-    return NULL;
+	vxlan_arp_key_init(&key, vdev->vni, ip);
+	return pal_cuckoo_lookup(vxlan_arp_table, &key);
 }
 
+/*only tells whether the entry exists, it may be freed once returned*/
 struct vxlan_arp_entry *find_vxlan_arp_entry(struct vxlan_dev *vdev,
 	__be32 ip)
 {
-    uint32_t index;
-    struct vxlan_arp_entry *tmp;
-
-	index = get_hash_index_arp(ip);
-	read_lock_vxlan_arp(vdev,index);
-	tmp = __find_arp_entry(vdev,ip,index);
-	read_unlock_vxlan_arp(vdev,index);
-
-    return tmp;
+	return __find_arp_entry(vdev, ip);
 }
 
-static int find_vxlan_arp_entry_info(struct vxlan_dev *vdev,
+static int __bvrouter find_vxlan_arp_entry_info(struct vxlan_dev *vdev,
 	__be32 ip,uint8_t *dst_mac)
 {
-    uint32_t index;
-    struct vxlan_arp_entry *tmp;
-
-	index = get_hash_index_arp(ip);
-	read_lock_vxlan_arp(vdev,index);
-	tmp = __find_arp_entry(vdev,ip,index);
-	if(unlikely(!tmp)){
-		read_unlock_vxlan_arp(vdev,index);
-		return -1;
-	}else{
-		mac_copy(dst_mac,tmp->mac_addr);
-	}
-	read_unlock_vxlan_arp(vdev,index);
+	struct vxlan_arp_key key;
+	struct vxlan_arp_entry *tmp;
+	uint8_t mac[6];
+	uint32_t seq;
+
+	vxlan_arp_key_init(&key, vdev->vni, ip);
+	do {
+		seq = pal_cuckoo_read_begin(vxlan_arp_table);
+		tmp = pal_cuckoo_lookup(vxlan_arp_table, &key);
+		if (unlikely(!tmp))
+			return -1;
+		mac_copy(mac, tmp->mac_addr);
+	} while (pal_cuckoo_read_retry(vxlan_arp_table, seq));
+
+	mac_copy(dst_mac, mac);
 
-    return 0;
+	return 0;
 }
 
 /* Fill in dst_mac with specified vxlan_vport and dst_ip. */
@@ -316,17 +528,19 @@ int locate_eth_dst(struct vport *vp, __be32 ip, uint8_t *dst_mac) {
     return find_vxlan_arp_entry_info(((struct int_vport *)vp)->vdev, ip, dst_mac);
 }
 
+/*arp entries are only changed by the control plane, arp lock held*/
 static int __add_arp_entry(struct vxlan_dev *vdev,
-	struct vxlan_arp_entry *entry,uint32_t index)
+	struct vxlan_arp_entry *entry)
 {
-    struct vxlan_arp_entry *add_entry;
+	struct vxlan_arp_entry *add_entry;
+	struct vxlan_arp_key key;
 
-    add_entry = __find_arp_entry(vdev,entry->ip,index);
+	add_entry = __find_arp_entry(vdev,entry->ip);
 	if(add_entry){
-		write_lock_vxlan_arp(vdev,index);
-		/*update arp entry mac, also should be protected by lock*/
+		/*update arp entry mac, readers copying it meanwhile retry*/
+		pal_cuckoo_write_begin(vxlan_arp_table);
 		rte_memcpy(add_entry->mac_addr, entry->mac_addr, 6);
-		write_unlock_vxlan_arp(vdev,index);
+		pal_cuckoo_write_end(vxlan_arp_table);
 	}else{
 		add_entry = pal_slab_alloc(vxlan_arp_slab);
 		if (!add_entry) {
@@ -336,10 +550,13 @@ static int __add_arp_entry(struct vxlan_dev *vdev,
 		add_entry->ip = entry->ip;
 		rte_memcpy(add_entry->mac_addr, entry->mac_addr, 6);
 
-		write_lock_vxlan_arp(vdev,index);
+		vxlan_arp_key_init(&key, vdev->vni, entry->ip);
+		if (pal_cuckoo_add(vxlan_arp_table, &key, add_entry) < 0) {
+			pal_slab_free(add_entry);
+			return -ENOSPC;
+		}
 		++vdev->arp_cnt;
-		pal_hlist_add_head(&add_entry->hlist,vxlan_arp_head_index(vdev,index));
-		write_unlock_vxlan_arp(vdev,index);
+		pal_list_add(&add_entry->list, &vdev->arp_list);
 	}
 
     return 0;
@@ -348,11 +565,10 @@ static int __add_arp_entry(struct vxlan_dev *vdev,
 int add_vxlan_arp_entry(struct vxlan_dev *vdev, struct vxlan_arp_entry *entry)
 {
 	int err;
-	uint32_t index;
-
-	index = get_hash_index_arp(entry->ip);
-	err = __add_arp_entry(vdev,entry,index);
 
+	lock_vxlan_arp();
+	err = __add_arp_entry(vdev,entry);
+	unlock_vxlan_arp();
 	return err;
 }
 
@@ -363,29 +579,30 @@ static void arp_entry_free(struct vxlan_arp_entry *entry)
 	}
 }
 
-static void __vxlan_arp_destroy(struct vxlan_dev *vdev, struct vxlan_arp_entry *entry,uint32_t index)
+static void __vxlan_arp_destroy(struct vxlan_dev *vdev, struct vxlan_arp_entry *entry)
 {
-	write_lock_vxlan_arp(vdev,index);
+	struct vxlan_arp_key key;
+
+	vxlan_arp_key_init(&key, vdev->vni, entry->ip);
+	pal_cuckoo_del(vxlan_arp_table, &key);
 	--vdev->arp_cnt;
-	pal_hlist_del(&entry->hlist);
-	write_unlock_vxlan_arp(vdev,index);
+	pal_list_del(&entry->list);
 
 	arp_entry_free(entry);
 }
 
 int del_vxlan_arp_entry(struct vxlan_dev *vdev, __be32 ip)
 {
-  	uint32_t index;
 	struct vxlan_arp_entry *entry;
 	int err = -ENOENT;
 
-	index = get_hash_index_arp(ip);
-
-	entry = __find_arp_entry(vdev,ip,index);
+	lock_vxlan_arp();
+	entry = __find_arp_entry(vdev,ip);
 	if (entry) {
-		__vxlan_arp_destroy(vdev, entry,index);
+		__vxlan_arp_destroy(vdev, entry);
 		err = 0;
 	}
+	unlock_vxlan_arp();
 
 	return err;
 }
@@ -393,27 +610,32 @@ int del_vxlan_arp_entry(struct vxlan_dev *vdev, __be32 ip)
 /*flush arp table*/
 int vxlan_arp_flush(struct vxlan_dev *vdev)
 {
-	unsigned int h;
+	struct vxlan_arp_entry *entry;
 
-	for (h = 0; h < ARP_HASH_SIZE; ++h) {
-		struct vxlan_arp_entry *entry;
-		while (!pal_hlist_empty(&vdev->arp_array[h].head)) {
-			entry = pal_hlist_entry(vdev->arp_array[h].head.first, struct vxlan_arp_entry, hlist);
-			__vxlan_arp_destroy(vdev,entry,h);
-		}
+	lock_vxlan_arp();
+	while (!pal_list_empty(&vdev->arp_list)) {
+		entry = pal_list_first_entry(&vdev->arp_list, struct vxlan_arp_entry, list);
+		__vxlan_arp_destroy(vdev,entry);
 	}
+	unlock_vxlan_arp();
 
 	return 0;
 }
 
 void vxlan_arp_slab_init(int numa_id)
 {
-    vxlan_arp_slab = pal_slab_create("vxlan_arp_entry", VXLAN_ARP_SLAB_SIZE,
+    vxlan_arp_slab = pal_slab_create_multipc("vxlan_arp_entry", VXLAN_ARP_SLAB_SIZE,
 		sizeof(struct vxlan_arp_entry), numa_id, 0);
 
 	if (!vxlan_arp_slab) {
 		PAL_PANIC("create vxlan_arp_entry slab failed\n");
 	}
+
+	vxlan_arp_table = pal_cuckoo_create("vxlan_arp", VXLAN_ARP_SLAB_SIZE,
+		sizeof(struct vxlan_arp_key), numa_id);
+	if (!vxlan_arp_table) {
+		PAL_PANIC("create vxlan_arp table failed\n");
+	}
 }
 
 static int int_vport_init(struct vport *dev){
@@ -421,7 +643,6 @@ static int int_vport_init(struct vport *dev){
 
 	vport->vni_hash_index = get_hash_index_vni(vport->vdev->vni);
 	vport->src_port = vtep_src_port(vport->vp.vport_ip);
-    memset(vport->stats, 0, sizeof(vport->stats));
 
 	return 0;
 }
@@ -435,11 +656,10 @@ static int __bvrouter int_vport_send(struct sk_buff *skb, struct vport *dev)
 	struct int_vport *vport = (struct int_vport *)dev;
 	struct eth_hdr *eth;
 	struct ip_hdr *iph;
-	struct vxlan_rdst *rdst0 = NULL, *rdst = NULL;
-	struct vxlan_fdb *f;
-	uint32_t index;
+	struct vxlan_rdst rdst[VXLAN_RDST_MAX];
     uint16_t src_port;
 	int rc1 = 0, rc = 0;
+	int n, i;
     int lcore_id = rte_lcore_id();
 
     eth = skb_eth_header(skb);
@@ -447,30 +667,7 @@ static int __bvrouter int_vport_send(struct sk_buff *skb, struct vport *dev)
 
     switch (eth->type) {
         case pal_htons_constant(PAL_ETH_ARP):
-            /*fdb find*/
-			index = get_hash_index_mac(eth->dst);
             /*this may cause arp request may not reply*/
-	        f = vxlan_find_lock_mac(vport->vdev, eth->dst,index);
-	        if (unlikely(!f)) {
-				read_unlock_vxlan_fdb(vport->vdev,index);
-		        vport->stats[lcore_id].tx_dropped++;
-		        goto drop;
-	        } else
-		        rdst0 = &f->remote;
-
-	        rc = 0;
-
-	        /* if there are multiple destinations, send copies */
-	        for (rdst = rdst0->remote_next; rdst; rdst = rdst->remote_next) {
-		        struct sk_buff *skb1;
-		        skb1 = skb_clone(skb,vxlan_skb_slab, 2000);
-		        if (skb1) {
-			        vport->stats[lcore_id].tx_packets++;
-			        rc1 = vtep_xmit_one(skb1, vport->vdev, rdst, src_port);
-			        if (rc == 0)
-				        rc = rc1;
-		        }
-	        }
             break;
         case pal_htons_constant(PAL_ETH_IP):
             iph = skb_ip_header(skb);
@@ -479,38 +676,34 @@ static int __bvrouter int_vport_send(struct sk_buff *skb, struct vport *dev)
              * may already be the nexthop's mac. */
 			find_vxlan_arp_entry_info(vport->vdev,iph->daddr,eth->dst);
 	        mac_copy(eth->src, vport->vp.vport_eth_addr);
-
-	        /*fdb find*/
-			index = get_hash_index_mac(eth->dst);
-	        f = vxlan_find_lock_mac(vport->vdev, eth->dst,index);
-	        if (unlikely(!f)) {
-				read_unlock_vxlan_fdb(vport->vdev,index);
-		        vport->stats[lcore_id].tx_dropped++;
-		        goto drop;
-	        } else
-		        rdst0 = &f->remote;
-
-	        rc = 0;
-
-	        /* if there are multiple destinations, send copies */
-	        for (rdst = rdst0->remote_next; rdst; rdst = rdst->remote_next) {
-		        struct sk_buff *skb1;
-		        skb1 = skb_clone(skb,vxlan_skb_slab, 2000);
-		        if (skb1) {
-			        vport->stats[lcore_id].tx_packets++;
-			        rc1 = vtep_xmit_one(skb1, vport->vdev, rdst, src_port);
-			        if (rc == 0)
-				        rc = rc1;
-		        }
-	        }
             break;
         default:
             goto drop;
     }
 
-	vport->stats[lcore_id].tx_packets++;
-	rc1 = vtep_xmit_one(skb, vport->vdev, rdst0, src_port);
-	read_unlock_vxlan_fdb(vport->vdev,index);
+	/*fdb find, the destinations are copied so no lock is held while sending*/
+	n = vxlan_fdb_get_rdst(vport->vdev, eth->dst, rdst);
+	if (unlikely(n == 0)) {
+		PAL_PCPU_ADD(&vport->stats[lcore_id], tx_dropped, 1);
+		goto drop;
+	}
+
+	/* if there are multiple destinations, send copies */
+	for (i = 1; i < n; i++) {
+		struct sk_buff *skb1;
+		skb1 = skb_clone(skb, vxlan_skb_slab, skb_pkt_len(skb));
+		if (unlikely(skb1 == NULL)) {
+			PAL_PCPU_ADD(&vport->stats[lcore_id], tx_dropped, 1);
+			continue;
+		}
+		PAL_PCPU_ADD(&vport->stats[lcore_id], tx_packets, 1);
+		rc1 = vtep_xmit_one(skb1, vport->vdev, &rdst[i], src_port);
+		if (rc == 0)
+			rc = rc1;
+	}
+
+	PAL_PCPU_ADD(&vport->stats[lcore_id], tx_packets, 1);
+	rc1 = vtep_xmit_one(skb, vport->vdev, &rdst[0], src_port);
 
 	if (rc == 0)
 		rc = rc1;
@@ -525,14 +718,12 @@ drop:
 /*protected by namespace lock*/
 static int __bvrouter int_vport_recv(struct sk_buff *skb,struct vport *dev)
 {
-	struct int_vport *vport = (struct int_vport *)dev;
 	int ret;
 
 	read_lock_namespace(dev->private);
 	ret = bvr_pkt_handler(skb,dev);
 	read_unlock_namespace(dev->private);
 
-	read_unlock_vxlan_dev(vport->vni_hash_index);
 	if(unlikely(ret == BVROUTER_DROP))
 		goto drop;
 
@@ -551,8 +742,8 @@ const struct vport_device_ops int_vport_ops = {
 
 void vxlan_skb_slab_init(int numa_id)
 {
-    vxlan_skb_slab = pal_slab_create_multipc("vxlan skb", VXLAN_SKB_SLAB_SIZE,
-		2048, numa_id, 0);
+    vxlan_skb_slab = pal_skb_slab_create_numa("vxlan skb", VXLAN_SKB_SLAB_SIZE,
+		numa_id);
 
 	if (!vxlan_skb_slab) {
 		PAL_PANIC("create vxlan skb slab failed\n");
@@ -7,12 +7,14 @@
 #include "pal_error.h"
 #include "pal_malloc.h"
 #include "pal_slab.h"
+#include "pal_qsbr.h"
 
 
 struct vxlan_dev_net vxlan_dev_nets;
 
 static struct pal_slab *int_vport_slab = NULL;
 static struct pal_slab *vxlan_dev_slab = NULL;
+static int int_vport_numa;
 
 /*
 * Look up vxlan_dev in vxlan_dev_nets, no lock  
@@ -44,20 +46,13 @@ static struct vxlan_dev *__bvrouter __find_vxlan_dev_nolock_index(uint32_t vni,u
 }
 
 /*
-* Look up vxlan_dev in vxlan_dev_nets ,and then hold the read_lcok
+* Look up vxlan_dev in vxlan_dev_nets for receivers, lock free.
+* The vxlan_dev and its int_vports stay valid until the receiver
+* reports its next quiescent state.
 */
-struct vxlan_dev *__bvrouter find_lock_vxlan_dev(uint32_t vni, uint32_t index)
+struct vxlan_dev *__bvrouter find_vxlan_dev(uint32_t vni, uint32_t index)
 {
-	struct vxlan_dev *vdev;	
-
-	read_lock_vxlan_dev(index);
-	vdev = __find_vxlan_dev_nolock_index(vni,index);
-	if(unlikely(!vdev)){
-		read_unlock_vxlan_dev(index);
-		return NULL;
-	}
-	
-	return vdev;
+	return __find_vxlan_dev_nolock_index(vni,index);
 }
 
 /*create vxlan_dev, no lock*/
@@ -79,10 +74,16 @@ static struct vxlan_dev * __vxlan_dev_create(struct vxlan_dev_net *vxlan,uint32_
 	vdev->tos = 0;
 	vdev->ttl = 64;
 	vdev->flags = 0;
-	vdev->fdb_cnt = 0;
+	atomic_set(&vdev->fdb_cnt, 0);
 	vdev->arp_cnt = 0;
 	vdev->vport_cnt = 0;
 	vdev->vport_cnt_max = VPORT_NUM_MAX_PER_VXLAN_DEV;
+	vdev->ageing_time = (uint64_t)VXLAN_FDB_AGEING_DEFAULT * HZ;
+
+	init_timer(&vdev->ageing_timer);
+	vdev->ageing_timer.function = vxlan_fdb_cleanup;
+	vdev->ageing_timer.data = (unsigned long)vdev;
+	vdev->ageing_timer.expires = 0;
 
 	atomic_set(&(vdev->count),0);
 	
@@ -90,15 +91,8 @@ static struct vxlan_dev * __vxlan_dev_create(struct vxlan_dev_net *vxlan,uint32_
 		PAL_INIT_HLIST_HEAD(&vdev->int_vport_head[h]);
 	}
 	
-	for (h = 0; h < FDB_HASH_SIZE; ++h){			
-		pal_rwlock_init(&vdev->fdb_array[h].hash_lock);
-		PAL_INIT_HLIST_HEAD(&vdev->fdb_array[h].head);
-	}
-	
-	for (h = 0; h < ARP_HASH_SIZE; ++h){			
-		pal_rwlock_init(&vdev->arp_array[h].hash_lock);
-		PAL_INIT_HLIST_HEAD(&vdev->arp_array[h].head);
-	}
+	PAL_INIT_LIST_HEAD(&vdev->fdb_list);
+	PAL_INIT_LIST_HEAD(&vdev->arp_list);
 
 	index = get_hash_index_vni(vni);
 	write_lock_vxlan_dev(index);
@@ -110,10 +104,16 @@ static struct vxlan_dev * __vxlan_dev_create(struct vxlan_dev_net *vxlan,uint32_
 	return vdev;
 }
 
+static void vxlan_dev_free_qsbr(struct pal_qsbr_head *head)
+{
+	pal_slab_free(container_of(head, struct vxlan_dev, qsbr));
+}
+
+/*receivers may still read the vxlan_dev, free it after a grace period*/
 static void vxlan_dev_free(struct vxlan_dev *vdev)
 {
 	if(vdev) {
-		pal_slab_free(vdev);
+		pal_qsbr_call(&vdev->qsbr, vxlan_dev_free_qsbr);
 	}
 }
 
@@ -128,19 +128,29 @@ static void __vxlan_dev_delete(struct vxlan_dev_net *vxlan,struct vxlan_dev *vde
 	if(vdev->vport_cnt != 0)
 		PAL_PANIC("vxlan_dev delete bug");
 
+	/*receivers learn under the fdb lock, none adds an entry after this*/
+	index = get_hash_index_vni(vdev->vni);
+	lock_vxlan_fdb();
+	vdev->flags &= ~VXLAN_F_LEARN;
+	unlock_vxlan_fdb();
+
+	/*the timer lock keeps the ageing timer from running meanwhile*/
+	lock_vxlan_timer();
+	del_timer(&vdev->ageing_timer);
+	unlock_vxlan_timer();
+
 	vxlan_fdb_flush(vdev);
-	if(vdev->fdb_cnt != 0)
+	if(atomic_read(&vdev->fdb_cnt) != 0)
 		PAL_PANIC("vxlan_dev delete bug");
 
 	vxlan_arp_flush(vdev);
 	if(vdev->arp_cnt != 0)
 		PAL_PANIC("vxlan_dev delete bug");
 
-	index = get_hash_index_vni(vdev->vni);
 	write_lock_vxlan_dev(index);
 	remove_vxlan_dev_from_vxlan_net(vxlan,vdev);	
 	write_unlock_vxlan_dev(index);
-	
+
 	vxlan_dev_free(vdev);
 }
 
@@ -205,6 +215,15 @@ static int __int_vport_create(struct vport_net *vpnet,
 		pal_slab_free(vp);		
 		return -ENOMEM;
 	}
+
+	vp->stats = pal_pcpu_alloc(sizeof(struct vport_stats), int_vport_numa);
+	if (!vp->stats){
+		__vxlan_dev_delete(vxlan,vdev);
+		pal_free(vp->vp.uuid);
+		pal_free(vp->vp.vport_name);
+		pal_slab_free(vp);
+		return -ENOMEM;
+	}
 	
 	vp->vp.vport_ip = int_gw_ip;
 	vp->vp.prefix_len = (prefix_len != 0 && prefix_len < 32) ? prefix_len : 24;
@@ -215,6 +234,7 @@ static int __int_vport_create(struct vport_net *vpnet,
 	vp->vp.vport_type = VXLAN_VPORT;
 	vp->vp.vport_ops = &int_vport_ops;	
 	vp->vdev = vdev;
+	vp->mss_clamp = 0;
 	
 	if(vp->vp.vport_ops->init((struct vport*)vp) < 0)
 		goto error;
@@ -240,6 +260,7 @@ static int __int_vport_create(struct vport_net *vpnet,
 	
 error:	
 	__vxlan_dev_delete(vxlan,vdev);	
+	pal_pcpu_free(vp->stats);
 	pal_free(vp->vp.uuid);
 	pal_free(vp->vp.vport_name);
 	pal_slab_free(vp);
@@ -272,22 +293,22 @@ int int_vport_add(char *vport_name,char *uuid,
 	if(!pal_is_valid_ether_addr(int_gw_mac))
 		return -ENXIO;
 	
-	pal_spinlock_lock(&vpnet->hash_lock);
+	pal_spinlock_lock(vport_lock(vpnet,vport_name));
 	vp= __find_vport_nolock(vport_name);
 	if (vp) {	
-			pal_spinlock_unlock(&vpnet->hash_lock);
+			pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 			return -EEXIST;
 	} else {
 		head = get_nd_vport_head(nd); 
 		if(find_vport_ip_from_list(head,int_gw_ip) == 1){
 			PAL_DEBUG("repeat ip in the namespace %x!\n",int_gw_ip);
-			pal_spinlock_unlock(&vpnet->hash_lock);
+			pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 			return -EEXIST;
 		}
 		
 		err = __int_vport_create(vpnet,vxlan,vport_name,uuid,int_gw_mac,int_gw_ip,prefix_len,vni,nd);
 	}	
-	pal_spinlock_unlock(&vpnet->hash_lock);
+	pal_spinlock_unlock(vport_lock(vpnet,vport_name));
 	
 	return err;
 }
@@ -303,10 +324,16 @@ static void int_vport_free(struct int_vport *vp)
 			pal_free(vp->vp.uuid);
 			vp->vp.uuid = NULL;
 		}
+		pal_pcpu_free(vp->stats);
 		pal_slab_free(vp);
 	}
 }
 
+static void int_vport_free_qsbr(struct pal_qsbr_head *head)
+{
+	int_vport_free(container_of(head, struct int_vport, qsbr));
+}
+
 /*must held lock*/
 static void __int_vport_destroy(struct vport_net *vpnet,
 						struct vxlan_dev_net *vxlan, struct int_vport *vp)
@@ -331,11 +358,15 @@ static void __int_vport_destroy(struct vport_net *vpnet,
 
 	vxlan_dev_release(vp->vdev);
 	__vxlan_dev_delete(vxlan,vp->vdev);
-	int_vport_free(vp);
+
+	/*receivers which found the vport before it was unlinked may still
+	  use it, it is freed after a grace period. The bucket lock of its
+	  name is held, so nothing here waits for one*/
+	pal_qsbr_call(&vp->qsbr, int_vport_free_qsbr);
 }
 
 /*
-* delete a vxlan_vport, and vpnet->hash_lock must be held 
+* delete a vxlan_vport, the lock of the bucket of its name must be held 
 */
 int int_vport_delete(struct vport_net *vpnet,struct int_vport *vp)
 {
@@ -364,14 +395,15 @@ int vxlan_dev_net_init(void)
 
 void vxlan_slab_init(int numa_id)
 {
-    int_vport_slab = pal_slab_create("int_vport", INT_VPORT_SLAB_SIZE, 
+	int_vport_numa = numa_id;
+    int_vport_slab = pal_slab_create_multipc("int_vport", INT_VPORT_SLAB_SIZE, 
 		sizeof(struct int_vport), numa_id, 0);
 	
 	if (!int_vport_slab) {
 		PAL_PANIC("create int_vport slab failed\n");
 	}
 	
-    vxlan_dev_slab = pal_slab_create("vxlan_dev", VXLAN_DEV_SLAB_SIZE, 
+    vxlan_dev_slab = pal_slab_create_multipc("vxlan_dev", VXLAN_DEV_SLAB_SIZE, 
 		sizeof(struct vxlan_dev), numa_id, 0);
 	
 	if (!vxlan_dev_slab) {
@@ -6,6 +6,8 @@
 #include "receiver.h"
 #include "timer.h"
 #include "thread.h"
+#include "pal_qsbr.h"
+#include "pal_pcpu.h"
 
 int worker_loop(__unused void *arg)
 {
@@ -23,6 +25,7 @@ int worker_loop(__unused void *arg)
 		}
 	}
 
+	pal_qsbr_online();
 	pal_cpu_idle();
 	while(1) {
 		for(i = 0; i < rcvfifo_cnt; i++) {
@@ -49,6 +52,9 @@ int worker_loop(__unused void *arg)
 		}
 
 		run_timer(100);
+
+		pal_pcpu_flush();
+		pal_qsbr_quiescent();
 	}
 
 	return 0;
@@ -5,11 +5,17 @@ if [ $# != 1 ]; then
 fi
 BVRID=`ps aux |grep bvrouter|grep -v grep|awk '{print $2}'`
 if [ -n "$BVRID" ];then
-        kill -9 $BVRID
+        # SIGTERM lets bvrouter write its snapshot, which the new one loads
+        kill $BVRID
+        for i in `seq 30`; do
+                kill -0 $BVRID 2>/dev/null || break
+                sleep 1
+        done
+        kill -0 $BVRID 2>/dev/null && kill -9 $BVRID
 else
         echo "no bvrouter running"
 fi
-sleep 10
+sleep 2
 /home/zhangyu/bvrouter/output/bvrouter -f /home/zhangyu/bvrouter/output/bvrouter.conf -m 
 
 